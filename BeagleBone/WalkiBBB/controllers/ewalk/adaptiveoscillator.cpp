@@ -0,0 +1,185 @@
+#include "adaptiveoscillator.h"
+#include "harmonickernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const float AFO_PI = 3.14159265f;
+const float AFO_TWO_PI = 2.0f * AFO_PI;
+const float AFO_DEG_TO_RAD = AFO_PI / 180.0f;
+const float MIN_AMPLITUDES_SUM = 0.01f; // Avoids dividing by 0 before learning [rad].
+const float INITIAL_AMPLITUDE = 0.1f;   // Fundamental, others start at 0 [rad].
+
+/**
+ * @brief Wraps an angle to [0, 2pi[.
+ * @param angle the angle [rad].
+ * @return the wrapped angle [rad].
+ */
+static inline float wrapTwoPi(float angle)
+{
+    return angle - AFO_TWO_PI * floorf(angle / AFO_TWO_PI);
+}
+
+/**
+ * @brief Constructor. Sets the default parameters, and resets the state for
+ * a gait cycle of 1 s.
+ */
+AdaptiveOscillator::AdaptiveOscillator()
+{
+    params = getDefaultParams();
+    reset(1.0f);
+}
+
+/**
+ * @brief Gets the parameters tuned with tools/phasebench.
+ * @return the default parameters.
+ */
+AdaptiveOscillatorParams AdaptiveOscillator::getDefaultParams()
+{
+    AdaptiveOscillatorParams p;
+    p.phaseGain = 20.0f;
+    p.frequencyGain = 20.0f;
+    p.amplitudeGain = 2.0f;
+    p.minPeriod = 0.4f;
+    p.maxPeriod = 3.0f;
+    p.alignmentRate = 0.5f;
+    return p;
+}
+
+/**
+ * @brief Resets the oscillators of all the joints, as before any step.
+ * @param period initial guess of the gait cycle duration [s].
+ */
+void AdaptiveOscillator::reset(float period)
+{
+    AdaptiveOscillatorState &s = joints;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        for(int k=0; k<AFO_N_HARMONICS; k++)
+        {
+            s.phases[j][k] = 0.0f;
+            s.amplitudes[j][k] = (k == 0) ? INITIAL_AMPLITUDE : 0.0f;
+        }
+        s.angleOffset[j] = 0.0f;
+        s.frequency[j] = AFO_TWO_PI / period;
+        s.angleError[j] = 0.0f;
+        s.strikePhase[j] = 0.0f;
+        s.nHeelStrikes[j] = 0;
+        s.gaitPhase[j] = 0.0f;
+        s.timeToHeelStrike[j] = period;
+    }
+}
+
+/**
+ * @brief Gets the parameters, to change them.
+ * @return a reference to the parameters.
+ */
+AdaptiveOscillatorParams &AdaptiveOscillator::getParams()
+{
+    return params;
+}
+
+/**
+ * @brief Gets the state of the oscillators, e.g. to expose it as SyncVars.
+ * @return a reference to the state, indexed by GaitLeg.
+ */
+AdaptiveOscillatorState &AdaptiveOscillator::getJoints()
+{
+    return joints;
+}
+
+/**
+ * @brief Gets the state of the oscillators.
+ * @return a reference to the state, indexed by GaitLeg.
+ */
+const AdaptiveOscillatorState &AdaptiveOscillator::getJoints() const
+{
+    return joints;
+}
+
+/**
+ * @brief Gets whether the gait phase of a joint is meaningful, i.e. whether
+ * a heel-strike was already given to align it.
+ * @param j the joint index.
+ * @return true if aligned, false otherwise.
+ */
+bool AdaptiveOscillator::isAligned(int j) const
+{
+    return joints.nHeelStrikes[j] > 0;
+}
+
+/**
+ * @brief Integrates the oscillators of all the joints over one time step, and
+ * updates the gait phase and the predicted heel-strike.
+ * @param hipAngles measured angle of each hip [deg].
+ * @param dt time elapsed since the last call [s].
+ */
+void AdaptiveOscillator::update(const float hipAngles[N_GAIT_LEGS], float dt)
+{
+    AdaptiveOscillatorState &s = joints;
+    const float minFrequency = AFO_TWO_PI / params.maxPeriod;
+    const float maxFrequency = AFO_TWO_PI / params.minPeriod;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        float sines[AFO_N_HARMONICS], cosines[AFO_N_HARMONICS];
+        float learnedAngle = s.angleOffset[j];
+        float amplitudesSum = 0.0f;
+
+        for(int k=0; k<AFO_N_HARMONICS; k++)
+        {
+            sines[k] = fastSin(s.phases[j][k]);
+            cosines[k] = fastSin(s.phases[j][k] + 0.5f * AFO_PI);
+            learnedAngle += s.amplitudes[j][k] * sines[k];
+            amplitudesSum += fabsf(s.amplitudes[j][k]);
+        }
+
+        float error = hipAngles[j] * AFO_DEG_TO_RAD - learnedAngle;
+        float normalizedError = error / max(amplitudesSum, MIN_AMPLITUDES_SUM);
+        s.angleError[j] = error;
+
+        s.frequency[j] += dt * params.frequencyGain * normalizedError * cosines[0];
+        s.frequency[j] = min(max(s.frequency[j], minFrequency), maxFrequency);
+
+        for(int k=0; k<AFO_N_HARMONICS; k++)
+        {
+            s.phases[j][k] = wrapTwoPi(s.phases[j][k] + dt * ((k + 1) * s.frequency[j] +
+                                       params.phaseGain * normalizedError * cosines[k]));
+            s.amplitudes[j][k] += dt * params.amplitudeGain * error * sines[k];
+        }
+        s.angleOffset[j] += dt * params.amplitudeGain * error;
+
+        s.gaitPhase[j] = wrapTwoPi(s.phases[j][0] - s.strikePhase[j]) / AFO_TWO_PI;
+        s.timeToHeelStrike[j] = (1.0f - s.gaitPhase[j]) * AFO_TWO_PI / s.frequency[j];
+    }
+}
+
+/**
+ * @brief Aligns the gait phase of a joint on a detected heel-strike: the
+ * phase of the fundamental at the heel-strike is learned, and the gait phase
+ * is counted from it. The first heel-strike sets it, the next ones correct a
+ * fraction alignmentRate of the error.
+ * @param j the joint index.
+ * @param age time elapsed since the heel-strike, e.g. from HeelStrikeTimer
+ * [s].
+ */
+void AdaptiveOscillator::onHeelStrike(int j, float age)
+{
+    AdaptiveOscillatorState &s = joints;
+
+    float phase = wrapTwoPi(s.phases[j][0] - age * s.frequency[j]);
+
+    if(s.nHeelStrikes[j] == 0)
+        s.strikePhase[j] = phase;
+    else
+    {
+        float error = wrapTwoPi(phase - s.strikePhase[j] + AFO_PI) - AFO_PI;
+        s.strikePhase[j] = wrapTwoPi(s.strikePhase[j] + params.alignmentRate * error);
+    }
+    s.nHeelStrikes[j]++;
+
+    s.gaitPhase[j] = wrapTwoPi(s.phases[j][0] - s.strikePhase[j]) / AFO_TWO_PI;
+    s.timeToHeelStrike[j] = (1.0f - s.gaitPhase[j]) * AFO_TWO_PI / s.frequency[j];
+}
@@ -0,0 +1,74 @@
+#ifndef ADAPTIVEOSCILLATOR_H
+#define ADAPTIVEOSCILLATOR_H
+
+#include "gaittorquegenerator.h"
+
+#define AFO_N_HARMONICS 3 ///< Number of harmonics of the hip angle learned for each joint.
+
+/**
+ * @brief Tuning parameters of the adaptive oscillators.
+ */
+struct AdaptiveOscillatorParams
+{
+    float phaseGain;        ///< Coupling of the phases to the angle error, nu_phi [1/s].
+    float frequencyGain;    ///< Coupling of the frequency to the angle error, nu_omega [1/s^2].
+    float amplitudeGain;    ///< Learning rate of the amplitudes and offset, eta [1/s].
+    float minPeriod;        ///< Shortest accepted gait cycle [s].
+    float maxPeriod;        ///< Longest accepted gait cycle [s].
+    float alignmentRate;    ///< Fraction of the heel-strike phase error corrected at each heel-strike [0-1].
+};
+
+/**
+ * @brief State of the oscillators of all the joints, as a structure of arrays
+ * indexed by GaitLeg, like GaitJointsState.
+ */
+struct AdaptiveOscillatorState
+{
+    float phases[N_GAIT_LEGS][AFO_N_HARMONICS];     ///< Phase of each harmonic [rad], in [0, 2pi[.
+    float amplitudes[N_GAIT_LEGS][AFO_N_HARMONICS]; ///< [rad]
+    float angleOffset[N_GAIT_LEGS];     ///< Mean hip angle [rad].
+    float frequency[N_GAIT_LEGS];       ///< Angular frequency of the fundamental [rad/s].
+    float angleError[N_GAIT_LEGS];      ///< Measured minus learned hip angle [rad].
+    float strikePhase[N_GAIT_LEGS];     ///< Phase of the fundamental at the heel-strikes [rad].
+    int nHeelStrikes[N_GAIT_LEGS];      ///< Heel-strikes used for the alignment.
+    float gaitPhase[N_GAIT_LEGS];       ///< Estimated phase of the gait cycle, 0 at heel-strike [0-1[.
+    float timeToHeelStrike[N_GAIT_LEGS]; ///< Predicted time until the next heel-strike [s].
+};
+
+/**
+ * @brief Continuous estimator of the gait phase of each joint, from its hip
+ * angle alone, with adaptive frequency oscillators.
+ *
+ * For each joint, a pool of AFO_N_HARMONICS oscillators learns the hip angle
+ * as a sum of sines (Ronsse et al., 2011): at each step, the error between the
+ * measured and learned angles pulls the phases, the common frequency and the
+ * amplitudes, so that the cadence is tracked continuously instead of once per
+ * heel-strike. The phase of the fundamental is then shifted by its value at
+ * the detected heel-strikes, so that the gait phase is 0 at heel-strike, like
+ * the profiles of GaitTorqueGenerator.
+ *
+ * Each step costs 2 * AFO_N_HARMONICS fastSin() per joint.
+ */
+class AdaptiveOscillator
+{
+public:
+    AdaptiveOscillator();
+
+    static AdaptiveOscillatorParams getDefaultParams();
+
+    void reset(float period);
+
+    AdaptiveOscillatorParams &getParams();
+    AdaptiveOscillatorState &getJoints();
+    const AdaptiveOscillatorState &getJoints() const;
+    bool isAligned(int j) const;
+
+    void update(const float hipAngles[N_GAIT_LEGS], float dt);
+    void onHeelStrike(int j, float age);
+
+private:
+    AdaptiveOscillatorParams params;
+    AdaptiveOscillatorState joints;
+};
+
+#endif // ADAPTIVEOSCILLATOR_H
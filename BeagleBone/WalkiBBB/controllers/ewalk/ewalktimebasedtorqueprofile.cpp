@@ -1,4 +1,5 @@
 #include "ewalktimebasedtorqueprofile.h"
+#include "harmonickernel.h"
 
 #include <algorithm>    // For rotate() and clamp() functions
 #include <numeric>      // For accumulate() function
@@ -13,115 +14,98 @@
 using namespace std;
 using namespace chrono;
 
-const float SOLES_EXCIT_VOLTAGE = 3.3f; // [V].
-const float ADC_REF = 1.243f; // [V].
-const float SOLE_ASSOCIATED_RESISTANCE = 3000.0f; // [ohm].
-const float SOLE_COEF_A = 2.8900e5f; // [ohm/N].
-const float SOLE_COEF_B = 4.7076e03f; // [ohm].
 
 
-/**
-
-//BOOK GAIT
-
-const float a1 = 0.4314f;
-const float a2 = 0.0932f;
-const float a3 = 0.0725f;
-const float a4 = 0.0f;
-const float a5 = 0.0f;
-const float a6 = 0.0f;
-const float a7 = 0.0f;
-const float a8 = 0.0f;
-
-const float b1 = 3.1417f;
-const float b2 = 9.4295f;
-const float b3 = 6.2821f;
-const float b4 = 0.0f;
-const float b5 = 0.0f;
-const float b6 = 0.0f;
-const float b7 = 0.0f;
-const float b8 = 0.0f;
-
-const float c1 = -1.8151f;
-const float c2 = -2.0574f;
-const float c3 =  2.5740f;
-const float c4 = 0.0f;
-const float c5 = 0.0f;
-const float c6 = 0.0f;
-const float c7 = 0.0f;
-const float c8 = 0.0f;
-
-**/
+const char *const selectedProfile = "BETA"; // Initial profile, see ProfileStore.
 
-/**
-
-//ALPHA
-
-const float a1 = +0.451135f;
-const float a2 = -0.295392f;
-const float a3 = +0.099296f;
-const float a4 = 0.0f;
-const float a5 = 0.0f;
-const float a6 = 0.0f;
-const float a7 = 0.0f;
-const float a8 = 0.0f;
-
-const float b1 = 3.1417f;
-const float b2 = 9.4295f;
-const float b3 = 6.2821f;
-const float b4 = 0.0f;
-const float b5 = 0.0f;
-const float b6 = 0.0f;
-const float b7 = 0.0f;
-const float b8 = 0.0f;
-
-const float c1 = -1.851456f;
-const float c2 = -1.017760f;
-const float c3 = +4.169075f;
-const float c4 = 0.0f;
-const float c5 = 0.0f;
-const float c6 = 0.0f;
-const float c7 = 0.0f;
-const float c8 = 0.0f;
-
-**/
+const float torque_multiplier = PROFILE_TORQUE_MULTIPLIER;
 
-//BETHA
+// The motor of each hip has always been driven by the profile of the opposite
+// leg.
+const GaitLeg MOTOR_PROFILES[N_GAIT_LEGS] = { GAIT_RIGHT, GAIT_LEFT };
 
-const float a1 = +0.310482f;
-const float a2 = +0.006469f;
-const float a3 = +0.111714f;
-const float a4 = 0.0f;
-const float a5 = 0.0f;
-const float a6 = 0.0f;
-const float a7 = 0.0f;
-const float a8 = 0.0f;
 
-const float b1 = 3.1417f;
-const float b2 = 9.4295f;
-const float b3 = 6.2821f;
-const float b4 = 0.0f;
-const float b5 = 0.0f;
-const float b6 = 0.0f;
-const float b7 = 0.0f;
-const float b8 = 0.0f;
 
-const float c1 = -1.779109f;
-const float c2 = -2.021154f;
-const float c3 = +2.535488f;
-const float c4 = 0.0f;
-const float c5 = 0.0f;
-const float c6 = 0.0f;
-const float c7 = 0.0f;
-const float c8 = 0.0f;
+// Recorded variables, in the order of the SyncVars. The channel names are the
+// names of the SyncVars.
+#define LOGGED_VAR(name, unit, member) TELEMETRY_FIELD(eWalkLoggedVars, name, unit, member)
+#define LOGGED_SOLE_CELLS(prefix, leg) \
+    LOGGED_VAR(prefix "0", "N", cellLoads[leg][0]), \
+    LOGGED_VAR(prefix "1", "N", cellLoads[leg][1]), \
+    LOGGED_VAR(prefix "2", "N", cellLoads[leg][2]), \
+    LOGGED_VAR(prefix "3", "N", cellLoads[leg][3]), \
+    LOGGED_VAR(prefix "4", "N", cellLoads[leg][4]), \
+    LOGGED_VAR(prefix "5", "N", cellLoads[leg][5]), \
+    LOGGED_VAR(prefix "6", "N", cellLoads[leg][6]), \
+    LOGGED_VAR(prefix "7", "N", cellLoads[leg][7])
 
-const float pi = 3.14159f;
+#define LOGGED_FOOT_IMU(prefix, leg) \
+    LOGGED_VAR(prefix "accel_x", "g", footAccels[leg][0]), \
+    LOGGED_VAR(prefix "accel_y", "g", footAccels[leg][1]), \
+    LOGGED_VAR(prefix "accel_z", "g", footAccels[leg][2]), \
+    LOGGED_VAR(prefix "gyro_x", "deg/s", footAngularSpeeds[leg][0]), \
+    LOGGED_VAR(prefix "gyro_y", "deg/s", footAngularSpeeds[leg][1]), \
+    LOGGED_VAR(prefix "gyro_z", "deg/s", footAngularSpeeds[leg][2])
 
-const float torque_multiplier = -0.22959f;
-
-float period = 1/(b1/(2*pi));
+static_assert(SOLE_N_CELLS == 8, "LOGGED_SOLE_CELLS lists 8 cells per sole.");
 
+// Values of the WHO_AM_I register of the supported foot IMUs: MPU-6000/6050,
+// MPU-6500, MPU-9250 and MPU-9255.
+const uint8_t FOOT_IMU_IDENTITIES[] = { 0x68, 0x70, 0x71, 0x73 };
 
+const TelemetryField LOGGED_VARS_FIELDS[] =
+{
+    LOGGED_VAR("enable_controller", "0/1", startController),
+    LOGGED_VAR("left_hip_angle", "deg", hipAngles[GAIT_LEFT]),
+    LOGGED_VAR("right_hip_angle", "deg", hipAngles[GAIT_RIGHT]),
+    LOGGED_VAR("left_hip_speed", "deg/s", hipSpeeds[GAIT_LEFT]),
+    LOGGED_VAR("right_hip_speed", "deg/s", hipSpeeds[GAIT_RIGHT]),
+    LOGGED_VAR("left_torque_cmd", "N.m", torqueCmds[GAIT_LEFT]),
+    LOGGED_VAR("right_torque_cmd", "N.m", torqueCmds[GAIT_RIGHT]),
+    LOGGED_VAR("left_gc_percent", "%", gaitCyclePercents[GAIT_LEFT]),
+    LOGGED_VAR("right_gc_percent", "%", gaitCyclePercents[GAIT_RIGHT]),
+    LOGGED_VAR("avg_GC_time", "s", averageGaitCycleTime),
+    LOGGED_VAR("check/left_stance?", "", inStance[GAIT_LEFT]),
+    LOGGED_VAR("check/right_stance?", "", inStance[GAIT_RIGHT]),
+    LOGGED_VAR("check/left_foot_load", "N", footLoads[GAIT_LEFT]),
+    LOGGED_VAR("check/right_foot_load", "N", footLoads[GAIT_RIGHT]),
+    LOGGED_VAR("check/left_strike_age", "s", strikeAges[GAIT_LEFT]),
+    LOGGED_VAR("check/right_strike_age", "s", strikeAges[GAIT_RIGHT]),
+    LOGGED_VAR("check/left_torque_actual", "N.m", measuredTorques[GAIT_LEFT]),
+    LOGGED_VAR("check/right_torque_actual", "N.m", measuredTorques[GAIT_RIGHT]),
+    LOGGED_VAR("check/sine_torque_right", "N.m", sineTorques[GAIT_RIGHT]),
+    LOGGED_VAR("check/sine_torque_left", "N.m", sineTorques[GAIT_LEFT]),
+    LOGGED_VAR("check/math_time", "s", gaitTime),
+    LOGGED_VAR("check/motors_state_age", "s", motorsStateAge),
+    LOGGED_VAR("check/safety_fault", "", safetyFault),
+    LOGGED_VAR("check/safety_reaction_max", "us", safetyReactionMax),
+    LOGGED_VAR("check/foot_sensors_age", "s", footSensorsAge),
+    LOGGED_VAR("check/new_period_left", "s", newPeriods[GAIT_LEFT]),
+    LOGGED_VAR("check/new_period_right", "s", newPeriods[GAIT_RIGHT]),
+    LOGGED_VAR("check/control_ratio_right", "k", controlRatios[GAIT_RIGHT]),
+    LOGGED_VAR("check/current_gain_right", "k", currentGains[GAIT_RIGHT]),
+    LOGGED_VAR("check/performed_gait_right", "%", performedGaits[GAIT_RIGHT]),
+    LOGGED_VAR("check/control_ratio_left", "k", controlRatios[GAIT_LEFT]),
+    LOGGED_VAR("check/current_gain_left", "k", currentGains[GAIT_LEFT]),
+    LOGGED_VAR("check/performed_gait_left", "%", performedGaits[GAIT_LEFT]),
+    LOGGED_VAR("check/ready_to_go", "0-1", ready),
+    LOGGED_VAR("check/first_step_left", "0-1", firstSteps[GAIT_LEFT]),
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+    LOGGED_VAR("check/left_afo_phase", "0-1", afoPhases[GAIT_LEFT]),
+    LOGGED_VAR("check/right_afo_phase", "0-1", afoPhases[GAIT_RIGHT]),
+    LOGGED_VAR("check/left_afo_next_strike", "s", afoNextStrikes[GAIT_LEFT]),
+    LOGGED_VAR("check/right_afo_next_strike", "s", afoNextStrikes[GAIT_RIGHT]),
+#endif
+    LOGGED_VAR("const/percent_assist", "0-100", percentAssistance),
+    LOGGED_VAR("const/profile", "", profileIndex),
+    LOGGED_VAR("const/bodyweight", "Kg", pilotBodyWeight),
+    LOGGED_VAR("const/baseline_GC_duration", "s", baselineGcDuration),
+    LOGGED_VAR("const/stance_footload_thresh", "N", stanceFootLoadThreshold),
+    LOGGED_SOLE_CELLS("left_sole/cell_", GAIT_LEFT),
+    LOGGED_SOLE_CELLS("right_sole/cell_", GAIT_RIGHT),
+    LOGGED_FOOT_IMU("left_foot_imu/", GAIT_LEFT),
+    LOGGED_FOOT_IMU("right_foot_imu/", GAIT_RIGHT)
+};
 
 //float fake_period = 4; //sim
 //int merda = 0; //sim
@@ -135,218 +119,381 @@ float period = 1/(b1/(2*pi));
 
 
 
-TorquePoint_T winterHipTorqueProfile1[51] =
+/**
+ * @brief Gets the current time of a monotonic clock, to timestamp the data
+ * exchanged between the threads, and the soles acquisitions. With the
+ * simulated clock, this is the simulated time, so that the runs are
+ * reproducible.
+ * @return the current time [us].
+ */
+static int64_t monotonicTimeUs()
 {
-    {0.00 , -0.249},
-    {0.02 , -0.600},
-    {0.04 , -0.556},
-    {0.06 , -0.416},
-    {0.08 , -0.359},
-    {0.10 , -0.305},
-    {0.12 , -0.245},
-    {0.14 , -0.159},
-    {0.16 , -0.084},
-    {0.18 , -0.000},
-    {0.20 , 0.064},
-    {0.22 , 0.092},
-    {0.24 , 0.098},
-    {0.26 , 0.092},
-    {0.28 , 0.085},
-    {0.30 , 0.088},
-    {0.32 , 0.100},
-    {0.34 , 0.130},
-    {0.36 , 0.168},
-    {0.38 , 0.199},
-    {0.40 , 0.231},
-    {0.42 , 0.269},
-    {0.44 , 0.312},
-    {0.46 , 0.364},
-    {0.48 , 0.401},
-    {0.50 , 0.404},
-    {0.52 , 0.356},
-    {0.54 , 0.262},
-    {0.56 , 0.251},
-    {0.58 , 0.310},
-    {0.60 , 0.344},
-    {0.62 , 0.295},
-    {0.64 , 0.228},
-    {0.66 , 0.169},
-    {0.68 , 0.126},
-    {0.70 , 0.089},
-    {0.72 , 0.069},
-    {0.74 , 0.057},
-    {0.76 , 0.044},
-    {0.78 , 0.026},
-    {0.80 , 0.009},
-    {0.82 , -0.008},
-    {0.84 , -0.029},
-    {0.86 , -0.060},
-    {0.88 , -0.106},
-    {0.90 , -0.170},
-    {0.92 , -0.242},
-    {0.94 , -0.296},
-    {0.96 , -0.301},
-    {0.98 , -0.237},
-    {1.00 , -0.118}
-};
-
+#ifdef EWALK_SIMULATED_CLOCK
+    return SimHardware::getInstance().timeUs;
+#else
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
 
 eWalkTimeBasedTorqueProfile::eWalkTimeBasedTorqueProfile(PeripheralsSet peripherals):
     Controller("eWalk Time-Based Josep", peripherals),
-    leftMotor(&can, 2, LEFT_MOTOR_SIGN, LEFT_ANGLE_OFFSET),
-    rightMotor(&can, 1, RIGHT_MOTOR_SIGN,RIGHT_ANGLE_OFFSET),
-    leftFootImuSpiChannel(*peripherals.spiBus, SpiBus::CS_LEFT_FOOT_MPU),
-    rightFootImuSpiChannel(*peripherals.spiBus, SpiBus::CS_RIGHT_FOOT_MPU),
-    leftSole(*peripherals.spiBus, SpiBus::CS_RIGHT_ADC, ADC_REF),
-    rightSole(*peripherals.spiBus, SpiBus::CS_LEFT_ADC, ADC_REF)
+    motors{{&can, 2, LEFT_MOTOR_SIGN, LEFT_ANGLE_OFFSET},
+           {&can, 1, RIGHT_MOTOR_SIGN,RIGHT_ANGLE_OFFSET}},
+    footImuSpiChannels{{*peripherals.spiBus, SpiBus::CS_LEFT_FOOT_MPU},
+                       {*peripherals.spiBus, SpiBus::CS_RIGHT_FOOT_MPU}},
+    soles{{*peripherals.spiBus, SpiBus::CS_RIGHT_ADC, SOLES_ADC_REF},  // Left sole
+          {*peripherals.spiBus, SpiBus::CS_LEFT_ADC, SOLES_ADC_REF}},  // Right sole
+    soleCalibration(SOLES_EXCIT_VOLTAGE),
+    canLoop(microseconds(CAN_UPDATE_PERIOD), 5.0f),
+    footSensorsLoop(microseconds(FOOT_SENSORS_PERIOD), 5.0f),
+    safetyLoop(microseconds(SAFETY_SUPERVISOR_PERIOD), 5.0f),
+    mainLoopMonitor(microseconds((int)(MAIN_LOOP_PERIOD * 1000000.0f)), 10.0f)
 {   
     //Initialize controller constant parameters
-    stanceFootLoadThreshold = 0.5f;
-    pilotBodyWeight = 60.0f;
-    baselineGcDuration = 1.0f;
-    percentAssistance = 25.0f;
-
-    syncVars.push_back(makeSyncVar("enable_controller", "0/1", startController,
-                                   VarAccess::READWRITE, true));
-
-    syncVars.push_back(makeSyncVar("left_hip_angle", "deg", leftHipAngle,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("right_hip_angle", "deg", rightHipAngle,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("left_hip_speed", "deg/s", leftHipSpeed,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("right_hip_speed", "deg/s", rightHipSpeed,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("left_torque_cmd", "N.m", leftTorqueCmd,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("right_torque_cmd", "N.m", rightTorqueCmd,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("left_gc_percent", "%", leftGaitCyclePercent,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("right_gc_percent", "%", rightGaitCyclePercent,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("avg_GC_time", "s", averageGaitCycleTime,
-                                   VarAccess::READ, true));
+    logged = eWalkLoggedVars();
+    logged.pilotBodyWeight = 60.0f;
+    logged.baselineGcDuration = 1.0f;
+    logged.percentAssistance = 25.0f;
+
+    // Load the calibration of the soles cells, and precompute the conversion
+    // tables.
+    if(!soleCalibration.load(SOLES_CALIBRATION_FILE))
+    {
+        debug << "Could not load " << SOLES_CALIBRATION_FILE
+              << ", using the default calibration of the soles." << endl;
+    }
+
+    GaitJointsState &joints = gait.getJoints();
+
+    addSyncVar("enable_controller", "0/1", logged.startController,
+               VarAccess::READWRITE, true);
+
+    addSyncVar("left_hip_angle", "deg", logged.hipAngles[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("right_hip_angle", "deg", logged.hipAngles[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("left_hip_speed", "deg/s", logged.hipSpeeds[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("right_hip_speed", "deg/s", logged.hipSpeeds[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("left_torque_cmd", "N.m", logged.torqueCmds[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("right_torque_cmd", "N.m", logged.torqueCmds[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("left_gc_percent", "%", logged.gaitCyclePercents[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("right_gc_percent", "%", logged.gaitCyclePercents[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("avg_GC_time", "s", logged.averageGaitCycleTime,
+               VarAccess::READ, true);
 
     // Params that are only needed for troubleshooting and checking
-    syncVars.push_back(makeSyncVar("check/left_stance?", "",leftInStance,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/right_stance?", "", rightInStance,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/left_foot_load", "N", leftFootLoad,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/right_foot_load", "N", rightFootLoad,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/left_torque_actual", "N.m", leftTorque,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/right_torque_actual", "N.m", rightTorque,
-                                   VarAccess::READ, true));
-
-    syncVars.push_back(makeSyncVar("check/sine_torque_right", "N.m", sine_torque_right,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/sine_torque_left", "N.m", sine_torque_left,
-                                   VarAccess::READ, true));
-
-    syncVars.push_back(makeSyncVar("check/math_time", "s", math_time,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/new_period_left", "s", new_period_left,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/new_period_right", "s", new_period_right,
-                                   VarAccess::READ, true));
+    addSyncVar("check/left_stance?", "", joints.inStance[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_stance?", "", joints.inStance[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/left_foot_load", "N", logged.footLoads[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_foot_load", "N", logged.footLoads[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/left_strike_age", "s", logged.strikeAges[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_strike_age", "s", logged.strikeAges[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/left_torque_actual", "N.m", logged.measuredTorques[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_torque_actual", "N.m", logged.measuredTorques[GAIT_RIGHT],
+               VarAccess::READ, true);
+
+    addSyncVar("check/sine_torque_right", "N.m", joints.torque[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/sine_torque_left", "N.m", joints.torque[GAIT_LEFT],
+               VarAccess::READ, true);
+
+    addSyncVar("check/math_time", "s", gait.getTime(),
+               VarAccess::READ, true);
+    addSyncVar("check/motors_state_age", "s", logged.motorsStateAge,
+               VarAccess::READ, true);
+    addSyncVar("check/safety_fault", "", logged.safetyFault,
+               VarAccess::READ, true);
+    addSyncVar("check/safety_reaction_max", "us", logged.safetyReactionMax,
+               VarAccess::READ, true);
+    addSyncVar("check/foot_sensors_age", "s", logged.footSensorsAge,
+               VarAccess::READ, true);
+    addSyncVar("check/timing/loop_jitter_p50", "us", mainLoopJitterP50,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/loop_jitter_p99", "us", mainLoopJitterP99,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/loop_jitter_max", "us", mainLoopJitterMax,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/loop_overruns", "", mainLoopOverruns,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/can_jitter_p50", "us", canJitterP50,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/can_jitter_p99", "us", canJitterP99,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/can_jitter_max", "us", canJitterMax,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/can_overruns", "", canOverruns,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/sensors_jitter_p50", "us", sensorsJitterP50,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/sensors_jitter_p99", "us", sensorsJitterP99,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/sensors_jitter_max", "us", sensorsJitterMax,
+               VarAccess::READ, false);
+    addSyncVar("check/timing/sensors_overruns", "", sensorsOverruns,
+               VarAccess::READ, false);
+    addSyncVar("check/foot_sensors_dropped", "", footSensorsDropped,
+               VarAccess::READ, false);
+    addSyncVar("check/telemetry_dropped", "", telemetryDropped,
+               VarAccess::READ, false);
+    addSyncVar("check/telemetry_failing?", "", telemetryFailing,
+               VarAccess::READ, false);
+    addSyncVar("check/stream_dropped", "", streamDropped,
+               VarAccess::READ, false);
+    addSyncVar("check/stream_decimation", "", streamDecimation,
+               VarAccess::READ, false);
+    addSyncVar("check/profiles_count", "", profilesCount,
+               VarAccess::READ, false);
+
+#ifdef STAGE_PROFILING
+    const char *stageNames[N_UPDATE_STAGES] = {"motors_read", "foot_loads",
+                                               "gait_cycle", "torques",
+                                               "set_torque"};
+    for(int i=0; i<N_UPDATE_STAGES; i++)
+    {
+        auto &stats = stageProfiler.getStats(i);
+        string name = string("check/stages/") + stageNames[i];
+        addSyncVar(name + "_min", "us", stats.min,
+                   VarAccess::READ, false);
+        addSyncVar(name + "_mean", "us", stats.mean,
+                   VarAccess::READ, false);
+        addSyncVar(name + "_max", "us", stats.max,
+                   VarAccess::READ, false);
+    }
+#endif
+    addSyncVar("check/new_period_left", "s", joints.newPeriod[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/new_period_right", "s", joints.newPeriod[GAIT_RIGHT],
+               VarAccess::READ, true);
                                    
 
-    //syncVars.push_back(makeSyncVar("check/fake_period", "s", fake_period,
-    //                               VarAccess::READWRITE, true));
-
-    syncVars.push_back(makeSyncVar("check/control_ratio_right", "k", control_ratio_right,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/current_gain_right", "k", current_gain_right,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/performed_gait_right", "%", performed_gait_right,
-                                   VarAccess::READ, true));
-
-    syncVars.push_back(makeSyncVar("check/control_ratio_left", "k", control_ratio_left,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/current_gain_left", "k", current_gain_left,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/performed_gait_left", "%", performed_gait_left,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/ready_to_go", "0-1", redy_to_go,
-                                   VarAccess::READ, true));
-    syncVars.push_back(makeSyncVar("check/first_step_left", "0-1", first_step_left,
-                                   VarAccess::READ, true));
+    //addSyncVar("check/fake_period", "s", fake_period,
+    //           VarAccess::READWRITE, true);
+
+    addSyncVar("check/control_ratio_right", "k", joints.controlRatio[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/current_gain_right", "k", joints.currentGain[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/performed_gait_right", "%", joints.performedGait[GAIT_RIGHT],
+               VarAccess::READ, true);
+
+    addSyncVar("check/control_ratio_left", "k", joints.controlRatio[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/current_gain_left", "k", joints.currentGain[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/performed_gait_left", "%", joints.performedGait[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/ready_to_go", "0-1", gait.getReady(),
+               VarAccess::READ, true);
+    addSyncVar("check/first_step_left", "0-1", joints.firstStep[GAIT_LEFT],
+               VarAccess::READ, true);
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+    AdaptiveOscillatorState &oscillators = phaseOscillator.getJoints();
+    addSyncVar("check/left_afo_phase", "0-1", oscillators.gaitPhase[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_afo_phase", "0-1", oscillators.gaitPhase[GAIT_RIGHT],
+               VarAccess::READ, true);
+    addSyncVar("check/left_afo_next_strike", "s", oscillators.timeToHeelStrike[GAIT_LEFT],
+               VarAccess::READ, true);
+    addSyncVar("check/right_afo_next_strike", "s", oscillators.timeToHeelStrike[GAIT_RIGHT],
+               VarAccess::READ, true);
+#endif
 
     // Constants
-    syncVars.push_back(makeSyncVar("const/percent_assist", "0-100", percentAssistance,
-                                   VarAccess::READWRITE, true));
-    syncVars.push_back(makeSyncVar("const/bodyweight", "Kg", pilotBodyWeight,
-                                   VarAccess::READWRITE, true));
-    syncVars.push_back(makeSyncVar("const/baseline_GC_duration", "s", baselineGcDuration,
-                                   VarAccess::READWRITE, true));
-    syncVars.push_back(makeSyncVar("const/stance_footload_thresh", "N", stanceFootLoadThreshold,
-                                   VarAccess::READWRITE, true));
-    /*
-    for(int i=0; i<8; i++)
-        syncVars.push_back(makeSyncVar("left_sole/cell_" + std::to_string(i),
-                                       "N", leftLoads[i], VarAccess::READ, true));
-    for(int i=0; i<8; i++)
-        syncVars.push_back(makeSyncVar("right_sole/cell_" + std::to_string(i),
-                                       "N", rightLoads[i], VarAccess::READ, true));
-    */
+    addSyncVar("const/percent_assist", "0-100", logged.percentAssistance,
+               VarAccess::READWRITE, true);
+    addSyncVar("const/profile", "", logged.profileIndex,
+               VarAccess::READWRITE, true);
+    addSyncVar("const/bodyweight", "Kg", logged.pilotBodyWeight,
+               VarAccess::READWRITE, true);
+    addSyncVar("const/baseline_GC_duration", "s", logged.baselineGcDuration,
+               VarAccess::READWRITE, true);
+    addSyncVar("const/stance_footload_thresh", "N",
+               gait.getParams().stanceFootLoadThreshold,
+               VarAccess::READWRITE, true);
+    for(int i=0; i<SOLE_N_CELLS; i++)
+        addSyncVar("left_sole/cell_" + std::to_string(i),
+                   "N", logged.cellLoads[GAIT_LEFT][i], VarAccess::READ, true);
+    for(int i=0; i<SOLE_N_CELLS; i++)
+        addSyncVar("right_sole/cell_" + std::to_string(i),
+                   "N", logged.cellLoads[GAIT_RIGHT][i], VarAccess::READ, true);
+    const char *const legNames[N_GAIT_LEGS] = {"left", "right"};
+    const char *const axes[3] = {"x", "y", "z"};
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        for(int k=0; k<3; k++)
+            addSyncVar(std::string(legNames[j]) + "_foot_imu/accel_" + axes[k],
+                       "g", logged.footAccels[j][k], VarAccess::READ, true);
+        for(int k=0; k<3; k++)
+            addSyncVar(std::string(legNames[j]) + "_foot_imu/gyro_" + axes[k],
+                       "deg/s", logged.footAngularSpeeds[j][k], VarAccess::READ, true);
+    }
 
     // Creating the thread for handling the CAN communication with the motors
+    motorsState.write(HipMotorsState{{}, {}, {}, monotonicTimeUs()});
+    motorsCommand.write(HipMotorsCommand{{}, monotonicTimeUs()});
+    logged.motorsStateAge = 0.0f;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        motorsSetpoints[j] = 0.0f;
+        logged.strikeAges[j] = 0.0f;
+        for(int k=0; k<3; k++)
+        {
+            logged.footAccels[j][k] = 0.0f;
+            logged.footAngularSpeeds[j][k] = 0.0f;
+        }
+    }
+    timingStatsTimer = 0.0f;
+    canJitterP50 = 0.0f; canJitterP99 = 0.0f; canJitterMax = 0.0f;
+    sensorsJitterP50 = 0.0f; sensorsJitterP99 = 0.0f; sensorsJitterMax = 0.0f;
+    mainLoopJitterP50 = 0.0f; mainLoopJitterP99 = 0.0f; mainLoopJitterMax = 0.0f;
+    canOverruns = 0; sensorsOverruns = 0; mainLoopOverruns = 0;
+    motorsInUse = false;
+
+    // The supervisor must be reset before the threads it watches start. The
+    // timeout of the control loop only runs from its first update().
+    safety.reset(monotonicTimeUs());
+
+    stopCanThread = false;
+#ifdef EWALK_SYNCHRONOUS_CAN
+    canThread = nullptr;
+#else
     canThread = new thread(&eWalkTimeBasedTorqueProfile::handleCanCommunication, this);
 
     // Setting the thread priority for CAN communication
     struct sched_param sp;
     sp.sched_priority = 2;
     pthread_setschedparam(canThread->native_handle(), SCHED_RR, &sp);
+#endif
+
+    // Creating the thread for the acquisition of the soles and foot IMUs, once
+    // the IMUs are configured. From then, only this thread accesses the SPI bus.
+    for(int j=0; j<N_GAIT_LEGS; j++)
+        footImusFound[j] = configureFootImu(j);
+
+    footSensors = FootSensorsFrame();
+    footSensors.timestamp = monotonicTimeUs();
+    logged.footSensorsAge = 0.0f;
+    footSensorsDropped = 0;
+    stopFootSensorsThread = false;
+#ifdef EWALK_SYNCHRONOUS_SENSORS
+    footSensorsThread = nullptr;
+#else
+    footSensorsThread = new thread(&eWalkTimeBasedTorqueProfile::handleFootSensorsAcquisition, this);
+
+    // Same priority as the CAN thread
+    struct sched_param sensorsSp;
+    sensorsSp.sched_priority = 2;
+    pthread_setschedparam(footSensorsThread->native_handle(), SCHED_RR, &sensorsSp);
+#endif
+
+    // Creating the thread of the safety supervisor, that watches the others,
+    // unless update() supervises them
+    logged.safetyFault = SAFETY_OK;
+    logged.safetyReactionMax = 0.0f;
+    safetyStopped = false;
+    stopSafetyThread = false;
+#ifdef EWALK_SYNCHRONOUS_CAN
+    safetyThread = nullptr;
+#else
+    safetyThread = new thread(&eWalkTimeBasedTorqueProfile::handleSafetySupervision, this);
+
+    // Above the CAN thread, so it can still cut the torque off if it stalls
+    struct sched_param safetySp;
+    safetySp.sched_priority = 3;
+    pthread_setschedparam(safetyThread->native_handle(), SCHED_RR, &safetySp);
+#endif
 
     // Set some initial values for the GC times
-    lastGaitCycleTimes.fill(baselineGcDuration);
-    averageGaitCycleTime = baselineGcDuration;
-    percentAssistance = 0.0f;
-    redy_to_go = 0;
-    startController = false;
-    math_time = 0;
-
-    time_right = 0; ///< [s]
-    time_left = 0; ///< [s]
-
-    original_period_right = period; previous_step_period_right = period; new_period_right = period; previous_step_duration_right = period; theoretical_period_right = period; theoretical_period_corrected_right = period; ///< [s]
-    original_period_left = period; previous_step_period_left = period; new_period_left = period; previous_step_duration_left = period; theoretical_period_left = period; theoretical_period_corrected_left = period; ///< [s]
-
-    performed_gait_right = 0.5; ///< [%]
-    performed_gait_left = 0.5; ///< [%]
-
-    time_offset_right = 0; ///< [s]
-    time_offset_left = 0; ///< [s]
-
-    previous_gain_right = 1; desired_gain_right = 1; current_gain_right = 1;
-    previous_gain_left = 1; desired_gain_left = 1; current_gain_left = 1;
-
-    control_ratio_right = 0.5;
-    control_ratio_left = 0.5;
-
-    first_step_left = 0;
-    first_step_right = 0;
-
-    sine_torque_left = 0;
-    sine_torque_right = 0;
-
+    lastGaitCycleTimes.fill(logged.baselineGcDuration);
+    logged.averageGaitCycleTime = logged.baselineGcDuration;
+    logged.percentAssistance = 0.0f;
+    logged.startController = false;
+
+    // Load the additional torque profiles, and watch for changes of their files.
+#if !defined(EWALK_SIMULATED_HARDWARE)
+    profiles.start(PROFILES_DIRECTORY);
+#endif
+    profilesCount = profiles.getCount();
+    logged.profileIndex = profiles.findProfile(selectedProfile);
+    winterProfile = profiles.getProfile(profiles.findProfile("WINTER"));
+
+    gait.setProfile(profiles.getProfile(logged.profileIndex));
+    gait.reset();
+    gait.setScale(torque_multiplier*logged.pilotBodyWeight);
+    phaseOscillator.reset(logged.baselineGcDuration);
+
+    // Start recording, now that all the recorded variables are initialized.
+    copyLoggedGaitState();
+    telemetry.setBlock(&logged, sizeof(logged), LOGGED_VARS_FIELDS,
+                       sizeof(LOGGED_VARS_FIELDS) / sizeof(LOGGED_VARS_FIELDS[0]));
+    telemetryDropped = 0;
+    telemetryFailing = false;
+#if defined(EWALK_BINARY_TELEMETRY) && !defined(EWALK_SIMULATED_HARDWARE)
+    if(!telemetry.start(TELEMETRY_DIRECTORY, "ewalk"))
+        debug << "The telemetry will not be recorded." << endl;
+#endif
+
+    stream.setBlock(&logged, sizeof(logged), LOGGED_VARS_FIELDS,
+                    sizeof(LOGGED_VARS_FIELDS) / sizeof(LOGGED_VARS_FIELDS[0]));
+    streamDropped = 0;
+    streamDecimation = 1;
+#if defined(EWALK_TELEMETRY_STREAM) && !defined(EWALK_SIMULATED_HARDWARE)
+    if(!stream.start(TELEMETRY_STREAM_PORT))
+        debug << "The telemetry will not be streamed." << endl;
+#endif
 }
 
 eWalkTimeBasedTorqueProfile::~eWalkTimeBasedTorqueProfile()
 {
-    rightMotor.setTorque(0.0f);
-    rightMotor.update(MAIN_LOOP_PERIOD);
-    leftMotor.setTorque(0.0f);
-    leftMotor.update(MAIN_LOOP_PERIOD);
+    telemetry.stop();
+    stream.stop();
+    profiles.stop();
+
+    // Stop the supervisor first, so the other threads stopping is not a fault
+    stopSafetyThread = true;
+    if(safetyThread != nullptr)
+    {
+        safetyThread->join();
+        delete safetyThread;
+    }
+
+    // Stop the acquisition thread
+    stopFootSensorsThread = true;
+    if(footSensorsThread != nullptr)
+    {
+        footSensorsThread->join();
+        delete footSensorsThread;
+    }
 
     // Stop the CAN communication thread
+    const float zeroTorques[N_GAIT_LEGS] = {};
+    sendTorques(zeroTorques);
     stopCanThread = true;
-    canThread->join();
-    delete canThread;
+    if(canThread != nullptr)
+    {
+        canThread->join();
+        delete canThread;
+    }
+
+    // The motors are not shared anymore, so they can be accessed directly.
+    for(Gyems &motor : motors)
+    {
+        motor.setTorque(0.0f);
+        motor.update(MAIN_LOOP_PERIOD);
+    }
 }
 
 /**
@@ -354,245 +501,280 @@ eWalkTimeBasedTorqueProfile::~eWalkTimeBasedTorqueProfile()
  */
 void eWalkTimeBasedTorqueProfile::update(float dt)
 {
+    mainLoopMonitor.tick();
+    updateTimingStats(dt);
+    safety.beatControl();
 
-    math_time = math_time + dt;
+    STAGE_PROFILER_BEGIN(stageProfiler);
 
-    // Get the current joint positions.
-    leftHipAngle = leftMotor.getPosition();
-    rightHipAngle = rightMotor.getPosition();
-    leftHipSpeed = leftMotor.getSpeed();
-    rightHipSpeed = rightMotor.getSpeed();
-    leftTorque = leftMotor.getTorque();
-    rightTorque = rightMotor.getTorque();
+#ifdef EWALK_SYNCHRONOUS_CAN
+    updateMotors(dt);
+    superviseSafety(dt);
+#endif
 
-    // If the values received from the motorboard are bogus, emergency stop.
-    if(leftHipAngle < -180.0f || leftHipAngle > 180.0f ||
-       rightHipAngle < -180.0f || rightHipAngle > 180.0f)
+    gait.advanceTime(dt);
+
+    // Get the current joint positions, from the latest CAN update.
+    HipMotorsState state;
+    motorsState.read(state);
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        logged.hipAngles[j] = state.angles[j];
+        logged.hipSpeeds[j] = state.speeds[j];
+        logged.measuredTorques[j] = state.torques[j];
+    }
+    logged.motorsStateAge = USEC_TO_SEC(monotonicTimeUs() - state.timestamp);
+
+    // On a fault (e.g. bogus values from the motorboard), the supervisor has
+    // already cut the torque off. The assistance stays disabled until it is
+    // enabled again, which clears the fault.
+    logged.safetyFault = safety.getFault();
+    if(logged.safetyFault != SAFETY_OK && !safetyStopped)
     {
-        debug<<"Abnormal joint angles."<<endl;
-        //motorBoard.disarmBridges();
-        //throw runtime_error("Bogus hip angles received from the motorboard.");
+        debug << "Safety stop: "
+              << SafetySupervisor::getFaultName((SafetyFault)logged.safetyFault)
+              << "." << endl;
+        logged.startController = false;
+        safetyStopped = true;
     }
+    else if(safetyStopped && logged.startController)
+    {
+        safety.clearFault();
+        safetyStopped = false;
+    }
+    logged.safetyReactionMax = (float)safety.getMaxReactionTime();
+
+    STAGE_PROFILER_MARK(stageProfiler, STAGE_MOTORS_READ);
 
     // Acquire the instrumented soles and update footLoad values
     updateFootLoads(dt);
 
+    STAGE_PROFILER_MARK(stageProfiler, STAGE_FOOT_LOADS);
 
-    if(startController)
+    if(logged.startController)
     {
         // Heel-strike detection and avg. GC time calculation
         updateGaitCycleDuration();
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+        updateGaitPhase(dt);
+#endif
+
+        STAGE_PROFILER_MARK(stageProfiler, STAGE_GAIT_CYCLE);
+
+        gait.setScale(torque_multiplier*logged.pilotBodyWeight);
+
+        // Switch to the selected profile at the next heel-strikes. An invalid
+        // index keeps the current profile.
+        const TorqueProfile *profile = profiles.getProfile(logged.profileIndex);
+        if(profile != nullptr)
+            gait.requestProfile(profile);
 
 
         //Calculate torque commands
-        leftTorqueCmd = computeTorqueRight();
-        rightTorqueCmd = computeTorqueLeft();
+#ifdef EWALK_DIRECT_SINE_TORQUE
+        computeTorquesDirect();
+#else
+        computeTorques();
+#endif
 
-        leftTorqueCmd *= percentAssistance / 100.0f;
-        rightTorqueCmd *= percentAssistance / 100.0f;
+        for(int j=0; j<N_GAIT_LEGS; j++)
+        {
+            logged.torqueCmds[j] = gait.getJoints().torque[MOTOR_PROFILES[j]];
+            logged.torqueCmds[j] *= logged.percentAssistance / 100.0f;
+        }
 
-        leftMotor.setTorque(leftTorqueCmd);
-        rightMotor.setTorque(rightTorqueCmd);
+        STAGE_PROFILER_MARK(stageProfiler, STAGE_TORQUES);
 
-        timeSinceLeftHeelStrike += dt; //unused
-        timeSinceRightHeelStrike += dt; //unused
+        sendTorques(logged.torqueCmds);
 
+        STAGE_PROFILER_MARK(stageProfiler, STAGE_SET_TORQUE);
     }
-    else if(fabsf(averageGaitCycleTime - baselineGcDuration) > 0.1f)
+    else if(fabsf(logged.averageGaitCycleTime - logged.baselineGcDuration) > 0.1f)
     {
         //Reset GC duration data to the assumed baseline once the controller
         //is disabled.
-        lastGaitCycleTimes.fill(baselineGcDuration);
-        averageGaitCycleTime = baselineGcDuration;
+        lastGaitCycleTimes.fill(logged.baselineGcDuration);
+        logged.averageGaitCycleTime = logged.baselineGcDuration;
     }
     else
     {
-        leftMotor.setTorque(0.0f);
-        rightMotor.setTorque(0.0f);
+        const float zeroTorques[N_GAIT_LEGS] = {};
+        sendTorques(zeroTorques);
     }
+
+    // The replaced profiles that the generator no longer uses can be freed.
+    const TorqueProfile *profilesInUse[GAIT_MAX_PROFILES_IN_USE];
+    gait.getProfilesInUse(profilesInUse);
+    profiles.reportProfilesInUse(profilesInUse, GAIT_MAX_PROFILES_IN_USE);
+
+    STAGE_PROFILER_END(stageProfiler);
+
+    // Snapshot of the logged variables, written to file and streamed by other
+    // threads.
+    copyLoggedGaitState();
+    int64_t now = monotonicTimeUs();
+    telemetry.record(now);
+    stream.push(now);
 }
 
-void eWalkTimeBasedTorqueProfile::updateFootLoads(float dt)
+/**
+ * @brief Refreshes the jitter statistics of the main loop, of the CAN thread
+ * and of the acquisition thread, every TIMING_STATS_PERIOD.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::updateTimingStats(float dt)
 {
-    leftSole.update(dt);
-    rightSole.update(dt);
+    timingStatsTimer += dt;
+    if(timingStatsTimer < TIMING_STATS_PERIOD)
+        return;
+
+    timingStatsTimer = 0.0f;
+
+    LatencyHistogram &mainLoopJitter = mainLoopMonitor.getJitterHistogram();
+    mainLoopJitter.updateStats();
+    mainLoopJitterP50 = mainLoopJitter.getP50();
+    mainLoopJitterP99 = mainLoopJitter.getP99();
+    mainLoopJitterMax = mainLoopJitter.getMax();
+    mainLoopOverruns = (int)mainLoopMonitor.getOverrunsCount();
+
+    LatencyHistogram &canJitter = canLoop.getMonitor().getJitterHistogram();
+    canJitter.updateStats();
+    canJitterP50 = canJitter.getP50();
+    canJitterP99 = canJitter.getP99();
+    canJitterMax = canJitter.getMax();
+    canOverruns = (int)canLoop.getMonitor().getOverrunsCount();
+
+    LatencyHistogram &sensorsJitter = footSensorsLoop.getMonitor().getJitterHistogram();
+    sensorsJitter.updateStats();
+    sensorsJitterP50 = sensorsJitter.getP50();
+    sensorsJitterP99 = sensorsJitter.getP99();
+    sensorsJitterMax = sensorsJitter.getMax();
+    sensorsOverruns = (int)footSensorsLoop.getMonitor().getOverrunsCount();
+    footSensorsDropped = (int)footSensorsRing.getDroppedCount();
+
+    telemetryDropped = (int)telemetry.getDroppedCount();
+    telemetryFailing = telemetry.isFailing();
+    streamDropped = (int)stream.getDroppedCount();
+    streamDecimation = stream.getDecimation();
+    profilesCount = profiles.getCount();
+
+#ifdef STAGE_PROFILING
+    stageProfiler.updateStats();
+#endif
+}
 
-    leftSoleVoltages = leftSole.getLastSamples();
-    rightSoleVoltages = rightSole.getLastSamples();
+/**
+ * @brief Publishes new torque setpoints, to be sent to the motors at the next
+ * iteration of the CAN thread.
+ * @param torques torque setpoint of each motor, indexed by GaitLeg [N.m].
+ */
+void eWalkTimeBasedTorqueProfile::sendTorques(const float torques[N_GAIT_LEGS])
+{
+    HipMotorsCommand command;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+        command.torques[j] = torques[j];
+    command.timestamp = monotonicTimeUs();
 
-    for(int i=0; i<8; i++)
-    {
-        leftLoads[i] = soleVoltageToForce(leftSoleVoltages[i]);
-        rightLoads[i] = soleVoltageToForce(rightSoleVoltages[i]);
-    }
-    leftFootLoad = leftLoads.sum();
-    rightFootLoad = rightLoads.sum();
+    motorsCommand.write(command);
 }
 
 /**
- * @brief Updates the average duration of the GC by detecting heel-strikes, counting the time
- * between 2 consecutive heel-strikes and averaging it over the last N gait cycles, where N is
- * defined by the GAIT_CYCLE_AVERAGING_PERIOD constant in the .h file. For heel-strike
- * detection, first we wait for each leg to enter swing (detected when footLoad < threshold),
- * then as soon as the footLoad is above the threshold value, heel-strike is detected.
+ * @brief Copies the recorded values owned by the GaitTorqueGenerator (and the
+ * AdaptiveOscillator) next to the other recorded variables, so that the
+ * telemetry snapshot is a single copy of eWalkLoggedVars.
  */
-void eWalkTimeBasedTorqueProfile::updateGaitCycleDuration()
+void eWalkTimeBasedTorqueProfile::copyLoggedGaitState()
 {
-    /**
-    residu = fmod(math_time,fake_period);
-    if (residu >= fake_period/2 )
-    {
-        merda = 1;
-    }
-    else
+    const GaitJointsState &joints = gait.getJoints();
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
     {
-        merda = 0;
+        logged.inStance[j] = joints.inStance[j];
+        logged.sineTorques[j] = joints.torque[j];
+        logged.newPeriods[j] = joints.newPeriod[j];
+        logged.controlRatios[j] = joints.controlRatio[j];
+        logged.currentGains[j] = joints.currentGain[j];
+        logged.performedGaits[j] = joints.performedGait[j];
+        logged.firstSteps[j] = joints.firstStep[j];
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+        logged.afoPhases[j] = phaseOscillator.getJoints().gaitPhase[j];
+        logged.afoNextStrikes[j] = phaseOscillator.getJoints().timeToHeelStrike[j];
+#endif
     }
-    **/
+    logged.gaitTime = gait.getTime();
+    logged.ready = gait.getReady();
+    logged.stanceFootLoadThreshold = gait.getParams().stanceFootLoadThreshold;
+}
 
+/**
+ * @brief Gets the acquisitions of the soles and foot IMUs made since the last
+ * time step. Only the latest one is used by the control, the others only date
+ * the heel-strikes more finely than the time step, see HeelStrikeTimer. If
+ * EWALK_SYNCHRONOUS_SENSORS is defined, the sensors are first acquired
+ * SOLES_BURST_SIZE times in a row.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::updateFootLoads(float dt)
+{
+#ifdef EWALK_SYNCHRONOUS_SENSORS
+    for(int i=0; i<SOLES_BURST_SIZE; i++)
+        acquireFootSensors(dt);
+#else
+    (void)dt;
+#endif
 
-    if(!leftInStance)   //left leg in swing
-    //if(merda == 0)   //left leg in swing
-    {
-        if(leftFootLoad > stanceFootLoadThreshold)  // left heel-strike detected
-        //if (merda == 0 && mutex_left == 1)
-        {
-            if (first_step_left == 0)  // we execute this at the first step to get a good first period
-            {
-                current_heel_strike_left = math_time;
-                first_step_left = first_step_left + 1;
-            }
-            else
-            {
-                // update the time of the previous step gather the time of the current step
-                last_heel_strike_left = current_heel_strike_left;
-                current_heel_strike_left = math_time;
-
-                // gather information from the past step
-                previous_step_period_left = new_period_left; // period of the previous step
-                previous_step_duration_left = current_heel_strike_left - last_heel_strike_left; //real duration of the previou step
-                
-                // we check how different was our step from what we expected
-                performed_gait_left = performed_gait_left + (previous_step_duration_left/previous_step_period_left) + (-1); // if bigger  than 1 -> the step was slower than the torque
-                                                                                                                    // if smaller than 1 -> the step was faster than the torque
-                
-                if (performed_gait_left >= 2)
-                {
-                    performed_gait_left = 1.9;
-                }
-                else if( performed_gait_left <= 0)
-                {
-                    performed_gait_left = 0.1;
-                }
-
-                // we compute the upcoming period
-                //control_ratio_left = 0.1;
-                control_ratio_left = 1;
-                //control_ratio_left = ((1-abs(1-performed_gait_left)) / (abs(1-performed_gait_left)+1))*((1-abs(1-performed_gait_left)) / (abs(1-performed_gait_left)+1));
-                //control_ratio_left = (1/(abs(1-performed_gait_left)+1)); //dynamic control ratio
-                theoretical_period_left = previous_step_duration_left/(2-performed_gait_left);
-                //theoretical_period_corrected_left = theoretical_period_corrected_left + ( - theoretical_period_corrected_left + theoretical_period_left ) * control_ratio_left; // desired duration of the following gait
-                theoretical_period_corrected_left = theoretical_period_corrected_left + ( - theoretical_period_corrected_left + theoretical_period_left ) * control_ratio_left; // desired duration of the following gait
-                new_period_left = theoretical_period_corrected_left; // period of the upcoming wave
-
-                if (new_period_left < 0.2)
-                {
-                    new_period_left = previous_step_period_left;
-                }
-
-                // we update the time_offset (used to compute wave reset point) every time we detect a heel strike
-                time_offset_left = math_time;
-                desired_gain_left = (1/new_period_left)/(1/period);
-
-                leftInStance = true;
-                timeSinceLeftHeelStrike = 0.0f; // reset period counter
-
-                //mutex_left = 0;
-                //mutex_right = 1;
-            }
-        }
-    }
-    else                //leg in stance, check for switching to swing
+    heelStrikeTimer.beginStep();
+
+    while(footSensorsRing.pop(footSensors))
     {
-        if(leftFootLoad < stanceFootLoadThreshold)
-            leftInStance = false;
+        heelStrikeTimer.addSample(footSensors.timestamp, footSensors.footLoads,
+                                  gait.getParams().stanceFootLoadThreshold);
     }
 
-    if(!rightInStance)   //right leg in swing
-    //if(merda == 1)   //right leg in swing
+    for(int j=0; j<N_GAIT_LEGS; j++)
     {
-        if(rightFootLoad > stanceFootLoadThreshold)
-        //if(merda == 1 && mutex_right == 1)
+        soleVoltages[j] = footSensors.soleVoltages[j];
+        for(int i=0; i<SOLE_N_CELLS; i++)
+            logged.cellLoads[j][i] = footSensors.cellLoads[j][i];
+        logged.footLoads[j] = footSensors.footLoads[j];
+        for(int k=0; k<3; k++)
         {
-
-            if (first_step_right == 0)  // we execute this at the first step to get a good first period
-            {
-
-                current_heel_strike_right = 0;
-                first_step_right = first_step_right + 1;
-            }
-            else
-            {
-                // update the time of the previous step gather the time of the current step
-                last_heel_strike_right = current_heel_strike_right;
-                current_heel_strike_right = math_time;
-
-                // gather information from the past step
-                previous_step_period_right = new_period_right; // period of the previous step
-                previous_step_duration_right = current_heel_strike_right - last_heel_strike_right; //real duration of the previou step
-                
-                // we check how different was our step from what we expected
-                performed_gait_right = performed_gait_right + (previous_step_duration_right/previous_step_period_right) + (-1); // if bigger  than 1 -> the step was slower than the torque
-                                                                                                                    // if smaller than 1 -> the step was faster than the torque
-                
-                if (performed_gait_right >= 2)
-                {
-                    performed_gait_right = 1.9;
-                }
-                else if( performed_gait_right <= 0)
-                {
-                    performed_gait_right = 0.1;
-                }
-
-                // we compute the upcoming period
-                //control_ratio_right = 0.1;
-                control_ratio_right = 1;
-                ///control_ratio_right = ((1-abs(1-performed_gait_right)) / (abs(1-performed_gait_right)+1))*((1-abs(1-performed_gait_right)) / (abs(1-performed_gait_right)+1));
-                //control_ratio_right = (1/(abs(1-performed_gait_right)+1)); //dynamic control ratio
-                theoretical_period_right = previous_step_duration_right/(2-performed_gait_right);
-                //theoretical_period_corrected_right = theoretical_period_corrected_right + ( - theoretical_period_corrected_right + theoretical_period_right ) * control_ratio_right; // desired duration of the following gait
-                theoretical_period_corrected_right = theoretical_period_corrected_right + ( - theoretical_period_corrected_right + theoretical_period_right ) * control_ratio_right; // desired duration of the following gait
-                new_period_right = theoretical_period_corrected_right; // period of the upcoming wave
-
-                if (new_period_right < 0.2)
-                {
-                    new_period_right = previous_step_period_right;
-                }
-
-                // we update the time_offset (used to compute wave reset point) every time we detect a heel strike
-                time_offset_right = math_time;
-                desired_gain_right = (1/new_period_right)/(1/period);
-
-
-                rightInStance = true;
-                timeSinceRightHeelStrike = 0.0f; // reset period counter
-
-                //mutex_left = 1; //sim
-                //mutex_right = 0; //sim
-            }
+            logged.footAccels[j][k] = footSensors.footImus[j].accel[k] *
+                                      (FOOT_IMU_ACCEL_RANGE / 32768.0f);
+            logged.footAngularSpeeds[j][k] = footSensors.footImus[j].gyro[k] *
+                                             (FOOT_IMU_GYRO_RANGE / 32768.0f);
         }
+#ifdef EWALK_SUBTICK_HEEL_STRIKES
+        logged.strikeAges[j] = heelStrikeTimer.getCrossingAge((GaitLeg)j);
+#endif
     }
-    else                //leg in stance, check for switching to swing
-    {
-        if(rightFootLoad < stanceFootLoadThreshold)
-            rightInStance = false;
-    }
+    logged.footSensorsAge = USEC_TO_SEC(monotonicTimeUs() - footSensors.timestamp);
+}
+
+/**
+ * @brief Detects the heel-strikes of both legs, and adapts the period and phase
+ * of their torque profile to the measured steps, see GaitTorqueGenerator.
+ */
+void eWalkTimeBasedTorqueProfile::updateGaitCycleDuration()
+{
+    gait.updateGaitCycle(logged.footLoads, logged.strikeAges);
+}
+
+/**
+ * @brief Integrates the adaptive oscillators over the hip angles of this time
+ * step, and aligns them on the heel-strikes just detected by
+ * updateGaitCycleDuration(), see AdaptiveOscillator.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::updateGaitPhase(float dt)
+{
+    phaseOscillator.update(logged.hipAngles, dt);
 
-    if(performed_gait_right > 0.90 && performed_gait_right < 1.10 && performed_gait_left > 0.90 && performed_gait_left < 1.10)
+    for(int j=0; j<N_GAIT_LEGS; j++)
     {
-        redy_to_go = 1;
+        if(gait.getJoints().nHeelStrikes[j] != phaseOscillator.getJoints().nHeelStrikes[j])
+            phaseOscillator.onHeelStrike(j, logged.strikeAges[j]);
     }
-    
 }
 
 /**
@@ -658,20 +840,13 @@ void eWalkTimeBasedTorqueProfile::updateGaitCycleDuration()
 }
 **/
 
-float eWalkTimeBasedTorqueProfile::soleVoltageToForce(float voltage)
-{
-    float cellResistance = SOLES_EXCIT_VOLTAGE * SOLE_ASSOCIATED_RESISTANCE /
-                           voltage - SOLE_ASSOCIATED_RESISTANCE; // [ohm].
-
-    return SOLE_COEF_A / (cellResistance - SOLE_COEF_B); // [N].
-}
-
 /**
  * @brief Calculates the desired torque for a given %GC from the torque profile taken from
- * Winter's gait data. The desired torque is calculated using linear interpolation between the
- * data points in the table. Also uses the winterHipTorqueProfile and pilotBodyWeight parameters
- * defined earlier in this file.
- * @param percentGc Current percentage of the gait cycle [0-1]
+ * Winter's gait data. The table is resampled once on a uniform grid by the ProfileStore, with
+ * linear interpolation between its points, so this is a single lookup whatever the spacing
+ * of the points. Also uses the pilotBodyWeight parameter.
+ * @param percentGc Current percentage of the gait cycle [0-1]. 1 is the heel-strike of the
+ * next cycle, so it gives the torque at 0.
  * @return Target torque based on the given profile [N.m].
  */
 float eWalkTimeBasedTorqueProfile::getTorqueFromProfile(float percentGc)
@@ -679,71 +854,312 @@ float eWalkTimeBasedTorqueProfile::getTorqueFromProfile(float percentGc)
     if(percentGc < 0.0f || percentGc > 1.0f)
         return 0.0f;    // percentGc has to be between 0 and 1
 
-    uint8_t index = percentGc * 100 / 2;        //%GC of the torque profile increases with
-                                                //2% increments, therefore the array index for
-                                                //the nearest point in the profile can be
-                                                //directly calculated from the %GC.
+    float normalizedTorque = winterProfile->table.getTorqueAtPhase(percentGc);
 
-    //Linear interpolation
-    float diffx = percentGc - winterHipTorqueProfile1[index].percentGc;
-    float diffn = 0.02f;
+    return normalizedTorque * logged.pilotBodyWeight; //Torque values are normalized by bodyweight
+}
 
-    float normalizedTorque = winterHipTorqueProfile1[index].torquePerBodyweight
-                + ( winterHipTorqueProfile1[index+1].torquePerBodyweight - winterHipTorqueProfile1[index].torquePerBodyweight ) * diffx / diffn;
+/**
+ * @brief Computes the torques of the profiles of all the joints, see
+ * GaitTorqueGenerator. The results are read with gait.getJoints().torque. If
+ * EWALK_ADAPTIVE_OSCILLATOR is defined, the phase of the profiles is the one
+ * of the adaptive oscillators.
+ */
+void eWalkTimeBasedTorqueProfile::computeTorques()
+{
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+    gait.computeTorquesFromPhases(phaseOscillator.getJoints().gaitPhase);
+#else
+    gait.computeTorques(); //Torque values are normalized by bodyweight
+#endif
+}
 
-    return normalizedTorque * pilotBodyWeight; //Torque values are normalized by bodyweight
+/**
+ * @brief Same as computeTorques(), but evaluates the sum of sines of both
+ * legs in closed form, with a single call to the
+ * vectorized kernel, instead of reading the sampled table. Slower than the
+ * table, but exact for any time, even when a heel-strike was missed.
+ */
+void eWalkTimeBasedTorqueProfile::computeTorquesDirect()
+{
+    gait.computeTorquesDirect();
 }
 
-float eWalkTimeBasedTorqueProfile::computeTorqueRight()
+
+void eWalkTimeBasedTorqueProfile::handleCanCommunication()
 {
-    if (redy_to_go == 1)
+    float dt = USEC_TO_SEC(CAN_UPDATE_PERIOD);
+
+    canLoop.start();
+
+    while(!stopCanThread)
     {
-        if (first_step_right == 1) // We start when we detect the first heel-strike
-        {
-            current_gain_right = current_gain_right + (desired_gain_right-current_gain_right)*0.001;
-            //current_gain_right = 1;
-            time_right = (math_time - time_offset_right + performed_gait_right*new_period_right) * ( original_period_right / new_period_right );
-            sine_torque_right = current_gain_right*torque_multiplier*pilotBodyWeight*(a1 * sin(b1 * time_right + c1) + a2 * sin(b2 * time_right + c2) + a3 * sin(b3 * time_right + c3) + a4 * sin(b4 * time_right + c4) + a5 * sin(b5 * time_right + c5) + a6 * sin(b6 * time_right + c6) + a7 * sin(b7 * time_right + c7) + a8 * sin(b8 * time_right + c8) );
-        }
+        updateMotors(dt);
+
+        // Sleep until the next absolute deadline, so the period does not drift
+        canLoop.waitNextPeriod();
     }
-    return sine_torque_right; //Torque values are normalized by bodyweight
 }
 
-float eWalkTimeBasedTorqueProfile::computeTorqueLeft()
+/**
+ * @brief Checks the other threads and the motors periodically, until the
+ * controller is destroyed, see superviseSafety().
+ */
+void eWalkTimeBasedTorqueProfile::handleSafetySupervision()
 {
-    if (redy_to_go == 1)
+    safetyLoop.start();
+
+    while(!stopSafetyThread)
     {
-        if (first_step_left == 1) // We start when we detect the first heel-strike
-        {
-            current_gain_left = current_gain_left + (desired_gain_left-current_gain_left)*0.001;
-            //current_gain_left = 1;
-            time_left = (math_time - time_offset_left + performed_gait_left*new_period_left) * ( original_period_left / new_period_left );
-            sine_torque_left = current_gain_left*torque_multiplier*pilotBodyWeight*(a1 * sin(b1 * time_left + c1) + a2 * sin(b2 * time_left + c2) + a3 * sin(b3 * time_left + c3) + a4 * sin(b4 * time_left + c4) + a5 * sin(b5 * time_left + c5) + a6 * sin(b6 * time_left + c6) + a7 * sin(b7 * time_left + c7) + a8 * sin(b8 * time_left + c8) );
-        }
+        superviseSafety(USEC_TO_SEC(SAFETY_SUPERVISOR_PERIOD));
+        safetyLoop.waitNextPeriod();
     }
-    return sine_torque_left; //Torque values are normalized by bodyweight
 }
 
+/**
+ * @brief Checks the other threads and the motors. If the CAN thread stalled,
+ * drives the motors to zero torque instead of it, but only if it is not
+ * accessing them: if it is only late inside updateMotors(), it will cut the
+ * torque off itself once it returns, otherwise the next call retries. Called
+ * periodically by the supervisor thread, or by update() if
+ * EWALK_SYNCHRONOUS_CAN is defined.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::superviseSafety(float dt)
+{
+    if(safety.check(monotonicTimeUs()) != SAFETY_CAN_STALLED ||
+       !safety.isCutOffPending())
+    {
+        return;
+    }
+
+    if(motorsInUse.exchange(true, memory_order_acquire))
+        return;
 
-void eWalkTimeBasedTorqueProfile::handleCanCommunication()
+    for(Gyems &motor : motors)
+    {
+        motor.setTorque(0.0f);
+        motor.update(dt);
+    }
+    safety.confirmCutOff(monotonicTimeUs());
+
+    motorsInUse.store(false, memory_order_release);
+}
+
+/**
+ * @brief Acquires the soles and foot IMUs periodically, until the controller
+ * is destroyed. This is the only thread that accesses the SPI bus.
+ */
+void eWalkTimeBasedTorqueProfile::handleFootSensorsAcquisition()
 {
-    float dt = USEC_TO_SEC(CAN_UPDATE_PERIOD);
-    system_clock::time_point nextExecTime = high_resolution_clock::now();
+    float dt = USEC_TO_SEC(FOOT_SENSORS_PERIOD);
 
-    stopCanThread = false;
+    footSensorsLoop.start();
 
-    while(!stopCanThread)
+    while(!stopFootSensorsThread)
     {
-        //
-        auto now = high_resolution_clock::now();
+        acquireFootSensors(dt);
+
+        // Sleep until the next absolute deadline, so the period does not drift
+        footSensorsLoop.waitNextPeriod();
+    }
+}
 
-        //handle the CAN communication
-        rightMotor.update(dt);
-        leftMotor.update(dt);
-        //can.Update();
+/**
+ * @brief Writes a register of a foot IMU.
+ * @param channel the SPI channel of the IMU.
+ * @param address the address of the register.
+ * @param value the value to write.
+ */
+static void writeFootImuRegister(SpiChannel &channel, uint8_t address, uint8_t value)
+{
+    uint8_t txBuffer[2] = { address, value };
+    uint8_t rxBuffer[2];
+
+    channel.transfer(txBuffer, rxBuffer, 2);
+}
 
-        //
-        nextExecTime = now + microseconds(CAN_UPDATE_PERIOD);
-        std::this_thread::sleep_until(nextExecTime);
+/**
+ * @brief Reads a register of a foot IMU.
+ * @param channel the SPI channel of the IMU.
+ * @param address the address of the register.
+ * @return the value of the register.
+ */
+static uint8_t readFootImuRegister(SpiChannel &channel, uint8_t address)
+{
+    uint8_t txBuffer[2] = { (uint8_t)(address | 0x80), 0 }; // Read flag
+    uint8_t rxBuffer[2];
+
+    channel.transfer(txBuffer, rxBuffer, 2);
+    return rxBuffer[1];
+}
+
+/**
+ * @brief Gets the value of the range bits of the gyroscope or accelerometer
+ * configuration register of a foot IMU.
+ * @param range the full scale, one of the 4 supported.
+ * @param smallestRange the smallest supported full scale, each of the others
+ * being twice the previous one.
+ * @return the value of the register.
+ */
+static uint8_t getFootImuRangeBits(float range, float smallestRange)
+{
+    uint8_t bits = 0;
+    while(bits < 3 && smallestRange * (1 << bits) < range)
+        bits++;
+
+    return (uint8_t)(bits << 3);
+}
+
+/**
+ * @brief Identifies a foot IMU, then resets it, wakes it up (the IMUs start
+ * asleep) and sets its ranges. Called before the acquisition thread starts.
+ * @param j the leg of the IMU.
+ * @return true if the IMU was identified and configured, false if it did not
+ * answer or is not supported, in which case it is not read.
+ */
+bool eWalkTimeBasedTorqueProfile::configureFootImu(int j)
+{
+    SpiChannel &channel = footImuSpiChannels[j];
+
+    uint8_t identity = readFootImuRegister(channel, FOOT_IMU_WHO_AM_I_REGISTER);
+    if(find(begin(FOOT_IMU_IDENTITIES), end(FOOT_IMU_IDENTITIES), identity) ==
+       end(FOOT_IMU_IDENTITIES))
+    {
+        debug << "Foot IMU " << j << " not found (WHO_AM_I = " << (int)identity
+              << "), it will not be read." << endl;
+        return false;
+    }
+
+    writeFootImuRegister(channel, FOOT_IMU_PWR_MGMT_1_REGISTER, 0x80); // Reset
+    this_thread::sleep_for(milliseconds(FOOT_IMU_RESET_DELAY));
+    writeFootImuRegister(channel, FOOT_IMU_PWR_MGMT_1_REGISTER, 0x01); // Awake, gyro PLL
+    writeFootImuRegister(channel, FOOT_IMU_USER_CTRL_REGISTER, 0x10);  // SPI only
+    writeFootImuRegister(channel, FOOT_IMU_CONFIG_REGISTER, 0x01);     // 184 Hz low-pass
+    writeFootImuRegister(channel, FOOT_IMU_GYRO_CONFIG_REGISTER,
+                         getFootImuRangeBits(FOOT_IMU_GYRO_RANGE, 250.0f));
+    writeFootImuRegister(channel, FOOT_IMU_ACCEL_CONFIG_REGISTER,
+                         getFootImuRangeBits(FOOT_IMU_ACCEL_RANGE, 2.0f));
+
+    // The IMU must still answer, and be awake.
+    if(readFootImuRegister(channel, FOOT_IMU_WHO_AM_I_REGISTER) != identity ||
+       (readFootImuRegister(channel, FOOT_IMU_PWR_MGMT_1_REGISTER) & 0x40) != 0)
+    {
+        debug << "Foot IMU " << j << " could not be configured, it will not be read."
+              << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the accelerometer, temperature and gyroscope registers of a
+ * foot IMU, in a single SPI transfer.
+ * @param channel the SPI channel of the IMU.
+ * @param sample the raw measurements.
+ */
+static void readFootImu(SpiChannel &channel, FootImuSample &sample)
+{
+    uint8_t txBuffer[FOOT_IMU_DATA_SIZE + 1] = { FOOT_IMU_FIRST_REGISTER | 0x80 }; // Read flag
+    uint8_t rxBuffer[FOOT_IMU_DATA_SIZE + 1];
+
+    channel.transfer(txBuffer, rxBuffer, FOOT_IMU_DATA_SIZE + 1);
+
+    int16_t values[FOOT_IMU_DATA_SIZE / 2]; // Big-endian registers
+    for(int i=0; i<FOOT_IMU_DATA_SIZE / 2; i++)
+        values[i] = (int16_t)((rxBuffer[1 + 2*i] << 8) | rxBuffer[2 + 2*i]);
+
+    for(int i=0; i<3; i++)
+    {
+        sample.accel[i] = values[i];
+        sample.gyro[i] = values[4 + i];
+    }
+    sample.temperature = values[3];
+}
+
+/**
+ * @brief Acquires the soles then the configured foot IMUs, back-to-back,
+ * converts the soles voltages to foot loads, and queues the result for
+ * update(). Called periodically by the acquisition thread, or by update() if
+ * EWALK_SYNCHRONOUS_SENSORS is defined.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::acquireFootSensors(float dt)
+{
+    FootSensorsFrame frame;
+
+    for(Ads7844 &sole : soles)
+        sole.update(dt);
+    frame.timestamp = monotonicTimeUs();
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(footImusFound[j])
+            readFootImu(footImuSpiChannels[j], frame.footImus[j]);
+        else
+            frame.footImus[j] = FootImuSample();
+        frame.soleVoltages[j] = soles[j].getLastSamples();
+    }
+
+    soleCalibration.convert(frame.soleVoltages[GAIT_LEFT], frame.soleVoltages[GAIT_RIGHT],
+                            frame.cellLoads[GAIT_LEFT], frame.cellLoads[GAIT_RIGHT],
+                            frame.footLoads[GAIT_LEFT], frame.footLoads[GAIT_RIGHT]);
+
+    footSensorsRing.push(frame);
+}
+
+/**
+ * @brief Sends the latest torque setpoints to the motors, and publishes their
+ * new state. Called periodically by the CAN thread, or by update() if
+ * EWALK_SYNCHRONOUS_CAN is defined.
+ * @param dt time elapsed since the last call [s].
+ */
+void eWalkTimeBasedTorqueProfile::updateMotors(float dt)
+{
+    // Skip this update if the supervisor is cutting the torque off, after
+    // this thread was late.
+    if(motorsInUse.exchange(true, memory_order_acquire))
+        return;
+
+    // Apply the latest torque setpoints, or zero after a safety fault
+    HipMotorsCommand command;
+    bool newCommand = motorsCommand.read(command);
+    bool cutOff = (safety.getFault() != SAFETY_OK);
+
+    // Handle the CAN communication, and publish the new state of the motors
+    HipMotorsState state;
+    SafetyMotorsSample sample;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(cutOff)
+            motorsSetpoints[j] = 0.0f;
+        else if(newCommand)
+            motorsSetpoints[j] = command.torques[j];
+
+        if(cutOff || newCommand)
+            motors[j].setTorque(motorsSetpoints[j]);
+
+        motors[j].update(dt);
+
+        state.angles[j] = motors[j].getPosition();
+        state.speeds[j] = motors[j].getSpeed();
+        state.torques[j] = motors[j].getTorque();
+
+        sample.angles[j] = state.angles[j];
+        sample.speeds[j] = state.speeds[j];
+        sample.torques[j] = state.torques[j];
+        sample.setpoints[j] = motorsSetpoints[j];
     }
+    //can.Update();
+
+    state.timestamp = monotonicTimeUs();
+    motorsState.write(state);
+
+    motorsInUse.store(false, memory_order_release);
+
+    sample.timestamp = state.timestamp;
+    safety.reportMotors(sample);
+    if(cutOff)
+        safety.confirmCutOff(sample.timestamp);
 }
@@ -10,13 +10,169 @@
 
 //controller-specific headers
 #include "../../drivers/ads7844.h"
+#include "solecalibration.h"
+#include "gaittorquegenerator.h"
+#include "profilestore.h"
+#include "heelstriketimer.h"
+#include "adaptiveoscillator.h"
+#include "safetysupervisor.h"
+#include "harmonicprofiles.h"
+#include "winterprofile.h"
+#include "../../lib/triplebuffer.h"
+#include "../../lib/spscring.h"
+#include "../../lib/periodicexecutor.h"
+#include "../../lib/telemetryrecorder.h"
+#include "../../lib/telemetrystreamer.h"
+
+//#define STAGE_PROFILING               //Time each stage of update() and report it
+                                        //as SyncVars. No overhead if not defined.
+#include "../../lib/stageprofiler.h"
+
+#include <atomic>
 
 #define MAIN_LOOP_PERIOD 0.002f ///< Main loop period [s].
+//#define EWALK_DIRECT_SINE_TORQUE      //Evaluate the sine profile in closed form
+                                        //at each step, instead of the sampled table.
 #define GAIT_CYCLE_AVERAGING_PERIOD 5   //No. of last GCs based on which the average
                                         //GC time is calculated.
 #define MAX_GC_DURATION 2.0f            //Max. duration of GC [s], used for detecting
                                         //standstill periods
+//#define EWALK_SYNCHRONOUS_CAN         //Update the motors from update() instead
+                                        //of a CAN thread (simulated motors only).
+#define TIMING_STATS_PERIOD 1.0f        //Period of update of the loops jitter
+                                        //statistics [s]
+#define EWALK_BINARY_TELEMETRY          //Record the logged SyncVars to binary files
+                                        //instead of the text log, see tools/telemetry2csv.
+#define TELEMETRY_DIRECTORY "telemetry" //Directory of the binary telemetry files
+#define EWALK_TELEMETRY_STREAM          //Stream the logged variables as quantized deltas,
+                                        //at the rate the client drains, see tools/streamclient.
+#define TELEMETRY_STREAM_PORT 9256      //TCP port of the telemetry stream, next to the
+                                        //one of the SyncVars server.
+#define PROFILES_DIRECTORY "profiles"   //Directory of the additional torque profiles,
+                                        //selectable with const/profile, see ProfileStore.
+#define SOLES_CALIBRATION_FILE "soles.conf" //Per-cell calibration of the soles
+#define SOLES_EXCIT_VOLTAGE 3.3f        //Supply voltage of the soles cells [V]
+#define SOLES_ADC_REF 1.243f            //Full-scale voltage of the soles ADCs [V]
+#define FOOT_SENSORS_PERIOD 500         //Period of the acquisition of the soles and of
+                                        //the foot IMUs [us].
+#define FOOT_SENSORS_RING_SIZE 16       //Max. No. of acquisitions waiting for update()
+//#define EWALK_SYNCHRONOUS_SENSORS     //Acquire the soles and foot IMUs from update()
+                                        //instead of an acquisition thread.
+#define SOLES_BURST_SIZE 2              //No. of acquisitions per time step, if
+                                        //EWALK_SYNCHRONOUS_SENSORS is defined.
+#define EWALK_SUBTICK_HEEL_STRIKES      //Date the heel-strikes between the time steps,
+                                        //from the timestamped soles acquisitions.
+//#define EWALK_ADAPTIVE_OSCILLATOR     //Estimate the gait phase at each step from the
+                                        //hip angles, instead of only at the heel-strikes.
+#define FOOT_IMU_FIRST_REGISTER 0x3B    //First register of the accel., temp. and gyro.
+                                        //measurements of the foot IMUs.
+#define FOOT_IMU_DATA_SIZE 14           //Size of these measurements [B].
+#define FOOT_IMU_CONFIG_REGISTER 0x1A   //Digital low-pass filter of the foot IMUs.
+#define FOOT_IMU_GYRO_CONFIG_REGISTER 0x1B  //Range of the gyroscopes.
+#define FOOT_IMU_ACCEL_CONFIG_REGISTER 0x1C //Range of the accelerometers.
+#define FOOT_IMU_USER_CTRL_REGISTER 0x6A    //Interfaces: 0x10 disables the I2C one.
+#define FOOT_IMU_PWR_MGMT_1_REGISTER 0x6B   //Reset, sleep and clock source.
+#define FOOT_IMU_WHO_AM_I_REGISTER 0x75     //Identity of the IMU.
+#define FOOT_IMU_RESET_DELAY 100        //Time for an IMU to restart after a reset [ms].
+#define FOOT_IMU_ACCEL_RANGE 8.0f       //Full scale of the accelerometers, +-2, 4, 8 or 16 [g].
+#define FOOT_IMU_GYRO_RANGE 1000.0f     //Full scale of the gyroscopes, +-250, 500, 1000
+                                        //or 2000 [deg/s].
+
+
+/**
+ * @brief Snapshot of the state of the hip motors, indexed by GaitLeg,
+ * published by the CAN thread after each update of the motors.
+ */
+struct HipMotorsState
+{
+    float angles[N_GAIT_LEGS];      ///< [deg]
+    float speeds[N_GAIT_LEGS];      ///< [deg/s]
+    float torques[N_GAIT_LEGS];     ///< Measured torques [N.m]
+    int64_t timestamp;              ///< Monotonic time of the motors update [us]
+};
+
+/**
+ * @brief Torque setpoints of the hip motors, indexed by GaitLeg, published by
+ * the control loop and sent to the motors by the CAN thread.
+ */
+struct HipMotorsCommand
+{
+    float torques[N_GAIT_LEGS];     ///< [N.m]
+    int64_t timestamp;              ///< Monotonic time of the command [us]
+};
+
+/**
+ * @brief Raw measurements of a foot IMU, read in one burst from its registers.
+ */
+struct FootImuSample
+{
+    int16_t accel[3];   ///< Accelerometer x, y, z [LSB]
+    int16_t temperature; ///< [LSB]
+    int16_t gyro[3];    ///< Gyroscope x, y, z [LSB]
+};
+
+/**
+ * @brief One acquisition of the soles and foot IMUs, indexed by GaitLeg,
+ * published by the acquisition thread to the control loop.
+ */
+struct FootSensorsFrame
+{
+    VecNf<8> soleVoltages[N_GAIT_LEGS]; ///< [V]
+    VecNf<8> cellLoads[N_GAIT_LEGS];    ///< Force of each cell [N]
+    float footLoads[N_GAIT_LEGS];       ///< [N]
+    FootImuSample footImus[N_GAIT_LEGS];
+    int64_t timestamp;                  ///< Monotonic time of the soles acquisition [us]
+};
+
+/**
+ * @brief Variables of the controller recorded by the binary telemetry, grouped
+ * in one structure with a standard layout, so that a snapshot is a single copy
+ * described by a static table of fields (see LOGGED_VARS_FIELDS). The
+ * controller works on them in place, and the few values owned by the
+ * GaitTorqueGenerator are copied here at the end of each step.
+ */
+struct eWalkLoggedVars
+{
+    // State of each joint, indexed by GaitLeg.
+    float hipAngles[N_GAIT_LEGS];       ///< [deg]
+    float hipSpeeds[N_GAIT_LEGS];       ///< [deg/s]
+    float measuredTorques[N_GAIT_LEGS]; ///< [N.m]
+    float torqueCmds[N_GAIT_LEGS];      ///< [N.m]
+    float gaitCyclePercents[N_GAIT_LEGS]; ///< %GC of each leg []
+    float footLoads[N_GAIT_LEGS];       ///< [N]
+    float strikeAges[N_GAIT_LEGS];      ///< Delay of the heel-strikes detection [s]
+    float cellLoads[N_GAIT_LEGS][SOLE_N_CELLS]; ///< Force of each cell [N]
+    float footAccels[N_GAIT_LEGS][3];   ///< Acceleration of the foot IMU, x, y, z [g]
+    float footAngularSpeeds[N_GAIT_LEGS][3]; ///< Angular speed of the foot IMU, x, y, z [deg/s]
+
+    float averageGaitCycleTime;         ///< GC time averaged over the last N GCs [s]
+    float motorsStateAge;               ///< Age of the last motors state [s]
+    int safetyFault;                    ///< SafetyFault latched by the supervisor, 0 if none.
+    float safetyReactionMax;            ///< Longest time to cut the torque off after a fault [us]
+    float footSensorsAge;               ///< Age of the latest acquisition [s]
+    float pilotBodyWeight;              ///< [kg]
+    float baselineGcDuration;           ///< [s]
+    float percentAssistance;            ///< [%] The fraction of the torque profile that will be applied
+    int profileIndex;                   ///< Selected torque profile, see ProfileStore.
 
+    // Copied from the GaitTorqueGenerator, indexed by GaitLeg.
+    float sineTorques[N_GAIT_LEGS];     ///< [N.m]
+    float newPeriods[N_GAIT_LEGS];      ///< [s]
+    float controlRatios[N_GAIT_LEGS];   ///< [0-1]
+    float currentGains[N_GAIT_LEGS];    ///< []
+    float performedGaits[N_GAIT_LEGS];  ///< []
+    float firstSteps[N_GAIT_LEGS];      ///< 0 until the first heel-strike, then 1.
+    float gaitTime;                     ///< [s]
+    float stanceFootLoadThreshold;      ///< [N]
+    int ready;                          ///< 1 once the legs are synchronized.
+#ifdef EWALK_ADAPTIVE_OSCILLATOR
+    float afoPhases[N_GAIT_LEGS];       ///< [0-1[
+    float afoNextStrikes[N_GAIT_LEGS];  ///< [s]
+#endif
+
+    bool inStance[N_GAIT_LEGS];
+    bool startController;
+};
 
 /**
  * @brief A controller to apply a predefined time-based torque profile. The time
@@ -27,87 +183,144 @@
  */
 class eWalkTimeBasedTorqueProfile : public Controller
 {
+    friend class ControllerHarness; // Hardware-free runs, see tools/common.
+
 public:
     eWalkTimeBasedTorqueProfile(PeripheralsSet peripherals);
     ~eWalkTimeBasedTorqueProfile();
 
     void update(float dt) override;
     void handleCanCommunication();
+    void handleFootSensorsAcquisition();
+    void handleSafetySupervision();
 
-    float soleVoltageToForce(float voltage);
     void updateFootLoads(float dt);
     void updateGaitCycleDuration();
+    void updateGaitPhase(float dt);
     float getTorqueFromProfile(float percentGc);
-    float computeTorqueRight();
-    float computeTorqueLeft();
-
+    void computeTorques();
+    void computeTorquesDirect();
 
 private:
     CanBus can;
-    Gyems leftMotor, rightMotor;
+    Gyems motors[N_GAIT_LEGS];
+
+    SpiChannel footImuSpiChannels[N_GAIT_LEGS];
+    Ads7844 soles[N_GAIT_LEGS];
+    SoleCalibration soleCalibration;
+
+    template<typename T>
+    void addSyncVar(const std::string &name, const std::string &unit, T &var,
+                    VarAccess access, bool log);
 
-    SpiChannel leftFootImuSpiChannel, rightFootImuSpiChannel;
-    Ads7844 leftSole, rightSole;
+    TelemetryRecorder telemetry;
+    int telemetryDropped;
+    bool telemetryFailing;
+    TelemetryStreamer stream;
+    int streamDropped, streamDecimation;
+
+    ProfileStore profiles;
+    int profilesCount;
+    const TorqueProfile *winterProfile; ///< See getTorqueFromProfile().
+
+    void sendTorques(const float torques[N_GAIT_LEGS]);
+    void copyLoggedGaitState();
+    void updateMotors(float dt);
+    void superviseSafety(float dt);
+    bool configureFootImu(int j);
+    void acquireFootSensors(float dt);
 
     std::thread *canThread;
-    volatile bool stopCanThread;
+    std::atomic<bool> stopCanThread;
 
-    float leftHipAngle, rightHipAngle;  ///< [deg]
-    float leftHipSpeed, rightHipSpeed;  ///< [deg/s]
-    float leftTorque, rightTorque;    ///< Measured torques [N.m]
+    // The Gyems objects are only accessed by the CAN thread, the control loop
+    // goes through these wait-free exchanges. The supervisor thread may take
+    // them over to cut the torque off, but only while the CAN thread is out of
+    // them: whichever sets motorsInUse first owns the motors and the bus.
+    TripleBuffer<HipMotorsState> motorsState;
+    TripleBuffer<HipMotorsCommand> motorsCommand;
+    float motorsSetpoints[N_GAIT_LEGS]; ///< Last torques sent by the CAN thread [N.m].
+    std::atomic<bool> motorsInUse;
 
-    VecNf<8> leftSoleVoltages, rightSoleVoltages;
-    VecNf<8> leftLoads, rightLoads;
-    float leftFootLoad, rightFootLoad;  ///< [N]
+    // The supervisor thread watches the control loop and the CAN thread, and
+    // cuts the torque off on a fault. If EWALK_SYNCHRONOUS_CAN is defined,
+    // there is no such thread, and update() runs the same supervision.
+    SafetySupervisor safety;
+    std::thread *safetyThread;
+    std::atomic<bool> stopSafetyThread;
+    bool safetyStopped;                 ///< The assistance was disabled by a fault.
 
-    bool leftInStance, rightInStance;
-    float stanceFootLoadThreshold;      ///< [N]
-    float pilotBodyWeight;              ///< [kg]
-    float baselineGcDuration;           ///< [s]
-    float percentAssistance;            ///< [%] The fraction of the torque profile that will be applied
-    bool startController;
+    // The soles and foot IMUs, and the SPI bus, are only accessed by the
+    // acquisition thread, which queues the timestamped acquisitions here.
+    std::thread *footSensorsThread;
+    std::atomic<bool> stopFootSensorsThread;
+    SpscRing<FootSensorsFrame, FOOT_SENSORS_RING_SIZE> footSensorsRing;
+    FootSensorsFrame footSensors;       ///< Latest acquisition.
+    int footSensorsDropped;
+
+    void updateTimingStats(float dt);
+
+    PeriodicExecutor canLoop;
+    PeriodicExecutor footSensorsLoop;
+    PeriodicExecutor safetyLoop;
+    PeriodMonitor mainLoopMonitor;
+    float timingStatsTimer;             ///< [s]
+    float canJitterP50, canJitterP99, canJitterMax;                 ///< [us]
+    float sensorsJitterP50, sensorsJitterP99, sensorsJitterMax;     ///< [us]
+    float mainLoopJitterP50, mainLoopJitterP99, mainLoopJitterMax;  ///< [us]
+    int canOverruns, sensorsOverruns, mainLoopOverruns;
+
+#ifdef STAGE_PROFILING
+    enum UpdateStage
+    {
+        STAGE_MOTORS_READ = 0,
+        STAGE_FOOT_LOADS,
+        STAGE_GAIT_CYCLE,
+        STAGE_TORQUES,
+        STAGE_SET_TORQUE,
+        N_UPDATE_STAGES
+    };
+
+    StageProfiler<N_UPDATE_STAGES, 500> stageProfiler; // 1 s window.
+#endif
+
+    eWalkLoggedVars logged;             ///< Recorded variables, see eWalkLoggedVars.
+
+    VecNf<8> soleVoltages[N_GAIT_LEGS];
+    bool footImusFound[N_GAIT_LEGS];    ///< Only the configured IMUs are read.
+    HeelStrikeTimer heelStrikeTimer;
 
-    float timeSinceLeftHeelStrike, timeSinceRightHeelStrike;    ///< [s]
     std::array<float, GAIT_CYCLE_AVERAGING_PERIOD> lastGaitCycleTimes;
-    float averageGaitCycleTime;     ///< GC time averaged over the last N GCs [s]
-    float leftGaitCyclePercent, rightGaitCyclePercent; ///< %GC for the left and right leg []
-    float leftTorqueCmd, rightTorqueCmd;    ///< [N.m]
-
-    float last_heel_strike_left, current_heel_strike_left; ///< [s]
-    float original_period_left, previous_step_period_left, new_period_left, previous_step_duration_left, theoretical_period_left, theoretical_period_corrected_left; ///< [s]
-    float performed_gait_left; ///< [%]
-    float time_offset_left; ///< [s]
-    float first_step_left; ///< <<[0-1]
-    float sine_torque_left;
-    float control_ratio_left;
-    
-
-    float last_heel_strike_right, current_heel_strike_right; ///< [s]
-    float original_period_right, previous_step_period_right, new_period_right, previous_step_duration_right, theoretical_period_right, theoretical_period_corrected_right; ///< [s]
-    float performed_gait_right; ///< [%]
-    float time_offset_right; ///< [s] 
-    float first_step_right; ///< <<[0-1]
-    float sine_torque_right;
-    float control_ratio_right;
-
-    float time_right, time_left;
-    float math_time;
-    int redy_to_go;
-
-    float previous_gain_right, desired_gain_right, current_gain_right;
-    float previous_gain_left, desired_gain_left, current_gain_left;
+
+    GaitTorqueGenerator gait; ///< Heel-strike synchronized profile, scaled by bodyweight [N.m].
+    AdaptiveOscillator phaseOscillator; ///< Continuous gait phase, if EWALK_ADAPTIVE_OSCILLATOR.
 
 };
 
 typedef eWalkTimeBasedTorqueProfile SelectedController;
 
+/**
+ * @brief Creates a SyncVar and adds it to the list of the controller. If
+ * EWALK_BINARY_TELEMETRY is defined, the logged variables are recorded by the
+ * binary telemetry recorder instead of the text log, from the copy of them in
+ * eWalkLoggedVars, so they must be listed in LOGGED_VARS_FIELDS.
+ * @param name name of the SyncVar.
+ * @param unit unit of the variable.
+ * @param var the variable.
+ * @param access access rights of the remote client.
+ * @param log true to record the variable, false otherwise.
+ */
+template<typename T>
+void eWalkTimeBasedTorqueProfile::addSyncVar(const std::string &name,
+                                             const std::string &unit, T &var,
+                                             VarAccess access, bool log)
+{
+#ifdef EWALK_BINARY_TELEMETRY
+    log = false;
+#endif
 
-// Data for the torque profile, taken from the appendix of the textbook
-// "The biomechanics and motor control of human gait" by D. A. Winter (1991).
-// The left column is the percent gait cycle, the right column is the hip torque
-// normalized by bodyweight (N.m/Kg). In the original textbook, the signs are
-// inverted because in the book, extension torques are defined as positive.
-typedef struct { float percentGc; float torquePerBodyweight; } TorquePoint_T;
+    syncVars.push_back(makeSyncVar(name, unit, var, access, log));
+}
 
 
 #endif // EWALKTIMEBASEDTORQUEPROFILE_H
@@ -0,0 +1,549 @@
+#include "gaittorquegenerator.h"
+#include "harmonickernel.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// The controller has always recorded the current time as the first heel-strike
+// of the left leg, but 0 for the right leg, so that the first measured step of
+// the right leg starts when the controller was created.
+const bool FIRST_STEP_FROM_START[N_GAIT_LEGS] = { false, true };
+
+/**
+ * @brief Converts a duration to ticks.
+ * @param seconds the duration, positive [s].
+ * @return the duration, rounded to the nearest tick [ticks].
+ */
+static inline int64_t secondsToTicks(float seconds)
+{
+    return (int64_t)((double)seconds * GAIT_TICKS_PER_SECOND + 0.5);
+}
+
+/**
+ * @brief Converts a duration to seconds. Only meant for durations of a few
+ * gait cycles, to keep the float precision.
+ * @param ticks the duration [ticks].
+ * @return the duration [s].
+ */
+static inline float ticksToSeconds(int64_t ticks)
+{
+    return (float)ticks * (1.0f / GAIT_TICKS_PER_SECOND);
+}
+
+/**
+ * @brief Constructor. Sets the default parameters, a zero profile, and resets
+ * the state.
+ */
+GaitTorqueGenerator::GaitTorqueGenerator()
+{
+    params = getDefaultParams();
+    scale = 1.0f;
+    ownProfile.harmonic = true;
+    ownProfile.coefficients.a.fill(0.0f);
+    ownProfile.coefficients.b.fill(0.0f);
+    ownProfile.coefficients.c.fill(0.0f);
+    ownProfile.period = 1.0f;
+    setProfile(nullptr);
+    reset();
+}
+
+/**
+ * @brief Gets the parameters used on the orthosis.
+ * @return the default parameters.
+ */
+GaitTorqueParams GaitTorqueGenerator::getDefaultParams()
+{
+    GaitTorqueParams p;
+    p.stanceFootLoadThreshold = 0.5f;
+    p.controlRatio = 1.0f;
+    p.gainSlewRate = 0.001f;
+    p.performedGaitMax = 2.0f;
+    p.performedGaitMaxReset = 1.9f;
+    p.performedGaitMin = 0.0f;
+    p.performedGaitMinReset = 0.1f;
+    p.minPeriod = 0.2f;
+    p.readyMinPerformedGait = 0.9f;
+    p.readyMaxPerformedGait = 1.1f;
+    p.profileCrossfadeDuration = 0.2f;
+    return p;
+}
+
+/**
+ * @brief Gets the period of a sum-of-sines profile, as always computed from
+ * its first term.
+ * @param coefficients the profile coefficients.
+ * @return the period [s].
+ */
+float GaitTorqueGenerator::getHarmonicPeriod(const HarmonicCoefficients &coefficients)
+{
+    return 1/(coefficients.b[0]/(2*GAIT_PROFILE_PI));
+}
+
+/**
+ * @brief Sets the torque profile of all the joints. Its period is given by the
+ * first term, so this should be followed by reset().
+ * @param coefficients the profile coefficients, normalized by bodyweight.
+ */
+void GaitTorqueGenerator::setProfile(const HarmonicCoefficients &coefficients)
+{
+    ownProfile.coefficients = coefficients;
+    ownProfile.period = getHarmonicPeriod(coefficients);
+    ownProfile.table.setHarmonics(coefficients);
+    setProfile(nullptr);
+}
+
+/**
+ * @brief Sets the torque profile of all the joints, immediately. The period of
+ * the profiles is the nominal period of this one, so this should be followed
+ * by reset().
+ * @param profile the profile, which must outlive the generator, or nullptr for
+ * the one set by coefficients.
+ */
+void GaitTorqueGenerator::setProfile(const TorqueProfile *profile)
+{
+    requestedProfile = profile;
+    profilePeriod = getProfile(profile).period;
+    phasePerSecond = 1.0f / profilePeriod;
+
+    GaitJointsState &s = joints;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        jointProfiles[j] = profile;
+        previousProfiles[j] = profile;
+        crossfadeStart[j] = 0;
+        s.crossfade[j] = 1.0f;
+    }
+}
+
+/**
+ * @brief Changes the torque profile while walking, keeping the period adapted
+ * to the steps. The joints that do not apply any torque yet switch
+ * immediately, the others at their next heel-strike. This can be called at
+ * each step, and never blocks.
+ * @param profile the new profile, which must outlive the generator, or nullptr
+ * for the one set by coefficients.
+ */
+void GaitTorqueGenerator::requestProfile(const TorqueProfile *profile)
+{
+    requestedProfile = profile;
+
+    GaitJointsState &s = joints;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(ready != 1 || s.firstStep[j] != 1)
+        {
+            jointProfiles[j] = profile;
+            s.crossfade[j] = 1.0f;
+        }
+    }
+}
+
+/**
+ * @brief Sets the factor applied to the normalized profiles. The profiles are
+ * not resampled, so this can be called at each step.
+ * @param scale the factor, e.g. proportional to the bodyweight [].
+ */
+void GaitTorqueGenerator::setScale(float scale)
+{
+    this->scale = scale;
+}
+
+/**
+ * @brief Resets the state of all the joints, as before the first heel-strike.
+ */
+void GaitTorqueGenerator::reset()
+{
+    ticks = 0;
+    time = 0.0f;
+    ready = 0;
+
+    GaitJointsState &s = joints;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        s.inStance[j] = false;
+        s.firstStep[j] = 0.0f;
+        s.nHeelStrikes[j] = 0;
+        s.lastHeelStrike[j] = 0;
+        s.currentHeelStrike[j] = 0;
+        s.originalPeriod[j] = profilePeriod;
+        s.previousStepPeriod[j] = profilePeriod;
+        s.newPeriod[j] = profilePeriod;
+        s.previousStepDuration[j] = profilePeriod;
+        s.theoreticalPeriod[j] = profilePeriod;
+        s.theoreticalPeriodCorrected[j] = profilePeriod;
+        s.performedGait[j] = 0.5f;
+        s.timeOffset[j] = 0;
+        s.controlRatio[j] = 0.5f;
+        s.desiredGain[j] = 1.0f;
+        s.currentGain[j] = 1.0f;
+        s.time[j] = 0.0f;
+        s.torque[j] = 0.0f;
+        s.crossfade[j] = 1.0f;
+        jointProfiles[j] = requestedProfile;
+    }
+}
+
+/**
+ * @brief Gets the parameters, to change them.
+ * @return a reference to the parameters.
+ */
+GaitTorqueParams &GaitTorqueGenerator::getParams()
+{
+    return params;
+}
+
+/**
+ * @brief Gets the state of the joints, e.g. to expose it as SyncVars.
+ * @return a reference to the state, indexed by GaitLeg.
+ */
+GaitJointsState &GaitTorqueGenerator::getJoints()
+{
+    return joints;
+}
+
+/**
+ * @brief Gets the state of the joints.
+ * @return a reference to the state, indexed by GaitLeg.
+ */
+const GaitJointsState &GaitTorqueGenerator::getJoints() const
+{
+    return joints;
+}
+
+/**
+ * @brief Gets the last requested torque profile.
+ * @return the profile, normalized by bodyweight.
+ */
+const TorqueProfile &GaitTorqueGenerator::getProfile() const
+{
+    return getProfile(requestedProfile);
+}
+
+/**
+ * @brief Gets the nominal period of the torque profiles, from the profile set
+ * before reset().
+ * @return the period [s].
+ */
+float GaitTorqueGenerator::getProfilePeriod() const
+{
+    return profilePeriod;
+}
+
+/**
+ * @brief Lists the profiles that the generator may still use: the requested
+ * one, the one of each joint, and the previous one of each joint that is still
+ * crossfading. The others, e.g. the previous profiles after the crossfade, can
+ * be freed.
+ * @param profiles array to fill, with nullptr for the unused entries, and for
+ * the one set by coefficients.
+ */
+void GaitTorqueGenerator::getProfilesInUse(const TorqueProfile *profiles[GAIT_MAX_PROFILES_IN_USE]) const
+{
+    int n = 0;
+    profiles[n++] = requestedProfile;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        profiles[n++] = jointProfiles[j];
+        profiles[n++] = (joints.crossfade[j] < 1.0f) ? previousProfiles[j] : nullptr;
+    }
+}
+
+/**
+ * @brief Gets the factor applied to the normalized profile.
+ * @return the scale factor [].
+ */
+float GaitTorqueGenerator::getScale() const
+{
+    return scale;
+}
+
+/**
+ * @brief Gets the time since the start, e.g. to expose it as a SyncVar. It is
+ * only for display: after a few hours, the float is less precise than the
+ * time step.
+ * @return a reference to the time [s].
+ */
+float &GaitTorqueGenerator::getTime()
+{
+    return time;
+}
+
+/**
+ * @brief Gets the time since the start, as counted by the generator.
+ * @return the time [ticks], see GAIT_TICKS_PER_SECOND.
+ */
+int64_t GaitTorqueGenerator::getTicks() const
+{
+    return ticks;
+}
+
+/**
+ * @brief Gets whether the legs are synchronized, and the torques applied.
+ * @return a reference to the flag, 1 if synchronized, 0 otherwise.
+ */
+int &GaitTorqueGenerator::getReady()
+{
+    return ready;
+}
+
+/**
+ * @brief Advances the time, at each time step, even when the assistance is
+ * disabled.
+ * @param dt time elapsed since the last call [s].
+ */
+void GaitTorqueGenerator::advanceTime(float dt)
+{
+    ticks += secondsToTicks(dt);
+    time = (float)(ticks * (1.0 / GAIT_TICKS_PER_SECOND));
+}
+
+/**
+ * @brief Detects the heel-strikes of all the legs, and updates the period and
+ * phase of their profile. A leg first waits to enter swing (footLoad <
+ * threshold), then a heel-strike is detected as soon as the foot load is above
+ * the threshold. The legs are synchronized once the performed gait of both is
+ * close to 1.
+ *
+ * A heel-strike detected at this step is dated by default at the current time,
+ * so up to one time step late. If the soles are sampled faster than the
+ * control loop, the exact time of the threshold crossing can be given as its
+ * age, see HeelStrikeTimer.
+ * @param footLoads total load of each foot [N].
+ * @param crossingAges time elapsed since each foot load crossed the threshold
+ * [s], or nullptr to date the heel-strikes at the current time.
+ */
+void GaitTorqueGenerator::updateGaitCycle(const float footLoads[N_GAIT_LEGS],
+                                          const float crossingAges[N_GAIT_LEGS])
+{
+    GaitJointsState &s = joints;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        int64_t strikeTime = ticks - ((crossingAges != nullptr) ?
+                                          secondsToTicks(crossingAges[j]) : 0);
+
+        if(!s.inStance[j])  // Leg in swing.
+        {
+            if(footLoads[j] > params.stanceFootLoadThreshold)
+                onHeelStrike(j, strikeTime, FIRST_STEP_FROM_START[j] ? 0 : strikeTime);
+        }
+        else                // Leg in stance, check for switching to swing.
+        {
+            if(footLoads[j] < params.stanceFootLoadThreshold)
+                s.inStance[j] = false;
+        }
+    }
+
+    if(s.performedGait[GAIT_RIGHT] > params.readyMinPerformedGait &&
+       s.performedGait[GAIT_RIGHT] < params.readyMaxPerformedGait &&
+       s.performedGait[GAIT_LEFT] > params.readyMinPerformedGait &&
+       s.performedGait[GAIT_LEFT] < params.readyMaxPerformedGait)
+    {
+        ready = 1;
+    }
+}
+
+/**
+ * @brief Computes the torques of all the joints at the current time. The
+ * torque of a joint is only updated once the legs are synchronized, and after
+ * its first heel-strike. The results are read with getJoints().torque.
+ */
+void GaitTorqueGenerator::computeTorques()
+{
+    GaitJointsState &s = joints;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(updateJointTime(j))
+            s.torque[j] = s.currentGain[j]*getProfileTorque(j, s.time[j] * phasePerSecond);
+    }
+}
+
+/**
+ * @brief Same as computeTorques() for both hips, but evaluates the sum of
+ * sines of both in closed form, with a single call to the vectorized kernel,
+ * instead of reading the sampled table. Slower than the table, but exact for
+ * any time, even when a heel-strike was missed. The tabulated profiles, and
+ * the crossfades between profiles, still use the tables.
+ */
+void GaitTorqueGenerator::computeTorquesDirect()
+{
+    GaitJointsState &s = joints;
+
+    bool rightActive = updateJointTime(GAIT_RIGHT);
+    bool leftActive = updateJointTime(GAIT_LEFT);
+
+    if(!rightActive && !leftActive)
+        return;
+
+    const TorqueProfile &profile = getProfile(jointProfiles[GAIT_LEFT]);
+    if(!profile.harmonic || jointProfiles[GAIT_RIGHT] != jointProfiles[GAIT_LEFT] ||
+       s.crossfade[GAIT_RIGHT] < 1.0f || s.crossfade[GAIT_LEFT] < 1.0f)
+    {
+        for(int j=0; j<N_GAIT_LEGS; j++)
+        {
+            if(j == GAIT_RIGHT ? rightActive : leftActive)
+                s.torque[j] = s.currentGain[j]*getProfileTorque(j, s.time[j] * phasePerSecond);
+        }
+        return;
+    }
+
+    // Time along the profile, at its own nominal period.
+    float timeScale = profile.period / profilePeriod;
+
+    float profileLeft, profileRight;
+    evaluateHarmonicsPair(profile.coefficients, s.time[GAIT_LEFT] * timeScale,
+                          s.time[GAIT_RIGHT] * timeScale, profileLeft, profileRight);
+
+    if(rightActive)
+        s.torque[GAIT_RIGHT] = s.currentGain[GAIT_RIGHT]*scale*profileRight;
+    if(leftActive)
+        s.torque[GAIT_LEFT] = s.currentGain[GAIT_LEFT]*scale*profileLeft;
+}
+
+/**
+ * @brief Same as computeTorques(), but the phase of the profile of each joint
+ * is given by an external estimator, e.g. AdaptiveOscillator, instead of being
+ * extrapolated from the last heel-strike. The gain still follows the period
+ * measured at the heel-strikes.
+ * @param phases phase of the gait cycle of each joint, 0 at heel-strike [0-1[.
+ */
+void GaitTorqueGenerator::computeTorquesFromPhases(const float phases[N_GAIT_LEGS])
+{
+    GaitJointsState &s = joints;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(ready != 1 || s.firstStep[j] != 1)
+            continue;
+
+        s.currentGain[j] = s.currentGain[j] + (s.desiredGain[j]-s.currentGain[j])*params.gainSlewRate;
+        s.time[j] = phases[j] * s.originalPeriod[j];
+        s.torque[j] = s.currentGain[j]*getProfileTorque(j, phases[j]);
+    }
+}
+
+/**
+ * @brief Compares the duration of the last step of a joint to the period of
+ * its profile, and computes the period of the next step.
+ * @param j the joint index.
+ * @param strikeTime time of the heel-strike [ticks].
+ * @param firstHeelStrike time recorded for the first heel-strike [ticks], see
+ * FIRST_STEP_FROM_START.
+ * @remark the first heel-strike does not switch the leg to stance, so the
+ * second one is detected at the next time step.
+ */
+void GaitTorqueGenerator::onHeelStrike(int j, int64_t strikeTime, int64_t firstHeelStrike)
+{
+    GaitJointsState &s = joints;
+
+    s.nHeelStrikes[j]++;
+
+    if(s.firstStep[j] == 0) // First heel-strike, only gives the start of the next step.
+    {
+        s.currentHeelStrike[j] = firstHeelStrike;
+        s.firstStep[j] = s.firstStep[j] + 1;
+        return;
+    }
+
+    s.lastHeelStrike[j] = s.currentHeelStrike[j];
+    s.currentHeelStrike[j] = strikeTime;
+
+    // Compare the real duration of the last step to the profile period.
+    s.previousStepPeriod[j] = s.newPeriod[j];
+    s.previousStepDuration[j] = ticksToSeconds(s.currentHeelStrike[j] - s.lastHeelStrike[j]);
+
+    // Above 1, the step was slower than the profile, below 1, it was faster.
+    s.performedGait[j] = s.performedGait[j] + (s.previousStepDuration[j]/s.previousStepPeriod[j]) + (-1);
+
+    if(s.performedGait[j] >= params.performedGaitMax)
+        s.performedGait[j] = params.performedGaitMaxReset;
+    else if(s.performedGait[j] <= params.performedGaitMin)
+        s.performedGait[j] = params.performedGaitMinReset;
+
+    // Period of the profile for the next step.
+    s.controlRatio[j] = params.controlRatio;
+    s.theoreticalPeriod[j] = s.previousStepDuration[j]/(2-s.performedGait[j]);
+    s.theoreticalPeriodCorrected[j] = s.theoreticalPeriodCorrected[j] + ( - s.theoreticalPeriodCorrected[j] + s.theoreticalPeriod[j] ) * s.controlRatio[j];
+    s.newPeriod[j] = s.theoreticalPeriodCorrected[j];
+
+    if(s.newPeriod[j] < params.minPeriod)
+        s.newPeriod[j] = s.previousStepPeriod[j];
+
+    // The profile restarts from this heel-strike.
+    s.timeOffset[j] = strikeTime;
+    s.desiredGain[j] = (1/s.newPeriod[j])/(1/profilePeriod);
+
+    // So does the requested profile, faded in from the previous one.
+    if(jointProfiles[j] != requestedProfile)
+    {
+        previousProfiles[j] = jointProfiles[j];
+        jointProfiles[j] = requestedProfile;
+        crossfadeStart[j] = strikeTime;
+        s.crossfade[j] = 0.0f;
+    }
+
+    s.inStance[j] = true;
+}
+
+/**
+ * @brief Advances the time along the profile of a joint.
+ * @param j the joint index.
+ * @return true if the torque of the joint is active, false otherwise.
+ */
+bool GaitTorqueGenerator::updateJointTime(int j)
+{
+    GaitJointsState &s = joints;
+
+    if(ready != 1 || s.firstStep[j] != 1)
+        return false;
+
+    // Without heel-strikes, e.g. when standing still, the profile repeats: the
+    // time since the last one is wrapped to whole periods, to stay small.
+    int64_t elapsed = ticks - s.timeOffset[j];
+    int64_t period = secondsToTicks(s.newPeriod[j]);
+    if(elapsed >= GAIT_WRAP_PERIODS * period)
+        elapsed %= period;
+
+    s.currentGain[j] = s.currentGain[j] + (s.desiredGain[j]-s.currentGain[j])*params.gainSlewRate;
+    s.time[j] = (ticksToSeconds(elapsed) + s.performedGait[j]*s.newPeriod[j]) * ( s.originalPeriod[j] / s.newPeriod[j] );
+    return true;
+}
+
+/**
+ * @brief Gets the scaled torque of the profile of a joint, crossfaded from the
+ * previous profile after a change.
+ * @param j the joint index.
+ * @param phase fraction of the gait cycle since the last heel-strike [].
+ * @return the torque, before the gain [N.m].
+ */
+float GaitTorqueGenerator::getProfileTorque(int j, float phase)
+{
+    GaitJointsState &s = joints;
+
+    float torque = getProfile(jointProfiles[j]).table.getTorqueAtPhase(phase);
+
+    if(s.crossfade[j] < 1.0f)
+    {
+        s.crossfade[j] = (params.profileCrossfadeDuration > 0.0f) ?
+                    ticksToSeconds(ticks - crossfadeStart[j]) / params.profileCrossfadeDuration : 1.0f;
+        s.crossfade[j] = min(max(s.crossfade[j], 0.0f), 1.0f);
+
+        float previous = getProfile(previousProfiles[j]).table.getTorqueAtPhase(phase);
+        torque = previous + (torque - previous) * s.crossfade[j];
+    }
+
+    return scale*torque;
+}
+
+/**
+ * @brief Resolves a profile pointer, nullptr being the one set by coefficients.
+ * @param profile the profile, or nullptr.
+ * @return the profile.
+ */
+const TorqueProfile &GaitTorqueGenerator::getProfile(const TorqueProfile *profile) const
+{
+    return (profile != nullptr) ? *profile : ownProfile;
+}
@@ -0,0 +1,153 @@
+#ifndef GAITTORQUEGENERATOR_H
+#define GAITTORQUEGENERATOR_H
+
+#include <cstdint>
+
+#include "torqueprofiletable.h"
+
+#define GAIT_PROFILE_PI 3.14159f ///< Value of pi of the original profile period computation.
+#define GAIT_TICKS_PER_SECOND 1000000000LL ///< Resolution of the time base, 1 ns [1/s].
+#define GAIT_WRAP_PERIODS 2     ///< Profile periods without heel-strike before the time along the profile wraps [].
+#define GAIT_MAX_PROFILES_IN_USE (1 + 2*N_GAIT_LEGS) ///< See getProfilesInUse().
+
+/**
+ * @brief Tuning parameters of the heel-strike synchronization of the torque
+ * profile. The defaults are the values used on the orthosis.
+ */
+struct GaitTorqueParams
+{
+    float stanceFootLoadThreshold;  ///< Foot load above which the foot is in stance [N].
+    float controlRatio;             ///< Fraction of the period error corrected at each heel-strike [0-1].
+    float gainSlewRate;             ///< Fraction of the gain error corrected at each step [0-1].
+    float performedGaitMax;         ///< Upper limit of the performed gait [].
+    float performedGaitMaxReset;    ///< Performed gait after reaching the upper limit [].
+    float performedGaitMin;         ///< Lower limit of the performed gait [].
+    float performedGaitMinReset;    ///< Performed gait after reaching the lower limit [].
+    float minPeriod;                ///< Shortest accepted profile period [s].
+    float readyMinPerformedGait;    ///< Lower bound of the performed gait to start [].
+    float readyMaxPerformedGait;    ///< Upper bound of the performed gait to start [].
+    float profileCrossfadeDuration; ///< Transition to a new profile, from the heel-strike [s].
+};
+
+/**
+ * @brief Joints driven by the generator, used as indices of its state. There
+ * is one hip per leg, and the heel-strikes of each leg drive its hip. Other
+ * actuated joints can be added before N_GAIT_LEGS.
+ */
+enum GaitLeg
+{
+    GAIT_LEFT = 0,
+    GAIT_RIGHT,
+    N_GAIT_LEGS
+};
+
+/**
+ * @brief State of the torque profiles of all the joints, as a structure of
+ * arrays indexed by GaitLeg, so that each step processes all the joints in one
+ * loop over contiguous values.
+ */
+struct GaitJointsState
+{
+    bool inStance[N_GAIT_LEGS];
+    float firstStep[N_GAIT_LEGS];           ///< 0 until the first heel-strike, then 1.
+    int nHeelStrikes[N_GAIT_LEGS];          ///< Heel-strikes detected since reset().
+    int64_t lastHeelStrike[N_GAIT_LEGS];    ///< [ticks]
+    int64_t currentHeelStrike[N_GAIT_LEGS]; ///< [ticks]
+    float originalPeriod[N_GAIT_LEGS];      ///< Period of the profile [s].
+    float previousStepPeriod[N_GAIT_LEGS];  ///< Profile period during the last step [s].
+    float newPeriod[N_GAIT_LEGS];           ///< Profile period of the current step [s].
+    float previousStepDuration[N_GAIT_LEGS]; ///< Measured duration of the last step [s].
+    float theoreticalPeriod[N_GAIT_LEGS];   ///< [s]
+    float theoreticalPeriodCorrected[N_GAIT_LEGS]; ///< [s]
+    float performedGait[N_GAIT_LEGS];       ///< Step duration over profile period, accumulated [].
+    int64_t timeOffset[N_GAIT_LEGS];        ///< Time of the last heel-strike [ticks].
+    float controlRatio[N_GAIT_LEGS];        ///< [0-1]
+    float desiredGain[N_GAIT_LEGS];         ///< Speed of the profile relative to the original one [].
+    float currentGain[N_GAIT_LEGS];         ///< []
+    float time[N_GAIT_LEGS];                ///< Time along the profile [s].
+    float torque[N_GAIT_LEGS];              ///< Last computed torque [N.m].
+    float crossfade[N_GAIT_LEGS];           ///< Weight of the profile adopted at the last heel-strike [0-1].
+};
+
+/**
+ * @brief Hardware-free logic of the time-based torque profile: detects the
+ * heel-strikes from the foot loads, adapts the period and phase of the profile
+ * of each joint to the measured steps, and computes the torques.
+ *
+ * All the state is in the object, so that many instances can run side by side
+ * with different parameters, e.g. to tune them offline (see tools/gaitsweep).
+ * The controller feeds it once per time step: advanceTime(), then
+ * updateGaitCycle() and computeTorques() while the assistance is enabled.
+ *
+ * The profile can be changed while walking with requestProfile(). Each joint
+ * then switches at its next heel-strike, crossfading from the previous profile,
+ * so that the torque never jumps. The profiles are looked up by phase, so they
+ * all follow the period adapted to the steps.
+ *
+ * The time is counted in 64-bit ticks of GAIT_TICKS_PER_SECOND, and only the
+ * durations since the last heel-strike are converted to float seconds, so
+ * that the profiles stay as accurate after a day of walking as after a minute.
+ * The time along the profile is kept within a few periods, even if the
+ * heel-strikes stop.
+ */
+class GaitTorqueGenerator
+{
+public:
+    GaitTorqueGenerator();
+
+    static GaitTorqueParams getDefaultParams();
+
+    static float getHarmonicPeriod(const HarmonicCoefficients &coefficients);
+
+    void setProfile(const HarmonicCoefficients &coefficients);
+    void setProfile(const TorqueProfile *profile);
+    void requestProfile(const TorqueProfile *profile);
+    void setScale(float scale);
+    void reset();
+
+    GaitTorqueParams &getParams();
+    GaitJointsState &getJoints();
+    const GaitJointsState &getJoints() const;
+    const TorqueProfile &getProfile() const;
+    float getProfilePeriod() const;
+    void getProfilesInUse(const TorqueProfile *profiles[GAIT_MAX_PROFILES_IN_USE]) const;
+    float getScale() const;
+    float &getTime();
+    int64_t getTicks() const;
+    int &getReady();
+
+    void advanceTime(float dt);
+    void updateGaitCycle(const float footLoads[N_GAIT_LEGS],
+                         const float crossingAges[N_GAIT_LEGS] = nullptr);
+
+    void computeTorques();
+    void computeTorquesDirect();
+    void computeTorquesFromPhases(const float phases[N_GAIT_LEGS]);
+
+private:
+    void onHeelStrike(int j, int64_t strikeTime, int64_t firstHeelStrike);
+    bool updateJointTime(int j);
+    float getProfileTorque(int j, float phase);
+    const TorqueProfile &getProfile(const TorqueProfile *profile) const;
+
+    GaitTorqueParams params;
+    float profilePeriod;        ///< [s]
+    float phasePerSecond;       ///< Inverse of the profile period [1/s].
+    float scale;                ///< []
+
+    // The profiles are owned by the caller of requestProfile(), except the one
+    // given by coefficients, stored here, and referred to as nullptr so that
+    // the generator can be copied.
+    TorqueProfile ownProfile;
+    const TorqueProfile *requestedProfile;
+    const TorqueProfile *jointProfiles[N_GAIT_LEGS];    ///< Used since the last heel-strike.
+    const TorqueProfile *previousProfiles[N_GAIT_LEGS]; ///< Faded out after the last heel-strike.
+    int64_t crossfadeStart[N_GAIT_LEGS];                ///< [ticks]
+
+    GaitJointsState joints;
+    int64_t ticks;              ///< Time since reset() [ticks].
+    float time;                 ///< Same, only for display [s].
+    int ready;                  ///< 0 until both legs are synchronized, then 1.
+};
+
+#endif // GAITTORQUEGENERATOR_H
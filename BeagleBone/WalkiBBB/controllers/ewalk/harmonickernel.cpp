@@ -0,0 +1,130 @@
+#include "harmonickernel.h"
+
+#include <cmath>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// 2*pi split in a high part with few significant bits (so k*TWO_PI_HI is exact
+// for |k| < 2^16, i.e. |x| < 4e5 rad) and a low part carrying the rest of the
+// precision. The rounding of k*TWO_PI_LO still grows with k.
+const float TWO_PI_HI = 6.28125f;
+const float TWO_PI_LO = 1.9353071795864769e-3f;
+const float INV_TWO_PI = 0.15915494309189535f;
+const float PI_F = 3.14159265358979f;
+const float HALF_PI_F = 1.57079632679490f;
+
+// Taylor coefficients of sin(x), truncated after x^11 (error < 6e-8 on
+// [-pi/2, pi/2], i.e. below the float resolution around 1).
+const float S3 = -1.6666666666666667e-1f;
+const float S5 = 8.3333333333333333e-3f;
+const float S7 = -1.9841269841269841e-4f;
+const float S9 = 2.7557319223985891e-6f;
+const float S11 = -2.5052108385441719e-8f;
+
+float fastSin(float x)
+{
+    // Reduce to [-pi, pi].
+    float q = x * INV_TWO_PI;
+    float k = (float)(int)(q + copysignf(0.5f, q));
+    float r = (x - k * TWO_PI_HI) - k * TWO_PI_LO;
+
+    // Fold to [-pi/2, pi/2], using sin(r) = sign(r)*sin(pi-|r|). Written
+    // without branches so that the loops calling it can be vectorized.
+    float absR = fabsf(r);
+    r = copysignf(1.0f, r) * fminf(absR, PI_F - absR);
+
+    float r2 = r * r;
+    return r + r * r2 * (S3 + r2 * (S5 + r2 * (S7 + r2 * (S9 + r2 * S11))));
+}
+
+#ifdef __ARM_NEON
+
+/**
+ * @brief NEON version of fastSin(), on 4 lanes.
+ */
+static inline float32x4_t fastSin4(float32x4_t x)
+{
+    float32x4_t q = vmulq_n_f32(x, INV_TWO_PI);
+    uint32x4_t positive = vcgeq_f32(q, vdupq_n_f32(0.0f));
+    float32x4_t half = vbslq_f32(positive, vdupq_n_f32(0.5f), vdupq_n_f32(-0.5f));
+    float32x4_t k = vcvtq_f32_s32(vcvtq_s32_f32(vaddq_f32(q, half)));
+
+    float32x4_t r = vmlsq_n_f32(x, k, TWO_PI_HI);
+    r = vmlsq_n_f32(r, k, TWO_PI_LO);
+
+    float32x4_t pi = vdupq_n_f32(PI_F);
+    float32x4_t minusPi = vdupq_n_f32(-PI_F);
+    r = vbslq_f32(vcgtq_f32(r, vdupq_n_f32(HALF_PI_F)), vsubq_f32(pi, r), r);
+    r = vbslq_f32(vcltq_f32(r, vdupq_n_f32(-HALF_PI_F)), vsubq_f32(minusPi, r), r);
+
+    float32x4_t r2 = vmulq_f32(r, r);
+    float32x4_t p = vmlaq_n_f32(vdupq_n_f32(S9), r2, S11);
+    p = vmlaq_f32(vdupq_n_f32(S7), r2, p);
+    p = vmlaq_f32(vdupq_n_f32(S5), r2, p);
+    p = vmlaq_f32(vdupq_n_f32(S3), r2, p);
+    return vmlaq_f32(r, vmulq_f32(r, r2), p);
+}
+
+static inline float horizontalSum(float32x4_t v)
+{
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+void evaluateHarmonicsPair(const HarmonicCoefficients &coefficients,
+                           float timeLeft, float timeRight,
+                           float &torqueLeft, float &torqueRight)
+{
+    static_assert(N_HARMONICS % 4 == 0, "N_HARMONICS must be a multiple of 4.");
+
+    float32x4_t sumLeft = vdupq_n_f32(0.0f);
+    float32x4_t sumRight = vdupq_n_f32(0.0f);
+
+    for(int i=0; i<N_HARMONICS; i+=4)
+    {
+        float32x4_t a = vld1q_f32(&coefficients.a[i]);
+        float32x4_t b = vld1q_f32(&coefficients.b[i]);
+        float32x4_t c = vld1q_f32(&coefficients.c[i]);
+
+        sumLeft = vmlaq_f32(sumLeft, a, fastSin4(vmlaq_n_f32(c, b, timeLeft)));
+        sumRight = vmlaq_f32(sumRight, a, fastSin4(vmlaq_n_f32(c, b, timeRight)));
+    }
+
+    torqueLeft = horizontalSum(sumLeft);
+    torqueRight = horizontalSum(sumRight);
+}
+
+#else
+
+void evaluateHarmonicsPair(const HarmonicCoefficients &coefficients,
+                           float timeLeft, float timeRight,
+                           float &torqueLeft, float &torqueRight)
+{
+    // Same lanes as the NEON version: the two legs are interleaved and every
+    // step is a plain loop, so that the compiler can vectorize them if the
+    // target allows it.
+    float lanes[2*N_HARMONICS];
+    for(int i=0; i<N_HARMONICS; i++)
+    {
+        lanes[2*i] = coefficients.b[i] * timeLeft + coefficients.c[i];
+        lanes[2*i+1] = coefficients.b[i] * timeRight + coefficients.c[i];
+    }
+
+    for(int i=0; i<2*N_HARMONICS; i++)
+        lanes[i] = fastSin(lanes[i]);
+
+    float sumLeft = 0.0f;
+    float sumRight = 0.0f;
+    for(int i=0; i<N_HARMONICS; i++)
+    {
+        sumLeft += coefficients.a[i] * lanes[2*i];
+        sumRight += coefficients.a[i] * lanes[2*i+1];
+    }
+
+    torqueLeft = sumLeft;
+    torqueRight = sumRight;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef HARMONICKERNEL_H
+#define HARMONICKERNEL_H
+
+#include "torqueprofiletable.h"
+
+/**
+ * @brief Float-only sine approximation: Cody-Waite reduction to [-pi, pi],
+ * folding to [-pi/2, pi/2], then a degree-11 odd polynomial.
+ * @remark compared to the double sin() of <tgmath.h> evaluated on the same
+ * float argument, the max. absolute error is 2.1e-7 for |x| <= 100 rad,
+ * 2.3e-7 for |x| <= 1000 rad, 2.8e-7 for |x| <= 1e4 rad, 1.2e-6 for
+ * |x| <= 1e5 rad and 4.5e-6 for |x| <= 4e5 rad (measured on 2e7 evenly spaced
+ * points each). The error of the reduction grows with |x|, and beyond 4e5 rad
+ * it is not bounded (3e-2 for |x| <= 1e6 rad).
+ * @param x angle [rad].
+ * @return sin(x).
+ */
+float fastSin(float x);
+
+/**
+ * @brief Evaluates the normalized sum-of-sines profile for both legs at once.
+ * All the N_HARMONICS terms of both legs are computed in a single pass with
+ * fastSin(), 4 lanes at a time with NEON on the BeagleBone, or with the
+ * equivalent scalar code on other architectures.
+ * @remark with the |a| <= 0.5 N.m/kg coefficients of the fitted profiles and
+ * leg times below 10 s, the result differs from the closed form in double
+ * precision by less than 2e-7 N.m/kg.
+ * @param coefficients the profile coefficients.
+ * @param timeLeft time along the profile of the left leg [s].
+ * @param timeRight time along the profile of the right leg [s].
+ * @param torqueLeft output profile value of the left leg [N.m/kg].
+ * @param torqueRight output profile value of the right leg [N.m/kg].
+ */
+void evaluateHarmonicsPair(const HarmonicCoefficients &coefficients,
+                           float timeLeft, float timeRight,
+                           float &torqueLeft, float &torqueRight);
+
+#endif // HARMONICKERNEL_H
@@ -0,0 +1,25 @@
+#include "harmonicprofiles.h"
+
+//BOOK GAIT
+const HarmonicCoefficients BOOK_PROFILE =
+{
+    {{0.4314f, 0.0932f, 0.0725f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},    // a
+    {{3.1417f, 9.4295f, 6.2821f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},    // b
+    {{-1.8151f, -2.0574f, 2.5740f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}}   // c
+};
+
+//ALPHA
+const HarmonicCoefficients ALPHA_PROFILE =
+{
+    {{+0.451135f, -0.295392f, +0.099296f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},
+    {{3.1417f, 9.4295f, 6.2821f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},
+    {{-1.851456f, -1.017760f, +4.169075f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}}
+};
+
+//BETHA
+const HarmonicCoefficients BETA_PROFILE =
+{
+    {{+0.310482f, +0.006469f, +0.111714f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},
+    {{3.1417f, 9.4295f, 6.2821f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}},
+    {{-1.779109f, -2.021154f, +2.535488f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}}
+};
@@ -0,0 +1,13 @@
+#ifndef HARMONICPROFILES_H
+#define HARMONICPROFILES_H
+
+#include "torqueprofiletable.h"
+
+#define PROFILE_TORQUE_MULTIPLIER -0.22959f ///< Scale of the profiles, per kg of bodyweight [].
+
+// Sum-of-sines fits of the hip torque profile, normalized by bodyweight.
+extern const HarmonicCoefficients BOOK_PROFILE;
+extern const HarmonicCoefficients ALPHA_PROFILE;
+extern const HarmonicCoefficients BETA_PROFILE;
+
+#endif // HARMONICPROFILES_H
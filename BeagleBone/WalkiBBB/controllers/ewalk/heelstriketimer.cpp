@@ -0,0 +1,101 @@
+#include "heelstriketimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/**
+ * @brief Constructor.
+ */
+HeelStrikeTimer::HeelStrikeTimer()
+{
+    reset();
+}
+
+/**
+ * @brief Forgets all the samples, e.g. after a pause of the acquisition.
+ */
+void HeelStrikeTimer::reset()
+{
+    hasSamples = false;
+    lastTimestamp = 0;
+
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        lastLoads[leg] = 0.0f;
+        crossed[leg] = false;
+        refining[leg] = false;
+        crossingTimes[leg] = 0;
+    }
+}
+
+/**
+ * @brief Starts a new time step: only the rising edges found after this call
+ * are reported by getCrossingAge(). The last sample of the previous step is
+ * kept, to interpolate the edges that happened between the steps.
+ */
+void HeelStrikeTimer::beginStep()
+{
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        crossed[leg] = false;
+}
+
+/**
+ * @brief Adds a sample of the foot loads, and looks for a rising edge above
+ * the threshold since the previous sample.
+ * @param timestamp monotonic time of the acquisition [us].
+ * @param loads total load of each foot [N].
+ * @param threshold foot load above which the foot is in stance [N].
+ */
+void HeelStrikeTimer::addSample(int64_t timestamp, const float loads[N_GAIT_LEGS],
+                                float threshold)
+{
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        if(refining[leg] && crossed[leg] && loads[leg] > lastLoads[leg])
+        {
+            // The load is flat before the heel-strike, so the line between
+            // the samples around the crossing dates it too early. The slope
+            // of the two samples after it is extrapolated back instead.
+            float slope = (loads[leg] - lastLoads[leg]) /
+                          (float)(timestamp - lastTimestamp);
+            int64_t extrapolated = lastTimestamp -
+                (int64_t)lroundf((lastLoads[leg] - threshold) / slope);
+            crossingTimes[leg] = max(crossingTimes[leg],
+                                     min(extrapolated, lastTimestamp));
+        }
+        refining[leg] = false;
+
+        if(hasSamples && lastLoads[leg] <= threshold && loads[leg] > threshold)
+        {
+            // First estimate, assuming the load linear between the samples.
+            float fraction = (threshold - lastLoads[leg]) /
+                             (loads[leg] - lastLoads[leg]);
+            crossingTimes[leg] = lastTimestamp +
+                (int64_t)lroundf(fraction * (float)(timestamp - lastTimestamp));
+            crossed[leg] = true;
+            refining[leg] = true;
+        }
+
+        lastLoads[leg] = loads[leg];
+    }
+
+    lastTimestamp = timestamp;
+    hasSamples = true;
+}
+
+/**
+ * @brief Gets how long before the last sample the foot load of a leg crossed
+ * the threshold, if it did during the current step.
+ * @param leg the leg.
+ * @return the age of the rising edge [s], or 0 if there was none during the
+ * current step.
+ */
+float HeelStrikeTimer::getCrossingAge(GaitLeg leg) const
+{
+    if(!crossed[leg])
+        return 0.0f;
+
+    return (float)(lastTimestamp - crossingTimes[leg]) / 1000000.0f;
+}
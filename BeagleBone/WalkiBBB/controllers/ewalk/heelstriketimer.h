@@ -0,0 +1,37 @@
+#ifndef HEELSTRIKETIMER_H
+#define HEELSTRIKETIMER_H
+
+#include <cstdint>
+
+#include "gaittorquegenerator.h"
+
+/**
+ * @brief Times the heel-strikes with a resolution finer than the control time
+ * step, from timestamped samples of the foot loads.
+ *
+ * The rising edge of each foot load above the threshold is found by linear
+ * interpolation between the two samples around it, using their actual
+ * timestamps. The soles can be sampled several times per time step: all the
+ * samples of a step are given between beginStep() and getCrossingAge(), and
+ * the crossing is reported relative to the last of them.
+ */
+class HeelStrikeTimer
+{
+public:
+    HeelStrikeTimer();
+
+    void reset();
+    void beginStep();
+    void addSample(int64_t timestamp, const float loads[N_GAIT_LEGS], float threshold);
+    float getCrossingAge(GaitLeg leg) const;
+
+private:
+    bool hasSamples;
+    int64_t lastTimestamp;              ///< [us]
+    float lastLoads[N_GAIT_LEGS];       ///< [N]
+    bool crossed[N_GAIT_LEGS];          ///< Rising edge since beginStep().
+    bool refining[N_GAIT_LEGS];         ///< Rising edge at the last sample.
+    int64_t crossingTimes[N_GAIT_LEGS]; ///< Time of the last rising edge [us].
+};
+
+#endif // HEELSTRIKETIMER_H
@@ -0,0 +1,499 @@
+#include "profilestore.h"
+#include "gaittorquegenerator.h"
+#include "harmonicprofiles.h"
+#include "winterprofile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../../lib/debugstream.h"
+#include "../../lib/keyvaluefile.h"
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Reads a list of numbers of a profile file.
+ * @param file the file.
+ * @param key the key of the list.
+ * @param values the numbers, empty if the key is missing.
+ * @return false if the list has an invalid number, true otherwise.
+ */
+static bool getFloatList(const KeyValueFile &file, const string &key,
+                         vector<float> &values)
+{
+    values.clear();
+
+    string text;
+    if(!file.getString(key, text))
+        return true;
+
+    istringstream stream(text);
+    float value;
+    while(stream >> value)
+        values.push_back(value);
+
+    return stream.eof();
+}
+
+/**
+ * @brief Creates a profile from sum-of-sines coefficients.
+ * @param name name of the profile.
+ * @param coefficients the coefficients, normalized by bodyweight.
+ * @param interpolation interpolation of the lookups in the table.
+ * @param profile the profile to fill.
+ */
+static void makeHarmonicProfile(const string &name,
+                                const HarmonicCoefficients &coefficients,
+                                TableInterpolation interpolation,
+                                TorqueProfile &profile)
+{
+    profile.name = name;
+    profile.harmonic = true;
+    profile.coefficients = coefficients;
+    profile.period = GaitTorqueGenerator::getHarmonicPeriod(coefficients);
+    profile.table.setInterpolation(interpolation);
+    profile.table.setHarmonics(coefficients);
+}
+
+/**
+ * @brief Creates a profile from a tabulated one.
+ * @param name name of the profile.
+ * @param phases phase of each point, increasing [0-1].
+ * @param torques torque of each point, normalized by bodyweight, with the sign
+ * of the sum-of-sines profiles [N.m/kg].
+ * @param period nominal period of the gait cycle [s].
+ * @param interpolation interpolation of the points, and of the lookups in the
+ * table.
+ * @param profile the profile to fill.
+ */
+static void makeTabulatedProfile(const string &name, const vector<float> &phases,
+                                 const vector<float> &torques, float period,
+                                 TableInterpolation interpolation,
+                                 TorqueProfile &profile)
+{
+    profile.name = name;
+    profile.harmonic = false;
+    profile.coefficients.a.fill(0.0f);
+    profile.coefficients.b.fill(0.0f);
+    profile.coefficients.c.fill(0.0f);
+    profile.period = period;
+    profile.table.setInterpolation(interpolation);
+    profile.table.setPoints(phases.data(), torques.data(), (int)phases.size(),
+                            period);
+}
+
+/**
+ * @brief Constructor. Samples the built-in profiles.
+ */
+ProfileStore::ProfileStore() :
+    nProfiles(0),
+    nRetiredProfiles(0),
+    reportSequence(0),
+    loaderThread(nullptr),
+    stopLoader(false)
+{
+    for(int i=0; i<PROFILE_STORE_MAX_PROFILES; i++)
+        profiles[i] = nullptr;
+    for(int i=0; i<PROFILE_STORE_MAX_IN_USE; i++)
+        profilesInUse[i] = nullptr;
+
+    const char *const names[] = {"BOOK", "ALPHA", "BETA"};
+    const HarmonicCoefficients *coefficients[] = {&BOOK_PROFILE, &ALPHA_PROFILE,
+                                                  &BETA_PROFILE};
+    for(int i=0; i<3; i++)
+    {
+        TorqueProfile *profile = new TorqueProfile();
+        makeHarmonicProfile(names[i], *coefficients[i], TABLE_LINEAR, *profile);
+        addProfile(profile);
+    }
+
+    vector<float> phases, torques;
+    for(int i=0; i<WINTER_PROFILE_N_POINTS; i++)
+    {
+        phases.push_back(winterHipTorqueProfile1[i].percentGc);
+        torques.push_back(winterHipTorqueProfile1[i].torquePerBodyweight);
+    }
+    TorqueProfile *winter = new TorqueProfile();
+    makeTabulatedProfile("WINTER", phases, torques, TABULATED_PROFILE_PERIOD,
+                         TABLE_LINEAR, *winter);
+    addProfile(winter);
+}
+
+/**
+ * @brief Destructor. Stops the loader thread and frees all the profiles.
+ */
+ProfileStore::~ProfileStore()
+{
+    stop();
+
+    for(TorqueProfile *profile : allProfiles)
+        delete profile;
+}
+
+/**
+ * @brief Loads the profile files of a directory, then starts a thread that
+ * loads the new files and reloads the modified ones.
+ * @param directory the directory of the files.
+ * @return true if the thread was started, false if it was already running.
+ */
+bool ProfileStore::start(const string &directory)
+{
+    if(loaderThread != nullptr)
+        return false;
+
+    this->directory = directory;
+    scanDirectory();
+
+    // The default (non real-time) priority.
+    stopLoader = false;
+    loaderThread = new thread(&ProfileStore::loaderLoop, this);
+
+    return true;
+}
+
+/**
+ * @brief Stops the loader thread. The profiles remain selectable.
+ */
+void ProfileStore::stop()
+{
+    if(loaderThread == nullptr)
+        return;
+
+    stopLoader = true;
+    loaderThread->join();
+    delete loaderThread;
+    loaderThread = nullptr;
+}
+
+/**
+ * @brief Gets the number of profiles. It only increases.
+ * @return the number of profiles.
+ */
+int ProfileStore::getCount() const
+{
+    return nProfiles.load(memory_order_acquire);
+}
+
+/**
+ * @brief Gets a profile, in its latest version. This is wait-free, so it can be
+ * called by the control loop at each step.
+ * @param index the index of the profile.
+ * @return the profile, or nullptr if the index is invalid. If the profile is
+ * replaced by a reload, it stays valid until a later reportProfilesInUse()
+ * no longer has it, or until the store is destroyed.
+ */
+const TorqueProfile *ProfileStore::getProfile(int index) const
+{
+    if(index < 0 || index >= nProfiles.load(memory_order_acquire))
+        return nullptr;
+
+    return profiles[index].load(memory_order_acquire);
+}
+
+/**
+ * @brief Finds a profile by name.
+ * @param name the name of the profile, e.g. "BETA".
+ * @return the index of the profile, or -1 if not found.
+ */
+int ProfileStore::findProfile(const string &name) const
+{
+    for(int i=0; i<getCount(); i++)
+    {
+        if(getProfile(i)->name == name)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Reports the profiles that the control loop may still use, so that
+ * the replaced ones that are not can be freed. This must be called by the
+ * thread that calls getProfile(), after each step, and never blocks.
+ * @param inUse the profiles, e.g. from GaitTorqueGenerator::getProfilesInUse().
+ * nullptr entries are ignored.
+ * @param n the number of profiles, at most PROFILE_STORE_MAX_IN_USE.
+ */
+void ProfileStore::reportProfilesInUse(const TorqueProfile *const inUse[], int n)
+{
+    uint64_t sequence = reportSequence.load(memory_order_relaxed);
+    reportSequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for(int i=0; i<PROFILE_STORE_MAX_IN_USE; i++)
+        profilesInUse[i].store((i < n) ? inUse[i] : nullptr, memory_order_relaxed);
+
+    reportSequence.store(sequence + 2, memory_order_release);
+
+    // Pairs with the fence of scanDirectory(): either the loader sees this
+    // report, or the next getProfile() sees the new profile.
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/**
+ * @brief Gets the number of profiles replaced by a reload, and not freed yet.
+ * @return the number of profiles.
+ */
+int ProfileStore::getRetiredCount() const
+{
+    return nRetiredProfiles.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Loads and samples a profile file, see ProfileStore for the format.
+ * @param path path of the file.
+ * @param name name of the profile.
+ * @param profile the profile to fill.
+ * @return true if the profile is valid, false otherwise.
+ */
+bool ProfileStore::loadFile(const string &path, const string &name,
+                            TorqueProfile &profile)
+{
+    KeyValueFile file;
+    if(!file.load(path, false))
+    {
+        debug << "Could not read the profile " << path << "." << endl;
+        return false;
+    }
+
+    vector<float> a, b, c, phases, torques, period;
+    if(!getFloatList(file, "a", a) || !getFloatList(file, "b", b) ||
+       !getFloatList(file, "c", c) || !getFloatList(file, "phase", phases) ||
+       !getFloatList(file, "torque", torques) || !getFloatList(file, "period", period))
+    {
+        debug << path << ": invalid number." << endl;
+        return false;
+    }
+
+    string interpolationName = "linear";
+    file.getString("interpolation", interpolationName);
+    if(interpolationName != "linear" && interpolationName != "cubic")
+    {
+        debug << path << ": the interpolation must be linear or cubic." << endl;
+        return false;
+    }
+    TableInterpolation interpolation = (interpolationName == "cubic") ?
+                TABLE_CUBIC_HERMITE : TABLE_LINEAR;
+
+    if(!a.empty())
+    {
+        // The trailing terms without amplitude are ignored, e.g. the zeros of
+        // the unused terms.
+        size_t n = a.size();
+        while(n > 0 && a[n-1] == 0.0f)
+            n--;
+
+        // The period is given by b[0], so it must be the fundamental: the
+        // smallest frequency, the others being in any order.
+        bool validSizes = (b.size() == a.size() && c.size() == a.size() &&
+                           n > 0 && n <= N_HARMONICS);
+        bool fundamentalFirst = validSizes && (b[0] > 0.0f);
+        for(size_t i=1; fundamentalFirst && i<n; i++)
+            fundamentalFirst = (b[i] == 0.0f || b[i] >= b[0]);
+
+        if(!fundamentalFirst)
+        {
+            debug << path << ": a, b and c must have the same size, with at most "
+                  << N_HARMONICS << " terms of non-zero a, and b[0] must be the "
+                  << "smallest non-zero frequency." << endl;
+            return false;
+        }
+        a.resize(n);
+        b.resize(n);
+        c.resize(n);
+
+        HarmonicCoefficients coefficients;
+        coefficients.a.fill(0.0f);
+        coefficients.b.fill(0.0f);
+        coefficients.c.fill(0.0f);
+        copy(a.begin(), a.end(), coefficients.a.begin());
+        copy(b.begin(), b.end(), coefficients.b.begin());
+        copy(c.begin(), c.end(), coefficients.c.begin());
+
+        makeHarmonicProfile(name, coefficients, interpolation, profile);
+        return true;
+    }
+
+    bool increasing = is_sorted(phases.begin(), phases.end());
+    if(phases.empty() || torques.size() != phases.size() || !increasing ||
+       phases.front() < 0.0f || phases.back() > 1.0f ||
+       (!period.empty() && period[0] <= 0.0f))
+    {
+        debug << path << ": needs either a, b and c, or phase and torque of the "
+              << "same size, with increasing phases within [0-1]." << endl;
+        return false;
+    }
+
+    makeTabulatedProfile(name, phases, torques,
+                         period.empty() ? TABULATED_PROFILE_PERIOD : period[0],
+                         interpolation, profile);
+    return true;
+}
+
+/**
+ * @brief Publishes a new profile, after all the others.
+ * @param profile the profile, owned by the store from now on. It is freed if
+ * there are too many profiles.
+ * @return the index of the profile, or -1 if there are too many profiles.
+ */
+int ProfileStore::addProfile(TorqueProfile *profile)
+{
+    int index = nProfiles.load(memory_order_relaxed);
+    if(index >= PROFILE_STORE_MAX_PROFILES)
+    {
+        debug << "Too many torque profiles, " << profile->name << " ignored." << endl;
+        delete profile;
+        return -1;
+    }
+
+    allProfiles.push_back(profile);
+    profiles[index].store(profile, memory_order_release);
+    nProfiles.store(index + 1, memory_order_release);
+
+    debug << "Torque profile " << index << ": " << profile->name << "." << endl;
+    return index;
+}
+
+/**
+ * @brief Loads the profile files of the directory that are new or were
+ * modified since the last scan.
+ */
+void ProfileStore::scanDirectory()
+{
+    DIR *dir = opendir(directory.c_str());
+    if(dir == nullptr)
+        return;
+
+    // Names of the files, in alphabetical order.
+    vector<string> fileNames;
+    const string extension = PROFILE_FILE_EXTENSION;
+    while(dirent *entry = readdir(dir))
+    {
+        string fileName = entry->d_name;
+        if(fileName.size() > extension.size() &&
+           fileName.compare(fileName.size() - extension.size(), extension.size(),
+                            extension) == 0)
+        {
+            fileNames.push_back(fileName);
+        }
+    }
+    closedir(dir);
+    sort(fileNames.begin(), fileNames.end());
+
+    for(const string &fileName : fileNames)
+    {
+        string path = directory + "/" + fileName;
+        struct stat status;
+        if(stat(path.c_str(), &status) != 0)
+            continue;
+
+        string name = fileName.substr(0, fileName.size() - extension.size());
+        auto file = find_if(files.begin(), files.end(),
+                            [&name](const ProfileFile &f) { return f.name == name; });
+        if(file == files.end())
+        {
+            files.push_back(ProfileFile{name, {0, 0}, -1, -1, false});
+            file = files.end() - 1;
+        }
+        else if(file->rejected ||
+                (file->modificationTime.tv_sec == status.st_mtim.tv_sec &&
+                 file->modificationTime.tv_nsec == status.st_mtim.tv_nsec &&
+                 file->size == status.st_size))
+        {
+            continue;
+        }
+
+        file->modificationTime = status.st_mtim;
+        file->size = status.st_size;
+
+        // The profiles are never removed, so there will be no room later.
+        if(file->index < 0 && getCount() >= PROFILE_STORE_MAX_PROFILES)
+        {
+            debug << "Too many torque profiles, " << name << " ignored." << endl;
+            file->rejected = true;
+            continue;
+        }
+
+        // Sampled here, then published at once.
+        TorqueProfile *profile = new TorqueProfile();
+        if(!loadFile(path, name, *profile))
+        {
+            delete profile;
+            continue;
+        }
+
+        if(file->index < 0)
+            file->index = addProfile(profile);
+        else
+        {
+            allProfiles.push_back(profile);
+            const TorqueProfile *replaced = profiles[file->index].exchange(
+                        profile, memory_order_acq_rel);
+            // Pairs with the fence of reportProfilesInUse().
+            atomic_thread_fence(memory_order_seq_cst);
+            retiredProfiles.push_back(
+                        RetiredProfile{replaced, reportSequence.load(memory_order_relaxed)});
+
+            debug << "Torque profile " << file->index << ": " << name
+                  << " reloaded." << endl;
+        }
+    }
+}
+
+/**
+ * @brief Frees the replaced profiles that the control loop no longer uses:
+ * those absent from a report started after their replacement. The reports
+ * made before may miss a profile that the control loop got just before the
+ * replacement.
+ */
+void ProfileStore::freeRetiredProfiles()
+{
+    if(retiredProfiles.empty())
+        return;
+
+    // Copy of the last report. If the control loop is writing it, the
+    // profiles are checked again at the next scan.
+    uint64_t sequence = reportSequence.load(memory_order_acquire);
+    const TorqueProfile *inUse[PROFILE_STORE_MAX_IN_USE];
+    for(int i=0; i<PROFILE_STORE_MAX_IN_USE; i++)
+        inUse[i] = profilesInUse[i].load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+
+    if((sequence & 1) != 0 || reportSequence.load(memory_order_relaxed) != sequence)
+        return;
+
+    auto freed = remove_if(retiredProfiles.begin(), retiredProfiles.end(),
+                           [&](const RetiredProfile &r)
+    {
+        if(sequence <= r.reportSequence ||
+           find(begin(inUse), end(inUse), r.profile) != end(inUse))
+        {
+            return false;
+        }
+
+        allProfiles.erase(find(allProfiles.begin(), allProfiles.end(), r.profile));
+        delete r.profile;
+        return true;
+    });
+    retiredProfiles.erase(freed, retiredProfiles.end());
+}
+
+/**
+ * @brief Loop of the loader thread: periodically checks the profile files,
+ * and frees the replaced profiles, until stopped.
+ */
+void ProfileStore::loaderLoop()
+{
+    while(!stopLoader)
+    {
+        this_thread::sleep_for(milliseconds(PROFILE_STORE_SCAN_PERIOD));
+        scanDirectory();
+        freeRetiredProfiles();
+        nRetiredProfiles.store((int)retiredProfiles.size(), memory_order_relaxed);
+    }
+}
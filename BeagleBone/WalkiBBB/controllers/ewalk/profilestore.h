@@ -0,0 +1,121 @@
+#ifndef PROFILESTORE_H
+#define PROFILESTORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "torqueprofiletable.h"
+
+#define PROFILE_STORE_MAX_PROFILES 32   ///< Max. number of selectable profiles.
+#define PROFILE_STORE_SCAN_PERIOD 1000  ///< Period of the check of the profile files [ms].
+#define PROFILE_STORE_MAX_IN_USE 8      ///< Max. number of profiles reported in use by the control loop.
+#define PROFILE_FILE_EXTENSION ".profile"
+#define TABULATED_PROFILE_PERIOD 2.0f   ///< Default nominal period of the tabulated profiles [s].
+
+/**
+ * @brief Set of torque profiles, selectable by index while walking. The
+ * built-in profiles come first (BOOK, ALPHA, BETA and WINTER), then the
+ * profiles of the files of a directory, in the order of their names.
+ *
+ * Each file is a KeyValueFile, named after the profile, with either the
+ * sum-of-sines coefficients, in the units of the built-in profiles, for the
+ * time since the heel-strike:
+ *     a: 0.3139 0.1712 ...
+ *     b: 3.1417 6.2820 ...
+ *     c: 1.8226 -0.4035 ...
+ * The period is given by the first frequency, so it must be the smallest, the
+ * others being in any order. The trailing terms with a zero amplitude are
+ * ignored. Or a tabulated profile, e.g. from gait analysis data, with the points
+ * unevenly spaced if needed, and the torque normalized by bodyweight, with the
+ * sign of the sum-of-sines profiles, as in winterprofile.h:
+ *     phase: 0.00 0.02 0.04 ...            [0-1]
+ *     torque: -0.249 -0.600 -0.556 ...     [N.m/kg]
+ *     period: 2.0                          [s], optional
+ * Both can also have "interpolation: cubic", to interpolate the points and the
+ * samples with cubic Hermite splines instead of straight lines.
+ *
+ * The profiles are sampled when loaded, by a low-priority thread that also
+ * reloads the files when they are modified (date in ns, or size). Each profile
+ * is then published as an immutable object, with an atomic pointer, so that
+ * getProfile() never blocks or allocates, and the control loop can switch
+ * profile at any time. The files should be written to a temporary name, then
+ * renamed, so that a file is never read half-written.
+ *
+ * A profile replaced by a reload may still be used by the control loop, e.g.
+ * until the end of its crossfade. The control loop reports the profiles it
+ * uses at the end of each step, with reportProfilesInUse(), and the loader
+ * frees a replaced profile once a report made after the replacement no longer
+ * has it. Without reports, the replaced profiles are kept until the store is
+ * destroyed.
+ *
+ * The profiles are never removed, so the files beyond
+ * PROFILE_STORE_MAX_PROFILES are ignored, even if modified later.
+ */
+class ProfileStore
+{
+public:
+    ProfileStore();
+    ~ProfileStore();
+
+    bool start(const std::string &directory);
+    void stop();
+
+    int getCount() const;
+    const TorqueProfile *getProfile(int index) const;
+    int findProfile(const std::string &name) const;
+    void reportProfilesInUse(const TorqueProfile *const inUse[], int n);
+    int getRetiredCount() const;
+
+    static bool loadFile(const std::string &path, const std::string &name,
+                         TorqueProfile &profile);
+
+private:
+    /**
+     * @brief Profile file of the directory, only accessed by the loader.
+     */
+    struct ProfileFile
+    {
+        std::string name;
+        timespec modificationTime;
+        off_t size;                     ///< [B]
+        int index;                      ///< Index of the profile, -1 if never loaded.
+        bool rejected;                  ///< Ignored, as there were too many profiles.
+    };
+
+    /**
+     * @brief Profile replaced by a reload, not freed yet.
+     */
+    struct RetiredProfile
+    {
+        const TorqueProfile *profile;
+        uint64_t reportSequence;        ///< Value of reportSequence when replaced.
+    };
+
+    int addProfile(TorqueProfile *profile);
+    void scanDirectory();
+    void freeRetiredProfiles();
+    void loaderLoop();
+
+    std::atomic<const TorqueProfile*> profiles[PROFILE_STORE_MAX_PROFILES];
+    std::atomic<int> nProfiles;
+    std::vector<TorqueProfile*> allProfiles; ///< Including the replaced ones, until freed.
+    std::vector<RetiredProfile> retiredProfiles;
+    std::atomic<int> nRetiredProfiles;
+
+    // Last report of the control loop, as a sequence lock: odd while written.
+    std::atomic<const TorqueProfile*> profilesInUse[PROFILE_STORE_MAX_IN_USE];
+    std::atomic<uint64_t> reportSequence;
+
+    std::string directory;
+    std::vector<ProfileFile> files;
+    std::thread *loaderThread;
+    std::atomic<bool> stopLoader;
+};
+
+#endif // PROFILESTORE_H
@@ -0,0 +1,334 @@
+#include "safetysupervisor.h"
+
+#include <cmath>
+
+using namespace std;
+
+/**
+ * @brief Constructor. Sets the default limits, and resets the state at time 0.
+ */
+SafetySupervisor::SafetySupervisor() :
+    controlBeats(0),
+    canBeats(0),
+    fault(SAFETY_OK),
+    faultOnset(0),
+    cutOffPending(false),
+    lastReactionTime(0),
+    maxReactionTime(0)
+{
+    limits = getDefaultLimits();
+    reset(0);
+}
+
+/**
+ * @brief Gets the limits used on the orthosis.
+ * @return the default limits.
+ */
+SafetyLimits SafetySupervisor::getDefaultLimits()
+{
+    SafetyLimits l;
+    l.maxAngle = 180.0f;            // Bogus values from the motorboard.
+    l.maxSpeed = 720.0f;            // About 3 times the fastest walking.
+    l.maxTorque = 25.0f;            // Full profile for a heavy pilot, with margin.
+    l.maxTorqueError = 5.0f;
+    l.torqueErrorDuration = 100000; // Longer than the response of the motors.
+    l.controlTimeout = 10000;       // 5 periods of the control loop.
+    l.canTimeout = 5000;            // 5 periods of the CAN thread.
+    return l;
+}
+
+/**
+ * @brief Gets the name of a fault, to display it.
+ * @param fault the fault.
+ * @return the name, e.g. "angle limit".
+ */
+const char *SafetySupervisor::getFaultName(SafetyFault fault)
+{
+    switch(fault)
+    {
+    case SAFETY_OK: return "none";
+    case SAFETY_CONTROL_STALLED: return "control loop stalled";
+    case SAFETY_CAN_STALLED: return "CAN thread stalled";
+    case SAFETY_ANGLE_LIMIT: return "angle limit";
+    case SAFETY_SPEED_LIMIT: return "speed limit";
+    case SAFETY_TORQUE_LIMIT: return "torque limit";
+    case SAFETY_TORQUE_ERROR: return "torque error";
+    default: return "unknown";
+    }
+}
+
+/**
+ * @brief Gets the limits, to change them before the threads start.
+ * @return a reference to the limits.
+ */
+SafetyLimits &SafetySupervisor::getLimits()
+{
+    return limits;
+}
+
+/**
+ * @brief Restarts the timeouts of the heartbeats, e.g. just before the watched
+ * threads start. Must not be called while they run. The timeout of the control
+ * loop only starts at its first heartbeat after, since the control loop may
+ * start much later than the CAN thread.
+ * @param now the current monotonic time [us].
+ */
+void SafetySupervisor::reset(int64_t now)
+{
+    controlStarted = false;
+    lastControlBeats = controlBeats.load(memory_order_relaxed);
+    lastCanBeats = canBeats.load(memory_order_relaxed);
+    lastControlBeatTime = now;
+    lastCanBeatTime = now;
+    lastCheckTime = now;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+        torqueErrorStart[j] = -1;
+
+    fault = SAFETY_OK;
+    cutOffPending = false;
+}
+
+/**
+ * @brief Counts a heartbeat of the control loop. Called by the control loop,
+ * at each time step. Wait-free.
+ */
+void SafetySupervisor::beatControl()
+{
+    controlBeats.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Reports the state of the motors, which is also a heartbeat of the CAN
+ * thread. Called by the CAN thread, after each update of the motors.
+ * Wait-free.
+ * @param sample the state of the motors, and the setpoints just sent.
+ */
+void SafetySupervisor::reportMotors(const SafetyMotorsSample &sample)
+{
+    motorsSamples.write(sample);
+    canBeats.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Confirms that zero torques were sent to the motors after a fault,
+ * which measures the reaction time. Called by the thread that sent them, after
+ * each update of the motors while getFault() is not SAFETY_OK; only the first
+ * call after a fault counts.
+ * @param now the current monotonic time [us].
+ */
+void SafetySupervisor::confirmCutOff(int64_t now)
+{
+    if(!cutOffPending.exchange(false, memory_order_acq_rel))
+        return;
+
+    int64_t reaction = now - faultOnset.load(memory_order_acquire);
+    lastReactionTime.store(reaction, memory_order_relaxed);
+    if(reaction > maxReactionTime.load(memory_order_relaxed))
+        maxReactionTime.store(reaction, memory_order_relaxed);
+}
+
+/**
+ * @brief Checks the heartbeats and the latest state of the motors. Called by
+ * the supervisor thread, every SAFETY_SUPERVISOR_PERIOD.
+ * @param now the current monotonic time [us].
+ * @return the fault, SAFETY_OK if none. If it is SAFETY_CAN_STALLED, the
+ * caller has to drive the motors to zero torque itself, once the CAN thread is
+ * out of them.
+ */
+SafetyFault SafetySupervisor::check(int64_t now)
+{
+    // If the supervisor itself was held up for long, e.g. because the whole
+    // CPU was, the watched threads could not beat either: this delay is not
+    // counted in their timeouts.
+    int64_t late = now - lastCheckTime - SAFETY_SUPERVISOR_PERIOD;
+    if(late > limits.canTimeout / 2)
+    {
+        lastControlBeatTime += late;
+        lastCanBeatTime += late;
+    }
+    lastCheckTime = now;
+
+    // A heartbeat is dated when it is seen, so up to one period late.
+    uint32_t beats = controlBeats.load(memory_order_relaxed);
+    if(beats != lastControlBeats)
+    {
+        lastControlBeats = beats;
+        lastControlBeatTime = now;
+        controlStarted = true;
+    }
+
+    beats = canBeats.load(memory_order_relaxed);
+    if(beats != lastCanBeats)
+    {
+        lastCanBeats = beats;
+        lastCanBeatTime = now;
+    }
+
+    SafetyFault detected = SAFETY_OK;
+    int64_t onset = now;
+
+    if(now - lastCanBeatTime > limits.canTimeout)
+    {
+        detected = SAFETY_CAN_STALLED;
+        onset = lastCanBeatTime + limits.canTimeout;
+    }
+    else if(controlStarted && now - lastControlBeatTime > limits.controlTimeout)
+    {
+        detected = SAFETY_CONTROL_STALLED;
+        onset = lastControlBeatTime + limits.controlTimeout;
+    }
+    else
+    {
+        SafetyMotorsSample sample;
+        if(motorsSamples.read(sample))
+            detected = checkMotors(sample, onset);
+    }
+
+    if(detected != SAFETY_OK && getFault() == SAFETY_OK)
+        trip(detected, onset);
+    else if(detected == SAFETY_CAN_STALLED && getFault() != SAFETY_CAN_STALLED)
+    {
+        // The CAN thread stalled before it could apply the first fault: the
+        // supervisor has to cut the torque off instead.
+        fault.store(SAFETY_CAN_STALLED, memory_order_release);
+    }
+
+    return getFault();
+}
+
+/**
+ * @brief Gets the latched fault.
+ * @return the fault, SAFETY_OK if none.
+ */
+SafetyFault SafetySupervisor::getFault() const
+{
+    return (SafetyFault)fault.load(memory_order_acquire);
+}
+
+/**
+ * @brief Gets whether the cut-off of the last fault was not confirmed yet.
+ * @return true if zero torques still have to be sent, false otherwise.
+ */
+bool SafetySupervisor::isCutOffPending() const
+{
+    return cutOffPending.load(memory_order_acquire);
+}
+
+/**
+ * @brief Clears the latched fault, e.g. when the assistance is enabled again.
+ * If the cause persists, the next check() trips again.
+ */
+void SafetySupervisor::clearFault()
+{
+    cutOffPending.store(false, memory_order_relaxed);
+    fault.store(SAFETY_OK, memory_order_release);
+}
+
+/**
+ * @brief Gets the reaction time to the last fault.
+ * @return the time from the onset of the fault to the confirmation of the
+ * cut-off [us].
+ */
+int64_t SafetySupervisor::getLastReactionTime() const
+{
+    return lastReactionTime.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the longest reaction time, since the creation.
+ * @return the time from the onset of a fault to the confirmation of the
+ * cut-off [us].
+ */
+int64_t SafetySupervisor::getMaxReactionTime() const
+{
+    return maxReactionTime.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the longest possible reaction time to a fault, if the threads
+ * run on time: the fault is seen at the latest at the second check after its
+ * onset, and the cut-off is sent at the latest one period of the CAN thread
+ * later. The motors state takes up to another period of the CAN thread to be
+ * reported.
+ * @param fault the fault.
+ * @param cutOffPeriod period of the CAN thread, that applies the cut-off
+ * [us].
+ * @return the bound of the reaction time, measured from the onset of the
+ * fault, not counting the scheduling latency of the threads [us]. The onset is
+ * the end of the timeout for a stall, and the start of the fault at the motors
+ * for the limits, or the end of torqueErrorDuration.
+ */
+int64_t SafetySupervisor::getReactionBound(SafetyFault fault, int64_t cutOffPeriod) const
+{
+    switch(fault)
+    {
+    case SAFETY_CAN_STALLED:
+        return 2 * SAFETY_SUPERVISOR_PERIOD;
+    case SAFETY_CONTROL_STALLED:
+        return 2 * SAFETY_SUPERVISOR_PERIOD + cutOffPeriod;
+    case SAFETY_TORQUE_ERROR:
+        return SAFETY_SUPERVISOR_PERIOD + 3 * cutOffPeriod;
+    default:
+        return SAFETY_SUPERVISOR_PERIOD + 2 * cutOffPeriod;
+    }
+}
+
+/**
+ * @brief Checks the state of the motors against the limits.
+ * @param sample the state of the motors.
+ * @param onset time of the fault, if any [us].
+ * @return the fault, SAFETY_OK if none.
+ */
+SafetyFault SafetySupervisor::checkMotors(const SafetyMotorsSample &sample,
+                                          int64_t &onset)
+{
+    SafetyFault detected = SAFETY_OK;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        // The torque error must last, since the motors take time to follow.
+        if(fabsf(sample.setpoints[j] - sample.torques[j]) > limits.maxTorqueError)
+        {
+            if(torqueErrorStart[j] < 0)
+                torqueErrorStart[j] = sample.timestamp;
+        }
+        else
+            torqueErrorStart[j] = -1;
+
+        if(detected != SAFETY_OK)
+            continue;
+
+        // Also the NaNs.
+        if(!(fabsf(sample.angles[j]) < limits.maxAngle))
+            detected = SAFETY_ANGLE_LIMIT;
+        else if(!(fabsf(sample.speeds[j]) < limits.maxSpeed))
+            detected = SAFETY_SPEED_LIMIT;
+        else if(!(fabsf(sample.setpoints[j]) <= limits.maxTorque))
+            detected = SAFETY_TORQUE_LIMIT;
+        else if(torqueErrorStart[j] >= 0 &&
+                sample.timestamp - torqueErrorStart[j] >= limits.torqueErrorDuration)
+        {
+            detected = SAFETY_TORQUE_ERROR;
+            onset = torqueErrorStart[j] + limits.torqueErrorDuration;
+            continue;
+        }
+
+        if(detected != SAFETY_OK)
+            onset = sample.timestamp;
+    }
+
+    return detected;
+}
+
+/**
+ * @brief Latches a fault, so that the torque is cut off.
+ * @param fault the fault.
+ * @param onset time of the fault [us].
+ */
+void SafetySupervisor::trip(SafetyFault fault, int64_t onset)
+{
+    faultOnset.store(onset, memory_order_relaxed);
+    cutOffPending.store(true, memory_order_relaxed);
+    this->fault.store(fault, memory_order_release);
+}
@@ -0,0 +1,124 @@
+#ifndef SAFETYSUPERVISOR_H
+#define SAFETYSUPERVISOR_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "gaittorquegenerator.h"
+#include "../../lib/triplebuffer.h"
+
+#define SAFETY_SUPERVISOR_PERIOD 500    ///< Period of the checks [us].
+
+/**
+ * @brief Reason of a safety stop. Only the first fault is kept, until
+ * clearFault().
+ */
+enum SafetyFault
+{
+    SAFETY_OK = 0,
+    SAFETY_CONTROL_STALLED,     ///< No heartbeat of the control loop.
+    SAFETY_CAN_STALLED,         ///< No heartbeat of the CAN thread.
+    SAFETY_ANGLE_LIMIT,         ///< Hip angle out of range, e.g. bogus motor data.
+    SAFETY_SPEED_LIMIT,         ///< Hip speed out of range.
+    SAFETY_TORQUE_LIMIT,        ///< Torque setpoint out of range.
+    SAFETY_TORQUE_ERROR,        ///< Measured torque too far from the setpoint, for too long.
+    N_SAFETY_FAULTS
+};
+
+/**
+ * @brief Limits of the safety supervisor. The defaults are the values used on
+ * the orthosis.
+ */
+struct SafetyLimits
+{
+    float maxAngle;                 ///< Max. absolute hip angle [deg].
+    float maxSpeed;                 ///< Max. absolute hip speed [deg/s].
+    float maxTorque;                ///< Max. absolute torque setpoint [N.m].
+    float maxTorqueError;           ///< Max. absolute setpoint minus measured torque [N.m].
+    int64_t torqueErrorDuration;    ///< Time above maxTorqueError before a fault [us].
+    int64_t controlTimeout;         ///< Max. time without heartbeat of the control loop [us].
+    int64_t canTimeout;             ///< Max. time without heartbeat of the CAN thread [us].
+};
+
+/**
+ * @brief State of the hip motors, indexed by GaitLeg, reported by the CAN
+ * thread after each update of the motors.
+ */
+struct SafetyMotorsSample
+{
+    float angles[N_GAIT_LEGS];      ///< [deg]
+    float speeds[N_GAIT_LEGS];      ///< [deg/s]
+    float torques[N_GAIT_LEGS];     ///< Measured torques [N.m]
+    float setpoints[N_GAIT_LEGS];   ///< Torque setpoints sent to the motors [N.m]
+    int64_t timestamp;              ///< Monotonic time of the motors update [us]
+};
+
+/**
+ * @brief Watches the control loop and the CAN thread, and cuts the torque of
+ * the motors off when one of them stalls, or when the motors go out of their
+ * limits.
+ *
+ * It is meant to run in its own thread, with the highest priority, calling
+ * check() every SAFETY_SUPERVISOR_PERIOD. The watched threads only exchange
+ * wait-free values with it: the control loop counts its heartbeats, and the
+ * CAN thread reports the state of the motors after each update. On a fault,
+ * the CAN thread sends zero torques at its next update, and confirms it with
+ * confirmCutOff(). If the CAN thread itself stalled, the supervisor thread
+ * drives the motors to zero instead, once the CAN thread is out of them, see
+ * eWalkTimeBasedTorqueProfile::superviseSafety().
+ *
+ * The fault is latched until clearFault(). The time from the onset of the
+ * fault to the confirmation of the cut-off is measured, and bounded by
+ * getReactionBound(), see tools/faultinject.
+ */
+class SafetySupervisor
+{
+public:
+    SafetySupervisor();
+
+    static SafetyLimits getDefaultLimits();
+    static const char *getFaultName(SafetyFault fault);
+
+    SafetyLimits &getLimits();
+    void reset(int64_t now);
+
+    void beatControl();
+    void reportMotors(const SafetyMotorsSample &sample);
+    void confirmCutOff(int64_t now);
+    SafetyFault check(int64_t now);
+
+    SafetyFault getFault() const;
+    bool isCutOffPending() const;
+    void clearFault();
+
+    int64_t getLastReactionTime() const;
+    int64_t getMaxReactionTime() const;
+    int64_t getReactionBound(SafetyFault fault, int64_t cutOffPeriod) const;
+
+private:
+    SafetyFault checkMotors(const SafetyMotorsSample &sample, int64_t &onset);
+    void trip(SafetyFault fault, int64_t onset);
+
+    SafetyLimits limits;
+
+    // Written by the watched threads.
+    std::atomic<uint32_t> controlBeats;
+    std::atomic<uint32_t> canBeats;
+    TripleBuffer<SafetyMotorsSample> motorsSamples;
+
+    // Only accessed by the supervisor thread.
+    bool controlStarted;                            ///< A control beat was seen since reset().
+    uint32_t lastControlBeats, lastCanBeats;
+    int64_t lastControlBeatTime, lastCanBeatTime;   ///< Time the beats were seen [us].
+    int64_t lastCheckTime;                          ///< [us]
+    int64_t torqueErrorStart[N_GAIT_LEGS];          ///< [us], -1 if no error.
+
+    // Shared by all the threads.
+    std::atomic<int> fault;                 ///< SafetyFault.
+    std::atomic<int64_t> faultOnset;        ///< [us]
+    std::atomic<bool> cutOffPending;        ///< Tripped, not confirmed yet.
+    std::atomic<int64_t> lastReactionTime;  ///< [us]
+    std::atomic<int64_t> maxReactionTime;   ///< [us]
+};
+
+#endif // SAFETYSUPERVISOR_H
@@ -0,0 +1,229 @@
+#include "solecalibration.h"
+
+#include <cmath>
+
+#include "../../lib/debugstream.h"
+#include "../../lib/keyvaluefile.h"
+
+using namespace std;
+
+// Model shared by all the cells before the per-cell calibration, used when no
+// calibration file is available.
+const SoleCellModel DEFAULT_CELL_MODEL =
+{
+    2.8900e5f, // a [ohm.N].
+    4.7076e03f, // b [ohm].
+    3000.0f // r [ohm].
+};
+
+const char * const SIDE_NAMES[N_SOLES] = {"left", "right"};
+
+/**
+ * @brief Constructor. Sets the default calibration for all the cells.
+ * @param excitationVoltage supply voltage of the cells [V].
+ */
+SoleCalibration::SoleCalibration(float excitationVoltage) :
+    excitationVoltage(excitationVoltage)
+{
+    setDefault();
+}
+
+/**
+ * @brief Checks that the coefficients of a cell give a valid model: finite,
+ * with a force that is zero at 0 V, then increases with the voltage until the
+ * saturation, for any positive force. This requires a > 0, r > 0 and b >= 0
+ * (the resistance of the cell a/force + b stays positive).
+ * @param model the model coefficients.
+ * @return true if the model is valid, false otherwise.
+ */
+bool SoleCalibration::isValidModel(const SoleCellModel &model)
+{
+    return std::isfinite(model.a) && std::isfinite(model.b) && std::isfinite(model.r) &&
+           model.a > 0.0f && model.b >= 0.0f && model.r > 0.0f;
+}
+
+/**
+ * @brief Sets the same, uncalibrated model for all the cells.
+ */
+void SoleCalibration::setDefault()
+{
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+            setCellModel((SoleSide)s, i, DEFAULT_CELL_MODEL);
+    }
+}
+
+/**
+ * @brief Loads the calibration of all the cells from a configuration file,
+ * with the entries "<side>_coef_a", "<side>_coef_b" and "<side>_resistance",
+ * each followed by the 8 values of the cells, for the left and right sides.
+ * @param path path of the configuration file.
+ * @param logContent true to print the content of the file to the log.
+ * @return true if the file could be loaded, false otherwise. In that case, the
+ * current calibration is not modified.
+ */
+bool SoleCalibration::load(const string &path, bool logContent)
+{
+    KeyValueFile file;
+    if(!file.load(path, logContent))
+        return false;
+
+    array<array<SoleCellModel, SOLE_N_CELLS>, N_SOLES> newModels;
+
+    for(int s=0; s<N_SOLES; s++)
+    {
+        string side = SIDE_NAMES[s];
+        float a[SOLE_N_CELLS], b[SOLE_N_CELLS], r[SOLE_N_CELLS];
+
+        if(!file.getFloats(side + "_coef_a", a, SOLE_N_CELLS) ||
+           !file.getFloats(side + "_coef_b", b, SOLE_N_CELLS) ||
+           !file.getFloats(side + "_resistance", r, SOLE_N_CELLS))
+        {
+            debug << path << ": missing or invalid coefficients for the "
+                  << side << " sole." << endl;
+            return false;
+        }
+
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            newModels[s][i] = SoleCellModel{a[i], b[i], r[i]};
+
+            if(!isValidModel(newModels[s][i]))
+            {
+                debug << path << ": invalid coefficients for the cell " << i
+                      << " of the " << side << " sole (a and r must be positive, b"
+                      << " positive or zero)." << endl;
+                return false;
+            }
+        }
+    }
+
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+            setCellModel((SoleSide)s, i, newModels[s][i]);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes the calibration of all the cells to a configuration file, in
+ * the format read by load().
+ * @param path path of the configuration file.
+ * @return true if the file could be written, false otherwise.
+ */
+bool SoleCalibration::save(const string &path) const
+{
+    KeyValueFile file;
+
+    for(int s=0; s<N_SOLES; s++)
+    {
+        string side = SIDE_NAMES[s];
+        float a[SOLE_N_CELLS], b[SOLE_N_CELLS], r[SOLE_N_CELLS];
+
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            a[i] = models[s][i].a;
+            b[i] = models[s][i].b;
+            r[i] = models[s][i].r;
+        }
+
+        file.setFloats(side + "_coef_a", a, SOLE_N_CELLS);
+        file.setFloats(side + "_coef_b", b, SOLE_N_CELLS);
+        file.setFloats(side + "_resistance", r, SOLE_N_CELLS);
+    }
+
+    return file.save(path);
+}
+
+/**
+ * @brief Sets the model of a cell, and computes the coefficients of its
+ * conversion.
+ * @param side the sole.
+ * @param cell the index of the cell [0-7].
+ * @param model the model coefficients, valid (see isValidModel()).
+ */
+void SoleCalibration::setCellModel(SoleSide side, int cell,
+                                   const SoleCellModel &model)
+{
+    models[side][cell] = model;
+
+    numerators[side][cell] = model.a;
+    offsets[side][cell] = model.r * excitationVoltage;
+    slopes[side][cell] = model.r + model.b;
+
+    // Voltage where the model gives twice SOLE_CELL_MAX_FORCE, below the
+    // divergence at offset/slope, so that the force of any voltage above it is
+    // saturated exactly to SOLE_CELL_MAX_FORCE, despite the rounding.
+    float clampForce = 2.0f * SOLE_CELL_MAX_FORCE;
+    clampVoltages[side][cell] = clampForce * offsets[side][cell] /
+        (model.a + clampForce * slopes[side][cell]);
+}
+
+/**
+ * @brief Gets the model of a cell.
+ * @param side the sole.
+ * @param cell the index of the cell [0-7].
+ * @return the model coefficients.
+ */
+const SoleCellModel &SoleCalibration::getCellModel(SoleSide side, int cell) const
+{
+    return models[side][cell];
+}
+
+/**
+ * @brief Converts the voltage of a cell to a force, by evaluating its model in
+ * its original form. convert() gives the same value, to the float rounding.
+ * @param side the sole.
+ * @param cell the index of the cell [0-7].
+ * @param voltage the voltage measured by the ADC [V].
+ * @return the force on the cell [N].
+ */
+float SoleCalibration::voltageToForce(SoleSide side, int cell, float voltage) const
+{
+    return evaluateModel(models[side][cell], excitationVoltage, voltage);
+}
+
+/**
+ * @brief Gets the voltage of a cell for a given force. This is the inverse of
+ * voltageToForce(), for simulating the soles.
+ * @param side the sole.
+ * @param cell the index of the cell [0-7].
+ * @param force the force on the cell [N].
+ * @return the voltage measured by the ADC [V].
+ */
+float SoleCalibration::forceToVoltage(SoleSide side, int cell, float force) const
+{
+    if(force <= 0.0f)
+        return 0.0f;
+
+    const SoleCellModel &m = models[side][cell];
+    float cellResistance = m.a / force + m.b; // [ohm].
+    return excitationVoltage * m.r / (cellResistance + m.r); // [V].
+}
+
+/**
+ * @brief Converts the voltage of a cell to a force. The force is saturated to
+ * SOLE_CELL_MAX_FORCE, since the model diverges when the cell resistance gets
+ * close to b, i.e. when the voltage gets close to the excitation voltage.
+ * @param model the model of the cell.
+ * @param excitationVoltage supply voltage of the cell [V].
+ * @param voltage the voltage measured by the ADC [V].
+ * @return the force on the cell [0-SOLE_CELL_MAX_FORCE] [N].
+ */
+float SoleCalibration::evaluateModel(const SoleCellModel &model,
+                                     float excitationVoltage, float voltage)
+{
+    if(voltage <= 0.0f)
+        return 0.0f;
+
+    float cellResistance = model.r * (excitationVoltage / voltage - 1.0f); // [ohm].
+    float denominator = cellResistance - model.b; // [ohm].
+
+    if(denominator <= model.a / SOLE_CELL_MAX_FORCE)
+        return SOLE_CELL_MAX_FORCE;
+    else
+        return model.a / denominator; // [N].
+}
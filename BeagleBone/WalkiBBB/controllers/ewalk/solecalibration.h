@@ -0,0 +1,142 @@
+#ifndef SOLECALIBRATION_H
+#define SOLECALIBRATION_H
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "../../lib/utils.h"
+
+#define SOLE_N_CELLS 8              ///< No. of force sensitive cells per sole.
+#define SOLE_CELL_MAX_FORCE 2000.0f ///< Saturation of the force of a cell [N].
+
+/**
+ * @brief Model of a force sensitive cell of an instrumented sole. The cell is
+ * in series with an associated resistance r, and the ADC measures the voltage
+ * across r. The cell resistance is a/force + b, so
+ * force = a / (R_cell - b), with R_cell = r * (V_excitation / V - 1).
+ */
+struct SoleCellModel
+{
+    float a; ///< [ohm.N].
+    float b; ///< [ohm].
+    float r; ///< Associated resistance [ohm].
+};
+
+enum SoleSide
+{
+    SOLE_LEFT = 0,
+    SOLE_RIGHT,
+    N_SOLES
+};
+
+/**
+ * @brief Per-cell calibration of both instrumented soles.
+ *
+ * Each cell has its own model coefficients. The model is rearranged as
+ * force = a*V / (r*V_excitation - (r+b)*V), whose coefficients and highest
+ * valid voltage are computed once per cell, so that the conversion of the soles
+ * voltages to forces is a single division per cell, in a loop without
+ * branches.
+ */
+class SoleCalibration
+{
+public:
+    SoleCalibration(float excitationVoltage);
+
+    static bool isValidModel(const SoleCellModel &model);
+
+    void setDefault();
+    bool load(const std::string &path, bool logContent = true);
+    bool save(const std::string &path) const;
+
+    void setCellModel(SoleSide side, int cell, const SoleCellModel &model);
+    const SoleCellModel &getCellModel(SoleSide side, int cell) const;
+
+    float voltageToForce(SoleSide side, int cell, float voltage) const;
+    float forceToVoltage(SoleSide side, int cell, float force) const;
+
+    /**
+     * @brief Converts the voltages of both soles to forces, and sums the
+     * forces of each sole. Same as voltageToForce() for each cell, to the
+     * float rounding: the force is 0 for a zero or negative voltage (and for
+     * NaN), and saturated to SOLE_CELL_MAX_FORCE where the model diverges.
+     * @param leftVoltages voltages of the cells of the left sole [V].
+     * @param rightVoltages voltages of the cells of the right sole [V].
+     * @param leftLoads forces of the cells of the left sole [N].
+     * @param rightLoads forces of the cells of the right sole [N].
+     * @param leftFootLoad total force on the left sole [N].
+     * @param rightFootLoad total force on the right sole [N].
+     */
+    inline void convert(const VecNf<SOLE_N_CELLS> &leftVoltages,
+                        const VecNf<SOLE_N_CELLS> &rightVoltages,
+                        VecNf<SOLE_N_CELLS> &leftLoads,
+                        VecNf<SOLE_N_CELLS> &rightLoads,
+                        float &leftFootLoad, float &rightFootLoad) const
+    {
+        convertSole(SOLE_LEFT, leftVoltages, leftLoads);
+        convertSole(SOLE_RIGHT, rightVoltages, rightLoads);
+
+        float leftSum = 0.0f, rightSum = 0.0f;
+
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            leftSum += leftLoads[i];
+            rightSum += rightLoads[i];
+        }
+
+        leftFootLoad = leftSum;
+        rightFootLoad = rightSum;
+    }
+
+    static float evaluateModel(const SoleCellModel &model,
+                               float excitationVoltage, float voltage);
+
+private:
+    /**
+     * @brief Converts the voltages of the cells of a sole to forces.
+     * @param side the sole.
+     * @param voltages the voltages measured by the ADC [V].
+     * @param loads the forces [0-SOLE_CELL_MAX_FORCE] [N].
+     */
+    inline void convertSole(SoleSide side, const VecNf<SOLE_N_CELLS> &voltages,
+                            VecNf<SOLE_N_CELLS> &loads) const
+    {
+        const float *a = numerators[side].data();
+        const float *offset = offsets[side].data();
+        const float *slope = slopes[side].data();
+        const float *clamp = clampVoltages[side].data();
+
+        // The voltage is clamped to the range where the model is valid, up to
+        // beyond the saturation, with std::min() and std::max() on local
+        // values, that are branch-free and NaN-safe in this argument order. The forces go to a local array
+        // first, that cannot alias the arguments, so that the loop can be
+        // vectorized without runtime checks. Within this range, the
+        // denominator is strictly positive. A NaN voltage gives 0.
+        float forces[SOLE_N_CELLS];
+
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            float voltage = voltages[i];
+            float maxVoltage = clamp[i];
+            voltage = std::min(std::max(0.0f, voltage), maxVoltage);
+
+            float force = a[i] * voltage / (offset[i] - slope[i] * voltage);
+            forces[i] = std::min(force, SOLE_CELL_MAX_FORCE);
+        }
+
+        for(int i=0; i<SOLE_N_CELLS; i++)
+            loads[i] = forces[i];
+    }
+
+    float excitationVoltage; ///< [V].
+    std::array<std::array<SoleCellModel, SOLE_N_CELLS>, N_SOLES> models;
+
+    // Coefficients of the rearranged model, indexed by [side][cell].
+    std::array<std::array<float, SOLE_N_CELLS>, N_SOLES> numerators; ///< a [ohm.N].
+    std::array<std::array<float, SOLE_N_CELLS>, N_SOLES> offsets;    ///< r*V_excitation [ohm.V].
+    std::array<std::array<float, SOLE_N_CELLS>, N_SOLES> slopes;     ///< r+b [ohm].
+    std::array<std::array<float, SOLE_N_CELLS>, N_SOLES> clampVoltages; ///< [V].
+};
+
+#endif // SOLECALIBRATION_H
@@ -0,0 +1,254 @@
+#include "torqueprofiletable.h"
+#include "harmonickernel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <tgmath.h>
+
+using namespace std;
+
+/**
+ * @brief Gets the first aligned address of a storage, after the padding
+ * sample.
+ * @param storage the first element of the storage.
+ * @return the address of the first sample of the table.
+ */
+static float *alignTable(float *storage)
+{
+    uintptr_t address = (uintptr_t)(storage + 1);
+    address = (address + TORQUE_PROFILE_TABLE_ALIGNMENT - 1) /
+              TORQUE_PROFILE_TABLE_ALIGNMENT * TORQUE_PROFILE_TABLE_ALIGNMENT;
+    return (float*)address;
+}
+
+/**
+ * @brief Constructor. The table is empty (zero torque) until harmonics are set.
+ */
+TorqueProfileTable::TorqueProfileTable()
+{
+    coefs.a.fill(0.0f);
+    coefs.b.fill(0.0f);
+    coefs.c.fill(0.0f);
+    interpolation = TABLE_LINEAR;
+    period = 1.0f;
+    samplesPerSecond = TORQUE_PROFILE_TABLE_SIZE / period;
+    storage.fill(0.0f);
+    table = alignTable(storage.data());
+}
+
+/**
+ * @brief Copy constructor. The samples of the copy are aligned in its own
+ * storage.
+ * @param other the table to copy.
+ */
+TorqueProfileTable::TorqueProfileTable(const TorqueProfileTable &other)
+{
+    table = alignTable(storage.data());
+    *this = other;
+}
+
+/**
+ * @brief Copies a table. The samples of the copy are aligned in its own
+ * storage.
+ * @param other the table to copy.
+ * @return this table.
+ */
+TorqueProfileTable &TorqueProfileTable::operator=(const TorqueProfileTable &other)
+{
+    coefs = other.coefs;
+    interpolation = other.interpolation;
+    period = other.period;
+    samplesPerSecond = other.samplesPerSecond;
+    copy(other.table - 1, other.table + TORQUE_PROFILE_TABLE_SIZE + 2, table - 1);
+    return *this;
+}
+
+/**
+ * @brief Sets the interpolation of the lookups. Call it before setPoints() to
+ * resample the points with the same interpolation.
+ * @param interpolation the interpolation, linear by default.
+ */
+void TorqueProfileTable::setInterpolation(TableInterpolation interpolation)
+{
+    this->interpolation = interpolation;
+}
+
+/**
+ * @brief Sets the sum-of-sines coefficients and rebuilds the table.
+ * @param coefficients the new profile coefficients.
+ */
+void TorqueProfileTable::setHarmonics(const HarmonicCoefficients &coefficients)
+{
+    coefs = coefficients;
+    sampleHarmonics();
+    copyPadding();
+}
+
+/**
+ * @brief Resamples a tabulated profile, e.g. from gait analysis data. The
+ * points can be unevenly spaced, and the profile wraps from the last one to the
+ * first one. With the cubic Hermite interpolation, the slopes at the points are
+ * the ones of the monotone cubic interpolation (Fritsch-Carlson, the "pchip"
+ * of MATLAB), so that there is no overshoot between the points.
+ * @param phases phase of each point, increasing, within [0-1] []. A point at 1
+ * is the same as a point at 0, for the next cycle.
+ * @param torques torque of each point, normalized by bodyweight [N.m/kg].
+ * @param nPoints number of points, at least 1.
+ * @param period period of the profile, e.g. the nominal gait cycle [s].
+ */
+void TorqueProfileTable::setPoints(const float *phases, const float *torques,
+                                   int nPoints, float period)
+{
+    coefs.a.fill(0.0f);
+    coefs.b.fill(0.0f);
+    coefs.c.fill(0.0f);
+    this->period = period;
+    samplesPerSecond = TORQUE_PROFILE_TABLE_SIZE / period;
+
+    // Points of the cycle, with the previous and next ones on each side. If
+    // both ends of the cycle are given, they are not repeated.
+    bool closed = (nPoints > 2 && phases[nPoints-1] - phases[0] >= 1.0f);
+    int last = closed ? nPoints - 2 : nPoints - 1;
+    int first = closed ? 1 : 0;
+
+    vector<float> x, y;
+    x.push_back(phases[last] - 1.0f);
+    y.push_back(torques[last]);
+    x.insert(x.end(), phases, phases + nPoints);
+    y.insert(y.end(), torques, torques + nPoints);
+    x.push_back(phases[first] + 1.0f);
+    y.push_back(torques[first]);
+    int n = (int)x.size();
+
+    // Slope of each interval, then at each point.
+    vector<float> deltas(n - 1), slopes(n, 0.0f);
+    for(int k=0; k<n-1; k++)
+    {
+        float h = x[k+1] - x[k];
+        deltas[k] = (h > 0.0f) ? (y[k+1] - y[k]) / h : 0.0f;
+    }
+    slopes[0] = deltas[0];
+    slopes[n-1] = deltas[n-2];
+    for(int k=1; k<n-1; k++)
+    {
+        float h0 = x[k] - x[k-1], h1 = x[k+1] - x[k];
+        if(deltas[k-1] * deltas[k] <= 0.0f || h0 <= 0.0f || h1 <= 0.0f)
+            continue; // Extremum, or duplicated point.
+
+        float w0 = 2.0f*h1 + h0, w1 = h1 + 2.0f*h0;
+        slopes[k] = (w0 + w1) / (w0 / deltas[k-1] + w1 / deltas[k]);
+    }
+
+    int k = 0; // Interval of the current sample.
+    for(int i=0; i<TORQUE_PROFILE_TABLE_SIZE; i++)
+    {
+        float phase = (float)i / TORQUE_PROFILE_TABLE_SIZE;
+        while(k < n-2 && x[k+1] <= phase)
+            k++;
+
+        float h = x[k+1] - x[k];
+        float t = (h > 0.0f) ? (phase - x[k]) / h : 0.0f;
+
+        if(interpolation == TABLE_LINEAR)
+            table[i] = y[k] + (y[k+1] - y[k]) * t;
+        else
+        {
+            float t2 = t*t, t3 = t2*t;
+            table[i] = (2.0f*t3 - 3.0f*t2 + 1.0f) * y[k] + (t3 - 2.0f*t2 + t) * h * slopes[k] +
+                       (-2.0f*t3 + 3.0f*t2) * y[k+1] + (t3 - t2) * h * slopes[k+1];
+        }
+    }
+
+    copyPadding();
+}
+
+/**
+ * @brief Gets the period of the profile, which is also the period of the table.
+ * @return the period [s].
+ */
+float TorqueProfileTable::getPeriod() const
+{
+    return period;
+}
+
+/**
+ * @brief Gets the interpolation of the lookups.
+ * @return the interpolation.
+ */
+TableInterpolation TorqueProfileTable::getInterpolation() const
+{
+    return interpolation;
+}
+
+/**
+ * @brief Evaluates the normalized profile in closed form with the libm sine,
+ * without the table. This is slow and only meant to check the accuracy of the
+ * table.
+ * @param coefficients the profile coefficients.
+ * @param time time since the start of the profile [s].
+ * @return the torque, normalized by bodyweight [N.m/kg].
+ */
+float TorqueProfileTable::evaluateHarmonics(const HarmonicCoefficients &coefficients,
+                                            float time)
+{
+    float sum = 0.0f;
+
+    for(int i=0; i<N_HARMONICS; i++)
+    {
+        if(coefficients.a[i] != 0.0f)
+            sum += coefficients.a[i] * sin(coefficients.b[i] * time + coefficients.c[i]);
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Samples the profile over one period of its fundamental frequency.
+ */
+void TorqueProfileTable::sampleHarmonics()
+{
+    // The fundamental is the lowest frequency with a non-zero amplitude.
+    float fundamental = 0.0f;
+    for(int i=0; i<N_HARMONICS; i++)
+    {
+        if(coefs.a[i] != 0.0f && coefs.b[i] > 0.0f &&
+           (fundamental == 0.0f || coefs.b[i] < fundamental))
+        {
+            fundamental = coefs.b[i];
+        }
+    }
+
+    if(fundamental == 0.0f)
+    {
+        fill(table, table + TORQUE_PROFILE_TABLE_SIZE, 0.0f);
+        return;
+    }
+
+    period = 2.0f * (float)M_PI / fundamental;
+    samplesPerSecond = TORQUE_PROFILE_TABLE_SIZE / period;
+
+    // Two samples per kernel call: one in each half of the period.
+    const int HALF_SIZE = TORQUE_PROFILE_TABLE_SIZE / 2;
+    for(int i=0; i<HALF_SIZE; i++)
+    {
+        float first, second;
+        evaluateHarmonicsPair(coefs, (float)i / samplesPerSecond,
+                              (float)(i + HALF_SIZE) / samplesPerSecond,
+                              first, second);
+        table[i] = first;
+        table[i + HALF_SIZE] = second;
+    }
+}
+
+/**
+ * @brief Copies the samples at both ends of the table to the padding, so that
+ * the interpolation never has to wrap the index.
+ */
+void TorqueProfileTable::copyPadding()
+{
+    table[-1] = table[TORQUE_PROFILE_TABLE_SIZE - 1];
+    table[TORQUE_PROFILE_TABLE_SIZE] = table[0];
+    table[TORQUE_PROFILE_TABLE_SIZE + 1] = table[1];
+}
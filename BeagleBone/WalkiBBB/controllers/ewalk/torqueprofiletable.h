@@ -0,0 +1,153 @@
+#ifndef TORQUEPROFILETABLE_H
+#define TORQUEPROFILETABLE_H
+
+#include <array>
+#include <cmath>
+#include <string>
+
+#define N_HARMONICS 8                   ///< Max. number of sine terms of a profile.
+#define TORQUE_PROFILE_TABLE_SIZE 1024  ///< No. of samples over one profile period, a power of 2.
+#define TORQUE_PROFILE_TABLE_ALIGNMENT 64 ///< Alignment of the samples, one cache line [B].
+
+/**
+ * @brief Interpolation between the samples of a table, and between the points
+ * of a tabulated profile when it is resampled.
+ */
+enum TableInterpolation
+{
+    TABLE_LINEAR = 0,       ///< Continuous, 2 samples per lookup.
+    TABLE_CUBIC_HERMITE     ///< Continuous slope, 4 samples per lookup.
+};
+
+/**
+ * @brief Coefficients of a sum-of-sines torque profile, as produced by the
+ * MATLAB "sin8" fit: torque(t) = sum_i a[i]*sin(b[i]*t + c[i]). Unused terms
+ * have all their coefficients set to zero.
+ */
+struct HarmonicCoefficients
+{
+    std::array<float, N_HARMONICS> a; ///< Amplitudes [N.m/kg].
+    std::array<float, N_HARMONICS> b; ///< Angular frequencies [rad/s].
+    std::array<float, N_HARMONICS> c; ///< Phases [rad].
+};
+
+/**
+ * @brief Phase-indexed table of a periodic torque profile. The profile is
+ * sampled once over its fundamental period (the smallest non-zero b[i]), so
+ * that getting the torque at a given time is a single lookup with
+ * interpolation, instead of evaluating every sine term. The samples are
+ * normalized by bodyweight: the caller multiplies the result by its own scale,
+ * so that a change of bodyweight or assistance never rebuilds the table.
+ *
+ * It can also be resampled from a tabulated profile with any number of
+ * unevenly spaced points (setPoints()), so that the lookup does not depend on
+ * the source, and never has to search it. The samples start on a cache line,
+ * and are padded so that the interpolation never has to wrap the index.
+ * @remark the fitted frequencies are harmonics of the fundamental to within a
+ * fraction of a percent, so wrapping the time to one period matches the closed
+ * form for the first period and stays within the fit error after that.
+ */
+class TorqueProfileTable
+{
+public:
+    TorqueProfileTable();
+    TorqueProfileTable(const TorqueProfileTable &other);
+    TorqueProfileTable &operator=(const TorqueProfileTable &other);
+
+    void setInterpolation(TableInterpolation interpolation);
+    void setHarmonics(const HarmonicCoefficients &coefficients);
+    void setPoints(const float *phases, const float *torques, int nPoints,
+                   float period);
+
+    float getPeriod() const;
+    TableInterpolation getInterpolation() const;
+
+    /**
+     * @brief Gets the torque of the profile at the given time.
+     * @param time time since the start of the profile [s]. Any value is
+     * accepted, it is wrapped to one period.
+     * @return the torque, normalized by bodyweight [N.m/kg].
+     */
+    inline float getTorque(float time) const
+    {
+        return getTorqueAtIndex(time * samplesPerSecond);
+    }
+
+    /**
+     * @brief Gets the torque of the profile at the given phase.
+     * @param phase fraction of the period since the start of the profile [].
+     * Any value is accepted, it is wrapped to [0-1[.
+     * @return the torque, normalized by bodyweight [N.m/kg].
+     */
+    inline float getTorqueAtPhase(float phase) const
+    {
+        return getTorqueAtIndex(phase * TORQUE_PROFILE_TABLE_SIZE);
+    }
+
+    static float evaluateHarmonics(const HarmonicCoefficients &coefficients,
+                                   float time);
+
+private:
+    /**
+     * @brief Interpolates the table.
+     * @param x fractional index in the table, wrapped to the table size [].
+     * @return the torque, normalized by bodyweight [N.m/kg].
+     */
+    inline float getTorqueAtIndex(float x) const
+    {
+        // Beyond 2^24, the floats are integers, and would overflow the int.
+        if(!(fabsf(x) < 16777216.0f))
+            x = std::isfinite(x) ? fmodf(x, TORQUE_PROFILE_TABLE_SIZE) : 0.0f;
+
+        // Rounded down without floorf(), which is a function call on the
+        // BeagleBone, then wrapped with the mask.
+        int index = (int)x;
+        if((float)index > x)
+            index--;
+        float frac = x - (float)index;
+
+        const float *p = &table[index & (TORQUE_PROFILE_TABLE_SIZE - 1)];
+        if(interpolation == TABLE_LINEAR)
+            return p[0] + (p[1] - p[0]) * frac;
+
+        // Catmull-Rom spline, the cubic Hermite with the central differences
+        // as slopes.
+        return p[0] + 0.5f * frac * (p[1] - p[-1] +
+                    frac * (2.0f*p[-1] - 5.0f*p[0] + 4.0f*p[1] - p[2] +
+                    frac * (3.0f*(p[0] - p[1]) + p[2] - p[-1])));
+    }
+
+    static_assert((TORQUE_PROFILE_TABLE_SIZE & (TORQUE_PROFILE_TABLE_SIZE - 1)) == 0,
+                  "The size of the table must be a power of 2.");
+
+    void sampleHarmonics();
+    void copyPadding();
+
+    HarmonicCoefficients coefs;
+    TableInterpolation interpolation;
+    float period;           ///< [s].
+    float samplesPerSecond; ///< [1/s].
+
+    // Samples [N.m/kg], preceded by a copy of the last one, and followed by a
+    // copy of the first two, so that table[-1] to table[SIZE+1] are valid.
+    // table points inside storage, to the first aligned address.
+    static const int TABLE_PADDING = TORQUE_PROFILE_TABLE_ALIGNMENT / sizeof(float);
+    std::array<float, TORQUE_PROFILE_TABLE_SIZE + 2 + TABLE_PADDING> storage;
+    float *table;
+};
+
+/**
+ * @brief Torque profile that can be selected while walking, see ProfileStore.
+ * Once published, it is never modified, so the control loop can read it
+ * without any lock.
+ */
+struct TorqueProfile
+{
+    std::string name;
+    bool harmonic;                      ///< true if given by coefficients, false if tabulated.
+    HarmonicCoefficients coefficients;  ///< Zero if tabulated.
+    float period;                       ///< Nominal period of the gait cycle [s].
+    TorqueProfileTable table;           ///< Unscaled, one gait cycle [N.m/kg].
+};
+
+#endif // TORQUEPROFILETABLE_H
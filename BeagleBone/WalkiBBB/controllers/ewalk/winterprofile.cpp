@@ -0,0 +1,56 @@
+#include "winterprofile.h"
+
+const TorquePoint_T winterHipTorqueProfile1[WINTER_PROFILE_N_POINTS] =
+{
+    {0.00 , -0.249},
+    {0.02 , -0.600},
+    {0.04 , -0.556},
+    {0.06 , -0.416},
+    {0.08 , -0.359},
+    {0.10 , -0.305},
+    {0.12 , -0.245},
+    {0.14 , -0.159},
+    {0.16 , -0.084},
+    {0.18 , -0.000},
+    {0.20 , 0.064},
+    {0.22 , 0.092},
+    {0.24 , 0.098},
+    {0.26 , 0.092},
+    {0.28 , 0.085},
+    {0.30 , 0.088},
+    {0.32 , 0.100},
+    {0.34 , 0.130},
+    {0.36 , 0.168},
+    {0.38 , 0.199},
+    {0.40 , 0.231},
+    {0.42 , 0.269},
+    {0.44 , 0.312},
+    {0.46 , 0.364},
+    {0.48 , 0.401},
+    {0.50 , 0.404},
+    {0.52 , 0.356},
+    {0.54 , 0.262},
+    {0.56 , 0.251},
+    {0.58 , 0.310},
+    {0.60 , 0.344},
+    {0.62 , 0.295},
+    {0.64 , 0.228},
+    {0.66 , 0.169},
+    {0.68 , 0.126},
+    {0.70 , 0.089},
+    {0.72 , 0.069},
+    {0.74 , 0.057},
+    {0.76 , 0.044},
+    {0.78 , 0.026},
+    {0.80 , 0.009},
+    {0.82 , -0.008},
+    {0.84 , -0.029},
+    {0.86 , -0.060},
+    {0.88 , -0.106},
+    {0.90 , -0.170},
+    {0.92 , -0.242},
+    {0.94 , -0.296},
+    {0.96 , -0.301},
+    {0.98 , -0.237},
+    {1.00 , -0.118}
+};
@@ -0,0 +1,15 @@
+#ifndef WINTERPROFILE_H
+#define WINTERPROFILE_H
+
+#define WINTER_PROFILE_N_POINTS 51 ///< No. of points, every 2% of the gait cycle.
+
+// Data for the torque profile, taken from the appendix of the textbook
+// "The biomechanics and motor control of human gait" by D. A. Winter (1991).
+// The left column is the percent gait cycle, the right column is the hip torque
+// normalized by bodyweight (N.m/Kg). In the original textbook, the signs are
+// inverted because in the book, extension torques are defined as positive.
+typedef struct { float percentGc; float torquePerBodyweight; } TorquePoint_T;
+
+extern const TorquePoint_T winterHipTorqueProfile1[WINTER_PROFILE_N_POINTS];
+
+#endif // WINTERPROFILE_H
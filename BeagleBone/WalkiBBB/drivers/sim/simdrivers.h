@@ -0,0 +1,161 @@
+#ifndef SIMDRIVERS_H
+#define SIMDRIVERS_H
+
+/**
+ * Hardware-free replacements for the CanBus, Gyems, SpiBus, SpiChannel and
+ * Ads7844 drivers, with the same interface, backed by SimHardware.
+ *
+ * These classes reuse the include guards of the real drivers headers. A
+ * program that runs a controller without the hardware is built with this
+ * header force-included first (g++ -include drivers/sim/simdrivers.h), so that
+ * the real drivers headers included by the controller become empty. The
+ * controller source is the same, but it is built with the flags defined
+ * below, which move its CAN and acquisition threads into update().
+ */
+
+#include <cstdint>
+
+#include "simhardware.h"
+#include "../../lib/utils.h"
+
+// The simulated motors have no bus latency: the controllers step them
+// synchronously from update(), instead of from a real-time CAN thread, and
+// read the simulated clock of SimHardware, so that they can run faster than
+// real time. A program that runs a controller in real time instead, with its
+// CAN and supervisor threads, as on the orthosis, defines SIM_REAL_TIME.
+#ifndef SIM_REAL_TIME
+#define EWALK_SYNCHRONOUS_CAN
+#define EWALK_SIMULATED_CLOCK
+#endif
+
+// Same for the soles and foot IMUs, acquired from update() instead of an
+// acquisition thread, even with SIM_REAL_TIME.
+#define EWALK_SYNCHRONOUS_SENSORS
+
+// Many simulated controllers can run at the same time, and much faster than
+// real time: they must not record files.
+#define EWALK_SIMULATED_HARDWARE
+
+#ifndef SPIBUS_H
+#define SPIBUS_H
+
+/**
+ * @brief Simulated SPI bus. Only provides the chip select identifiers.
+ */
+class SpiBus
+{
+public:
+    enum ChipSelect
+    {
+        CS_LEFT_FOOT_MPU = 0,
+        CS_RIGHT_FOOT_MPU,
+        CS_LEFT_ADC,
+        CS_RIGHT_ADC
+    };
+};
+
+/**
+ * @brief Simulated SPI device. Transfers only return zeros.
+ */
+class SpiChannel
+{
+public:
+    SpiChannel(SpiBus &, SpiBus::ChipSelect chipSelect) :
+        chipSelect(chipSelect) { }
+
+    void transfer(uint8_t *, uint8_t *rxBuffer, int length)
+    {
+        for(int i=0; i<length; i++)
+            rxBuffer[i] = 0;
+    }
+
+    SpiBus::ChipSelect getChipSelect() const { return chipSelect; }
+
+private:
+    SpiBus::ChipSelect chipSelect;
+};
+
+#endif // SPIBUS_H
+
+#ifndef CANBUS_H
+#define CANBUS_H
+
+#define CAN_UPDATE_PERIOD 1000 ///< Period of the CAN communication [us].
+
+/**
+ * @brief Simulated CAN bus. The simulated motors do not use it.
+ */
+class CanBus
+{
+
+};
+
+#endif // CANBUS_H
+
+#ifndef GYEMS_H
+#define GYEMS_H
+
+/**
+ * @brief Simulated Gyems motor. Reads its state from, and writes its setpoint
+ * to, the SimHardware motor with the same CAN ID.
+ */
+class Gyems
+{
+public:
+    Gyems(CanBus *, int id, float, float) :
+        hardware(SimHardware::getInstance()),
+        motor(hardware.motors[id]),
+        id(id) { }
+
+    float getPosition() { return motor.position; }
+    float getSpeed() { return motor.speed; }
+    float getTorque() { return motor.torque; }
+    void setTorque(float torque) { motor.torqueSetpoint = torque; }
+
+    void update(float)
+    {
+        if(hardware.torqueFollowsSetpoint)
+            motor.torque = motor.torqueSetpoint;
+        if(hardware.motorModel)
+            hardware.motorModel(id, motor);
+        motor.nUpdates++;
+    }
+
+private:
+    SimHardware &hardware;
+    SimMotor &motor;
+    int id;
+};
+
+#endif // GYEMS_H
+
+#ifndef ADS7844_H
+#define ADS7844_H
+
+/**
+ * @brief Simulated 8-channel ADC. Returns the voltages of the SimHardware ADC
+ * with the same chip select.
+ */
+class Ads7844
+{
+public:
+    Ads7844(SpiBus &, SpiBus::ChipSelect chipSelect, float) :
+        voltages(SimHardware::getInstance().adcVoltages[chipSelect]) { }
+
+    void update(float) { }
+
+    VecNf<SIM_N_ADC_CHANNELS> getLastSamples()
+    {
+        VecNf<SIM_N_ADC_CHANNELS> samples;
+        for(int i=0; i<SIM_N_ADC_CHANNELS; i++)
+            samples[i] = voltages[i];
+        return samples;
+    }
+
+private:
+    const std::array<float, SIM_N_ADC_CHANNELS> &voltages;
+};
+
+#endif // ADS7844_H
+
+#endif // SIMDRIVERS_H
@@ -0,0 +1,48 @@
+#include "simhardware.h"
+
+static thread_local SimHardware *threadInstance = nullptr;
+
+/**
+ * @brief Gets the simulated hardware of the calling thread.
+ * @return the instance selected by the thread with setThreadInstance(), or
+ * else the instance shared by the whole process.
+ */
+SimHardware &SimHardware::getInstance()
+{
+    static SimHardware sharedInstance;
+    return (threadInstance != nullptr) ? *threadInstance : sharedInstance;
+}
+
+/**
+ * @brief Selects the simulated hardware of the calling thread. The simulated
+ * drivers keep a reference to the instance they were created with, so it must
+ * be selected before creating the controller, and outlive it.
+ * @param hardware the instance, or nullptr to use the shared one again.
+ */
+void SimHardware::setThreadInstance(SimHardware *hardware)
+{
+    threadInstance = hardware;
+}
+
+/**
+ * @brief Constructor.
+ */
+SimHardware::SimHardware()
+{
+    reset();
+}
+
+/**
+ * @brief Sets all the sensor values, the setpoints and the time to zero.
+ */
+void SimHardware::reset()
+{
+    for(SimMotor &m : motors)
+        m = SimMotor{0.0f, 0.0f, 0.0f, 0.0f, 0};
+
+    for(auto &adc : adcVoltages)
+        adc.fill(0.0f);
+
+    torqueFollowsSetpoint = true;
+    timeUs = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SIMHARDWARE_H
+#define SIMHARDWARE_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#define SIM_N_MOTORS 8          ///< Number of simulated CAN motor IDs.
+#define SIM_N_CHIP_SELECTS 8    ///< Number of simulated SPI chip selects.
+#define SIM_N_ADC_CHANNELS 8    ///< Number of channels of each simulated ADC.
+
+/**
+ * @brief State of a simulated motor, as seen by the controller. The values
+ * are in the joint frame (sign and offset already applied).
+ */
+struct SimMotor
+{
+    float position;         ///< [deg]
+    float speed;            ///< [deg/s]
+    float torque;           ///< Measured torque [N.m]
+    float torqueSetpoint;   ///< Last torque set by the controller [N.m]
+    int nUpdates;           ///< Number of CAN updates of this motor.
+};
+
+/**
+ * @brief Shared state of all the simulated drivers of drivers/sim.
+ *
+ * A replay or simulation program writes the sensor values here before stepping
+ * the controller, and reads back the torque setpoints after. All the simulated
+ * drivers of one process share a single instance, unless a thread selects its
+ * own with setThreadInstance(), e.g. to run several controllers in parallel,
+ * each one created and stepped by its own thread.
+ */
+class SimHardware
+{
+public:
+    SimHardware();
+
+    static SimHardware &getInstance();
+    static void setThreadInstance(SimHardware *hardware);
+
+    void reset();
+
+    std::array<SimMotor, SIM_N_MOTORS> motors; ///< Indexed by CAN ID.
+
+    /// Voltages of the ADC channels [V], indexed by chip select then channel.
+    std::array<std::array<float, SIM_N_ADC_CHANNELS>, SIM_N_CHIP_SELECTS> adcVoltages;
+
+    /// If true, the measured torque of a motor is set to its setpoint at each
+    /// update, as if the current loop were perfect.
+    bool torqueFollowsSetpoint;
+
+    /// If set, called at each update of a motor, with its CAN ID, after its
+    /// setpoint was written, by the thread that updates it. It can change the
+    /// state of the motor, e.g. to inject faults. Not changed by reset(): with
+    /// SIM_REAL_TIME, it must be set before creating the controller, whose CAN
+    /// thread updates the motors from then.
+    std::function<void(int, SimMotor&)> motorModel;
+
+    /// Simulated monotonic clock, read by the controllers instead of the real
+    /// one, unless SIM_REAL_TIME, and advanced by the program at each step [us].
+    int64_t timeUs;
+};
+
+#endif // SIMHARDWARE_H
@@ -0,0 +1,207 @@
+#include "keyvaluefile.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "debugstream.h"
+
+using namespace std;
+
+/**
+ * @brief Removes the leading and trailing whitespace of a string.
+ * @param s the string to trim.
+ * @return the trimmed string.
+ */
+static string trim(const string &s)
+{
+    size_t first = s.find_first_not_of(" \t\r\n");
+    if(first == string::npos)
+        return "";
+
+    size_t last = s.find_last_not_of(" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+/**
+ * @brief Loads the entries of a file, replacing the current ones.
+ * @param path path of the file.
+ * @param logContent true to print the content of the file to the log, as for
+ * the other configuration files, false to load it silently.
+ * @return true if the file could be read and all its lines are valid, false
+ * otherwise.
+ */
+bool KeyValueFile::load(const string &path, bool logContent)
+{
+    ifstream file(path);
+    if(!file.is_open())
+        return false;
+
+    entries.clear();
+
+    if(logContent)
+        debug << "Configuration file " << path << " content:" << endl;
+
+    string line;
+    int lineNumber = 0;
+    while(getline(file, line))
+    {
+        lineNumber++;
+        line = trim(line);
+
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        size_t separator = line.find(':');
+        if(separator == string::npos || separator == 0)
+        {
+            debug << path << ": invalid line " << lineNumber << "." << endl;
+            return false;
+        }
+
+        string key = trim(line.substr(0, separator));
+        string value = trim(line.substr(separator + 1));
+        entries.push_back(make_pair(key, value));
+
+        if(logContent)
+            debug << key << ": " << value << endl;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes all the entries to a file, in the format read by load().
+ * @param path path of the file.
+ * @return true if the file could be written, false otherwise.
+ */
+bool KeyValueFile::save(const string &path) const
+{
+    ofstream file(path);
+    if(!file.is_open())
+        return false;
+
+    for(auto &e : entries)
+        file << e.first << ": " << e.second << "\n";
+
+    return file.good();
+}
+
+/**
+ * @brief Checks if the file has an entry with the given key.
+ * @param key the key to look for.
+ * @return true if the entry exists, false otherwise.
+ */
+bool KeyValueFile::hasKey(const string &key) const
+{
+    return find(key) != nullptr;
+}
+
+/**
+ * @brief Gets the values of an entry, as numbers.
+ * @param key the key of the entry.
+ * @param values array to write the values to. It is not modified if the entry
+ * is missing or invalid.
+ * @param nValues the exact number of values expected.
+ * @return true if the entry exists and has nValues numbers, false otherwise.
+ */
+bool KeyValueFile::getFloats(const string &key, float *values, int nValues) const
+{
+    const string *value = find(key);
+    if(value == nullptr)
+        return false;
+
+    istringstream iss(*value);
+    vector<float> parsed(nValues);
+    for(int i=0; i<nValues; i++)
+    {
+        if(!(iss >> parsed[i]))
+            return false;
+    }
+
+    string extra;
+    if(iss >> extra)
+        return false;
+
+    for(int i=0; i<nValues; i++)
+        values[i] = parsed[i];
+
+    return true;
+}
+
+/**
+ * @brief Gets the value of an entry, as text.
+ * @param key the key of the entry.
+ * @param value the value of the entry. It is not modified if the entry is
+ * missing.
+ * @return true if the entry exists, false otherwise.
+ */
+bool KeyValueFile::getString(const string &key, string &value) const
+{
+    const string *v = find(key);
+    if(v == nullptr)
+        return false;
+
+    value = *v;
+    return true;
+}
+
+/**
+ * @brief Sets the values of an entry, creating it if necessary.
+ * @param key the key of the entry.
+ * @param values the values to set.
+ * @param nValues the number of values.
+ */
+void KeyValueFile::setFloats(const string &key, const float *values, int nValues)
+{
+    ostringstream oss;
+    oss << setprecision(9);
+    for(int i=0; i<nValues; i++)
+        oss << (i > 0 ? " " : "") << values[i];
+
+    setString(key, oss.str());
+}
+
+/**
+ * @brief Sets the value of an entry, creating it if necessary.
+ * @param key the key of the entry.
+ * @param value the value to set.
+ */
+void KeyValueFile::setString(const string &key, const string &value)
+{
+    for(auto &e : entries)
+    {
+        if(e.first == key)
+        {
+            e.second = value;
+            return;
+        }
+    }
+
+    entries.push_back(make_pair(key, value));
+}
+
+/**
+ * @brief Gets all the entries, in the order of the file.
+ * @return the (key, value) pairs.
+ */
+const vector<pair<string, string>> &KeyValueFile::getEntries() const
+{
+    return entries;
+}
+
+/**
+ * @brief Finds the value of an entry.
+ * @param key the key of the entry.
+ * @return a pointer to the value, or nullptr if there is no such entry.
+ */
+const string *KeyValueFile::find(const string &key) const
+{
+    for(auto &e : entries)
+    {
+        if(e.first == key)
+            return &e.second;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,34 @@
+#ifndef KEYVALUEFILE_H
+#define KEYVALUEFILE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Text configuration file with one "key: values" entry per line, like
+ * the IMU calibration files (back_imu.conf). The values are separated by
+ * spaces. Empty lines and lines starting with '#' are ignored.
+ */
+class KeyValueFile
+{
+public:
+    bool load(const std::string &path, bool logContent = true);
+    bool save(const std::string &path) const;
+
+    bool hasKey(const std::string &key) const;
+    bool getFloats(const std::string &key, float *values, int nValues) const;
+    bool getString(const std::string &key, std::string &value) const;
+
+    void setFloats(const std::string &key, const float *values, int nValues);
+    void setString(const std::string &key, const std::string &value);
+
+    const std::vector<std::pair<std::string, std::string>> &getEntries() const;
+
+private:
+    const std::string *find(const std::string &key) const;
+
+    std::vector<std::pair<std::string, std::string>> entries; ///< In file order.
+};
+
+#endif // KEYVALUEFILE_H
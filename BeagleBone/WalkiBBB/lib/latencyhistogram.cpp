@@ -0,0 +1,140 @@
+#include "latencyhistogram.h"
+
+#include <cmath>
+
+using namespace std;
+
+/**
+ * @brief Constructor.
+ * @param bucketWidth width of each bucket [us]. The histogram range is
+ * LATENCY_HISTOGRAM_N_BUCKETS times this value.
+ */
+LatencyHistogram::LatencyHistogram(float bucketWidth) :
+    bucketWidth(bucketWidth)
+{
+    for(auto &b : buckets)
+        b.store(0, memory_order_relaxed);
+
+    previousCounts.fill(0);
+    p50 = 0.0f;
+    p99 = 0.0f;
+    max = 0.0f;
+    windowCount = 0;
+}
+
+/**
+ * @brief Adds a sample. Must only be called from the writer thread.
+ * @param value the sample value [us]. Negative values are counted in the first
+ * bucket, values beyond the range in the last one.
+ */
+void LatencyHistogram::add(float value)
+{
+    int index = (int)(value / bucketWidth);
+
+    if(index < 0)
+        index = 0;
+    else if(index >= LATENCY_HISTOGRAM_N_BUCKETS)
+        index = LATENCY_HISTOGRAM_N_BUCKETS - 1;
+
+    // Only this thread writes the counter, so load+store is enough.
+    buckets[index].store(buckets[index].load(memory_order_relaxed) + 1,
+                         memory_order_relaxed);
+}
+
+/**
+ * @brief Computes the statistics of the samples added since the last call.
+ * Must only be called from the reader thread.
+ */
+void LatencyHistogram::updateStats()
+{
+    array<uint32_t, LATENCY_HISTOGRAM_N_BUCKETS> windowCounts;
+    uint32_t total = 0;
+
+    for(int i=0; i<LATENCY_HISTOGRAM_N_BUCKETS; i++)
+    {
+        uint32_t count = buckets[i].load(memory_order_relaxed);
+        windowCounts[i] = count - previousCounts[i];
+        previousCounts[i] = count;
+        total += windowCounts[i];
+    }
+
+    windowCount = total;
+
+    if(total == 0)
+        return; // Keep the previous values.
+
+    p50 = getPercentile(windowCounts, total, 0.50f);
+    p99 = getPercentile(windowCounts, total, 0.99f);
+
+    for(int i=LATENCY_HISTOGRAM_N_BUCKETS-1; i>=0; i--)
+    {
+        if(windowCounts[i] > 0)
+        {
+            max = (i + 1) * bucketWidth;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Gets the median of the last window.
+ * @return the upper edge of the bucket containing the median [us].
+ */
+float LatencyHistogram::getP50() const
+{
+    return p50;
+}
+
+/**
+ * @brief Gets the 99th percentile of the last window.
+ * @return the upper edge of the bucket containing the percentile [us].
+ */
+float LatencyHistogram::getP99() const
+{
+    return p99;
+}
+
+/**
+ * @brief Gets the maximum of the last window.
+ * @return the upper edge of the highest non-empty bucket [us].
+ */
+float LatencyHistogram::getMax() const
+{
+    return max;
+}
+
+/**
+ * @brief Gets the number of samples in the last window.
+ * @return the number of samples added between the two last calls to
+ * updateStats().
+ */
+uint32_t LatencyHistogram::getWindowCount() const
+{
+    return windowCount;
+}
+
+/**
+ * @brief Computes a percentile from bucket counts.
+ * @param counts the number of samples in each bucket.
+ * @param total the sum of counts.
+ * @param fraction the percentile to compute [0-1].
+ * @return the upper edge of the bucket containing the percentile [us].
+ */
+float LatencyHistogram::getPercentile(const array<uint32_t, LATENCY_HISTOGRAM_N_BUCKETS> &counts,
+                                      uint32_t total, float fraction) const
+{
+    uint32_t rank = (uint32_t)ceilf(fraction * total); // 1-based.
+    if(rank == 0)
+        rank = 1;
+
+    uint32_t cumulated = 0;
+
+    for(int i=0; i<LATENCY_HISTOGRAM_N_BUCKETS; i++)
+    {
+        cumulated += counts[i];
+        if(cumulated >= rank)
+            return (i + 1) * bucketWidth;
+    }
+
+    return LATENCY_HISTOGRAM_N_BUCKETS * bucketWidth;
+}
@@ -0,0 +1,45 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#define LATENCY_HISTOGRAM_N_BUCKETS 256 ///< The last bucket also counts the overflows.
+
+/**
+ * @brief Fixed-bucket histogram of durations, filled by one thread and read by
+ * another one, without locks.
+ *
+ * The writer thread only increments the bucket counters. The reader thread
+ * periodically calls updateStats(), which computes the statistics of the
+ * samples added since the previous call, by comparing the counters with a
+ * copy made at that previous call.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(float bucketWidth);
+
+    void add(float value);
+
+    void updateStats();
+    float getP50() const;
+    float getP99() const;
+    float getMax() const;
+    uint32_t getWindowCount() const;
+
+private:
+    float getPercentile(const std::array<uint32_t, LATENCY_HISTOGRAM_N_BUCKETS> &counts,
+                        uint32_t total, float fraction) const;
+
+    float bucketWidth; ///< [us].
+    std::array<std::atomic<uint32_t>, LATENCY_HISTOGRAM_N_BUCKETS> buckets;
+
+    // Only accessed by the reader thread.
+    std::array<uint32_t, LATENCY_HISTOGRAM_N_BUCKETS> previousCounts;
+    float p50, p99, max; ///< [us].
+    uint32_t windowCount;
+};
+
+#endif // LATENCYHISTOGRAM_H
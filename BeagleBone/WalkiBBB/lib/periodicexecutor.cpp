@@ -0,0 +1,133 @@
+#include "periodicexecutor.h"
+
+#include <cerrno>
+#include <time.h>
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Constructor.
+ * @param nominalPeriod the period the loop should run at.
+ * @param bucketWidth width of the buckets of the jitter histogram [us].
+ */
+PeriodMonitor::PeriodMonitor(microseconds nominalPeriod, float bucketWidth) :
+    nominalPeriod(nominalPeriod),
+    started(false),
+    jitter(bucketWidth),
+    overrunsCount(0)
+{
+
+}
+
+/**
+ * @brief Records the start of a loop iteration.
+ */
+void PeriodMonitor::tick()
+{
+    auto now = steady_clock::now();
+
+    if(started)
+    {
+        auto period = now - lastTick;
+        auto deviation = (period > nominalPeriod) ? (period - nominalPeriod)
+                                                  : (nominalPeriod - period);
+
+        jitter.add(duration<float, micro>(deviation).count());
+
+        if(period > nominalPeriod + nominalPeriod / 2)
+        {
+            overrunsCount.store(overrunsCount.load(memory_order_relaxed) + 1,
+                                memory_order_relaxed);
+        }
+    }
+
+    lastTick = now;
+    started = true;
+}
+
+/**
+ * @brief Forgets the last tick, so that a pause of the loop is not counted as
+ * an overrun. Must be called from the loop thread.
+ */
+void PeriodMonitor::reset()
+{
+    started = false;
+}
+
+/**
+ * @brief Gets the histogram of the deviations from the nominal period.
+ * @return the jitter histogram, in [us].
+ */
+LatencyHistogram &PeriodMonitor::getJitterHistogram()
+{
+    return jitter;
+}
+
+/**
+ * @brief Gets the number of iterations that started more than half a period
+ * late, since the start of the loop.
+ * @return the number of overruns.
+ */
+uint32_t PeriodMonitor::getOverrunsCount() const
+{
+    return overrunsCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Constructor.
+ * @param period the period of the loop.
+ * @param bucketWidth width of the buckets of the jitter histogram [us].
+ */
+PeriodicExecutor::PeriodicExecutor(microseconds period, float bucketWidth) :
+    period(period),
+    monitor(period, bucketWidth)
+{
+
+}
+
+/**
+ * @brief Sets the reference time of the deadlines. Must be called by the loop
+ * thread, just before entering the loop.
+ */
+void PeriodicExecutor::start()
+{
+    deadline = steady_clock::now();
+    monitor.reset();
+    monitor.tick();
+}
+
+/**
+ * @brief Sleeps until the next deadline. Must be called by the loop thread, at
+ * the end of each iteration.
+ */
+void PeriodicExecutor::waitNextPeriod()
+{
+    deadline += period;
+
+    // Skip the deadlines that were already missed.
+    auto now = steady_clock::now();
+    if(now >= deadline)
+        deadline += ((now - deadline) / period + 1) * period;
+
+    // steady_clock is CLOCK_MONOTONIC, sleep until the absolute deadline.
+    auto sinceEpoch = deadline.time_since_epoch();
+    auto secs = duration_cast<seconds>(sinceEpoch);
+    struct timespec ts;
+    ts.tv_sec = secs.count();
+    ts.tv_nsec = duration_cast<nanoseconds>(sinceEpoch - secs).count();
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        ; // Interrupted by a signal, sleep again.
+
+    monitor.tick();
+}
+
+/**
+ * @brief Gets the monitor of the actual period of the loop.
+ * @return the period monitor.
+ */
+PeriodMonitor &PeriodicExecutor::getMonitor()
+{
+    return monitor;
+}
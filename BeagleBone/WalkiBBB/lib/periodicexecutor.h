@@ -0,0 +1,63 @@
+#ifndef PERIODICEXECUTOR_H
+#define PERIODICEXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+
+#include "latencyhistogram.h"
+
+/**
+ * @brief Measures the actual period of a loop that should run at a fixed
+ * rate, on the monotonic clock.
+ *
+ * At each iteration, the deviation from the nominal period is added to a
+ * histogram, and the iteration is counted as an overrun if it came more than
+ * half a period late. tick() is meant to be called by the loop thread, the
+ * statistics can be read from any other single thread.
+ */
+class PeriodMonitor
+{
+public:
+    PeriodMonitor(std::chrono::microseconds nominalPeriod, float bucketWidth);
+
+    void tick();
+    void reset();
+
+    LatencyHistogram &getJitterHistogram();
+    uint32_t getOverrunsCount() const;
+
+private:
+    std::chrono::steady_clock::duration nominalPeriod;
+    std::chrono::steady_clock::time_point lastTick;
+    bool started;
+
+    LatencyHistogram jitter; ///< |actual period - nominal period| [us].
+    std::atomic<uint32_t> overrunsCount;
+};
+
+/**
+ * @brief Paces a loop at a fixed rate, using absolute deadlines on the
+ * monotonic clock, so that the lateness of one iteration does not shift all
+ * the next ones.
+ *
+ * If an iteration takes longer than the period, the missed deadlines are
+ * skipped instead of running the next iterations back-to-back, so the loop
+ * keeps its phase. The actual period is monitored by a PeriodMonitor.
+ */
+class PeriodicExecutor
+{
+public:
+    PeriodicExecutor(std::chrono::microseconds period, float bucketWidth);
+
+    void start();
+    void waitNextPeriod();
+
+    PeriodMonitor &getMonitor();
+
+private:
+    std::chrono::steady_clock::duration period;
+    std::chrono::steady_clock::time_point deadline;
+    PeriodMonitor monitor;
+};
+
+#endif // PERIODICEXECUTOR_H
@@ -0,0 +1,92 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Lock-free queue of values between exactly one writer thread and
+ * exactly one reader thread.
+ *
+ * The values are stored in a ring of N slots. The writer fills the slot at the
+ * head then advances it, the reader copies the slot at the tail then advances
+ * it, so each slot is only accessed by one side at a time. If the reader falls
+ * behind and the ring is full, the new values are dropped and counted, the
+ * writer never waits.
+ * @tparam T the type of the values. It must be copyable.
+ * @tparam N the number of slots, a power of 2.
+ */
+template<typename T, size_t N>
+class SpscRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2.");
+
+public:
+    /**
+     * @brief Constructor.
+     */
+    SpscRing()
+    {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        droppedCount.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Adds a value at the end of the queue. Must only be called from
+     * the writer thread.
+     * @param value the value to add.
+     * @return true if the value was added, false if the ring was full.
+     */
+    bool push(const T &value)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+
+        if(h - tail.load(std::memory_order_acquire) >= N)
+        {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        slots[h & (N - 1)] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest value of the queue. Must only be called from
+     * the reader thread.
+     * @param value the removed value. Unchanged if the queue is empty.
+     * @return true if a value was removed, false if the queue was empty.
+     */
+    bool pop(T &value)
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+
+        if(t == head.load(std::memory_order_acquire))
+            return false;
+
+        value = slots[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Gets the number of values dropped because the ring was full.
+     * Can be called from any thread.
+     * @return the number of dropped values.
+     */
+    uint64_t getDroppedCount() const
+    {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    T slots[N];
+    std::atomic<uint64_t> head; ///< Number of values pushed.
+    std::atomic<uint64_t> tail; ///< Number of values popped.
+    std::atomic<uint64_t> droppedCount;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,156 @@
+#ifndef STAGEPROFILER_H
+#define STAGEPROFILER_H
+
+#include <array>
+#include <cstdint>
+#include <time.h>
+
+/**
+ * @brief Lightweight timing of the successive stages of a loop iteration.
+ *
+ * The profiler is only compiled in if STAGE_PROFILING is defined. Otherwise,
+ * the STAGE_PROFILER_* macros expand to nothing, so that the instrumented code
+ * has no overhead at all. The profiler object itself should also be declared
+ * only if STAGE_PROFILING is defined.
+ *
+ * Usage, inside the loop:
+ * STAGE_PROFILER_BEGIN(profiler);
+ * doFirstStage();
+ * STAGE_PROFILER_MARK(profiler, FIRST_STAGE);
+ * doSecondStage();
+ * STAGE_PROFILER_MARK(profiler, SECOND_STAGE);
+ * STAGE_PROFILER_END(profiler);
+ */
+#ifdef STAGE_PROFILING
+#define STAGE_PROFILER_BEGIN(profiler) (profiler).begin()
+#define STAGE_PROFILER_MARK(profiler, stage) (profiler).mark(stage)
+#define STAGE_PROFILER_END(profiler) (profiler).end()
+#else
+#define STAGE_PROFILER_BEGIN(profiler) ((void)0)
+#define STAGE_PROFILER_MARK(profiler, stage) ((void)0)
+#define STAGE_PROFILER_END(profiler) ((void)0)
+#endif
+
+/**
+ * @brief Records the duration of each stage of the last WINDOW iterations
+ * into a preallocated ring buffer, and computes their rolling min/mean/max.
+ * The timestamps are taken from the monotonic clock. A stage that was not
+ * executed during an iteration counts as a zero duration.
+ * @tparam N_STAGES number of stages.
+ * @tparam WINDOW number of iterations kept in the ring buffer.
+ */
+template<int N_STAGES, int WINDOW>
+class StageProfiler
+{
+public:
+    /**
+     * @brief Rolling statistics of a stage duration [us].
+     */
+    struct StageStats
+    {
+        float min, mean, max;
+    };
+
+    StageProfiler()
+    {
+        for(auto &stageDurations : durations)
+            stageDurations.fill(0);
+        for(auto &s : stats)
+            s = StageStats{0.0f, 0.0f, 0.0f};
+
+        position = 0;
+        filled = 0;
+        lastTimestamp = 0;
+    }
+
+    /**
+     * @brief Starts a new iteration.
+     */
+    inline void begin()
+    {
+        for(int i=0; i<N_STAGES; i++)
+            durations[i][position] = 0;
+
+        lastTimestamp = now();
+    }
+
+    /**
+     * @brief Marks the end of a stage. Its duration is the time elapsed since
+     * the end of the previous stage, or since begin() for the first stage.
+     * @param stage index of the stage that just ended.
+     */
+    inline void mark(int stage)
+    {
+        uint64_t timestamp = now();
+        durations[stage][position] = (uint32_t)(timestamp - lastTimestamp);
+        lastTimestamp = timestamp;
+    }
+
+    /**
+     * @brief Ends the current iteration.
+     */
+    inline void end()
+    {
+        position = (position + 1) % WINDOW;
+        if(filled < WINDOW)
+            filled++;
+    }
+
+    /**
+     * @brief Computes the statistics over the iterations in the ring buffer.
+     * This loops over the whole buffer, so it should not be called at every
+     * iteration.
+     */
+    void updateStats()
+    {
+        if(filled == 0)
+            return;
+
+        for(int i=0; i<N_STAGES; i++)
+        {
+            uint32_t min = UINT32_MAX, max = 0;
+            uint64_t sum = 0;
+
+            for(int j=0; j<filled; j++)
+            {
+                uint32_t d = durations[i][j];
+                if(d < min)
+                    min = d;
+                if(d > max)
+                    max = d;
+                sum += d;
+            }
+
+            stats[i].min = min / 1000.0f;
+            stats[i].mean = (float)sum / filled / 1000.0f;
+            stats[i].max = max / 1000.0f;
+        }
+    }
+
+    /**
+     * @brief Gets the statistics of a stage, as computed by the last call to
+     * updateStats(). The returned reference stays valid, so it can be bound to
+     * SyncVars.
+     * @param stage index of the stage.
+     * @return the min/mean/max durations of the stage [us].
+     */
+    StageStats &getStats(int stage)
+    {
+        return stats[stage];
+    }
+
+private:
+    static inline uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    std::array<std::array<uint32_t, WINDOW>, N_STAGES> durations; ///< [ns].
+    std::array<StageStats, N_STAGES> stats;
+    int position, filled;
+    uint64_t lastTimestamp; ///< [ns].
+};
+
+#endif // STAGEPROFILER_H
@@ -0,0 +1,529 @@
+#include "telemetryrecorder.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "debugstream.h"
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Constructor.
+ */
+TelemetryRecorder::TelemetryRecorder() :
+    nWordChannels(0),
+    nBoolChannels(0),
+    block(nullptr),
+    blockSize(0),
+    blockFields(nullptr),
+    nBlockFields(0),
+    recordSize(0),
+    ringHead(0),
+    ringTail(0),
+    recordsCount(0),
+    droppedCount(0),
+    failing(false),
+    minFreeSpace(TELEMETRY_MIN_FREE_SPACE),
+    writerThread(nullptr),
+    stopWriter(false),
+    startWallTime(0),
+    startMonotonicTime(0),
+    segmentIndex(0),
+    fd(-1),
+    map(nullptr),
+    mapUsed(0)
+{
+
+}
+
+/**
+ * @brief Destructor. Writes the remaining records and closes the file.
+ */
+TelemetryRecorder::~TelemetryRecorder()
+{
+    stop();
+}
+
+/**
+ * @brief Adds a variable to record. Must be called before start().
+ * @param name name of the channel.
+ * @param unit unit of the variable.
+ * @param var the variable. It must stay valid while recording.
+ */
+void TelemetryRecorder::addChannel(const string &name, const string &unit,
+                                   const float &var)
+{
+    addChannel(name, unit, TELEMETRY_FLOAT32, &var);
+}
+
+/**
+ * @brief Adds a variable to record. Must be called before start().
+ * @param name name of the channel.
+ * @param unit unit of the variable.
+ * @param var the variable. It must stay valid while recording.
+ */
+void TelemetryRecorder::addChannel(const string &name, const string &unit,
+                                   const int &var)
+{
+    static_assert(sizeof(int) == 4, "The int channels are recorded on 4 bytes.");
+    addChannel(name, unit, TELEMETRY_INT32, &var);
+}
+
+/**
+ * @brief Adds a variable to record. Must be called before start().
+ * @param name name of the channel.
+ * @param unit unit of the variable.
+ * @param var the variable. It must stay valid while recording.
+ */
+void TelemetryRecorder::addChannel(const string &name, const string &unit,
+                                   const bool &var)
+{
+    addChannel(name, unit, TELEMETRY_BOOL, &var);
+}
+
+void TelemetryRecorder::addChannel(const string &name, const string &unit,
+                                   TelemetryType type, const void *var)
+{
+    if(isRecording())
+        return;
+
+    Channel c;
+    c.name = name.substr(0, 255);
+    c.unit = unit.substr(0, 255);
+    c.type = type;
+    c.var = var;
+    c.offset = 0;
+    c.bit = 0;
+
+    // Keep the 4-byte values first, so that record() copies them in one pass.
+    if(type == TELEMETRY_BOOL)
+    {
+        channels.push_back(c);
+        nBoolChannels++;
+    }
+    else
+    {
+        channels.insert(channels.begin() + nWordChannels, c);
+        nWordChannels++;
+    }
+}
+
+/**
+ * @brief Records a whole block of memory, e.g. a structure grouping the
+ * variables, at the beginning of each record. Its layout is described by a
+ * static table of fields, built with TELEMETRY_FIELD(), so that record() only
+ * copies the block, whatever the number of fields. The bytes of the block
+ * that are not described by a field are recorded but ignored. Must be called
+ * before start().
+ * @param block the block. It must stay valid while recording.
+ * @param size size of the block [B].
+ * @param fields the variables of the block. The table must stay valid while
+ * recording.
+ * @param nFields the number of fields.
+ */
+void TelemetryRecorder::setBlock(const void *block, uint32_t size,
+                                 const TelemetryField *fields, size_t nFields)
+{
+    if(isRecording())
+        return;
+
+    this->block = block;
+    blockSize = size;
+    blockFields = fields;
+    nBlockFields = nFields;
+}
+
+/**
+ * @brief Starts recording, to new segment files named
+ * "<directory>/<prefix>_<date>_<index>.wtlm".
+ * @param directory directory of the files. It is created if needed.
+ * @param prefix beginning of the files names.
+ * @return true if the first file could be created, false otherwise.
+ */
+bool TelemetryRecorder::start(const string &directory, const string &prefix)
+{
+    if(isRecording())
+        return false;
+
+    // Layout of a record: timestamp, block, 4-byte values, then packed
+    // booleans.
+    uint32_t offset = sizeof(int64_t) + blockSize;
+    for(uint32_t i=0; i<nWordChannels; i++)
+    {
+        channels[i].offset = offset;
+        offset += 4;
+    }
+    for(uint32_t i=0; i<nBoolChannels; i++)
+    {
+        channels[nWordChannels + i].offset = offset + i / 8;
+        channels[nWordChannels + i].bit = i % 8;
+    }
+    recordSize = offset + (nBoolChannels + 7) / 8;
+
+    wordVars.clear();
+    boolVars.clear();
+    for(uint32_t i=0; i<nWordChannels; i++)
+        wordVars.push_back(channels[i].var);
+    for(uint32_t i=0; i<nBoolChannels; i++)
+        boolVars.push_back((const bool*)channels[nWordChannels + i].var);
+
+    // Header, identical for all the segments except the counters.
+    startWallTime = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    startMonotonicTime = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+    segmentHeader.assign(sizeof(TelemetrySegmentHeader), 0);
+
+    auto addDescriptor = [this](const string &name, const string &unit,
+                                TelemetryType type, uint32_t offset, uint8_t bit)
+    {
+        TelemetryChannelDescriptor d;
+        d.offset = offset;
+        d.type = type;
+        d.bit = bit;
+        d.nameLength = (uint8_t)name.size();
+        d.unitLength = (uint8_t)unit.size();
+
+        const uint8_t *p = (const uint8_t*)&d;
+        segmentHeader.insert(segmentHeader.end(), p, p + sizeof(d));
+        segmentHeader.insert(segmentHeader.end(), name.begin(), name.end());
+        segmentHeader.insert(segmentHeader.end(), unit.begin(), unit.end());
+    };
+
+    // The booleans of the block are stored as bytes, so their bit 0.
+    for(size_t i=0; i<nBlockFields; i++)
+    {
+        const TelemetryField &f = blockFields[i];
+        addDescriptor(string(f.name).substr(0, 255), string(f.unit).substr(0, 255),
+                      f.type, (uint32_t)sizeof(int64_t) + f.offset, 0);
+    }
+    for(const Channel &c : channels)
+        addDescriptor(c.name, c.unit, c.type, c.offset, c.bit);
+
+    TelemetrySegmentHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TELEMETRY_MAGIC;
+    h.version = TELEMETRY_VERSION;
+    h.nChannels = (uint16_t)(nBlockFields + channels.size());
+    h.headerSize = (uint32_t)segmentHeader.size();
+    h.recordSize = recordSize;
+    h.startWallTime = startWallTime;
+    h.startMonotonicTime = startMonotonicTime;
+    memcpy(segmentHeader.data(), &h, sizeof(h));
+
+    // Name of the files, from the date.
+    mkdir(directory.c_str(), 0755);
+
+    time_t now = time(nullptr);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d_%H_%M_%S", localtime(&now));
+    this->directory = directory;
+    basePath = directory + "/" + prefix + "_" + date;
+
+    segmentIndex = 0;
+    failing = false;
+    if(!openSegment())
+        return false;
+
+    // Start the writer thread, with the default (non real-time) priority.
+    ring.assign((size_t)TELEMETRY_RING_SIZE * recordSize, 0);
+    ringHead = 0;
+    ringTail = 0;
+    recordsCount = 0;
+    droppedCount = 0;
+    stopWriter = false;
+    writerThread = new thread(&TelemetryRecorder::writerLoop, this);
+
+    debug << "Recording " << nBlockFields + channels.size() << " variables (" << recordSize
+          << " bytes/record) to " << basePath << "_*.wtlm." << endl;
+
+    return true;
+}
+
+/**
+ * @brief Stops recording, after writing all the buffered records.
+ */
+void TelemetryRecorder::stop()
+{
+    if(writerThread == nullptr)
+        return;
+
+    stopWriter = true;
+    writerThread->join();
+    delete writerThread;
+    writerThread = nullptr;
+
+    closeSegment();
+}
+
+/**
+ * @brief Checks if the recorder was started.
+ * @return true if recording, false otherwise.
+ */
+bool TelemetryRecorder::isRecording() const
+{
+    return writerThread != nullptr;
+}
+
+/**
+ * @brief Copies the current values of all the channels as a new record. This
+ * is wait-free, and can only be called by a single thread. Does nothing if not
+ * recording.
+ * @param timestamp time of the record, usually monotonic [us].
+ */
+void TelemetryRecorder::record(int64_t timestamp)
+{
+    if(writerThread == nullptr)
+        return;
+
+    uint64_t head = ringHead.load(memory_order_relaxed);
+    if(head - ringTail.load(memory_order_acquire) >= TELEMETRY_RING_SIZE)
+    {
+        droppedCount.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    uint8_t *r = &ring[(head % TELEMETRY_RING_SIZE) * recordSize];
+
+    memcpy(r, &timestamp, sizeof(timestamp));
+    r += sizeof(timestamp);
+
+    if(blockSize > 0)
+    {
+        memcpy(r, block, blockSize);
+        r += blockSize;
+    }
+
+    for(uint32_t i=0; i<nWordChannels; i++)
+        memcpy(r + 4*i, wordVars[i], 4);
+    r += 4*nWordChannels;
+
+    for(uint32_t i=0; i<nBoolChannels; i+=8)
+    {
+        uint8_t bits = 0;
+        for(uint32_t j=i; j<nBoolChannels && j<i+8; j++)
+            bits |= (uint8_t)((*boolVars[j] ? 1 : 0) << (j - i));
+        r[i/8] = bits;
+    }
+
+    ringHead.store(head + 1, memory_order_release);
+}
+
+/**
+ * @brief Gets the size of a record.
+ * @return the size of a record [B], once started.
+ */
+uint32_t TelemetryRecorder::getRecordSize() const
+{
+    return recordSize;
+}
+
+/**
+ * @brief Gets the number of records written to the files.
+ * @return the number of records since start().
+ */
+uint64_t TelemetryRecorder::getRecordsCount() const
+{
+    return recordsCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the number of records dropped because the ring was full.
+ * @return the number of dropped records since start().
+ */
+uint64_t TelemetryRecorder::getDroppedCount() const
+{
+    return droppedCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Checks if the records are dropped because the last segment file could
+ * not be created, e.g. when the disk is full.
+ * @return true if no segment is open while recording, false otherwise.
+ */
+bool TelemetryRecorder::isFailing() const
+{
+    return failing.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Sets the space to leave free on the disk: a segment is not created if
+ * the free space would be smaller after it. It applies from the next segment.
+ * @param size the free space [B], TELEMETRY_MIN_FREE_SPACE by default.
+ */
+void TelemetryRecorder::setMinFreeSpace(uint64_t size)
+{
+    minFreeSpace.store(size, memory_order_relaxed);
+}
+
+/**
+ * @brief Loop of the writer thread: periodically moves the records from the
+ * ring to the segment files, until stopped and the ring is empty.
+ */
+void TelemetryRecorder::writerLoop()
+{
+    while(true)
+    {
+        bool stopping = stopWriter.load();
+        uint64_t tail = ringTail.load(memory_order_relaxed);
+        uint64_t head = ringHead.load(memory_order_acquire);
+
+        if(head == tail)
+        {
+            if(stopping)
+                break;
+
+            this_thread::sleep_for(milliseconds(TELEMETRY_WRITER_PERIOD));
+            continue;
+        }
+
+        uint64_t written = 0;
+        for(; tail != head; tail++)
+        {
+            if(map != nullptr && mapUsed + recordSize > TELEMETRY_SEGMENT_SIZE)
+            {
+                closeSegment();
+                segmentIndex++;
+                openSegment();
+            }
+            else if(map == nullptr && steady_clock::now() >= nextOpenAttempt)
+                openSegment();
+
+            if(map == nullptr) // The file could not be created.
+            {
+                droppedCount.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+
+            memcpy(map + mapUsed, &ring[(tail % TELEMETRY_RING_SIZE) * recordSize],
+                   recordSize);
+            mapUsed += recordSize;
+            written++;
+        }
+
+        ringTail.store(tail, memory_order_release);
+
+        updateSegmentHeader();
+
+        recordsCount.store(recordsCount.load(memory_order_relaxed) + written,
+                           memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Creates the next segment file, maps it to memory and writes its
+ * header. It is only created if enough space would stay free on the disk.
+ * @return true if the file could be created, false otherwise.
+ */
+bool TelemetryRecorder::openSegment()
+{
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%03u.wtlm", segmentIndex);
+    string path = basePath + suffix;
+
+    struct statvfs fs;
+    if(statvfs(directory.c_str(), &fs) == 0 &&
+       (uint64_t)fs.f_bavail * fs.f_frsize <
+       TELEMETRY_SEGMENT_SIZE + minFreeSpace.load(memory_order_relaxed))
+    {
+        return openSegmentFailed("Not enough free space for " + path + ".");
+    }
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return openSegmentFailed("Could not create " + path + ".");
+
+    // Allocate the disk blocks of the full segment, otherwise writing to the
+    // mapping raises SIGBUS if the disk gets full. It is truncated when closed.
+    if(posix_fallocate(fd, 0, TELEMETRY_SEGMENT_SIZE) != 0)
+    {
+        close(fd);
+        fd = -1;
+        unlink(path.c_str());
+        return openSegmentFailed("Could not allocate " + path + ".");
+    }
+
+    void *p = mmap(nullptr, TELEMETRY_SEGMENT_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+    {
+        close(fd);
+        fd = -1;
+        unlink(path.c_str());
+        return openSegmentFailed("Could not map " + path + ".");
+    }
+
+    if(failing.load(memory_order_relaxed))
+        debug << "Recording the telemetry again, to " << path << "." << endl;
+    failing.store(false, memory_order_relaxed);
+
+    map = (uint8_t*)p;
+    memcpy(map, segmentHeader.data(), segmentHeader.size());
+    memcpy(map + offsetof(TelemetrySegmentHeader, segmentIndex), &segmentIndex,
+           sizeof(segmentIndex));
+    mapUsed = segmentHeader.size();
+
+    return true;
+}
+
+/**
+ * @brief Marks the recording as failing after a segment could not be created,
+ * and delays the next attempt by TELEMETRY_RETRY_PERIOD.
+ * @param message description of the error, only logged at the first failure.
+ * @return false.
+ */
+bool TelemetryRecorder::openSegmentFailed(const string &message)
+{
+    if(!failing.load(memory_order_relaxed))
+    {
+        debug << message << (isRecording() ? " The telemetry is dropped until a"
+                                             " segment can be created." : "")
+              << endl;
+    }
+
+    failing.store(true, memory_order_relaxed);
+    nextOpenAttempt = steady_clock::now() + milliseconds(TELEMETRY_RETRY_PERIOD);
+    return false;
+}
+
+/**
+ * @brief Writes the number of records of the current segment to its header.
+ */
+void TelemetryRecorder::updateSegmentHeader()
+{
+    if(map == nullptr)
+        return;
+
+    uint64_t nRecords = (mapUsed - segmentHeader.size()) / recordSize;
+    memcpy(map + offsetof(TelemetrySegmentHeader, nRecords), &nRecords,
+           sizeof(nRecords));
+}
+
+/**
+ * @brief Unmaps the current segment file, and truncates it to the records
+ * actually written. The header is updated first, since a segment can be closed
+ * in the middle of a batch of records.
+ */
+void TelemetryRecorder::closeSegment()
+{
+    if(map == nullptr)
+        return;
+
+    updateSegmentHeader();
+    munmap(map, TELEMETRY_SEGMENT_SIZE);
+    map = nullptr;
+
+    if(ftruncate(fd, mapUsed) != 0)
+        debug << "Could not truncate the telemetry file." << endl;
+    close(fd);
+    fd = -1;
+}
@@ -0,0 +1,202 @@
+#ifndef TELEMETRYRECORDER_H
+#define TELEMETRYRECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define TELEMETRY_MAGIC 0x4D4C5457      ///< "WTLM", little-endian.
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING_SIZE 2048        ///< No. of records buffered between the threads.
+#define TELEMETRY_SEGMENT_SIZE (32*1024*1024) ///< Max. size of a segment file [B].
+#define TELEMETRY_WRITER_PERIOD 20      ///< Sleep period of the writer thread [ms].
+#define TELEMETRY_MIN_FREE_SPACE (64*1024*1024) ///< Free space left on the disk by the segments [B].
+#define TELEMETRY_RETRY_PERIOD 1000     ///< Min. period between the attempts to create a segment [ms].
+
+enum TelemetryType : uint8_t
+{
+    TELEMETRY_FLOAT32 = 0,  ///< 4 bytes at the channel offset.
+    TELEMETRY_INT32,        ///< 4 bytes at the channel offset.
+    TELEMETRY_BOOL          ///< 1 bit of the byte at the channel offset.
+};
+
+/**
+ * @brief Telemetry type of a C++ type, to check the fields of a block at
+ * compile time. Only float, int and bool can be recorded.
+ */
+template<typename T> struct TelemetryTypeOf;
+template<> struct TelemetryTypeOf<float> { static const TelemetryType value = TELEMETRY_FLOAT32; };
+template<> struct TelemetryTypeOf<int> { static const TelemetryType value = TELEMETRY_INT32; };
+template<> struct TelemetryTypeOf<bool> { static const TelemetryType value = TELEMETRY_BOOL; };
+
+/**
+ * @brief Variable of a block recorded as a whole, see
+ * TelemetryRecorder::setBlock(). The tables of fields are built at compile
+ * time with TELEMETRY_FIELD().
+ */
+struct TelemetryField
+{
+    const char *name;
+    const char *unit;
+    TelemetryType type;
+    uint32_t offset;    ///< Offset of the value in the block [B].
+};
+
+/**
+ * @brief Describes a member of a block structure as a TelemetryField, with its
+ * type and offset computed by the compiler.
+ * @param Block the structure, with a standard layout.
+ * @param name name of the channel.
+ * @param unit unit of the variable.
+ * @param member the member, e.g. "angles[0]".
+ */
+#define TELEMETRY_FIELD(Block, name, unit, member) \
+    { name, unit, \
+      TelemetryTypeOf<std::remove_cv<std::remove_reference< \
+          decltype(((Block*)nullptr)->member)>::type>::type>::value, \
+      (uint32_t)offsetof(Block, member) }
+
+/**
+ * @brief Header at the beginning of each segment file. It is followed by one
+ * TelemetryChannelDescriptor per channel, then by the records, starting at
+ * headerSize. All the values are little-endian.
+ */
+struct TelemetrySegmentHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t nChannels;
+    uint32_t headerSize;        ///< Offset of the first record [B].
+    uint32_t recordSize;        ///< [B].
+    int64_t startWallTime;      ///< Wall clock time at the recording start [us].
+    int64_t startMonotonicTime; ///< Monotonic time at the recording start [us].
+    uint64_t nRecords;          ///< Updated after each batch of records.
+    uint32_t segmentIndex;      ///< Index of the file in the recording.
+    uint32_t reserved;
+};
+
+/**
+ * @brief Description of a channel, in the header of the segment files. It is
+ * followed by the characters of the name, then of the unit, without
+ * terminating zeros.
+ */
+struct TelemetryChannelDescriptor
+{
+    uint32_t offset;    ///< Offset of the value in the record [B].
+    uint8_t type;       ///< TelemetryType.
+    uint8_t bit;        ///< Bit index, for TELEMETRY_BOOL.
+    uint8_t nameLength;
+    uint8_t unitLength;
+};
+
+/**
+ * @brief Records variables at a high rate into compact binary files.
+ *
+ * The variables are registered once as channels, which fixes the layout of
+ * the records: a 64-bit timestamp, the 4-byte values, then the booleans packed
+ * as bits. record() copies the current values into a ring buffer, without any
+ * lock, allocation or system call, so it can be called from the control loop.
+ *
+ * The variables can also be grouped in a block of memory, described by a
+ * static table of fields (setBlock()). The block is then copied as is, with a
+ * single memcpy(), right after the timestamp, whatever the number of fields.
+ * A low-priority writer thread moves the records from the ring to memory-
+ * mapped segment files. If the writer falls behind and the ring is full, the
+ * new records are dropped and counted, the control loop is never blocked.
+ *
+ * The disk blocks of a segment are allocated when it is created, so that
+ * writing to the mapping cannot fail later. A segment is only created if
+ * TELEMETRY_MIN_FREE_SPACE would still be free after it. Otherwise, or if the
+ * file cannot be created, the records are dropped, isFailing() returns true,
+ * and the writer tries again every TELEMETRY_RETRY_PERIOD.
+ *
+ * Each segment file starts with the schema, so it can be decoded on its own,
+ * e.g. by tools/telemetry2csv.
+ */
+class TelemetryRecorder
+{
+public:
+    TelemetryRecorder();
+    ~TelemetryRecorder();
+
+    void addChannel(const std::string &name, const std::string &unit,
+                    const float &var);
+    void addChannel(const std::string &name, const std::string &unit,
+                    const int &var);
+    void addChannel(const std::string &name, const std::string &unit,
+                    const bool &var);
+    void setBlock(const void *block, uint32_t size,
+                  const TelemetryField *fields, size_t nFields);
+
+    bool start(const std::string &directory, const std::string &prefix);
+    void stop();
+    bool isRecording() const;
+
+    void record(int64_t timestamp);
+
+    uint32_t getRecordSize() const;
+    uint64_t getRecordsCount() const;
+    uint64_t getDroppedCount() const;
+    bool isFailing() const;
+
+    void setMinFreeSpace(uint64_t size);
+
+private:
+    struct Channel
+    {
+        std::string name, unit;
+        TelemetryType type;
+        const void *var;
+        uint32_t offset;
+        uint8_t bit;
+    };
+
+    void addChannel(const std::string &name, const std::string &unit,
+                    TelemetryType type, const void *var);
+    void writerLoop();
+    bool openSegment();
+    bool openSegmentFailed(const std::string &message);
+    void updateSegmentHeader();
+    void closeSegment();
+
+    std::vector<Channel> channels;
+    uint32_t nWordChannels, nBoolChannels;
+
+    // Block copied as is, stored from offset 8.
+    const void *block;
+    uint32_t blockSize; ///< [B].
+    const TelemetryField *blockFields;
+    size_t nBlockFields;
+
+    // Compact copy of the variables pointers, for record().
+    std::vector<const void*> wordVars;  ///< Stored after the block, 4 bytes each.
+    std::vector<const bool*> boolVars;  ///< Stored as bits after the words.
+    uint32_t recordSize; ///< [B].
+
+    // Ring of records, filled by record() and emptied by the writer thread.
+    std::vector<uint8_t> ring;
+    std::atomic<uint64_t> ringHead, ringTail;
+    std::atomic<uint64_t> recordsCount, droppedCount;
+    std::atomic<bool> failing;          ///< No segment is open, the records are dropped.
+    std::atomic<uint64_t> minFreeSpace; ///< [B].
+
+    std::thread *writerThread;
+    std::atomic<bool> stopWriter;
+
+    // Only accessed by the writer thread, while recording.
+    std::string directory, basePath;
+    std::vector<uint8_t> segmentHeader;
+    int64_t startWallTime, startMonotonicTime; ///< [us].
+    uint32_t segmentIndex;
+    int fd;
+    uint8_t *map;
+    size_t mapUsed; ///< [B].
+    std::chrono::steady_clock::time_point nextOpenAttempt;
+};
+
+#endif // TELEMETRYRECORDER_H
@@ -0,0 +1,543 @@
+#include "telemetrystreamer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "debugstream.h"
+
+using namespace std;
+using namespace chrono;
+
+const float MAX_QUANTIZED_FLOAT = 2147483520.0f; // Largest float below 2^31.
+
+/**
+ * @brief Quantizes the value of a field, as sent in the stream.
+ * @param values the block.
+ * @param field the field.
+ * @return the quantized value.
+ */
+static int32_t quantize(const uint8_t *values, const TelemetryField &field)
+{
+    switch(field.type)
+    {
+    case TELEMETRY_FLOAT32:
+    {
+        float v;
+        memcpy(&v, values + field.offset, sizeof(v));
+        if(!isfinite(v))
+            return STREAM_NAN;
+
+        float q = v / STREAM_RESOLUTION;
+        q = min(max(q, -MAX_QUANTIZED_FLOAT), MAX_QUANTIZED_FLOAT);
+        return (int32_t)lroundf(q);
+    }
+    case TELEMETRY_INT32:
+    {
+        int32_t v;
+        memcpy(&v, values + field.offset, sizeof(v));
+        return v;
+    }
+    default: // TELEMETRY_BOOL, stored as a byte in the block.
+        return (values[field.offset] & 1) ? 1 : 0;
+    }
+}
+
+/**
+ * @brief Constructor.
+ */
+TelemetryStreamer::TelemetryStreamer() :
+    block(nullptr),
+    blockSize(0),
+    fields(nullptr),
+    nFields(0),
+    snapshotSize(0),
+    ringHead(0),
+    ringTail(0),
+    senderThread(nullptr),
+    stopSender(false),
+    clientConnected(false),
+    decimation(1),
+    droppedCount(0),
+    sentFramesCount(0),
+    sentBytesCount(0),
+    listenFd(-1),
+    clientFd(-1),
+    pendingSent(0),
+    messageStart(0),
+    lastTimestamp(0),
+    keyframeSent(false),
+    snapshotsCount(0),
+    skippedCount(0),
+    dropsSinceFrame(0)
+{
+
+}
+
+/**
+ * @brief Destructor. Closes the connection.
+ */
+TelemetryStreamer::~TelemetryStreamer()
+{
+    stop();
+}
+
+/**
+ * @brief Sets the block of memory to stream, described by a static table of
+ * fields, built with TELEMETRY_FIELD(). Must be called before start().
+ * @param block the block. It must stay valid while streaming.
+ * @param size size of the block [B].
+ * @param fields the variables of the block. The table must stay valid while
+ * streaming.
+ * @param nFields the number of fields.
+ */
+void TelemetryStreamer::setBlock(const void *block, uint32_t size,
+                                 const TelemetryField *fields, size_t nFields)
+{
+    if(isStreaming())
+        return;
+
+    this->block = block;
+    blockSize = size;
+    this->fields = fields;
+    this->nFields = nFields;
+}
+
+/**
+ * @brief Starts listening for a client, and streaming to it once connected.
+ * @param port TCP port to listen on.
+ * @return true if the port could be opened, false otherwise.
+ */
+bool TelemetryStreamer::start(int port)
+{
+    if(isStreaming())
+        return false;
+
+    // Largest message: the schema, or a delta where all the fields changed.
+    size_t schemaSize = 3 + sizeof(uint16_t) + sizeof(float);
+    for(size_t i=0; i<nFields; i++)
+        schemaSize += 3 + min(strlen(fields[i].name), (size_t)255) +
+                      min(strlen(fields[i].unit), (size_t)255);
+    size_t frameSize = 3 + 3*10 + (nFields + 7) / 8 + nFields * 5;
+
+    if(max(schemaSize, frameSize) > STREAM_MAX_MESSAGE_SIZE)
+    {
+        debug << "Too many variables to stream." << endl;
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listenFd < 0)
+    {
+        debug << "Could not create the telemetry stream socket." << endl;
+        return false;
+    }
+
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t)port);
+
+    if(bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(listenFd, 1) != 0)
+    {
+        debug << "Could not listen on port " << port << " for the telemetry stream." << endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+
+    // Reserve everything now, so that the sender never allocates.
+    snapshotSize = sizeof(int64_t) + blockSize;
+    ring.assign((size_t)STREAM_RING_SIZE * snapshotSize, 0);
+    ringHead = 0;
+    ringTail = 0;
+    pending.reserve(2 * STREAM_MAX_MESSAGE_SIZE);
+    lastValues.assign(nFields, 0);
+
+    droppedCount = 0;
+    sentFramesCount = 0;
+    sentBytesCount = 0;
+    stopSender = false;
+    senderThread = new thread(&TelemetryStreamer::senderLoop, this);
+
+    debug << "Streaming " << nFields << " variables on port " << port << "." << endl;
+
+    return true;
+}
+
+/**
+ * @brief Stops streaming, and closes the connection.
+ */
+void TelemetryStreamer::stop()
+{
+    if(senderThread == nullptr)
+        return;
+
+    stopSender = true;
+    senderThread->join();
+    delete senderThread;
+    senderThread = nullptr;
+
+    closeClient();
+    close(listenFd);
+    listenFd = -1;
+}
+
+/**
+ * @brief Checks if the streamer was started.
+ * @return true if streaming or waiting for a client, false otherwise.
+ */
+bool TelemetryStreamer::isStreaming() const
+{
+    return senderThread != nullptr;
+}
+
+/**
+ * @brief Copies the current values of the block, to be streamed. This is
+ * wait-free, and can only be called by a single thread. Does nothing if no
+ * client is connected.
+ * @param timestamp time of the snapshot, usually monotonic [us].
+ */
+void TelemetryStreamer::push(int64_t timestamp)
+{
+    if(!clientConnected.load(memory_order_relaxed))
+        return;
+
+    uint64_t head = ringHead.load(memory_order_relaxed);
+    if(head - ringTail.load(memory_order_acquire) >= STREAM_RING_SIZE)
+    {
+        droppedCount.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    uint8_t *s = &ring[(head % STREAM_RING_SIZE) * snapshotSize];
+    memcpy(s, &timestamp, sizeof(timestamp));
+    memcpy(s + sizeof(timestamp), block, blockSize);
+
+    ringHead.store(head + 1, memory_order_release);
+}
+
+/**
+ * @brief Checks if a client is connected.
+ * @return true if connected, false otherwise.
+ */
+bool TelemetryStreamer::hasClient() const
+{
+    return clientConnected.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the current decimation, adapted to the link.
+ * @return the number of snapshots per frame sent.
+ */
+int TelemetryStreamer::getDecimation() const
+{
+    return decimation.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the number of frames dropped because the link or the sender
+ * thread was too slow. The snapshots skipped by the decimation are not
+ * counted.
+ * @return the number of dropped frames since start().
+ */
+uint64_t TelemetryStreamer::getDroppedCount() const
+{
+    return droppedCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the number of frames sent.
+ * @return the number of frames since start().
+ */
+uint64_t TelemetryStreamer::getSentFramesCount() const
+{
+    return sentFramesCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the number of bytes accepted by the socket.
+ * @return the number of bytes since start() [B].
+ */
+uint64_t TelemetryStreamer::getSentBytesCount() const
+{
+    return sentBytesCount.load(memory_order_relaxed);
+}
+
+/**
+ * @brief Loop of the sender thread: accepts a client, then periodically
+ * encodes the snapshots of the ring as frames, and adapts the decimation to
+ * the speed of the link.
+ */
+void TelemetryStreamer::senderLoop()
+{
+    lastCongestion = steady_clock::now();
+
+    while(!stopSender.load())
+    {
+        if(clientFd < 0)
+            acceptClient();
+
+        if(clientFd >= 0 && !flush())
+            closeClient();
+
+        bool congested = false;
+        uint64_t tail = ringTail.load(memory_order_relaxed);
+        uint64_t head = ringHead.load(memory_order_acquire);
+
+        for(; tail != head; tail++)
+        {
+            if(clientFd < 0)
+                continue;
+
+            snapshotsCount++;
+            if(keyframeSent && snapshotsCount % decimation.load() != 0)
+            {
+                skippedCount++;
+                continue;
+            }
+
+            // The link is too slow to take this frame. The keyframe just waits
+            // for the schema.
+            if(isLinkCongested())
+            {
+                if(keyframeSent)
+                {
+                    dropsSinceFrame++;
+                    droppedCount.fetch_add(1, memory_order_relaxed);
+                    congested = true;
+                }
+                continue;
+            }
+
+            encodeFrame(&ring[(tail % STREAM_RING_SIZE) * snapshotSize], !keyframeSent);
+            keyframeSent = true;
+
+            if(!flush())
+                closeClient();
+        }
+
+        ringTail.store(tail, memory_order_release);
+
+        // Halve the frame rate on congestion, then raise it slowly again, by
+        // about 1/8 per STREAM_RECOVERY_PERIOD.
+        steady_clock::time_point now = steady_clock::now();
+        if(congested && now - lastCongestion >= milliseconds(STREAM_BACKOFF_PERIOD))
+        {
+            decimation = min(2 * decimation.load(), STREAM_MAX_DECIMATION);
+            lastCongestion = now;
+        }
+        else if(decimation.load() > 1 &&
+                now - lastCongestion >= milliseconds(STREAM_RECOVERY_PERIOD))
+        {
+            decimation -= max(1, decimation.load() / 8);
+            lastCongestion = now;
+        }
+
+        this_thread::sleep_for(milliseconds(STREAM_SENDER_PERIOD));
+    }
+}
+
+/**
+ * @brief Accepts a waiting client, if any, and queues the schema for it.
+ */
+void TelemetryStreamer::acceptClient()
+{
+    sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    int fd = accept(listenFd, (sockaddr*)&address, &addressLength);
+    if(fd < 0)
+        return;
+
+    // Small send buffer, so that a slow link is detected before the frames
+    // queued in the kernel are seconds late.
+    int bufferSize = STREAM_SOCKET_BUFFER;
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    clientFd = fd;
+    debug << "Telemetry stream client connected (" << inet_ntoa(address.sin_addr)
+          << ")." << endl;
+
+    pending.clear();
+    pendingSent = 0;
+
+    beginMessage(STREAM_SCHEMA);
+    uint16_t n = (uint16_t)nFields;
+    float resolution = STREAM_RESOLUTION;
+    pending.insert(pending.end(), (const uint8_t*)&n, (const uint8_t*)&n + sizeof(n));
+    pending.insert(pending.end(), (const uint8_t*)&resolution,
+                   (const uint8_t*)&resolution + sizeof(resolution));
+    for(size_t i=0; i<nFields; i++)
+    {
+        size_t nameLength = min(strlen(fields[i].name), (size_t)255);
+        size_t unitLength = min(strlen(fields[i].unit), (size_t)255);
+        pending.push_back(fields[i].type);
+        pending.push_back((uint8_t)nameLength);
+        pending.push_back((uint8_t)unitLength);
+        pending.insert(pending.end(), fields[i].name, fields[i].name + nameLength);
+        pending.insert(pending.end(), fields[i].unit, fields[i].unit + unitLength);
+    }
+    endMessage();
+
+    keyframeSent = false;
+    snapshotsCount = 0;
+    skippedCount = 0;
+    dropsSinceFrame = 0;
+    decimation = 1;
+    lastCongestion = steady_clock::now();
+
+    // Discard the snapshots pushed before the connection.
+    ringTail.store(ringHead.load(memory_order_acquire), memory_order_release);
+    clientConnected = true;
+}
+
+/**
+ * @brief Closes the connection with the client, if any. The next client can
+ * then connect.
+ */
+void TelemetryStreamer::closeClient()
+{
+    if(clientFd < 0)
+        return;
+
+    clientConnected = false;
+    close(clientFd);
+    clientFd = -1;
+    pending.clear();
+    pendingSent = 0;
+
+    debug << "Telemetry stream client disconnected." << endl;
+}
+
+/**
+ * @brief Writes as much of the pending bytes as the socket accepts, without
+ * blocking.
+ * @return false if the connection failed, true otherwise.
+ */
+bool TelemetryStreamer::flush()
+{
+    while(pendingSent < pending.size())
+    {
+        ssize_t n = send(clientFd, pending.data() + pendingSent,
+                         pending.size() - pendingSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+
+        pendingSent += (size_t)n;
+        sentBytesCount.fetch_add((uint64_t)n, memory_order_relaxed);
+    }
+
+    pending.clear();
+    pendingSent = 0;
+    return true;
+}
+
+/**
+ * @brief Checks if the link can take a new frame now: the previous one must be
+ * fully written to the socket, and most of the data sent acknowledged by the
+ * client. Otherwise, the frame would wait in the kernel buffers and arrive
+ * late.
+ * @return true if the next frame should be dropped, false otherwise.
+ */
+bool TelemetryStreamer::isLinkCongested()
+{
+    if(pendingSent < pending.size())
+        return true;
+
+    int queued = 0;
+    return ioctl(clientFd, SIOCOUTQ, &queued) == 0 && queued > STREAM_MAX_QUEUED;
+}
+
+/**
+ * @brief Encodes a snapshot as a frame, after the pending bytes.
+ * @param snapshot the snapshot: timestamp then block.
+ * @param keyframe true to send the absolute values, false to send only the
+ * changes since the last frame.
+ */
+void TelemetryStreamer::encodeFrame(const uint8_t *snapshot, bool keyframe)
+{
+    int64_t timestamp;
+    memcpy(&timestamp, snapshot, sizeof(timestamp));
+    const uint8_t *values = snapshot + sizeof(timestamp);
+
+    beginMessage(keyframe ? STREAM_KEYFRAME : STREAM_DELTA);
+    streamPutVarint(pending, keyframe ? timestamp : timestamp - lastTimestamp);
+    streamPutVarint(pending, skippedCount);
+    streamPutVarint(pending, dropsSinceFrame);
+
+    if(keyframe)
+    {
+        for(size_t i=0; i<nFields; i++)
+        {
+            lastValues[i] = quantize(values, fields[i]);
+            streamPutVarint(pending, lastValues[i]);
+        }
+    }
+    else
+    {
+        size_t mask = pending.size();
+        pending.resize(mask + (nFields + 7) / 8, 0);
+
+        for(size_t i=0; i<nFields; i++)
+        {
+            int32_t q = quantize(values, fields[i]);
+            if(q == lastValues[i])
+                continue;
+
+            pending[mask + i/8] |= (uint8_t)(1 << (i % 8));
+            streamPutVarint(pending, (int64_t)q - lastValues[i]);
+            lastValues[i] = q;
+        }
+    }
+
+    endMessage();
+
+    lastTimestamp = timestamp;
+    skippedCount = 0;
+    dropsSinceFrame = 0;
+    sentFramesCount.fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Starts a new message after the pending bytes.
+ * @param type the type of the message.
+ */
+void TelemetryStreamer::beginMessage(StreamMessageType type)
+{
+    messageStart = pending.size();
+    pending.push_back(0); // Length, set by endMessage().
+    pending.push_back(0);
+    pending.push_back(type);
+}
+
+/**
+ * @brief Writes the length of the message started by beginMessage().
+ */
+void TelemetryStreamer::endMessage()
+{
+    uint16_t length = (uint16_t)(pending.size() - messageStart - sizeof(uint16_t));
+    memcpy(&pending[messageStart], &length, sizeof(length));
+}
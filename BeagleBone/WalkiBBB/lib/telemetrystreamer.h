@@ -0,0 +1,170 @@
+#ifndef TELEMETRYSTREAMER_H
+#define TELEMETRYSTREAMER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "telemetryrecorder.h"
+
+#define STREAM_RING_SIZE 256            ///< No. of snapshots buffered between the threads.
+#define STREAM_SENDER_PERIOD 5          ///< Sleep period of the sender thread [ms].
+#define STREAM_SOCKET_BUFFER (16*1024)  ///< Send buffer of the socket [B].
+#define STREAM_MAX_QUEUED 4096          ///< Max. bytes not acknowledged by the client before
+                                        ///< dropping frames, i.e. max. latency on a slow link [B].
+#define STREAM_RESOLUTION 1e-4f         ///< Quantization step of the float values.
+#define STREAM_MAX_DECIMATION 64        ///< Max. No. of snapshots per sent frame.
+#define STREAM_BACKOFF_PERIOD 250       ///< Min. time between two increases of the decimation [ms].
+#define STREAM_RECOVERY_PERIOD 500      ///< Time without drop before sending more often [ms].
+#define STREAM_MAX_MESSAGE_SIZE 65535   ///< [B].
+
+/**
+ * @brief Type of the messages of the stream. Each message is a 16-bit
+ * little-endian length (type and payload), the type, then the payload.
+ *
+ * - STREAM_SCHEMA, sent first: the number of fields (uint16), the resolution
+ *   (float), then for each field its type, the lengths of its name and unit,
+ *   and their characters.
+ * - STREAM_KEYFRAME, sent after the schema: the timestamp [us], the snapshots
+ *   skipped by the decimation and dropped since the previous frame, then the
+ *   quantized value of each field.
+ * - STREAM_DELTA: the time since the previous frame [us], the skipped and
+ *   dropped snapshots, a bitmask of the fields that changed (1 bit per field,
+ *   LSB first), then the change of each of them.
+ *
+ * The integers of the payloads are zigzag varints, except where noted. The
+ * floats are quantized as round(value / resolution), the booleans as 0 or 1.
+ */
+enum StreamMessageType : uint8_t
+{
+    STREAM_SCHEMA = 0,
+    STREAM_KEYFRAME,
+    STREAM_DELTA
+};
+
+const int32_t STREAM_NAN = INT32_MIN; ///< Quantized value of the non-finite floats.
+
+/**
+ * @brief Appends a signed integer as a zigzag varint: 7 bits per byte, LSB
+ * first, small absolute values in few bytes.
+ * @param out the buffer.
+ * @param value the integer.
+ */
+inline void streamPutVarint(std::vector<uint8_t> &out, int64_t value)
+{
+    uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    while(v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+/**
+ * @brief Reads a zigzag varint written by streamPutVarint().
+ * @param p the current position, advanced after the integer.
+ * @param end the end of the buffer.
+ * @param value the integer.
+ * @return true if the integer was complete, false otherwise.
+ */
+inline bool streamGetVarint(const uint8_t *&p, const uint8_t *end, int64_t &value)
+{
+    uint64_t v = 0;
+    for(int shift=0; shift<64; shift+=7)
+    {
+        if(p >= end)
+            return false;
+
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+        {
+            value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Streams variables to a remote client over TCP, with delta
+ * compression, adapting the rate to what the link can carry.
+ *
+ * The variables are a block of memory described by a static table of fields,
+ * as for TelemetryRecorder::setBlock(). push() copies the block into a ring
+ * buffer, without any lock, allocation or system call, so it can be called
+ * from the control loop. A low-priority sender thread accepts one client at a
+ * time, and sends one frame per DECIMATION snapshots: only the fields whose
+ * quantized value changed since the last frame sent, as varint deltas.
+ *
+ * The socket never blocks. If the previous frame is still not fully written
+ * when the next one is due, or if more than STREAM_MAX_QUEUED bytes are not
+ * acknowledged by the client yet, the link is too slow: the frame is dropped
+ * and counted, and the decimation is doubled. It is decreased again by about
+ * 1/8 per STREAM_RECOVERY_PERIOD without drop. As the deltas are relative to the last
+ * frame actually sent, the dropped frames do not corrupt the stream.
+ */
+class TelemetryStreamer
+{
+public:
+    TelemetryStreamer();
+    ~TelemetryStreamer();
+
+    void setBlock(const void *block, uint32_t size,
+                  const TelemetryField *fields, size_t nFields);
+
+    bool start(int port);
+    void stop();
+    bool isStreaming() const;
+
+    void push(int64_t timestamp);
+
+    bool hasClient() const;
+    int getDecimation() const;
+    uint64_t getDroppedCount() const;
+    uint64_t getSentFramesCount() const;
+    uint64_t getSentBytesCount() const;
+
+private:
+    void senderLoop();
+    void acceptClient();
+    void closeClient();
+    bool flush();
+    bool isLinkCongested();
+    void encodeFrame(const uint8_t *snapshot, bool keyframe);
+    void beginMessage(StreamMessageType type);
+    void endMessage();
+
+    const void *block;
+    uint32_t blockSize;     ///< [B].
+    const TelemetryField *fields;
+    size_t nFields;
+    uint32_t snapshotSize;  ///< Timestamp and block [B].
+
+    // Ring of snapshots, filled by push() and emptied by the sender thread.
+    std::vector<uint8_t> ring;
+    std::atomic<uint64_t> ringHead, ringTail;
+
+    std::thread *senderThread;
+    std::atomic<bool> stopSender;
+    std::atomic<bool> clientConnected;
+    std::atomic<int> decimation;
+    std::atomic<uint64_t> droppedCount, sentFramesCount, sentBytesCount;
+
+    // Only accessed by the sender thread.
+    int listenFd, clientFd;
+    std::vector<uint8_t> pending;   ///< Bytes not yet accepted by the socket.
+    size_t pendingSent;             ///< [B].
+    size_t messageStart;            ///< Position of the message being encoded.
+    std::vector<int32_t> lastValues; ///< Quantized values of the last frame sent.
+    int64_t lastTimestamp;          ///< Of the last frame sent [us].
+    bool keyframeSent;
+    uint64_t snapshotsCount;        ///< Since the client connected.
+    uint32_t skippedCount, dropsSinceFrame; ///< Since the last frame sent.
+    std::chrono::steady_clock::time_point lastCongestion;
+};
+
+#endif // TELEMETRYSTREAMER_H
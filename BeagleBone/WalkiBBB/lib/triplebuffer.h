@@ -0,0 +1,83 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Wait-free exchange of a value between exactly one writer thread and
+ * exactly one reader thread.
+ *
+ * The value is stored in three slots: one owned by the writer, one owned by
+ * the reader, and one "middle" slot holding the latest published value. The
+ * writer fills its slot then swaps it with the middle one, the reader swaps
+ * its slot with the middle one if it holds a newer value. Since each side only
+ * ever touches the slot it owns, the reader always gets a complete value
+ * (never a mix of two writes), and neither side ever waits or retries.
+ * @tparam T the type of the exchanged value. It must be copyable.
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param initialValue the value read until the first write.
+     */
+    TripleBuffer(const T &initialValue = T())
+    {
+        for(auto &slot : slots)
+            slot = initialValue;
+
+        writeIndex = 0;
+        middle.store(1, std::memory_order_relaxed);
+        readIndex = 2;
+    }
+
+    /**
+     * @brief Publishes a new value. Must only be called from the writer thread.
+     * @param value the value to publish.
+     */
+    void write(const T &value)
+    {
+        slots[writeIndex] = value;
+
+        uint8_t previous = middle.exchange(writeIndex | NEW_DATA_FLAG,
+                                           std::memory_order_acq_rel);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    /**
+     * @brief Gets the latest published value. Must only be called from the
+     * reader thread.
+     * @param value the latest value. If nothing new was published since the
+     * last call, it is the same value as the last time.
+     * @return true if the value was published since the last call, false
+     * otherwise.
+     */
+    bool read(T &value)
+    {
+        bool isNew = (middle.load(std::memory_order_relaxed) & NEW_DATA_FLAG) != 0;
+
+        if(isNew)
+        {
+            uint8_t previous = middle.exchange(readIndex,
+                                               std::memory_order_acq_rel);
+            readIndex = previous & INDEX_MASK;
+        }
+
+        value = slots[readIndex];
+        return isNew;
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 0x03;
+    static const uint8_t NEW_DATA_FLAG = 0x04;
+
+    T slots[3];
+    uint8_t writeIndex; ///< Only accessed by the writer.
+    std::atomic<uint8_t> middle; ///< Index of the latest value, and new flag.
+    uint8_t readIndex; ///< Only accessed by the reader.
+};
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,502 @@
+/**
+ * Runs the eWalk controller in closed loop with a surrogate model of the
+ * pilot's hips and feet (tools/common/surrogateplant.h), instead of a pilot on
+ * a treadmill or a SCONE/OpenSim simulation: the torques of the controller
+ * change the hip angles and the timing of the steps it then sees. Thousands of
+ * randomized walking scenarios (pilot, cadence changes, hesitations,
+ * assistance, profile) are run on all the cores, each with its own controller
+ * built on the simulated drivers (see ControllerHarness), and the heel-strike
+ * synchronization and the effect of the assistance on the gait are summarized
+ * over all of them.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/controllerharness.h"
+#include "../common/surrogateplant.h"
+
+using namespace std;
+using namespace chrono;
+
+#define DEFAULT_N_SCENARIOS 1000
+#define DEFAULT_DURATION 60.0f  ///< Simulated walk of each scenario [s].
+#define N_PROFILES 4            ///< Built-in profiles of the controller, see ProfileStore.
+
+/**
+ * @brief Randomized walking scenario.
+ */
+struct Scenario
+{
+    SurrogatePlantParams plant;
+    float assistance;   ///< [%]
+    int profile;        ///< Index of the torque profile, see ProfileStore.
+};
+
+/**
+ * @brief Result of a scenario.
+ */
+struct ScenarioResult
+{
+    float readyTime;        ///< Time to synchronize the legs, negative if never [s].
+    float phaseErrorRms;    ///< Profile phase error at the heel-strikes [%GC].
+    float phaseErrorMax;    ///< [%GC]
+    int nDetectedHeelStrikes; ///< Heel-strikes detected by the controller, both legs.
+    int nHeelStrikes;       ///< Heel-strikes of the plant, both legs.
+    float cycleShift;       ///< Mean cycle duration relative to the intended one [%].
+    float hipDeviationRms;  ///< Hip flexion minus the pilot's pattern [deg].
+    float positiveWork;     ///< Work of the orthosis per step of a leg [J].
+    float negativeWork;     ///< [J]
+    int safetyFault;        ///< First SafetyFault latched by the controller, SAFETY_OK if none.
+    float safetyStopTime;   ///< Time of this fault, negative if none [s].
+    double hostTime;        ///< [s]
+};
+
+/**
+ * @brief Discards everything written to it.
+ */
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+};
+
+static void printUsage()
+{
+    cout << "Usage: closedloop [options]" << endl
+         << "  --scenarios <n>       number of randomized scenarios (default: "
+         << DEFAULT_N_SCENARIOS << ")" << endl
+         << "  --duration <s>        simulated walk of each scenario (default: "
+         << DEFAULT_DURATION << ")" << endl
+         << "  --seed <n>            random seed of the scenarios (default: 0)" << endl
+         << "  --assist <%>          percent assistance (default: random within [0-100])" << endl
+         << "  --profile <n>         torque profile, 0: BOOK, 1: ALPHA, 2: BETA, 3: WINTER (default: random)" << endl
+         << "  --steady              no cadence change, hesitation or cycle variability" << endl
+         << "  --threads <n>         number of threads (default: all cores)" << endl
+         << "  --out <file.csv>      write the parameters and results of each scenario" << endl
+         << "  --save-trace <file>   save the sensor values of the first scenario as a CSV trace" << endl
+         << "  --min-speed <x>       exit with code 2 if a thread runs slower than x times real time" << endl;
+}
+
+/**
+ * @brief Draws the parameters of a scenario. They only depend on the seed and
+ * the index, not on the thread that runs it.
+ * @param seed random seed of the batch.
+ * @param index index of the scenario.
+ * @param assistance fixed assistance, or negative to draw it [%].
+ * @param profile fixed profile, or negative to draw it.
+ * @param steady true for a walk without perturbations, false otherwise.
+ * @return the scenario.
+ */
+static Scenario makeScenario(unsigned int seed, unsigned int index, float assistance,
+                             int profile, bool steady)
+{
+    seed_seq seeds{seed, index};
+    mt19937 generator(seeds);
+    auto uniform = [&generator](float min, float max)
+    {
+        return uniform_real_distribution<float>(min, max)(generator);
+    };
+
+    Scenario s;
+    s.plant = SurrogatePlant::getDefaultParams();
+    s.plant.bodyweight = uniform(45.0f, 100.0f);
+    s.plant.cycleDuration = uniform(0.9f, 1.5f);
+    s.plant.hipAmplitude = uniform(15.0f, 25.0f);
+    s.plant.hipOffset = uniform(0.0f, 10.0f);
+    s.plant.hipFrequency = uniform(2.0f, 4.0f);
+    s.plant.loadingTime = uniform(0.07f, 0.13f) * s.plant.cycleDuration;
+    s.plant.seed = generator();
+
+    if(!steady)
+    {
+        s.plant.cycleVariability = uniform(0.01f, 0.04f);
+        s.plant.cadenceChangeInterval = uniform(10.0f, 30.0f);
+        s.plant.cadenceChangeRange = 0.2f;
+        s.plant.cadenceChangeTime = uniform(1.0f, 5.0f);
+        s.plant.stumbleProbability = uniform(0.0f, 0.05f);
+    }
+    else
+        s.plant.cycleVariability = 0.0f;
+
+    s.assistance = (assistance >= 0.0f) ? assistance : uniform(0.0f, 100.0f);
+    s.profile = (profile >= 0) ? profile : (int)(generator() % N_PROFILES);
+    return s;
+}
+
+/**
+ * @brief Runs the controller in closed loop with the plant, the assistance
+ * enabled from the start.
+ *
+ * The phase error is that of gaitsweep: the phase of the profile of a leg at
+ * the exact time of each heel-strike of the plant, wrapped to [-50%, 50%[,
+ * once the legs are synchronized. The plant gets the torques set by the
+ * controller at the previous step, as the motors would.
+ * @param scenario the scenario.
+ * @param duration simulated time [s].
+ * @param calibration calibration of the soles cells, the same as the
+ * controller's.
+ * @param trace if not nullptr, the sensor values of each step are added to it.
+ * @return the result.
+ */
+static ScenarioResult runScenario(const Scenario &scenario, float duration,
+                                  const SoleCalibration &calibration, GaitTrace *trace)
+{
+    auto startTime = steady_clock::now();
+    const float dt = MAIN_LOOP_PERIOD;
+
+    ControllerHarness harness;
+    harness.setBodyweight(scenario.plant.bodyweight);
+    harness.setAssistance(scenario.assistance);
+    harness.setProfile(scenario.profile);
+    harness.setEnabled(true);
+
+    GaitTorqueGenerator &gait = harness.getGait();
+    const GaitJointsState &joints = gait.getJoints();
+    SurrogatePlant plant(scenario.plant, calibration);
+
+    ScenarioResult r;
+    r.readyTime = -1.0f;
+    r.phaseErrorMax = 0.0f;
+    r.nDetectedHeelStrikes = 0;
+    r.nHeelStrikes = 0;
+    r.safetyFault = SAFETY_OK;
+    r.safetyStopTime = -1.0f;
+
+    double phaseErrorSum2 = 0.0, deviationSum2 = 0.0;
+    double positiveWork = 0.0, negativeWork = 0.0;
+    double actualCycles = 0.0, intendedCycles = 0.0;
+    int nPhaseErrors = 0;
+    float lastHeelStrike[N_GAIT_LEGS] = { -1.0f, -1.0f };
+    float intendedCycle[N_GAIT_LEGS];
+    float torques[N_GAIT_LEGS] = { 0.0f, 0.0f };
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        intendedCycle[leg] = plant.getLeg(leg).cycleDuration;
+
+    if(trace != nullptr)
+        trace->dt = dt;
+
+    const long nSteps = lround(duration / dt);
+    for(long s=0; s<nSteps; s++)
+    {
+        plant.step(dt, torques);
+        float stepStart = plant.getTime() - dt;
+
+        bool wasInStance[N_GAIT_LEGS];
+        float wasFirstStep[N_GAIT_LEGS];
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            const SurrogateLeg &l = plant.getLeg(leg);
+            wasInStance[leg] = joints.inStance[leg];
+            wasFirstStep[leg] = joints.firstStep[leg];
+
+            float deviation = l.angle - l.reference;
+            deviationSum2 += deviation * deviation;
+            float power = torques[leg] * l.speed * (float)M_PI / 180.0f; // [W].
+            (power > 0.0f ? positiveWork : negativeWork) += power * dt;
+
+            if(!l.heelStrike)
+                continue;
+
+            r.nHeelStrikes++;
+            if(lastHeelStrike[leg] >= 0.0f)
+            {
+                actualCycles += l.heelStrikeTime - lastHeelStrike[leg];
+                intendedCycles += intendedCycle[leg];
+            }
+            lastHeelStrike[leg] = l.heelStrikeTime;
+            intendedCycle[leg] = l.cycleDuration;
+
+            // Phase of the profile at the heel-strike, extrapolated from the
+            // previous step.
+            if(gait.getReady() == 1 && joints.firstStep[leg] == 1)
+            {
+                float profileTime = joints.time[leg] + (l.heelStrikeTime - stepStart) *
+                                    joints.originalPeriod[leg] / joints.newPeriod[leg];
+                float cycles = profileTime / joints.originalPeriod[leg];
+                float phase = cycles - floorf(cycles);
+                if(phase >= 0.5f)
+                    phase -= 1.0f;
+
+                float error = fabsf(phase) * 100.0f;
+                phaseErrorSum2 += error * error;
+                r.phaseErrorMax = max(r.phaseErrorMax, error);
+                nPhaseErrors++;
+            }
+        }
+
+        harness.step(dt, plant.getFrame());
+        if(trace != nullptr)
+            trace->frames.push_back(plant.getFrame());
+
+        if(r.readyTime < 0.0f && gait.getReady() == 1)
+            r.readyTime = gait.getTime();
+
+        // The assistance stays off after a safety stop, so the scenario
+        // continues without it.
+        int fault = harness.getLoggedVars().safetyFault;
+        if(r.safetyFault == SAFETY_OK && fault != SAFETY_OK)
+        {
+            r.safetyFault = fault;
+            r.safetyStopTime = plant.getTime();
+        }
+
+        // The changes when the controller starts, before any step, are not
+        // heel-strikes.
+        for(int leg=0; leg<N_GAIT_LEGS && r.nHeelStrikes > 0; leg++)
+        {
+            if((!wasInStance[leg] && joints.inStance[leg]) ||
+               wasFirstStep[leg] != joints.firstStep[leg])
+            {
+                r.nDetectedHeelStrikes++;
+            }
+        }
+
+        torques[GAIT_LEFT] = harness.getLeftTorque();
+        torques[GAIT_RIGHT] = harness.getRightTorque();
+    }
+
+    r.phaseErrorRms = (nPhaseErrors > 0) ? (float)sqrt(phaseErrorSum2 / nPhaseErrors) : NAN;
+    r.cycleShift = (intendedCycles > 0.0) ?
+                       (float)((actualCycles / intendedCycles - 1.0) * 100.0) : NAN;
+    r.hipDeviationRms = (float)sqrt(deviationSum2 / (N_GAIT_LEGS * max(nSteps, 1L)));
+    r.positiveWork = (r.nHeelStrikes > 0) ? (float)(positiveWork / r.nHeelStrikes) : 0.0f;
+    r.negativeWork = (r.nHeelStrikes > 0) ? (float)(negativeWork / r.nHeelStrikes) : 0.0f;
+    r.hostTime = duration_cast<std::chrono::duration<double>>(steady_clock::now() - startTime).count();
+
+    return r;
+}
+
+/**
+ * @brief Prints the distribution of a result over the scenarios, ignoring the
+ * scenarios where it is undefined (NaN).
+ * @param name name of the result, with its unit.
+ * @param values value of each scenario.
+ */
+static void printDistribution(const string &name, vector<float> values)
+{
+    values.erase(remove_if(values.begin(), values.end(),
+                           [](float v) { return std::isnan(v); }), values.end());
+    if(values.empty())
+    {
+        cout << left << setw(22) << name << "-" << endl;
+        return;
+    }
+
+    sort(values.begin(), values.end());
+    double sum = 0.0;
+    for(float v : values)
+        sum += v;
+
+    auto percentile = [&values](double p)
+    {
+        return values[min((size_t)(p * values.size()), values.size() - 1)];
+    };
+
+    cout << left << setw(22) << name << right << fixed << setprecision(3)
+         << setw(11) << values.front() << setw(11) << sum / values.size()
+         << setw(11) << percentile(0.5) << setw(11) << percentile(0.95)
+         << setw(11) << values.back() << defaultfloat << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int nScenarios = DEFAULT_N_SCENARIOS;
+    float duration = DEFAULT_DURATION;
+    unsigned int seed = 0;
+    float assistance = -1.0f;
+    int profile = -1;
+    bool steady = false;
+    int nThreads = (int)thread::hardware_concurrency();
+    string outPath, tracePath;
+    double minSpeed = 0.0;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--scenarios" && hasValue)
+            nScenarios = atoi(argv[++i]);
+        else if(arg == "--duration" && hasValue)
+            duration = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            seed = atoi(argv[++i]);
+        else if(arg == "--assist" && hasValue)
+            assistance = atof(argv[++i]);
+        else if(arg == "--profile" && hasValue)
+            profile = atoi(argv[++i]);
+        else if(arg == "--steady")
+            steady = true;
+        else if(arg == "--threads" && hasValue)
+            nThreads = atoi(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if(arg == "--save-trace" && hasValue)
+            tracePath = argv[++i];
+        else if(arg == "--min-speed" && hasValue)
+            minSpeed = atof(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    if(nScenarios < 1 || duration <= 0.0f || profile >= N_PROFILES)
+    {
+        printUsage();
+        return 1;
+    }
+    nThreads = max(1, min(nThreads, nScenarios));
+
+    // Same calibration of the soles as the controller, so that it reads back
+    // the simulated forces.
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+
+    vector<Scenario> scenarios;
+    for(int i=0; i<nScenarios; i++)
+        scenarios.push_back(makeScenario(seed, i, assistance, profile, steady));
+
+    // Run the scenarios in parallel, each thread with its own simulated
+    // hardware. The messages of the controllers, the same for each scenario,
+    // are discarded meanwhile.
+    vector<ScenarioResult> results(nScenarios);
+    atomic<size_t> nextScenario(0);
+    GaitTrace trace;
+
+    auto worker = [&]()
+    {
+        SimHardware hardware;
+        SimHardware::setThreadInstance(&hardware);
+
+        size_t i;
+        while((i = nextScenario.fetch_add(1)) < scenarios.size())
+        {
+            results[i] = runScenario(scenarios[i], duration, calibration,
+                                     (i == 0 && !tracePath.empty()) ? &trace : nullptr);
+        }
+
+        SimHardware::setThreadInstance(nullptr);
+    };
+
+    NullBuffer nullBuffer;
+    streambuf *coutBuffer = cout.rdbuf(&nullBuffer);
+    auto startTime = steady_clock::now();
+
+    vector<thread> threads;
+    for(int t=1; t<nThreads; t++)
+        threads.push_back(thread(worker));
+    worker();
+    for(thread &t : threads)
+        t.join();
+
+    double elapsed = duration_cast<std::chrono::duration<double>>(steady_clock::now() - startTime).count();
+    cout.rdbuf(coutBuffer);
+
+    if(!tracePath.empty() && !saveGaitTrace(tracePath, trace))
+        return 1;
+
+    // Write the scenarios.
+    if(!outPath.empty())
+    {
+        ofstream outFile(outPath);
+        if(!outFile.is_open())
+        {
+            cerr << "Could not create " << outPath << "." << endl;
+            return 1;
+        }
+
+        outFile << "scenario,bodyweight[kg],cycle[s],variability,cadence_change_interval[s],"
+                << "stumble_probability,hip_amplitude[deg],hip_frequency[Hz],assist[%],"
+                << "profile,ready_time[s],phase_rms[%],phase_max[%],detected_heel_strikes,"
+                << "heel_strikes,cycle_shift[%],hip_deviation_rms[deg],work_pos[J],"
+                << "work_neg[J],safety_fault,safety_stop_time[s]\n" << setprecision(5);
+        for(int i=0; i<nScenarios; i++)
+        {
+            const SurrogatePlantParams &p = scenarios[i].plant;
+            const ScenarioResult &r = results[i];
+            outFile << i << "," << p.bodyweight << "," << p.cycleDuration << ","
+                    << p.cycleVariability << "," << p.cadenceChangeInterval << ","
+                    << p.stumbleProbability << "," << p.hipAmplitude << ","
+                    << p.hipFrequency << "," << scenarios[i].assistance << ","
+                    << scenarios[i].profile << "," << r.readyTime << ","
+                    << r.phaseErrorRms << "," << r.phaseErrorMax << ","
+                    << r.nDetectedHeelStrikes << "," << r.nHeelStrikes << ","
+                    << r.cycleShift << "," << r.hipDeviationRms << ","
+                    << r.positiveWork << "," << r.negativeWork << ","
+                    << SafetySupervisor::getFaultName((SafetyFault)r.safetyFault) << ","
+                    << r.safetyStopTime << "\n";
+        }
+    }
+
+    // Summary over all the scenarios.
+    vector<float> readyTimes, phaseRms, phaseMax, detection, cycleShifts, deviations, negativeWork;
+    int nNeverReady = 0;
+    int nFaults[N_SAFETY_FAULTS] = { 0 };
+    double hostTime = 0.0;
+    for(const ScenarioResult &r : results)
+    {
+        readyTimes.push_back(r.readyTime >= 0.0f ? r.readyTime : NAN);
+        nNeverReady += (r.readyTime < 0.0f) ? 1 : 0;
+        phaseRms.push_back(r.phaseErrorRms);
+        phaseMax.push_back(r.phaseErrorMax);
+        detection.push_back(r.nHeelStrikes > 0 ?
+                                100.0f * r.nDetectedHeelStrikes / r.nHeelStrikes : NAN);
+        cycleShifts.push_back(r.cycleShift);
+        deviations.push_back(r.hipDeviationRms);
+        negativeWork.push_back(r.negativeWork);
+        nFaults[r.safetyFault]++;
+        hostTime += r.hostTime;
+    }
+
+    cout << left << setw(22) << "" << right << setw(11) << "min" << setw(11) << "mean"
+         << setw(11) << "median" << setw(11) << "p95" << setw(11) << "max" << endl;
+    printDistribution("ready_time [s]", readyTimes);
+    printDistribution("phase_rms [%GC]", phaseRms);
+    printDistribution("phase_max [%GC]", phaseMax);
+    printDistribution("detected_strikes [%]", detection);
+    printDistribution("cycle_shift [%]", cycleShifts);
+    printDistribution("hip_deviation [deg]", deviations);
+    printDistribution("work_neg [J/step]", negativeWork);
+
+    for(int f=SAFETY_OK+1; f<N_SAFETY_FAULTS; f++)
+    {
+        if(nFaults[f] > 0)
+        {
+            cout << "Safety stop (" << SafetySupervisor::getFaultName((SafetyFault)f)
+                 << ") in " << nFaults[f] << " scenarios." << endl;
+        }
+    }
+
+    double simulatedTime = (double)duration * nScenarios;
+    double threadSpeed = simulatedTime / hostTime;
+    cout << nScenarios << " scenarios, " << nNeverReady << " never synchronized, "
+         << fixed << setprecision(0) << simulatedTime << " s simulated in "
+         << setprecision(2) << elapsed << " s (" << nThreads << " threads): "
+         << setprecision(0) << threadSpeed << "x real time per thread, "
+         << simulatedTime / elapsed << "x in total." << endl;
+
+    if(minSpeed > 0.0 && threadSpeed < minSpeed)
+    {
+        cout << "Slower than " << minSpeed << "x real time." << endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include "controllerharness.h"
+
+#include <cmath>
+
+// Wiring of the controller (see its constructor): the left sole is read from
+// the right ADC chip select and vice versa, the left motor has CAN ID 2 and
+// the right one CAN ID 1.
+const SpiBus::ChipSelect LEFT_SOLE_CS = SpiBus::CS_RIGHT_ADC;
+const SpiBus::ChipSelect RIGHT_SOLE_CS = SpiBus::CS_LEFT_ADC;
+const int LEFT_MOTOR_ID = 2;
+const int RIGHT_MOTOR_ID = 1;
+
+/**
+ * @brief Constructor. Resets the simulated hardware and creates a controller,
+ * disabled, with its default parameters.
+ */
+ControllerHarness::ControllerHarness()
+{
+    SimHardware::getInstance().reset();
+
+    PeripheralsSet peripherals;
+    peripherals.spiBus = &spiBus;
+    controller = new eWalkTimeBasedTorqueProfile(peripherals);
+}
+
+/**
+ * @brief Destructor.
+ */
+ControllerHarness::~ControllerHarness()
+{
+    delete controller;
+}
+
+/**
+ * @brief Enables or disables the controller, like the "enable_controller"
+ * SyncVar.
+ * @param enabled true to enable the controller, false to disable it.
+ */
+void ControllerHarness::setEnabled(bool enabled)
+{
+    controller->logged.startController = enabled;
+}
+
+/**
+ * @brief Sets the fraction of the torque profile to apply, like the
+ * "const/percent_assist" SyncVar.
+ * @param percent the assistance [0-100].
+ */
+void ControllerHarness::setAssistance(float percent)
+{
+    controller->logged.percentAssistance = percent;
+}
+
+/**
+ * @brief Sets the bodyweight of the pilot, like the "const/bodyweight" SyncVar.
+ * @param bodyweight the bodyweight [kg].
+ */
+void ControllerHarness::setBodyweight(float bodyweight)
+{
+    controller->logged.pilotBodyWeight = bodyweight;
+}
+
+/**
+ * @brief Sets the foot load threshold of the heel-strike detection, like the
+ * "const/stance_footload_thresh" SyncVar.
+ * @param threshold the threshold [N].
+ */
+void ControllerHarness::setStanceThreshold(float threshold)
+{
+    controller->gait.getParams().stanceFootLoadThreshold = threshold;
+}
+
+/**
+ * @brief Selects the torque profile, like the "const/profile" SyncVar. The
+ * legs switch to it at their next heel-strike.
+ * @param index the index of the profile, see ProfileStore.
+ */
+void ControllerHarness::setProfile(int index)
+{
+    controller->logged.profileIndex = index;
+}
+
+/**
+ * @brief Starts streaming the logged variables, like the controller does on
+ * the hardware if EWALK_TELEMETRY_STREAM is defined.
+ * @param port TCP port to listen on.
+ * @return true if the port could be opened, false otherwise.
+ */
+bool ControllerHarness::startStream(int port)
+{
+    return controller->stream.start(port);
+}
+
+/**
+ * @brief Runs one time step of the controller.
+ * @param dt the time step [s].
+ * @param frame the sensor values of this time step.
+ */
+void ControllerHarness::step(float dt, const SensorFrame &frame)
+{
+    SimHardware::getInstance().timeUs += (int64_t)llroundf(dt * 1000000.0f);
+    setSensors(frame);
+    controller->update(dt);
+}
+
+/**
+ * @brief Writes sensor values to the simulated motors and soles ADCs, to be
+ * read at the next acquisition of the controller.
+ * @param frame the sensor values.
+ */
+void ControllerHarness::setSensors(const SensorFrame &frame)
+{
+    SimHardware &hw = SimHardware::getInstance();
+
+    hw.motors[LEFT_MOTOR_ID].position = frame.leftHipAngle;
+    hw.motors[LEFT_MOTOR_ID].speed = frame.leftHipSpeed;
+    hw.motors[RIGHT_MOTOR_ID].position = frame.rightHipAngle;
+    hw.motors[RIGHT_MOTOR_ID].speed = frame.rightHipSpeed;
+
+    setSoles(frame);
+}
+
+/**
+ * @brief Writes the sole voltages of a sensor frame to the simulated ADCs, but
+ * not the hip angles and speeds. With SIM_REAL_TIME, the motors belong to the
+ * CAN thread of the controller, and only SimHardware::motorModel may change
+ * them.
+ * @param frame the sensor values.
+ */
+void ControllerHarness::setSoles(const SensorFrame &frame)
+{
+    SimHardware &hw = SimHardware::getInstance();
+
+    for(int i=0; i<8; i++)
+    {
+        hw.adcVoltages[LEFT_SOLE_CS][i] = frame.leftSoleVoltages[i];
+        hw.adcVoltages[RIGHT_SOLE_CS][i] = frame.rightSoleVoltages[i];
+    }
+}
+
+/**
+ * @brief Gets the torque setpoint currently applied to the left motor.
+ * @return the torque setpoint [N.m].
+ */
+float ControllerHarness::getLeftTorque() const
+{
+    return SimHardware::getInstance().motors[LEFT_MOTOR_ID].torqueSetpoint;
+}
+
+/**
+ * @brief Gets the torque setpoint currently applied to the right motor.
+ * @return the torque setpoint [N.m].
+ */
+float ControllerHarness::getRightTorque() const
+{
+    return SimHardware::getInstance().motors[RIGHT_MOTOR_ID].torqueSetpoint;
+}
+
+/**
+ * @brief Gets the time counted by the torque generator of the controller.
+ * @return the time since the creation of the controller [ticks], see
+ * GAIT_TICKS_PER_SECOND.
+ */
+int64_t ControllerHarness::getGaitTicks() const
+{
+    return controller->gait.getTicks();
+}
+
+/**
+ * @brief Gets the controller, to read its internal state.
+ * @return the controller.
+ */
+eWalkTimeBasedTorqueProfile &ControllerHarness::getController()
+{
+    return *controller;
+}
+
+/**
+ * @brief Gets the torque generator of the controller, to read the state of
+ * its heel-strike synchronization.
+ * @return the torque generator.
+ */
+GaitTorqueGenerator &ControllerHarness::getGait()
+{
+    return controller->gait;
+}
+
+/**
+ * @brief Gets the variables recorded and streamed by the controller, as of
+ * the last step.
+ * @return the logged variables.
+ */
+const eWalkLoggedVars &ControllerHarness::getLoggedVars() const
+{
+    return controller->logged;
+}
+
+/**
+ * @brief Gets the safety supervisor of the controller.
+ * @return the supervisor.
+ */
+SafetySupervisor &ControllerHarness::getSafetySupervisor()
+{
+    return controller->safety;
+}
+
+/**
+ * @brief Gets the CAN thread of the controller.
+ * @return the thread, or nullptr if the controller was built with
+ * EWALK_SYNCHRONOUS_CAN.
+ */
+std::thread *ControllerHarness::getCanThread()
+{
+    return controller->canThread;
+}
+
+/**
+ * @brief Gets whether the CAN thread, or the supervisor cutting the torque
+ * off, is accessing the motors. Async-signal-safe.
+ * @return true if the motors are in use, false otherwise.
+ */
+bool ControllerHarness::areMotorsInUse() const
+{
+    return controller->motorsInUse.load();
+}
+
+/**
+ * @brief Gets the number of iterations of the CAN and supervisor threads of
+ * the controller that started more than half a period late.
+ * @return the total of both threads.
+ */
+uint32_t ControllerHarness::getThreadsOverrunsCount()
+{
+    return controller->canLoop.getMonitor().getOverrunsCount() +
+           controller->safetyLoop.getMonitor().getOverrunsCount();
+}
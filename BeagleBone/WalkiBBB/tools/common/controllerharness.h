@@ -0,0 +1,58 @@
+#ifndef CONTROLLERHARNESS_H
+#define CONTROLLERHARNESS_H
+
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+#include "gaittrace.h"
+
+/**
+ * @brief Runs the eWalk controller without the hardware, on the simulated
+ * drivers of drivers/sim.
+ *
+ * Each step writes a sensor frame to the simulated hardware, calls update()
+ * of the controller, and reads back the torques sent to the motors. The steps
+ * run as fast as the host allows, the time only advances by the given dt. The
+ * harness is a friend of the controller, to set its parameters and read its
+ * state without the SyncVars.
+ * @remark this must be compiled with drivers/sim/simdrivers.h force-included,
+ * which builds the controller with EWALK_SYNCHRONOUS_CAN and
+ * EWALK_SYNCHRONOUS_SENSORS: the motors and the sensors are updated from
+ * update(), instead of from their own threads. With SIM_REAL_TIME, the motors
+ * are updated by the CAN thread, and the controller is not stepped, but
+ * updated in real time by the program, see tools/faultinject.
+ */
+class ControllerHarness
+{
+public:
+    ControllerHarness();
+    ~ControllerHarness();
+
+    void setEnabled(bool enabled);
+    void setAssistance(float percent);
+    void setBodyweight(float bodyweight);
+    void setStanceThreshold(float threshold);
+    void setProfile(int index);
+    bool startStream(int port);
+
+    void setSensors(const SensorFrame &frame);
+    void setSoles(const SensorFrame &frame);
+    void step(float dt, const SensorFrame &frame);
+
+    float getLeftTorque() const;
+    float getRightTorque() const;
+    int64_t getGaitTicks() const;
+
+    eWalkTimeBasedTorqueProfile &getController();
+    GaitTorqueGenerator &getGait();
+    const eWalkLoggedVars &getLoggedVars() const;
+
+    SafetySupervisor &getSafetySupervisor();
+    std::thread *getCanThread();
+    bool areMotorsInUse() const;
+    uint32_t getThreadsOverrunsCount();
+
+private:
+    SpiBus spiBus;
+    eWalkTimeBasedTorqueProfile *controller;
+};
+
+#endif // CONTROLLERHARNESS_H
@@ -0,0 +1,136 @@
+#include "gaitcycles.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+vector<double> findHeelStrikes(const float *time, const float *load, size_t nRows,
+                               float threshold, double minInterval)
+{
+    vector<double> heelStrikes;
+
+    for(size_t r=1; r<nRows; r++)
+    {
+        float previous = fabsf(load[r-1]);
+        float current = fabsf(load[r]);
+        if(!(previous <= threshold && current > threshold))
+            continue;
+
+        double crossing = time[r-1] + (double)(threshold - previous) /
+                (current - previous) * (time[r] - time[r-1]);
+
+        if(heelStrikes.empty() || crossing - heelStrikes.back() >= minInterval)
+            heelStrikes.push_back(crossing);
+    }
+
+    return heelStrikes;
+}
+
+vector<GaitCycle> selectCycles(const vector<double> &heelStrikes, double startTime,
+                               double tolerance, int &nRejected)
+{
+    vector<GaitCycle> candidates;
+    for(size_t i=1; i<heelStrikes.size(); i++)
+    {
+        if(heelStrikes[i-1] >= startTime)
+            candidates.push_back({ heelStrikes[i-1], heelStrikes[i] });
+    }
+
+    nRejected = 0;
+    if(candidates.empty())
+        return candidates;
+
+    vector<double> durations;
+    for(const GaitCycle &c : candidates)
+        durations.push_back(c.end - c.start);
+    nth_element(durations.begin(), durations.begin() + durations.size() / 2,
+                durations.end());
+    double median = durations[durations.size() / 2];
+
+    vector<GaitCycle> cycles;
+    for(const GaitCycle &c : candidates)
+    {
+        if(fabs(c.end - c.start - median) <= tolerance * median)
+            cycles.push_back(c);
+        else
+            nRejected++;
+    }
+
+    return cycles;
+}
+
+CycleSampling sampleCycles(const float *time, size_t nRows,
+                           const vector<GaitCycle> &cycles, int nPoints)
+{
+    CycleSampling sampling;
+    sampling.nPoints = nPoints;
+
+    if(nRows < 2)
+        return sampling;
+
+    for(const GaitCycle &c : cycles)
+    {
+        if(c.start < time[0] || c.end > time[nRows-1])
+            continue;
+
+        sampling.cycles.push_back(c);
+
+        // The points are increasing, so the rows are found by walking forward.
+        size_t r = upper_bound(time, time + nRows, (float)c.start) - time;
+        r = (r == 0) ? 0 : r - 1;
+
+        for(int p=0; p<nPoints; p++)
+        {
+            double t = c.start + (c.end - c.start) * p / (nPoints - 1);
+            while(r + 2 < nRows && time[r+1] <= t)
+                r++;
+
+            double gap = time[r+1] - time[r];
+            float weight = (gap > 0.0) ? (float)((t - time[r]) / gap) : 0.0f;
+
+            sampling.rows.push_back(r);
+            sampling.weights.push_back(min(max(weight, 0.0f), 1.0f));
+        }
+    }
+
+    return sampling;
+}
+
+void averageCycles(const CycleSampling &sampling, const float *values,
+                   float *mean, float *sd)
+{
+    const int nPoints = sampling.nPoints;
+    const size_t nCycles = sampling.cycles.size();
+
+    for(int p=0; p<nPoints; p++)
+    {
+        double sum = 0.0, squares = 0.0;
+        double first = 0.0; // Shift, against the cancellation of large offsets.
+
+        for(size_t c=0; c<nCycles; c++)
+        {
+            size_t i = c * nPoints + p;
+            size_t r = sampling.rows[i];
+            float w = sampling.weights[i];
+            double v = (1.0f - w) * values[r] + w * values[r+1];
+
+            if(c == 0)
+                first = v;
+            sum += v - first;
+            squares += (v - first) * (v - first);
+        }
+
+        if(nCycles == 0)
+        {
+            mean[p] = NAN;
+            sd[p] = NAN;
+            continue;
+        }
+
+        double m = sum / nCycles;
+        mean[p] = (float)(first + m);
+        sd[p] = (nCycles > 1) ?
+                    (float)sqrt(max(squares - nCycles * m * m, 0.0) / (nCycles - 1)) : 0.0f;
+    }
+}
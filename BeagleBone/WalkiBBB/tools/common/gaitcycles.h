@@ -0,0 +1,86 @@
+#ifndef GAITCYCLES_H
+#define GAITCYCLES_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Gait cycle, from a heel-strike to the next one of the same leg.
+ */
+struct GaitCycle
+{
+    double start;   ///< [s]
+    double end;     ///< [s]
+};
+
+/**
+ * @brief Samples of a set of gait cycles, evenly spaced from 0 to 100% GC,
+ * located in the rows of a table. As all the columns of a table share the time
+ * column, it is computed once per table, then used for all its columns.
+ */
+struct CycleSampling
+{
+    int nPoints;                    ///< Points per cycle, including 0 and 100% GC.
+    std::vector<GaitCycle> cycles;  ///< The cycles within the time span of the table.
+    std::vector<size_t> rows;       ///< Row before each point, per cycle then per point.
+    std::vector<float> weights;     ///< Weight of the next row, for each point [0-1].
+};
+
+/**
+ * @brief Finds the heel-strikes of a leg, as the times where the magnitude of
+ * its foot load rises above a threshold, interpolated between the samples.
+ * With a threshold of 0, this is the contact onset of encoder_heelstrike.m.
+ * @param time time of each row, increasing [s].
+ * @param load foot load of each row, of either sign (e.g. a ground reaction
+ * force) [N].
+ * @param nRows number of rows.
+ * @param threshold threshold of the load magnitude [N].
+ * @param minInterval rising edges closer than this to the previous heel-strike
+ * are ignored, as bounces of the contact [s].
+ * @return the times of the heel-strikes [s].
+ */
+std::vector<double> findHeelStrikes(const float *time, const float *load, size_t nRows,
+                                    float threshold, double minInterval);
+
+/**
+ * @brief Gets the gait cycles between consecutive heel-strikes, except the
+ * ones starting before a given time (the transient at the start of a
+ * simulation), and the ones whose duration is far from the median, like a
+ * stumble or a missed heel-strike.
+ * @param heelStrikes times of the heel-strikes, increasing [s].
+ * @param startTime the cycles must start after this time [s].
+ * @param tolerance max. relative deviation of the duration from the median
+ * [].
+ * @param nRejected number of cycles rejected for their duration.
+ * @return the cycles.
+ */
+std::vector<GaitCycle> selectCycles(const std::vector<double> &heelStrikes,
+                                    double startTime, double tolerance, int &nRejected);
+
+/**
+ * @brief Locates the points of the cycles in the rows of a table, for linear
+ * interpolation. The cycles that are not fully within the time span of the
+ * table are left out.
+ * @param time time column of the table, increasing [s].
+ * @param nRows number of rows.
+ * @param cycles the cycles.
+ * @param nPoints points per cycle, at least 2.
+ * @return the sampling.
+ */
+CycleSampling sampleCycles(const float *time, size_t nRows,
+                           const std::vector<GaitCycle> &cycles, int nPoints);
+
+/**
+ * @brief Time-normalizes a column over all the cycles, and computes the mean
+ * and the standard deviation (normalized by N-1, as MATLAB's std()) at each
+ * point.
+ * @param sampling the sampling of the table of the column.
+ * @param values the column.
+ * @param mean mean at each point, nPoints values.
+ * @param sd standard deviation at each point, nPoints values, 0 if there is
+ * only one cycle.
+ */
+void averageCycles(const CycleSampling &sampling, const float *values,
+                   float *mean, float *sd);
+
+#endif // GAITCYCLES_H
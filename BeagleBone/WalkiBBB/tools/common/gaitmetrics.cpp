@@ -0,0 +1,177 @@
+#include "gaitmetrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../../controllers/ewalk/harmonicprofiles.h"
+
+using namespace std;
+
+/**
+ * @brief Converts the soles voltages of a trace to foot loads, like the
+ * controller, and finds the heel-strikes of reference, as the rising edges of
+ * the foot loads above a threshold.
+ * @param trace the gait trace.
+ * @param calibration calibration of the soles cells.
+ * @param referenceThreshold foot load of the reference heel-strikes [N].
+ * @return the foot loads.
+ */
+FootLoadTrace computeFootLoads(const GaitTrace &trace,
+                               const SoleCalibration &calibration,
+                               float referenceThreshold)
+{
+    FootLoadTrace loads;
+    loads.dt = trace.dt;
+
+    VecNf<SOLE_N_CELLS> leftVoltages, rightVoltages, leftCells, rightCells;
+    bool inContact[N_GAIT_LEGS] = { false, false };
+
+    for(size_t s=0; s<trace.frames.size(); s++)
+    {
+        const SensorFrame &f = trace.frames[s];
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            leftVoltages[i] = f.leftSoleVoltages[i];
+            rightVoltages[i] = f.rightSoleVoltages[i];
+        }
+
+        float footLoads[N_GAIT_LEGS];
+        calibration.convert(leftVoltages, rightVoltages, leftCells, rightCells,
+                            footLoads[GAIT_LEFT], footLoads[GAIT_RIGHT]);
+
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            loads.loads[leg].push_back(footLoads[leg]);
+
+            bool contact = (footLoads[leg] > referenceThreshold);
+            if(contact && !inContact[leg])
+                loads.heelStrikes[leg].push_back(s);
+            inContact[leg] = contact;
+        }
+    }
+
+    return loads;
+}
+
+/**
+ * @brief Runs a torque generator over a trace, as the controller would with
+ * the assistance enabled from the start, and evaluates the result.
+ *
+ * The phase error is the phase of the profile of a leg, just before each
+ * heel-strike of reference, wrapped to [-50%, 50%[. It is 0 when the profile
+ * ends its cycle exactly at the heel-strike. Only the heel-strikes after the
+ * synchronization of the legs are counted. If the exact times of the
+ * heel-strikes of reference are known, the phase is extrapolated from the
+ * previous step to them.
+ * @param trace the foot loads.
+ * @param profile the torque profile.
+ * @param config the parameters of the run.
+ * @return the metrics of the run.
+ */
+GaitMetrics runGait(const FootLoadTrace &trace, const HarmonicCoefficients &profile,
+                    const GaitRunConfig &config)
+{
+    GaitTorqueGenerator gait;
+    gait.getParams() = config.params;
+    gait.setProfile(profile);
+    gait.reset();
+    gait.setScale(PROFILE_TORQUE_MULTIPLIER * config.bodyweight);
+
+    GaitMetrics m;
+    m.readyTime = -1.0f;
+    m.phaseErrorMax = 0.0f;
+    m.nPhaseErrors = 0;
+    m.nDetectedHeelStrikes = 0;
+    m.nReferenceHeelStrikes = (int)(trace.heelStrikes[GAIT_LEFT].size() +
+                                    trace.heelStrikes[GAIT_RIGHT].size());
+    m.torqueStepMax = 0.0f;
+
+    double phaseErrorSum2 = 0.0, torqueSum2 = 0.0, torqueRateSum2 = 0.0;
+    size_t nextHeelStrike[N_GAIT_LEGS] = { 0, 0 };
+    float lastTorque[N_GAIT_LEGS] = { 0.0f, 0.0f };
+    const size_t nSteps = trace.loads[GAIT_LEFT].size();
+    const float assistance = config.assistance / 100.0f;
+
+    for(size_t s=0; s<nSteps; s++)
+    {
+        gait.advanceTime(trace.dt);
+
+        const GaitJointsState &joints = gait.getJoints();
+
+        bool wasInStance[N_GAIT_LEGS];
+        float wasFirstStep[N_GAIT_LEGS];
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            wasInStance[leg] = joints.inStance[leg];
+            wasFirstStep[leg] = joints.firstStep[leg];
+
+            // Phase of the profile just before the heel-strike of reference.
+            const vector<size_t> &strikes = trace.heelStrikes[leg];
+            if(nextHeelStrike[leg] < strikes.size() &&
+               strikes[nextHeelStrike[leg]] == s)
+            {
+                nextHeelStrike[leg]++;
+
+                if(gait.getReady() == 1 && joints.firstStep[leg] == 1)
+                {
+                    float profileTime = joints.time[leg];
+                    if(!trace.heelStrikeDelays[leg].empty())
+                    {
+                        float delay = trace.heelStrikeDelays[leg][nextHeelStrike[leg]-1];
+                        profileTime += (trace.dt - delay) * joints.originalPeriod[leg] /
+                                       joints.newPeriod[leg];
+                    }
+
+                    float cycles = profileTime / joints.originalPeriod[leg];
+                    float phase = cycles - floorf(cycles);
+                    if(phase >= 0.5f)
+                        phase -= 1.0f;
+
+                    float error = fabsf(phase) * 100.0f;
+                    phaseErrorSum2 += error * error;
+                    m.phaseErrorMax = max(m.phaseErrorMax, error);
+                    m.nPhaseErrors++;
+                }
+            }
+        }
+
+        float footLoads[N_GAIT_LEGS], crossingAges[N_GAIT_LEGS];
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            footLoads[leg] = trace.loads[leg][s];
+            if(!trace.crossingAges[leg].empty())
+                crossingAges[leg] = trace.crossingAges[leg][s];
+        }
+        gait.updateGaitCycle(footLoads, trace.crossingAges[GAIT_LEFT].empty() ?
+                                        nullptr : crossingAges);
+
+        if(m.readyTime < 0.0f && gait.getReady() == 1)
+            m.readyTime = gait.getTime();
+
+        gait.computeTorques();
+
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            if((!wasInStance[leg] && joints.inStance[leg]) ||
+               wasFirstStep[leg] != joints.firstStep[leg])
+            {
+                m.nDetectedHeelStrikes++;
+            }
+
+            float torque = joints.torque[leg] * assistance;
+            float step = fabsf(torque - lastTorque[leg]);
+
+            torqueSum2 += torque * torque;
+            torqueRateSum2 += (step / trace.dt) * (step / trace.dt);
+            m.torqueStepMax = max(m.torqueStepMax, step);
+            lastTorque[leg] = torque;
+        }
+    }
+
+    m.phaseErrorRms = (m.nPhaseErrors > 0) ?
+                      (float)sqrt(phaseErrorSum2 / m.nPhaseErrors) : 0.0f;
+    m.torqueRms = (nSteps > 0) ? (float)sqrt(torqueSum2 / (N_GAIT_LEGS * nSteps)) : 0.0f;
+    m.torqueRateRms = (nSteps > 0) ? (float)sqrt(torqueRateSum2 / (N_GAIT_LEGS * nSteps)) : 0.0f;
+
+    return m;
+}
@@ -0,0 +1,60 @@
+#ifndef GAITMETRICS_H
+#define GAITMETRICS_H
+
+#include <vector>
+
+#include "../../controllers/ewalk/gaittorquegenerator.h"
+#include "gaittrace.h"
+
+/**
+ * @brief Total load of both feet at each time step of a gait trace, as seen
+ * by the controller, with the heel-strikes of reference.
+ *
+ * If the soles were sampled faster than the time step, the optional fields
+ * give the exact heel-strike times: the age of the threshold crossings found
+ * by the HeelStrikeTimer, passed to the torque generator at each step, and
+ * the exact time of the heel-strikes of reference, for the phase error.
+ */
+struct FootLoadTrace
+{
+    float dt;                                   ///< [s]
+    std::vector<float> loads[N_GAIT_LEGS];      ///< [N]
+    std::vector<size_t> heelStrikes[N_GAIT_LEGS]; ///< Indices of the steps.
+    std::vector<float> crossingAges[N_GAIT_LEGS]; ///< Per step [s], or empty.
+    std::vector<float> heelStrikeDelays[N_GAIT_LEGS]; ///< Per heel-strike of reference, time until its step [s], or empty.
+};
+
+/**
+ * @brief Settings of one run of the torque generator over a trace.
+ */
+struct GaitRunConfig
+{
+    GaitTorqueParams params;
+    float assistance;   ///< [%]
+    float bodyweight;   ///< [kg]
+};
+
+/**
+ * @brief Performance of the torque generator over a trace.
+ */
+struct GaitMetrics
+{
+    float readyTime;        ///< Time to synchronize the legs, negative if never [s].
+    float phaseErrorRms;    ///< Profile phase error at the reference heel-strikes [%GC].
+    float phaseErrorMax;    ///< [%GC]
+    int nPhaseErrors;       ///< Number of heel-strikes in the phase error statistics.
+    int nDetectedHeelStrikes; ///< Heel-strikes detected by the generator, both legs.
+    int nReferenceHeelStrikes; ///< Heel-strikes of reference, both legs.
+    float torqueRms;        ///< [N.m]
+    float torqueRateRms;    ///< RMS of the torque derivative [N.m/s].
+    float torqueStepMax;    ///< Largest torque change in one time step [N.m].
+};
+
+FootLoadTrace computeFootLoads(const GaitTrace &trace,
+                               const SoleCalibration &calibration,
+                               float referenceThreshold);
+
+GaitMetrics runGait(const FootLoadTrace &trace, const HarmonicCoefficients &profile,
+                    const GaitRunConfig &config);
+
+#endif // GAITMETRICS_H
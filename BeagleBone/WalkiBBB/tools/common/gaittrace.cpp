@@ -0,0 +1,241 @@
+#include "gaittrace.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+const float GRAVITY = 9.81f; // [m/s^2].
+
+// Fraction of the foot load carried by each of the 8 cells, from the heel
+// (cells 0-2) to the toes (cells 5-7).
+const array<float, 8> HEEL_DISTRIBUTION = {{0.3f, 0.3f, 0.2f, 0.1f, 0.1f, 0.0f, 0.0f, 0.0f}};
+const array<float, 8> TOE_DISTRIBUTION = {{0.0f, 0.0f, 0.0f, 0.1f, 0.1f, 0.2f, 0.3f, 0.3f}};
+
+/**
+ * @brief Gets typical parameters of treadmill walking.
+ * @return the default parameters.
+ */
+SyntheticGaitParams getDefaultSyntheticGaitParams()
+{
+    SyntheticGaitParams p;
+    p.duration = 600.0f;
+    p.dt = 0.002f;
+    p.cycleDuration = 1.1f;
+    p.cycleVariability = 0.02f;
+    p.changeTime = -1.0f;
+    p.changedCycleDuration = 1.1f;
+    p.stanceRatio = 0.6f;
+    p.bodyweight = 60.0f;
+    p.hipAmplitude = 25.0f;
+    p.seed = 0;
+    return p;
+}
+
+/**
+ * @brief Converts a foot load to the voltages of the cells of a sole, the load
+ * rolling from the heel to the toes during stance.
+ * @param load total load on the sole [N].
+ * @param rollover progress of the stance, 0 on the heel, 1 on the toes [0-1].
+ * @param calibration calibration of the soles cells.
+ * @param side the sole.
+ * @param voltages output voltages of the 8 cells [V].
+ */
+void distributeFootLoad(float load, float rollover, const SoleCalibration &calibration,
+                        SoleSide side, array<float, 8> &voltages)
+{
+    for(int i=0; i<8; i++)
+    {
+        float cellForce = load * ((1.0f - rollover) * HEEL_DISTRIBUTION[i] +
+                                  rollover * TOE_DISTRIBUTION[i]);
+        voltages[i] = calibration.forceToVoltage(side, i, cellForce);
+    }
+}
+
+/**
+ * @brief Fills the soles voltages for a given phase of the gait cycle.
+ * @param phase phase of the gait cycle, 0 at heel-strike [0-1[.
+ * @param stanceRatio fraction of the gait cycle in stance [].
+ * @param weight foot load in full stance [N].
+ * @param calibration calibration of the soles cells.
+ * @param side the sole.
+ * @param voltages output voltages of the 8 cells [V].
+ */
+static void fillSoleVoltages(float phase, float stanceRatio, float weight,
+                             const SoleCalibration &calibration, SoleSide side,
+                             array<float, 8> &voltages)
+{
+    if(phase >= stanceRatio)
+    {
+        voltages.fill(0.0f);
+        return;
+    }
+
+    // The load rises then falls during stance, and rolls from heel to toes.
+    float stancePhase = phase / stanceRatio;
+    float load = weight * sinf((float)M_PI * stancePhase);
+    distributeFootLoad(load, stancePhase, calibration, side, voltages);
+}
+
+/**
+ * @brief Generates the sensor values of a steady walk, the right leg half a
+ * cycle ahead of the left one. The duration of each cycle is drawn randomly
+ * around the mean. If changeTime is set, the cycles that start after it are
+ * drawn around changedCycleDuration instead, e.g. to test the tracking of a
+ * cadence change.
+ * @param params gait parameters.
+ * @param calibration calibration of the soles cells, to convert the simulated
+ * forces to voltages.
+ * @return the generated trace.
+ */
+GaitTrace makeSyntheticGait(const SyntheticGaitParams &params,
+                            const SoleCalibration &calibration)
+{
+    GaitTrace trace;
+    trace.dt = params.dt;
+
+    mt19937 generator(params.seed);
+    normal_distribution<float> cycleDistribution(params.cycleDuration,
+                                                 params.cycleVariability * params.cycleDuration);
+
+    int nFrames = (int)(params.duration / params.dt);
+    trace.frames.reserve(nFrames);
+
+    float weight = params.bodyweight * GRAVITY;
+    float phase = 0.0f; // Right leg, 0 at heel-strike [0-1[.
+    float currentCycle = params.cycleDuration;
+
+    for(int i=0; i<nFrames; i++)
+    {
+        SensorFrame f;
+        f.time = i * params.dt;
+
+        float leftPhase = fmodf(phase + 0.5f, 1.0f);
+
+        // Hip flexed at heel-strike, extended at the end of stance.
+        f.rightHipAngle = params.hipAmplitude * cosf(2.0f * (float)M_PI * phase);
+        f.leftHipAngle = params.hipAmplitude * cosf(2.0f * (float)M_PI * leftPhase);
+        f.rightHipSpeed = -params.hipAmplitude * 2.0f * (float)M_PI / currentCycle *
+                          sinf(2.0f * (float)M_PI * phase);
+        f.leftHipSpeed = -params.hipAmplitude * 2.0f * (float)M_PI / currentCycle *
+                         sinf(2.0f * (float)M_PI * leftPhase);
+
+        fillSoleVoltages(phase, params.stanceRatio, weight, calibration,
+                         SOLE_RIGHT, f.rightSoleVoltages);
+        fillSoleVoltages(leftPhase, params.stanceRatio, weight, calibration,
+                         SOLE_LEFT, f.leftSoleVoltages);
+
+        trace.frames.push_back(f);
+
+        phase += params.dt / currentCycle;
+        if(phase >= 1.0f)
+        {
+            phase -= 1.0f;
+            float cycle = cycleDistribution(generator);
+            if(params.changeTime >= 0.0f && f.time >= params.changeTime)
+                cycle *= params.changedCycleDuration / params.cycleDuration;
+            currentCycle = max(0.4f, cycle);
+        }
+    }
+
+    return trace;
+}
+
+/**
+ * @brief Loads a trace from a CSV file with one line per time step and the
+ * columns: time, left_hip_angle, right_hip_angle, left_hip_speed,
+ * right_hip_speed, left_sole_0..7, right_sole_0..7. The first line is a
+ * header. The time step is taken from the first two lines.
+ * @param path path of the CSV file.
+ * @param trace the loaded trace.
+ * @return true if the file could be loaded, false otherwise.
+ */
+bool loadGaitTrace(const string &path, GaitTrace &trace)
+{
+    ifstream file(path);
+    if(!file.is_open())
+    {
+        cerr << "Could not open " << path << "." << endl;
+        return false;
+    }
+
+    string line;
+    getline(file, line); // Header.
+
+    trace.frames.clear();
+
+    while(getline(file, line))
+    {
+        for(char &c : line)
+        {
+            if(c == ',')
+                c = ' ';
+        }
+
+        istringstream iss(line);
+        SensorFrame f;
+        iss >> f.time >> f.leftHipAngle >> f.rightHipAngle
+            >> f.leftHipSpeed >> f.rightHipSpeed;
+        for(float &v : f.leftSoleVoltages)
+            iss >> v;
+        for(float &v : f.rightSoleVoltages)
+            iss >> v;
+
+        if(iss.fail())
+        {
+            cerr << path << ": invalid line " << trace.frames.size() + 2 << "."
+                 << endl;
+            return false;
+        }
+
+        trace.frames.push_back(f);
+    }
+
+    if(trace.frames.size() < 2)
+    {
+        cerr << path << ": not enough samples." << endl;
+        return false;
+    }
+
+    trace.dt = trace.frames[1].time - trace.frames[0].time;
+    return true;
+}
+
+/**
+ * @brief Saves a trace to a CSV file, in the format read by loadGaitTrace().
+ * @param path path of the CSV file.
+ * @param trace the trace to save.
+ * @return true if the file could be written, false otherwise.
+ */
+bool saveGaitTrace(const string &path, const GaitTrace &trace)
+{
+    ofstream file(path);
+    if(!file.is_open())
+    {
+        cerr << "Could not create " << path << "." << endl;
+        return false;
+    }
+
+    file << "time,left_hip_angle,right_hip_angle,left_hip_speed,right_hip_speed";
+    for(int i=0; i<8; i++)
+        file << ",left_sole_" << i;
+    for(int i=0; i<8; i++)
+        file << ",right_sole_" << i;
+    file << "\n";
+
+    for(const SensorFrame &f : trace.frames)
+    {
+        file << f.time << "," << f.leftHipAngle << "," << f.rightHipAngle << ","
+             << f.leftHipSpeed << "," << f.rightHipSpeed;
+        for(float v : f.leftSoleVoltages)
+            file << "," << v;
+        for(float v : f.rightSoleVoltages)
+            file << "," << v;
+        file << "\n";
+    }
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef GAITTRACE_H
+#define GAITTRACE_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "../../controllers/ewalk/solecalibration.h"
+
+/**
+ * @brief Sensor values seen by the controller during one time step.
+ */
+struct SensorFrame
+{
+    float time;                             ///< [s]
+    float leftHipAngle, rightHipAngle;      ///< [deg]
+    float leftHipSpeed, rightHipSpeed;      ///< [deg/s]
+    std::array<float, 8> leftSoleVoltages;  ///< [V]
+    std::array<float, 8> rightSoleVoltages; ///< [V]
+};
+
+/**
+ * @brief Sequence of sensor frames at a fixed time step.
+ */
+struct GaitTrace
+{
+    float dt;                       ///< [s]
+    std::vector<SensorFrame> frames;
+};
+
+/**
+ * @brief Parameters of a synthetic gait.
+ */
+struct SyntheticGaitParams
+{
+    float duration;         ///< Total duration of the trace [s]
+    float dt;               ///< Time step [s]
+    float cycleDuration;    ///< Mean gait cycle duration [s]
+    float cycleVariability; ///< Relative SD of the duration of each cycle []
+    float changeTime;       ///< Time of a step change of the mean cycle duration, negative for none [s]
+    float changedCycleDuration; ///< Mean gait cycle duration after changeTime [s]
+    float stanceRatio;      ///< Fraction of the gait cycle in stance []
+    float bodyweight;       ///< Load on the soles in full stance [kg]
+    float hipAmplitude;     ///< Amplitude of the hip flexion [deg]
+    unsigned int seed;      ///< Random seed for the cycles variability
+};
+
+void distributeFootLoad(float load, float rollover, const SoleCalibration &calibration,
+                        SoleSide side, std::array<float, 8> &voltages);
+
+SyntheticGaitParams getDefaultSyntheticGaitParams();
+GaitTrace makeSyntheticGait(const SyntheticGaitParams &params,
+                            const SoleCalibration &calibration);
+
+bool loadGaitTrace(const std::string &path, GaitTrace &trace);
+bool saveGaitTrace(const std::string &path, const GaitTrace &trace);
+
+#endif // GAITTRACE_H
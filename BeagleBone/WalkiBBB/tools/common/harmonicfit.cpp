@@ -0,0 +1,286 @@
+#include "harmonicfit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+#define N_UNKNOWNS_MAX (2*N_HARMONICS)
+
+/**
+ * @brief Least-squares solution of the harmonic model for one fundamental:
+ * values ~ sum_k s[k]*sin(k*w*t) + q[k]*cos(k*w*t).
+ */
+struct LinearSolution
+{
+    double x[N_UNKNOWNS_MAX]; ///< s[0], q[0], s[1], q[1]...
+    double sse;               ///< Weighted sum of squared residuals.
+};
+
+/**
+ * @brief Solves the symmetric positive definite system A*x = b in place, by
+ * Cholesky decomposition. Only the lower triangle of A is used.
+ * @param A n*n matrix, row-major, overwritten by the factor.
+ * @param b right-hand side, overwritten by the solution.
+ * @param n size of the system.
+ * @return true if the system could be solved, false if A is singular.
+ */
+static bool solveCholesky(double *A, double *b, int n)
+{
+    for(int j=0; j<n; j++)
+    {
+        double d = A[j*n+j];
+        for(int k=0; k<j; k++)
+            d -= A[j*n+k] * A[j*n+k];
+
+        if(d <= 1e-12 * fabs(A[j*n+j]) || d <= 0.0)
+            return false;
+
+        d = sqrt(d);
+        A[j*n+j] = d;
+
+        for(int i=j+1; i<n; i++)
+        {
+            double s = A[i*n+j];
+            for(int k=0; k<j; k++)
+                s -= A[i*n+k] * A[j*n+k];
+            A[i*n+j] = s / d;
+        }
+    }
+
+    for(int i=0; i<n; i++) // L*y = b.
+    {
+        for(int k=0; k<i; k++)
+            b[i] -= A[i*n+k] * b[k];
+        b[i] /= A[i*n+i];
+    }
+
+    for(int i=n-1; i>=0; i--) // L^T*x = y.
+    {
+        for(int k=i+1; k<n; k++)
+            b[i] -= A[k*n+i] * b[k];
+        b[i] /= A[i*n+i];
+    }
+
+    return true;
+}
+
+/**
+ * @brief Computes sin(k*theta) and cos(k*theta), k = 1..nHarmonics, with the
+ * angle addition recurrence, so that only one sin() and one cos() are needed.
+ * @param theta angle of the first term [rad].
+ * @param nHarmonics number of terms.
+ * @param basis output, interleaved sine and cosine of each term.
+ */
+static inline void computeBasis(double theta, int nHarmonics, double *basis)
+{
+    double s1 = sin(theta), c1 = cos(theta);
+    double s = s1, c = c1;
+
+    for(int k=0; k<nHarmonics; k++)
+    {
+        basis[2*k] = s;
+        basis[2*k+1] = c;
+
+        double sNext = s * c1 + c * s1;
+        c = c * c1 - s * s1;
+        s = sNext;
+    }
+}
+
+/**
+ * @brief Solves the weighted linear least-squares problem for one fundamental.
+ * @param time sample times [s].
+ * @param values samples of the trace.
+ * @param weights weight of each sample, or nullptr for uniform weights.
+ * @param nHarmonics number of terms.
+ * @param fundamental angular frequency of the first term [rad/s].
+ * @return the solution. Its sse is infinite if the system is singular.
+ */
+static LinearSolution solveLinear(const vector<double> &time,
+                                  const vector<double> &values,
+                                  const double *weights, int nHarmonics,
+                                  double fundamental)
+{
+    const int n = 2 * nHarmonics;
+    double A[N_UNKNOWNS_MAX*N_UNKNOWNS_MAX] = { 0.0 };
+    double basis[N_UNKNOWNS_MAX];
+    LinearSolution solution = { { 0.0 }, 0.0 };
+    double yy = 0.0;
+
+    for(size_t s=0; s<time.size(); s++)
+    {
+        double w = (weights != nullptr) ? weights[s] : 1.0;
+        double y = values[s];
+        computeBasis(fundamental * time[s], nHarmonics, basis);
+
+        for(int i=0; i<n; i++)
+        {
+            double wb = w * basis[i];
+            for(int j=0; j<=i; j++)
+                A[i*n+j] += wb * basis[j];
+            solution.x[i] += wb * y;
+        }
+        yy += w * y * y;
+    }
+
+    double rhs[N_UNKNOWNS_MAX];
+    copy(solution.x, solution.x + n, rhs);
+
+    if(!solveCholesky(A, solution.x, n))
+    {
+        solution.sse = numeric_limits<double>::infinity();
+        return solution;
+    }
+
+    // At the optimum, the sum of squared residuals is y'y - x'A'y.
+    solution.sse = yy;
+    for(int i=0; i<n; i++)
+        solution.sse -= solution.x[i] * rhs[i];
+
+    return solution;
+}
+
+HarmonicFit fitHarmonics(const vector<double> &time, const vector<double> &values,
+                         int nHarmonics, double fundamental,
+                         int robustIterations)
+{
+    nHarmonics = max(1, min(nHarmonics, N_HARMONICS));
+
+    LinearSolution solution = solveLinear(time, values, nullptr, nHarmonics,
+                                          fundamental);
+
+    // Least absolute residuals, by iteratively reweighted least squares.
+    vector<double> weights(time.size());
+    double basis[N_UNKNOWNS_MAX];
+    for(int it=0; it<robustIterations && isfinite(solution.sse); it++)
+    {
+        for(size_t s=0; s<time.size(); s++)
+        {
+            computeBasis(fundamental * time[s], nHarmonics, basis);
+            double model = 0.0;
+            for(int i=0; i<2*nHarmonics; i++)
+                model += solution.x[i] * basis[i];
+
+            weights[s] = 1.0 / max(fabs(values[s] - model),
+                                   HARMONIC_FIT_LAR_EPSILON);
+        }
+
+        LinearSolution weighted = solveLinear(time, values, weights.data(),
+                                              nHarmonics, fundamental);
+        if(!isfinite(weighted.sse))
+            break;
+        solution = weighted;
+    }
+
+    // Convert s*sin(x) + q*cos(x) to a*sin(x + c).
+    HarmonicFit fit;
+    fit.nHarmonics = nHarmonics;
+    fit.fundamental = fundamental;
+    fit.coefficients.a.fill(0.0f);
+    fit.coefficients.b.fill(0.0f);
+    fit.coefficients.c.fill(0.0f);
+
+    for(int k=0; k<nHarmonics; k++)
+    {
+        double s = solution.x[2*k], q = solution.x[2*k+1];
+        fit.coefficients.a[k] = (float)sqrt(s*s + q*q);
+        fit.coefficients.b[k] = (float)((k+1) * fundamental);
+        fit.coefficients.c[k] = (float)atan2(q, s);
+    }
+
+    // Goodness of fit, of the coefficients as the controller will use them.
+    double mean = 0.0;
+    for(double v : values)
+        mean += v;
+    mean /= max<size_t>(1, values.size());
+
+    double sse = 0.0, sst = 0.0;
+    for(size_t s=0; s<time.size(); s++)
+    {
+        double model = 0.0;
+        for(int k=0; k<nHarmonics; k++)
+        {
+            model += fit.coefficients.a[k] * sin(fit.coefficients.b[k] * time[s]
+                                                 + fit.coefficients.c[k]);
+        }
+
+        double r = values[s] - model;
+        sse += r * r;
+        sst += (values[s] - mean) * (values[s] - mean);
+    }
+
+    fit.rmse = sqrt(sse / max<size_t>(1, time.size()));
+    fit.r2 = (sst > 0.0) ? 1.0 - sse / sst : 0.0;
+
+    return fit;
+}
+
+HarmonicFit searchHarmonics(const vector<double> &time, const vector<double> &values,
+                            int nHarmonics, double minPeriod, double maxPeriod,
+                            int robustIterations, int nThreads)
+{
+    nHarmonics = max(1, min(nHarmonics, N_HARMONICS));
+
+    const double minFundamental = 2.0 * M_PI / maxPeriod;
+    const double maxFundamental = 2.0 * M_PI / minPeriod;
+    const int nGridPoints = 1 + (int)ceil((maxFundamental - minFundamental)
+                                          / HARMONIC_FIT_GRID_STEP);
+
+    // Evaluate the grid.
+    vector<double> gridSse(nGridPoints);
+    atomic<int> nextPoint(0);
+
+    auto worker = [&]()
+    {
+        int i;
+        while((i = nextPoint.fetch_add(1)) < nGridPoints)
+        {
+            double w = minFundamental + i * HARMONIC_FIT_GRID_STEP;
+            gridSse[i] = solveLinear(time, values, nullptr, nHarmonics, w).sse;
+        }
+    };
+
+    vector<thread> threads;
+    for(int t=1; t<max(1, nThreads); t++)
+        threads.push_back(thread(worker));
+    worker();
+    for(thread &t : threads)
+        t.join();
+
+    int best = (int)(min_element(gridSse.begin(), gridSse.end()) - gridSse.begin());
+
+    // Refine around the best grid point.
+    const double invPhi = (sqrt(5.0) - 1.0) / 2.0;
+    double lo = minFundamental + (best - 1) * HARMONIC_FIT_GRID_STEP;
+    double hi = minFundamental + (best + 1) * HARMONIC_FIT_GRID_STEP;
+    double x1 = hi - invPhi * (hi - lo), x2 = lo + invPhi * (hi - lo);
+    double f1 = solveLinear(time, values, nullptr, nHarmonics, x1).sse;
+    double f2 = solveLinear(time, values, nullptr, nHarmonics, x2).sse;
+
+    for(int it=0; it<HARMONIC_FIT_REFINE_ITERATIONS; it++)
+    {
+        if(f1 < f2)
+        {
+            hi = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = hi - invPhi * (hi - lo);
+            f1 = solveLinear(time, values, nullptr, nHarmonics, x1).sse;
+        }
+        else
+        {
+            lo = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = lo + invPhi * (hi - lo);
+            f2 = solveLinear(time, values, nullptr, nHarmonics, x2).sse;
+        }
+    }
+
+    return fitHarmonics(time, values, nHarmonics, (lo + hi) / 2.0,
+                        robustIterations);
+}
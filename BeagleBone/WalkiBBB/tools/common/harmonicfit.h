@@ -0,0 +1,61 @@
+#ifndef HARMONICFIT_H
+#define HARMONICFIT_H
+
+#include <vector>
+
+#include "../../controllers/ewalk/torqueprofiletable.h"
+
+#define HARMONIC_FIT_GRID_STEP 0.01     ///< Step of the fundamental search grid [rad/s].
+#define HARMONIC_FIT_REFINE_ITERATIONS 40 ///< Golden-section iterations after the grid.
+#define HARMONIC_FIT_LAR_EPSILON 1e-6   ///< Min. residual of the robust weights.
+
+/**
+ * @brief Result of the fit of a sum-of-sines model to a torque trace.
+ */
+struct HarmonicFit
+{
+    int nHarmonics;
+    HarmonicCoefficients coefficients;
+    double fundamental;     ///< [rad/s].
+    double rmse;            ///< Root mean square of the residuals, same unit as the trace.
+    double r2;              ///< Coefficient of determination.
+};
+
+/**
+ * @brief Fits torque(t) = sum_k a[k]*sin(k*w*t + c[k]), k = 1..nHarmonics,
+ * for a given fundamental w. For a fixed w the model is linear in the sine and
+ * cosine amplitudes, so this is a single least-squares solve.
+ * @param time sample times [s].
+ * @param values samples of the trace.
+ * @param nHarmonics number of terms, from 1 to N_HARMONICS.
+ * @param fundamental angular frequency of the first term [rad/s].
+ * @param robustIterations number of iteratively reweighted passes that
+ * approximate a least absolute residuals fit, like the "LAR" robust option of
+ * MATLAB. 0 for an ordinary least-squares fit.
+ * @return the fit. Its a[k] are positive, its c[k] in [-pi, pi].
+ */
+HarmonicFit fitHarmonics(const std::vector<double> &time,
+                         const std::vector<double> &values,
+                         int nHarmonics, double fundamental,
+                         int robustIterations = 0);
+
+/**
+ * @brief Fits the sum-of-sines model, also searching the fundamental.
+ * The sum of squared residuals is evaluated on a grid of fundamentals, then
+ * the best grid point is refined by golden-section search. The grid points are
+ * shared between the given number of threads.
+ * @param time sample times [s].
+ * @param values samples of the trace.
+ * @param nHarmonics number of terms, from 1 to N_HARMONICS.
+ * @param minPeriod shortest gait cycle duration searched [s].
+ * @param maxPeriod longest gait cycle duration searched [s].
+ * @param robustIterations see fitHarmonics(). Only applied to the final fit.
+ * @param nThreads number of threads evaluating the grid.
+ * @return the best fit.
+ */
+HarmonicFit searchHarmonics(const std::vector<double> &time,
+                            const std::vector<double> &values,
+                            int nHarmonics, double minPeriod, double maxPeriod,
+                            int robustIterations, int nThreads);
+
+#endif // HARMONICFIT_H
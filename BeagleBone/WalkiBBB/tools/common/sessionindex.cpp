@@ -0,0 +1,743 @@
+#include "sessionindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "telemetryreader.h"
+
+using namespace std;
+
+const char *const CLOCK_SET_MESSAGE = "The date was set by the remote client.";
+const char *const INITIAL_VALUES_MESSAGE = "Values of the writable SyncVars:";
+
+/**
+ * @brief Gets the size and modification time of a file, to check if its
+ * entries in the index are up to date.
+ * @param path path of the file.
+ * @param size size of the file [B].
+ * @param mtime modification time of the file [ns].
+ * @return true if the file exists, false otherwise.
+ */
+static bool getFileStamp(const string &path, uint64_t &size, int64_t &mtime)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return false;
+
+    size = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Lists the session logs (.txt) and telemetry segments (.wtlm) of a
+ * directory and its sub-directories, except the hidden ones.
+ * @param root the indexed directory.
+ * @param relative the listed sub-directory, relative to root, "" for root.
+ * @param files the paths relative to root, appended.
+ */
+static void listSessionFiles(const string &root, const string &relative,
+                             vector<string> &files)
+{
+    DIR *dir = opendir((relative.empty() ? root : root + "/" + relative).c_str());
+    if(dir == nullptr)
+        return;
+
+    while(struct dirent *entry = readdir(dir))
+    {
+        string fileName = entry->d_name;
+        if(fileName.empty() || fileName[0] == '.')
+            continue;
+
+        string path = relative.empty() ? fileName : relative + "/" + fileName;
+        struct stat st;
+        if(stat((root + "/" + path).c_str(), &st) != 0)
+            continue;
+
+        auto endsWith = [&](const char *suffix)
+        {
+            size_t n = strlen(suffix);
+            return fileName.size() > n && fileName.compare(fileName.size() - n, n, suffix) == 0;
+        };
+
+        if(S_ISDIR(st.st_mode))
+            listSessionFiles(root, path, files);
+        else if(endsWith(".txt") || endsWith(".wtlm"))
+            files.push_back(path);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * @brief Parses a line of a session log, "[YYYY-MM-DD_hh_mm_ss__<us>] text".
+ * @param line the line.
+ * @param date the date of the line, as Unix time [us].
+ * @param time the timestamp of the line, as Unix time [us].
+ * @param text the text after the timestamp.
+ * @return true if the line has a timestamp, false otherwise.
+ */
+static bool parseLogLine(const string &line, int64_t &date, int64_t &time, string &text)
+{
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    long long timestamp;
+    int length = 0;
+
+    if(sscanf(line.c_str(), "[%d-%d-%d_%d_%d_%d__%lld]%n", &t.tm_year, &t.tm_mon,
+              &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec, &timestamp, &length) != 7 ||
+       length == 0)
+        return false;
+
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    date = (int64_t)timegm(&t) * 1000000LL;
+    time = timestamp;
+
+    size_t start = (size_t)length;
+    if(start < line.size() && line[start] == ' ')
+        start++;
+    size_t end = line.find_last_not_of("\r\n");
+    text = (end == string::npos || end < start) ? "" : line.substr(start, end + 1 - start);
+    return true;
+}
+
+/**
+ * @brief Parses a number, that must be the whole string or followed by a
+ * space (e.g. before a unit).
+ * @param s the string.
+ * @return the number, NaN if none (e.g. "?").
+ */
+static float parseValue(const string &s)
+{
+    char *end;
+    float value = strtof(s.c_str(), &end);
+    if(end == s.c_str() || (*end != '\0' && *end != ' '))
+        return NAN;
+    return value;
+}
+
+/**
+ * @brief Constructor.
+ */
+SessionIndex::SessionIndex() :
+    nScannedFiles(0)
+{
+
+}
+
+/**
+ * @brief Indexes a directory. Loads its saved index, reads again the files
+ * added or modified since, drops the removed ones, then saves the index if it
+ * changed.
+ * @param directory path of the directory.
+ * @param rebuild if true, ignores the saved index and reads all the files.
+ * @return true if the directory could be read, false otherwise. Failing to
+ * save the index is not an error, it will be built again the next time.
+ */
+bool SessionIndex::build(const string &directory, bool rebuild)
+{
+    struct stat st;
+    if(stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return false;
+
+    SessionIndex previous;
+    bool hasPrevious = !rebuild && previous.load(getIndexPath(directory));
+
+    this->directory = directory;
+    sources.clear();
+    sessions.clear();
+    segments.clear();
+    varNames = previous.varNames; // Keep the indices of the unchanged sessions.
+    nScannedFiles = 0;
+
+    map<string, const SourceFile*> previousSources;
+    for(const SourceFile &source : previous.sources)
+        previousSources[source.path] = &source;
+
+    vector<string> files;
+    listSessionFiles(directory, "", files);
+    sort(files.begin(), files.end());
+
+    for(const string &path : files)
+    {
+        SourceFile source;
+        source.path = path;
+        if(!getFileStamp(directory + "/" + path, source.size, source.mtime))
+            continue;
+
+        auto it = previousSources.find(path);
+        if(it != previousSources.end() && it->second->size == source.size &&
+           it->second->mtime == source.mtime)
+        {
+            for(const LogSession &session : previous.sessions)
+            {
+                if(session.path == path)
+                    sessions.push_back(session);
+            }
+            for(const TelemetrySegmentInfo &segment : previous.segments)
+            {
+                if(segment.path == path)
+                    segments.push_back(segment);
+            }
+        }
+        else
+        {
+            // A file that is not a session log nor a segment is kept in the
+            // index without entries, so it is not read again.
+            if(path.compare(path.size() - 5, 5, ".wtlm") == 0)
+                scanSegment(path);
+            else
+                scanLog(path);
+            nScannedFiles++;
+        }
+
+        sources.push_back(source);
+    }
+
+    if(!hasPrevious || nScannedFiles > 0 || sources.size() != previous.sources.size())
+    {
+        mkdir((directory + "/" + SESSION_INDEX_DIRECTORY).c_str(), 0755);
+        save(getIndexPath(directory));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Loads a saved index.
+ * @param indexPath path of the index file.
+ * @return true if the file is a valid index, false otherwise.
+ */
+bool SessionIndex::load(const string &indexPath)
+{
+    ifstream file(indexPath, ios::binary);
+    if(!file.is_open())
+        return false;
+
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t pos = 0;
+    bool valid = true;
+
+    auto read = [&](void *value, size_t size)
+    {
+        if(!valid || pos + size > data.size())
+        {
+            valid = false;
+            memset(value, 0, size);
+            return;
+        }
+        memcpy(value, &data[pos], size);
+        pos += size;
+    };
+
+    auto readCount = [&]() -> uint32_t
+    {
+        uint32_t n;
+        read(&n, sizeof(n));
+        if(n > data.size() - pos) // Each item takes at least one byte.
+            valid = false;
+        return valid ? n : 0;
+    };
+
+    auto readString = [&]() -> string
+    {
+        uint32_t length = readCount();
+        string s((const char*)data.data() + pos, length);
+        pos += length;
+        return s;
+    };
+
+    SessionIndexHeader h;
+    read(&h, sizeof(h));
+    if(!valid || h.magic != SESSION_INDEX_MAGIC || h.version != SESSION_INDEX_VERSION ||
+       (uint64_t)h.nSources + h.nVars + h.nSessions + h.nSegments > data.size())
+        return false;
+
+    vector<SourceFile> loadedSources(h.nSources);
+    for(SourceFile &source : loadedSources)
+    {
+        source.path = readString();
+        read(&source.size, sizeof(source.size));
+        read(&source.mtime, sizeof(source.mtime));
+    }
+
+    vector<string> loadedVarNames(h.nVars);
+    for(string &name : loadedVarNames)
+        name = readString();
+
+    vector<LogSession> loadedSessions(h.nSessions);
+    for(LogSession &session : loadedSessions)
+    {
+        session.path = readString();
+        read(&session.startTime, sizeof(session.startTime));
+        read(&session.endTime, sizeof(session.endTime));
+
+        session.events.resize(readCount());
+        read(session.events.data(), session.events.size() * sizeof(SessionEvent));
+
+        session.messages.resize(readCount());
+        for(string &message : session.messages)
+            message = readString();
+    }
+
+    vector<TelemetrySegmentInfo> loadedSegments(h.nSegments);
+    for(TelemetrySegmentInfo &segment : loadedSegments)
+    {
+        segment.path = readString();
+        read(&segment.startTime, sizeof(segment.startTime));
+        read(&segment.endTime, sizeof(segment.endTime));
+        read(&segment.nRecords, sizeof(segment.nRecords));
+
+        segment.channels.resize(readCount());
+        for(string &channel : segment.channels)
+            channel = readString();
+    }
+
+    if(!valid)
+        return false;
+
+    size_t slash = indexPath.rfind("/" SESSION_INDEX_DIRECTORY "/");
+    directory = (slash == string::npos) ? "." : indexPath.substr(0, slash);
+    sources = loadedSources;
+    varNames = loadedVarNames;
+    sessions = loadedSessions;
+    segments = loadedSegments;
+    return true;
+}
+
+/**
+ * @brief Saves the index.
+ * @param indexPath path of the index file. Its directory must exist.
+ * @return true if the file could be written, false otherwise.
+ */
+bool SessionIndex::save(const string &indexPath) const
+{
+    vector<uint8_t> buffer;
+
+    auto write = [&](const void *value, size_t size)
+    {
+        const uint8_t *p = (const uint8_t*)value;
+        buffer.insert(buffer.end(), p, p + size);
+    };
+
+    auto writeCount = [&](size_t n)
+    {
+        uint32_t count = (uint32_t)n;
+        write(&count, sizeof(count));
+    };
+
+    auto writeString = [&](const string &s)
+    {
+        writeCount(s.size());
+        write(s.data(), s.size());
+    };
+
+    SessionIndexHeader h;
+    h.magic = SESSION_INDEX_MAGIC;
+    h.version = SESSION_INDEX_VERSION;
+    h.nSources = (uint32_t)sources.size();
+    h.nVars = (uint32_t)varNames.size();
+    h.nSessions = (uint32_t)sessions.size();
+    h.nSegments = (uint32_t)segments.size();
+    write(&h, sizeof(h));
+
+    for(const SourceFile &source : sources)
+    {
+        writeString(source.path);
+        write(&source.size, sizeof(source.size));
+        write(&source.mtime, sizeof(source.mtime));
+    }
+
+    for(const string &name : varNames)
+        writeString(name);
+
+    for(const LogSession &session : sessions)
+    {
+        writeString(session.path);
+        write(&session.startTime, sizeof(session.startTime));
+        write(&session.endTime, sizeof(session.endTime));
+
+        writeCount(session.events.size());
+        write(session.events.data(), session.events.size() * sizeof(SessionEvent));
+
+        writeCount(session.messages.size());
+        for(const string &message : session.messages)
+            writeString(message);
+    }
+
+    for(const TelemetrySegmentInfo &segment : segments)
+    {
+        writeString(segment.path);
+        write(&segment.startTime, sizeof(segment.startTime));
+        write(&segment.endTime, sizeof(segment.endTime));
+        write(&segment.nRecords, sizeof(segment.nRecords));
+
+        writeCount(segment.channels.size());
+        for(const string &channel : segment.channels)
+            writeString(channel);
+    }
+
+    // Write to a temporary file then rename, so a concurrent query never
+    // reads a partial index.
+    string tmpPath = indexPath + ".tmp" + to_string(getpid());
+    ofstream file(tmpPath, ios::binary);
+    if(!file.is_open())
+        return false;
+
+    file.write((const char*)buffer.data(), buffer.size());
+    file.close();
+
+    if(!file.good() || rename(tmpPath.c_str(), indexPath.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gets the indexed directory.
+ * @return the path of the directory, as given to build().
+ */
+const string &SessionIndex::getDirectory() const
+{
+    return directory;
+}
+
+/**
+ * @brief Gets the session logs.
+ * @return the sessions, sorted by path.
+ */
+const vector<LogSession> &SessionIndex::getSessions() const
+{
+    return sessions;
+}
+
+/**
+ * @brief Gets the telemetry segments.
+ * @return the segments, sorted by path.
+ */
+const vector<TelemetrySegmentInfo> &SessionIndex::getSegments() const
+{
+    return segments;
+}
+
+/**
+ * @brief Gets the names of the SyncVars found in the logs.
+ * @return the full names, e.g. "controller/const/percent_assist".
+ */
+const vector<string> &SessionIndex::getVarNames() const
+{
+    return varNames;
+}
+
+/**
+ * @brief Finds a SyncVar by its full name, or by the end of it after a '/'
+ * (e.g. "percent_assist").
+ * @param name the name.
+ * @return the index in getVarNames(), -1 if not found or ambiguous.
+ */
+int SessionIndex::findVar(const string &name) const
+{
+    int found = -1;
+    for(size_t i=0; i<varNames.size(); i++)
+    {
+        const string &v = varNames[i];
+        if(v == name)
+            return (int)i;
+
+        if(v.size() > name.size() && v[v.size() - name.size() - 1] == '/' &&
+           v.compare(v.size() - name.size(), name.size(), name) == 0)
+        {
+            if(found >= 0)
+                return -1;
+            found = (int)i;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Gets the number of files read by the last build().
+ * @return the number of files added or modified since the saved index.
+ */
+size_t SessionIndex::getScannedFilesCount() const
+{
+    return nScannedFiles;
+}
+
+/**
+ * @brief Finds the time intervals where all the conditions hold. A SyncVar
+ * whose value is not known yet (not listed at the start, nor set) fails all
+ * its conditions.
+ * @param conditions the conditions. If empty, each whole session is a window.
+ * @return the windows, by session then time.
+ */
+vector<SessionWindow> SessionIndex::findWindows(const vector<SessionCondition> &conditions) const
+{
+    auto holds = [](float a, const string &op, float b)
+    {
+        if(op == "=")
+            return fabsf(a - b) <= 1e-6f * max(1.0f, fabsf(b));
+        else if(op == "!=")
+            return !std::isnan(a) && fabsf(a - b) > 1e-6f * max(1.0f, fabsf(b));
+        else if(op == "<")
+            return a < b;
+        else if(op == "<=")
+            return a <= b;
+        else if(op == ">")
+            return a > b;
+        else if(op == ">=")
+            return a >= b;
+        else
+            return false;
+    };
+
+    vector<SessionWindow> windows;
+    for(size_t s=0; s<sessions.size(); s++)
+    {
+        const LogSession &session = sessions[s];
+        if(conditions.empty())
+        {
+            windows.push_back({s, session.startTime, session.endTime});
+            continue;
+        }
+
+        vector<float> values(conditions.size(), NAN);
+        bool open = false;
+        int64_t windowStart = 0;
+
+        // The conditions are evaluated after all the events of a same time.
+        const vector<SessionEvent> &events = session.events;
+        for(size_t i=0; i<events.size();)
+        {
+            int64_t t = events[i].time;
+            for(; i<events.size() && events[i].time == t; i++)
+            {
+                for(size_t c=0; c<conditions.size(); c++)
+                {
+                    if(events[i].var == conditions[c].var)
+                        values[c] = events[i].value;
+                }
+            }
+
+            bool allHold = true;
+            for(size_t c=0; c<conditions.size(); c++)
+                allHold = allHold && holds(values[c], conditions[c].op, conditions[c].value);
+
+            if(allHold && !open)
+            {
+                open = true;
+                windowStart = t;
+            }
+            else if(!allHold && open)
+            {
+                open = false;
+                if(t > windowStart)
+                    windows.push_back({s, windowStart, t});
+            }
+        }
+
+        if(open && session.endTime > windowStart)
+            windows.push_back({s, windowStart, session.endTime});
+    }
+
+    return windows;
+}
+
+/**
+ * @brief Finds the telemetry segments that overlap a time interval.
+ * @param start start of the interval, as Unix time [us].
+ * @param end end of the interval, as Unix time [us].
+ * @return the indices in getSegments().
+ */
+vector<size_t> SessionIndex::findSegments(int64_t start, int64_t end) const
+{
+    vector<size_t> found;
+    for(size_t i=0; i<segments.size(); i++)
+    {
+        if(segments[i].startTime <= end && segments[i].endTime >= start)
+            found.push_back(i);
+    }
+
+    return found;
+}
+
+/**
+ * @brief Gets the path of the index file of a directory.
+ * @param directory path of the indexed directory.
+ * @return the path of the index file.
+ */
+string SessionIndex::getIndexPath(const string &directory)
+{
+    return directory + "/" + SESSION_INDEX_DIRECTORY + "/" + SESSION_INDEX_FILE;
+}
+
+/**
+ * @brief Formats a time like the session logs, in UTC, with milliseconds.
+ * @param time Unix time [us].
+ * @return the date and time, e.g. "2021-07-14_08_06_48.010".
+ */
+string SessionIndex::formatTime(int64_t time)
+{
+    time_t seconds = (time_t)(time / 1000000);
+    int milliseconds = (int)((time % 1000000) / 1000);
+    if(milliseconds < 0)
+    {
+        seconds--;
+        milliseconds += 1000;
+    }
+
+    struct tm t;
+    gmtime_r(&seconds, &t);
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d_%02d_%02d_%02d.%03d",
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min,
+             t.tm_sec, milliseconds);
+    return buffer;
+}
+
+/**
+ * @brief Reads a session log, and adds it to the sessions.
+ * @param relativePath path of the file, relative to the directory.
+ * @return true if it is a session log, false otherwise.
+ */
+bool SessionIndex::scanLog(const string &relativePath)
+{
+    ifstream file(directory + "/" + relativePath);
+    if(!file.is_open())
+        return false;
+
+    LogSession session;
+    session.path = relativePath;
+
+    bool initialValues = false;
+    string line, text;
+    while(getline(file, line))
+    {
+        int64_t date, time;
+        if(!parseLogLine(line, date, time, text))
+            continue;
+
+        // The clock was just set: move the previous lines to the new clock.
+        if(text == CLOCK_SET_MESSAGE)
+        {
+            int64_t shift = date - time;
+            for(SessionEvent &event : session.events)
+                event.time += shift;
+        }
+
+        // The timestamp can lag behind the date by a few seconds, e.g. at the
+        // start, or just after the clock was set.
+        time = max(time, date);
+
+        SessionEvent event;
+        memset(&event, 0, sizeof(event));
+        event.time = time;
+        event.var = -1;
+        event.value = NAN;
+        event.previous = NAN;
+
+        size_t colon = text.find(": ");
+        size_t to = text.find(" to ");
+        size_t was = text.find(" (was ");
+
+        if(initialValues && colon != string::npos && text.find(' ') > colon &&
+           !std::isnan(parseValue(text.substr(colon + 2))))
+        {
+            // "name: value", in the list of the SyncVars at the start.
+            event.type = SESSION_EVENT_INITIAL;
+            event.var = getVarIndex(text.substr(0, colon));
+            event.value = parseValue(text.substr(colon + 2));
+        }
+        else if(text.compare(0, 4, "Set ") == 0 && to != string::npos &&
+                was != string::npos && to < was)
+        {
+            // "Set name to value unit (was previous unit before)."
+            initialValues = false;
+            event.type = SESSION_EVENT_SET;
+            event.var = getVarIndex(text.substr(4, to - 4));
+            event.value = parseValue(text.substr(to + 4, was - to - 4));
+            event.previous = parseValue(text.substr(was + 6));
+        }
+        else
+        {
+            initialValues = (text == INITIAL_VALUES_MESSAGE);
+            event.type = SESSION_EVENT_MESSAGE;
+            event.message = (uint32_t)session.messages.size();
+            session.messages.push_back(text);
+        }
+
+        session.events.push_back(event);
+    }
+
+    if(session.events.empty())
+        return false;
+
+    // The times could go back if the clock was set backwards.
+    stable_sort(session.events.begin(), session.events.end(),
+                [](const SessionEvent &a, const SessionEvent &b) { return a.time < b.time; });
+
+    session.startTime = session.events.front().time;
+    session.endTime = session.events.back().time;
+    sessions.push_back(session);
+    return true;
+}
+
+/**
+ * @brief Reads a telemetry segment, and adds it to the segments.
+ * @param relativePath path of the file, relative to the directory.
+ * @return true if it is a valid segment, false otherwise.
+ */
+bool SessionIndex::scanSegment(const string &relativePath)
+{
+    TelemetryReader reader;
+    if(!reader.appendSegment(directory + "/" + relativePath))
+        return false;
+
+    TelemetrySegmentInfo segment;
+    segment.path = relativePath;
+    segment.nRecords = reader.getRecordsCount();
+    segment.startTime = reader.getStartWallTime();
+    segment.endTime = segment.startTime;
+    if(segment.nRecords > 0)
+    {
+        segment.startTime += llround(reader.getTime(0) * 1e6);
+        segment.endTime += llround(reader.getTime(segment.nRecords - 1) * 1e6);
+    }
+
+    for(const TelemetryChannel &channel : reader.getChannels())
+        segment.channels.push_back(channel.name);
+
+    segments.push_back(segment);
+    return true;
+}
+
+/**
+ * @brief Gets the index of a SyncVar, adding it if new.
+ * @param name the full name of the SyncVar.
+ * @return the index in varNames.
+ */
+int SessionIndex::getVarIndex(const string &name)
+{
+    auto it = find(varNames.begin(), varNames.end(), name);
+    if(it != varNames.end())
+        return (int)(it - varNames.begin());
+
+    varNames.push_back(name);
+    return (int)varNames.size() - 1;
+}
@@ -0,0 +1,156 @@
+#ifndef SESSIONINDEX_H
+#define SESSIONINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SESSION_INDEX_MAGIC 0x58444953      ///< "SIDX", little-endian.
+#define SESSION_INDEX_VERSION 1
+#define SESSION_INDEX_DIRECTORY ".logindex" ///< Sub-directory of the index file.
+#define SESSION_INDEX_FILE "sessions.idx"
+
+/**
+ * @brief Header of the index file. It is followed by the indexed files, the
+ * SyncVar names, the sessions then the telemetry segments. The strings are
+ * stored as a 32-bit length then the characters, and the arrays as a 32-bit
+ * count then the items.
+ */
+struct SessionIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nSources;
+    uint32_t nVars;
+    uint32_t nSessions;
+    uint32_t nSegments;
+};
+
+/**
+ * @brief Kind of a line of a session log.
+ */
+enum SessionEventType
+{
+    SESSION_EVENT_MESSAGE = 0,  ///< Any other line.
+    SESSION_EVENT_INITIAL,      ///< Value listed at the start, "name: value".
+    SESSION_EVENT_SET           ///< "Set name to value (was previous before)."
+};
+
+/**
+ * @brief Line of a session log.
+ */
+struct SessionEvent
+{
+    int64_t time;       ///< Unix time [us].
+    int32_t type;       ///< SessionEventType.
+    int32_t var;        ///< Index in SessionIndex::getVarNames(), -1 for a message.
+    float value;        ///< New value of the SyncVar, NaN if not a number.
+    float previous;     ///< Value before, NaN if unknown.
+    uint32_t message;   ///< Index in LogSession::messages, for a message.
+    uint32_t reserved;  ///< Zero, for the alignment.
+};
+
+/**
+ * @brief Session log of the WalkiBBB program (e.g. log_<name>_info.txt), from
+ * its start to its end.
+ */
+struct LogSession
+{
+    std::string path;                   ///< Relative to the indexed directory.
+    int64_t startTime, endTime;         ///< Unix time of the first and last lines [us].
+    std::vector<SessionEvent> events;   ///< In the order of the log.
+    std::vector<std::string> messages;  ///< Text of the other lines.
+};
+
+/**
+ * @brief Telemetry segment file recorded by the controller (.wtlm).
+ */
+struct TelemetrySegmentInfo
+{
+    std::string path;                   ///< Relative to the indexed directory.
+    int64_t startTime, endTime;         ///< Unix time of the first and last records [us].
+    uint64_t nRecords;
+    std::vector<std::string> channels;
+};
+
+/**
+ * @brief Comparison of a SyncVar with a value, e.g. "percent_assist=60".
+ */
+struct SessionCondition
+{
+    int var;            ///< Index in SessionIndex::getVarNames().
+    std::string op;     ///< "=", "!=", "<", "<=", ">" or ">=".
+    float value;
+};
+
+/**
+ * @brief Time interval of a session where conditions hold.
+ */
+struct SessionWindow
+{
+    size_t session;     ///< Index in SessionIndex::getSessions().
+    int64_t start, end; ///< Unix time [us].
+};
+
+/**
+ * @brief Persistent time index of a directory of sessions: the SyncVar changes
+ * and the other events of the session logs, and the time span and channels of
+ * the telemetry segments.
+ *
+ * The directory is scanned recursively once, and the index saved to
+ * SESSION_INDEX_DIRECTORY/SESSION_INDEX_FILE in it. The next builds load the
+ * index, and only read again the files added or modified since, so the
+ * queries never parse the logs. Only the telemetry records extracted for a
+ * query are read, from the segments that overlap the queried windows.
+ *
+ * The time of a line is its microseconds timestamp, or its date if the
+ * timestamp lags behind. The lines written before the clock of the BeagleBone
+ * was set by the remote client are moved to the new clock, with the date of
+ * the line where it was set, so to about a second.
+ */
+class SessionIndex
+{
+public:
+    SessionIndex();
+
+    bool build(const std::string &directory, bool rebuild = false);
+    bool load(const std::string &indexPath);
+    bool save(const std::string &indexPath) const;
+
+    const std::string &getDirectory() const;
+    const std::vector<LogSession> &getSessions() const;
+    const std::vector<TelemetrySegmentInfo> &getSegments() const;
+    const std::vector<std::string> &getVarNames() const;
+    int findVar(const std::string &name) const;
+    size_t getScannedFilesCount() const;
+
+    std::vector<SessionWindow> findWindows(const std::vector<SessionCondition> &conditions) const;
+    std::vector<size_t> findSegments(int64_t start, int64_t end) const;
+
+    static std::string getIndexPath(const std::string &directory);
+    static std::string formatTime(int64_t time);
+
+private:
+    /**
+     * @brief File indexed, to detect when it changes.
+     */
+    struct SourceFile
+    {
+        std::string path;   ///< Relative to the indexed directory.
+        uint64_t size;      ///< [B].
+        int64_t mtime;      ///< [ns].
+    };
+
+    bool scanLog(const std::string &relativePath);
+    bool scanSegment(const std::string &relativePath);
+    int getVarIndex(const std::string &name);
+
+    std::string directory;
+    std::vector<SourceFile> sources;
+    std::vector<LogSession> sessions;
+    std::vector<TelemetrySegmentInfo> segments;
+    std::vector<std::string> varNames;
+    size_t nScannedFiles;   ///< Files read by the last build().
+};
+
+#endif // SESSIONINDEX_H
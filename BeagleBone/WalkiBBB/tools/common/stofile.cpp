@@ -0,0 +1,716 @@
+#include "stofile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * @brief Read-only memory mapping of a whole file, unmapped when destroyed.
+ */
+struct MappedFile
+{
+    MappedFile() : data(nullptr), size(0) { }
+    ~MappedFile()
+    {
+        if(data != nullptr)
+            munmap((void*)data, size);
+    }
+
+    bool open(const string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        size = (size_t)st.st_size;
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if(p == MAP_FAILED)
+            return false;
+
+        data = (const char*)p;
+        madvise(p, size, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    const char *data;
+    size_t size; ///< [B].
+};
+
+/**
+ * @brief Gets the size and modification time of a file, to check if a cache
+ * is up to date.
+ * @param path path of the file.
+ * @param size size of the file [B].
+ * @param mtime modification time of the file [ns].
+ * @return true if the file exists, false otherwise.
+ */
+static bool getFileStamp(const string &path, uint64_t &size, int64_t &mtime)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return false;
+
+    size = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * @brief Parses a decimal number, as written in the .sto files. The common
+ * forms ("-0.12345678", "7e-15") are converted directly, in a single pass; the
+ * other ones ("nan", "inf"...) go through strtof().
+ * @param p position of the first character, moved past the number.
+ * @param end end of the text.
+ * @param value the parsed value.
+ * @return true if a number could be parsed, false otherwise.
+ */
+static bool parseFloat(const char *&p, const char *end, float &value)
+{
+    // Powers of ten that are exact in double precision.
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                   1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                   1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char *start = p;
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int nDigits = 0, nSignificant = 0, exponent = 0;
+
+    for(; p < end && *p >= '0' && *p <= '9'; p++, nDigits++)
+    {
+        if(nSignificant < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            nSignificant += (mantissa > 0) ? 1 : 0;
+        }
+        else
+            exponent++;
+    }
+
+    if(p < end && *p == '.')
+    {
+        p++;
+        for(; p < end && *p >= '0' && *p <= '9'; p++, nDigits++)
+        {
+            if(nSignificant < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                nSignificant += (mantissa > 0) ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+
+    if(nDigits > 0 && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if(e < end && (*e == '-' || *e == '+'))
+        {
+            negativeExponent = (*e == '-');
+            e++;
+        }
+
+        int explicitExponent = 0;
+        const char *digitsStart = e;
+        for(; e < end && *e >= '0' && *e <= '9' && explicitExponent < 10000; e++)
+            explicitExponent = explicitExponent * 10 + (*e - '0');
+
+        if(e > digitsStart)
+        {
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            p = e;
+        }
+    }
+
+    if(nDigits == 0 || (p < end && !isBlank(*p) && *p != '\n'))
+    {
+        // Not a plain decimal number: let the C library handle it.
+        const char *tokenEnd = start;
+        while(tokenEnd < end && !isBlank(*tokenEnd) && *tokenEnd != '\n')
+            tokenEnd++;
+
+        string token(start, tokenEnd);
+        char *parsedEnd;
+        value = strtof(token.c_str(), &parsedEnd);
+        p = tokenEnd;
+        return !token.empty() && *parsedEnd == '\0';
+    }
+
+    double v = (double)mantissa;
+    if(exponent >= 0)
+        v *= (exponent <= 22) ? POW10[exponent] : pow(10.0, exponent);
+    else
+        v /= (exponent >= -22) ? POW10[-exponent] : pow(10.0, -exponent);
+
+    value = (float)(negative ? -v : v);
+    return true;
+}
+
+/**
+ * @brief Constructor. The table is empty.
+ */
+StoTable::StoTable() :
+    nRows(0),
+    mappedData(nullptr),
+    mappedSize(0)
+{
+
+}
+
+/**
+ * @brief Destructor.
+ */
+StoTable::~StoTable()
+{
+    clear();
+}
+
+/**
+ * @brief Loads a .sto file, from its cache if it is up to date, otherwise by
+ * parsing the text, then writing the cache for the next time.
+ * @param path path of the .sto file.
+ * @param useCache false to always parse the text, and ignore the cache.
+ * @return true if the table could be loaded, false otherwise.
+ */
+bool StoTable::load(const string &path, bool useCache)
+{
+    if(!useCache)
+        return parse(path);
+
+    string cachePath = getCachePath(path);
+    if(loadCache(cachePath, path))
+        return true;
+
+    if(!parse(path))
+        return false;
+
+    // Not being able to write the cache is not an error.
+    string directory = cachePath.substr(0, cachePath.find_last_of('/'));
+    mkdir(directory.c_str(), 0755);
+    saveCache(cachePath, path);
+
+    return true;
+}
+
+/**
+ * @brief Parses a .sto text file, in a single pass over the mapped file.
+ * @param path path of the .sto file.
+ * @return true if the file could be parsed, false otherwise.
+ */
+bool StoTable::parse(const string &path)
+{
+    clear();
+
+    MappedFile file;
+    if(!file.open(path))
+    {
+        cerr << "Could not open " << path << "." << endl;
+        return false;
+    }
+
+    const char *p = file.data;
+    const char *end = file.data + file.size;
+    size_t nRowsHint = 0;
+    int lineNumber = 0;
+
+    // Header, until the "endheader" line.
+    bool headerEnded = false;
+    while(p < end && !headerEnded)
+    {
+        const char *lineEnd = (const char*)memchr(p, '\n', end - p);
+        if(lineEnd == nullptr)
+            lineEnd = end;
+
+        string line(p, lineEnd);
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if(lineNumber == 0)
+            name = line;
+        else if(line.compare(0, 6, "nRows=") == 0)
+            nRowsHint = strtoul(line.c_str() + 6, nullptr, 10);
+        else if(line == "endheader")
+            headerEnded = true;
+
+        lineNumber++;
+        p = lineEnd + 1;
+    }
+
+    if(!headerEnded)
+    {
+        cerr << path << ": no \"endheader\" line." << endl;
+        return false;
+    }
+
+    // Column names.
+    const char *namesEnd = (const char*)memchr(p, '\n', end - p);
+    if(namesEnd == nullptr)
+        namesEnd = end;
+
+    // The names are separated by tabs, and may contain spaces (e.g.
+    // "Ground_Force 0"), unless there is no tab at all.
+    bool tabSeparated = (memchr(p, '\t', namesEnd - p) != nullptr);
+    auto isSeparator = [tabSeparated](char c)
+    {
+        return tabSeparated ? (c == '\t' || c == '\r') : isBlank(c);
+    };
+
+    while(p < namesEnd)
+    {
+        while(p < namesEnd && isBlank(*p))
+            p++;
+
+        const char *nameStart = p;
+        while(p < namesEnd && !isSeparator(*p))
+            p++;
+
+        const char *nameEnd = p;
+        while(nameEnd > nameStart && isBlank(nameEnd[-1]))
+            nameEnd--;
+
+        if(nameEnd > nameStart)
+        {
+            string columnName(nameStart, nameEnd);
+            string uniqueName = columnName;
+            for(int n=2; find(columnNames.begin(), columnNames.end(), uniqueName)
+                         != columnNames.end(); n++)
+            {
+                uniqueName = columnName + "_" + to_string(n);
+            }
+            columnNames.push_back(uniqueName);
+        }
+    }
+    lineNumber++;
+    p = namesEnd + 1;
+
+    size_t nColumns = columnNames.size();
+    if(nColumns == 0)
+    {
+        cerr << path << ": no columns." << endl;
+        return false;
+    }
+
+    // Values, row by row, then transposed to columns.
+    vector<float> rows;
+    rows.reserve(nRowsHint * nColumns);
+
+    while(p < end)
+    {
+        lineNumber++;
+        size_t nValues = 0;
+
+        while(true)
+        {
+            while(p < end && isBlank(*p))
+                p++;
+
+            if(p >= end || *p == '\n')
+                break;
+
+            float value;
+            if(!parseFloat(p, end, value) || nValues >= nColumns)
+            {
+                cerr << path << ": invalid line " << lineNumber << "." << endl;
+                clear();
+                return false;
+            }
+
+            rows.push_back(value);
+            nValues++;
+        }
+        p++; // '\n'.
+
+        if(nValues == 0)
+            continue; // Empty line.
+
+        if(nValues != nColumns)
+        {
+            cerr << path << ": line " << lineNumber << " has " << nValues
+                 << " values instead of " << nColumns << "." << endl;
+            clear();
+            return false;
+        }
+    }
+
+    nRows = rows.size() / nColumns;
+    ownedData.resize(rows.size());
+    for(size_t c=0; c<nColumns; c++)
+    {
+        float *column = &ownedData[c * nRows];
+        for(size_t r=0; r<nRows; r++)
+            column[r] = rows[r * nColumns + c];
+
+        columns.push_back(column);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Maps a cache file written by saveCache(), if it is up to date with
+ * the .sto file. The columns then point directly into the mapped file.
+ * @param cachePath path of the cache file.
+ * @param sourcePath path of the .sto file the cache was built from.
+ * @return true if the cache is valid and could be mapped, false otherwise.
+ */
+bool StoTable::loadCache(const string &cachePath, const string &sourcePath)
+{
+    clear();
+
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if(!getFileStamp(sourcePath, sourceSize, sourceMtime))
+        return false;
+
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StoCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    mappedData = map;
+    mappedSize = size;
+
+    const uint8_t *data = (const uint8_t*)map;
+    StoCacheHeader h;
+    memcpy(&h, data, sizeof(h));
+
+    if(h.magic != STO_CACHE_MAGIC || h.version != STO_CACHE_VERSION ||
+       h.sourceSize != sourceSize || h.sourceMtime != sourceMtime ||
+       h.dataOffset > size)
+    {
+        clear();
+        return false;
+    }
+
+    // Column index: the table name, then for each column its offset and name.
+    size_t pos = sizeof(h);
+    auto readString = [&](string &s) -> bool
+    {
+        uint16_t length;
+        if(pos + sizeof(length) > h.dataOffset)
+            return false;
+        memcpy(&length, data + pos, sizeof(length));
+        pos += sizeof(length);
+
+        if(pos + length > h.dataOffset)
+            return false;
+        s.assign((const char*)data + pos, length);
+        pos += length;
+        return true;
+    };
+
+    if(!readString(name))
+    {
+        clear();
+        return false;
+    }
+
+    nRows = (size_t)h.nRows;
+    for(uint32_t c=0; c<h.nColumns; c++)
+    {
+        uint64_t offset;
+        string columnName;
+
+        if(pos + sizeof(offset) > h.dataOffset)
+        {
+            clear();
+            return false;
+        }
+        memcpy(&offset, data + pos, sizeof(offset));
+        pos += sizeof(offset);
+
+        if(!readString(columnName) || offset + nRows * sizeof(float) > size ||
+           offset % sizeof(float) != 0)
+        {
+            clear();
+            return false;
+        }
+
+        columnNames.push_back(columnName);
+        columns.push_back((const float*)(data + offset));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes the table to a columnar cache file: a header with the stamp
+ * of the .sto file, the column index, then the columns, aligned to
+ * STO_CACHE_ALIGNMENT.
+ * @param cachePath path of the cache file.
+ * @param sourcePath path of the .sto file the table was parsed from.
+ * @return true if the cache could be written, false otherwise.
+ */
+bool StoTable::saveCache(const string &cachePath, const string &sourcePath) const
+{
+    StoCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    if(!getFileStamp(sourcePath, h.sourceSize, h.sourceMtime))
+        return false;
+
+    h.magic = STO_CACHE_MAGIC;
+    h.version = STO_CACHE_VERSION;
+    h.nRows = nRows;
+    h.nColumns = (uint32_t)columns.size();
+
+    // Size of the index, to place the columns.
+    size_t indexSize = sizeof(uint16_t) + name.size();
+    for(const string &n : columnNames)
+        indexSize += sizeof(uint64_t) + sizeof(uint16_t) + n.size();
+
+    auto align = [](size_t x) -> size_t
+    {
+        return (x + STO_CACHE_ALIGNMENT - 1) / STO_CACHE_ALIGNMENT * STO_CACHE_ALIGNMENT;
+    };
+
+    h.dataOffset = align(sizeof(h) + indexSize);
+    size_t columnStride = align(nRows * sizeof(float));
+
+    vector<uint8_t> buffer(h.dataOffset + columns.size() * columnStride, 0);
+    memcpy(buffer.data(), &h, sizeof(h));
+
+    size_t pos = sizeof(h);
+    auto writeString = [&](const string &s)
+    {
+        uint16_t length = (uint16_t)min(s.size(), (size_t)UINT16_MAX);
+        memcpy(&buffer[pos], &length, sizeof(length));
+        pos += sizeof(length);
+        memcpy(&buffer[pos], s.data(), length);
+        pos += length;
+    };
+
+    writeString(name);
+    for(size_t c=0; c<columns.size(); c++)
+    {
+        uint64_t offset = h.dataOffset + c * columnStride;
+        memcpy(&buffer[pos], &offset, sizeof(offset));
+        pos += sizeof(offset);
+        writeString(columnNames[c]);
+
+        memcpy(&buffer[offset], columns[c], nRows * sizeof(float));
+    }
+
+    // Write to a temporary file then rename, so a concurrent reader never
+    // maps a partial cache.
+    string tmpPath = cachePath + ".tmp" + to_string(getpid());
+    ofstream file(tmpPath, ios::binary);
+    if(!file.is_open())
+        return false;
+
+    file.write((const char*)buffer.data(), buffer.size());
+    file.close();
+
+    if(!file.good() || rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Gets the name of the table, i.e. the first line of the header.
+ * @return the name of the table.
+ */
+const string &StoTable::getName() const
+{
+    return name;
+}
+
+/**
+ * @brief Gets the number of rows.
+ * @return the number of rows.
+ */
+size_t StoTable::getRowsCount() const
+{
+    return nRows;
+}
+
+/**
+ * @brief Gets the number of columns.
+ * @return the number of columns.
+ */
+size_t StoTable::getColumnsCount() const
+{
+    return columns.size();
+}
+
+/**
+ * @brief Gets the names of the columns, made unique.
+ * @return the names of the columns.
+ */
+const vector<string> &StoTable::getColumnNames() const
+{
+    return columnNames;
+}
+
+/**
+ * @brief Gets the index of a column.
+ * @param name the name of the column.
+ * @return the index of the column, or -1 if there is no such column.
+ */
+int StoTable::getColumnIndex(const string &name) const
+{
+    auto it = find(columnNames.begin(), columnNames.end(), name);
+    return (it != columnNames.end()) ? (int)(it - columnNames.begin()) : -1;
+}
+
+/**
+ * @brief Gets the values of a column.
+ * @param index the index of the column.
+ * @return the nRows values of the column.
+ */
+const float *StoTable::getColumn(size_t index) const
+{
+    return columns[index];
+}
+
+/**
+ * @brief Gets the values of a column.
+ * @param name the name of the column.
+ * @return the nRows values of the column, or nullptr if there is no such
+ * column.
+ */
+const float *StoTable::getColumn(const string &name) const
+{
+    int index = getColumnIndex(name);
+    return (index >= 0) ? columns[index] : nullptr;
+}
+
+/**
+ * @brief Gets the time column, i.e. the last column named "time" (see the
+ * class remark).
+ * @return the time values [s], or nullptr if there is no time column.
+ */
+const float *StoTable::getTimeColumn() const
+{
+    const float *time = nullptr;
+    for(size_t c=0; c<columnNames.size(); c++)
+    {
+        const string &n = columnNames[c];
+        if(n == "time" || (n.compare(0, 5, "time_") == 0 &&
+                           n.find_first_not_of("0123456789", 5) == string::npos))
+        {
+            time = columns[c];
+        }
+    }
+
+    return time;
+}
+
+/**
+ * @brief Checks if the values are mapped from a cache file.
+ * @return true if mapped from a cache, false if parsed from the text.
+ */
+bool StoTable::isMapped() const
+{
+    return mappedData != nullptr;
+}
+
+/**
+ * @brief Gets the path of the cache file of a .sto file, in the
+ * STO_CACHE_DIRECTORY sub-directory of the directory of the .sto file.
+ * @param sourcePath path of the .sto file.
+ * @return the path of the cache file.
+ */
+string StoTable::getCachePath(const string &sourcePath)
+{
+    size_t slash = sourcePath.find_last_of('/');
+    string directory = (slash == string::npos) ? "." : sourcePath.substr(0, slash);
+    string fileName = (slash == string::npos) ? sourcePath : sourcePath.substr(slash + 1);
+
+    return directory + "/" + STO_CACHE_DIRECTORY + "/" + fileName + ".stoc";
+}
+
+/**
+ * @brief Releases the values and the mapped cache, if any.
+ */
+void StoTable::clear()
+{
+    name.clear();
+    columnNames.clear();
+    columns.clear();
+    ownedData.clear();
+    ownedData.shrink_to_fit();
+    nRows = 0;
+
+    if(mappedData != nullptr)
+    {
+        munmap(mappedData, mappedSize);
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+}
+
+/**
+ * @brief Lists the .sto files of a directory, sorted by name.
+ * @param directory path of the directory.
+ * @return the paths of the .sto files.
+ */
+vector<string> listStoFiles(const string &directory)
+{
+    vector<string> files;
+
+    DIR *dir = opendir(directory.c_str());
+    if(dir == nullptr)
+        return files;
+
+    while(struct dirent *entry = readdir(dir))
+    {
+        string fileName = entry->d_name;
+        if(fileName.size() > 4 &&
+           fileName.compare(fileName.size() - 4, 4, ".sto") == 0)
+        {
+            files.push_back(directory + "/" + fileName);
+        }
+    }
+    closedir(dir);
+
+    sort(files.begin(), files.end());
+    return files;
+}
@@ -0,0 +1,81 @@
+#ifndef STOFILE_H
+#define STOFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define STO_CACHE_MAGIC 0x434F5453  ///< "STOC", little-endian.
+#define STO_CACHE_VERSION 1
+#define STO_CACHE_ALIGNMENT 64      ///< Alignment of the columns in the cache [B].
+#define STO_CACHE_DIRECTORY ".stocache" ///< Sub-directory of the cache files.
+
+/**
+ * @brief Header of a columnar cache file. It is followed by the column index,
+ * then by the columns, each one nRows floats, contiguous and aligned.
+ */
+struct StoCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nRows;
+    uint32_t nColumns;
+    uint32_t reserved;
+    uint64_t sourceSize;    ///< Size of the .sto file the cache was built from [B].
+    int64_t sourceMtime;    ///< Modification time of the .sto file [ns].
+    uint64_t dataOffset;    ///< Offset of the first column [B].
+};
+
+/**
+ * @brief Table of an OpenSim storage file (.sto), as written by SCONE and the
+ * OpenSim analyses: a text header terminated by "endheader", a line of
+ * tab-separated column names, then one line of numbers per row.
+ *
+ * The values are stored by column, as floats. A table is either parsed from
+ * the text file, or mapped from its columnar cache file without any copy.
+ * @remark some exported files (e.g. "Torque_right") have a "time" column
+ * twice: the first one is the row index, the second the actual time. The
+ * duplicated names get a "_2", "_3"... suffix, and getTimeColumn() returns the
+ * last column named "time".
+ */
+class StoTable
+{
+public:
+    StoTable();
+    ~StoTable();
+    StoTable(const StoTable &) = delete;
+    StoTable &operator=(const StoTable &) = delete;
+
+    bool load(const std::string &path, bool useCache = true);
+    bool parse(const std::string &path);
+    bool loadCache(const std::string &cachePath, const std::string &sourcePath);
+    bool saveCache(const std::string &cachePath, const std::string &sourcePath) const;
+
+    const std::string &getName() const;
+    size_t getRowsCount() const;
+    size_t getColumnsCount() const;
+    const std::vector<std::string> &getColumnNames() const;
+    int getColumnIndex(const std::string &name) const;
+    const float *getColumn(size_t index) const;
+    const float *getColumn(const std::string &name) const;
+    const float *getTimeColumn() const;
+    bool isMapped() const;
+
+    static std::string getCachePath(const std::string &sourcePath);
+
+private:
+    void clear();
+
+    std::string name; ///< First line of the header.
+    std::vector<std::string> columnNames;
+    size_t nRows;
+    std::vector<const float*> columns;
+
+    std::vector<float> ownedData; ///< Values, if parsed from text.
+    void *mappedData;             ///< Cache file, if mapped.
+    size_t mappedSize;            ///< [B].
+};
+
+std::vector<std::string> listStoFiles(const std::string &directory);
+
+#endif // STOFILE_H
@@ -0,0 +1,335 @@
+#include "surrogateplant.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const float GRAVITY = 9.81f;            // [m/s^2].
+const float RAD_PER_DEG = (float)M_PI / 180.0f; // [rad/deg].
+const float LEG_MASS_RATIO = 0.16f;     // Mass of a leg over the bodyweight [].
+const float LEG_COM_DISTANCE = 0.38f;   // From the hip to the center of mass of the leg [m].
+const float LEG_GYRATION = 0.42f;       // Radius of gyration of the leg around the hip [m].
+const float STANCE_INERTIA_RATIO = 6.0f; // Inertia of the leg carrying the body, over the swing one [].
+const float TRACKING_DAMPING = 0.7f;    // Damping ratio of the tracking by the pilot [].
+const float COUPLING_GAIN = 0.1f;       // Pull of the phases towards opposition [].
+const float MIN_LANDING_PHASE = 0.75f;  // The foot cannot land earlier in the cycle [].
+const float MAX_LANDING_PHASE = 1.2f;   // The foot lands at the latest there [].
+const float STUMBLE_DURATION = 0.25f;   // [s].
+const float STUMBLE_SLOWDOWN = 0.3f;    // Speed of the pattern during a hesitation [].
+
+/**
+ * @brief Constructor. The right foot has just landed, and the left one is at
+ * the end of its stance, both legs on the pattern of the pilot.
+ * @param params parameters of the pilot.
+ * @param calibration calibration of the soles cells, to convert the loads to
+ * voltages, as seen by the controller. It must outlive the plant.
+ */
+SurrogatePlant::SurrogatePlant(const SurrogatePlantParams &params,
+                               const SoleCalibration &calibration) :
+    params(params),
+    calibration(calibration),
+    generator(params.seed)
+{
+    legMass = LEG_MASS_RATIO * params.bodyweight;
+    swingInertia = legMass * LEG_GYRATION * LEG_GYRATION;
+    stanceInertia = STANCE_INERTIA_RATIO * swingInertia;
+    float omega = 2.0f * (float)M_PI * params.hipFrequency;
+    stiffness = swingInertia * omega * omega;
+    damping = 2.0f * TRACKING_DAMPING * omega * swingInertia;
+
+    // Shift the pattern so that it reaches the contact angle at the end of the
+    // cycle, and not earlier.
+    float contactWarped = 1.0f - acosf(min(max(params.contactAngle, -1.0f), 1.0f)) /
+                                 (2.0f * (float)M_PI);
+    phaseShift = params.stanceRatio + (contactWarped - 0.5f) * 2.0f *
+                 (1.0f - params.stanceRatio) - 1.0f;
+
+    time = 0.0f;
+    intendedCycle = params.cycleDuration;
+    targetCycle = params.cycleDuration;
+    exponential_distribution<float> intervalDistribution(1.0f / max(params.cadenceChangeInterval,
+                                                                    1e-3f));
+    nextCadenceChange = (params.cadenceChangeInterval > 0.0f) ?
+                            intervalDistribution(generator) : INFINITY;
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        SurrogateLeg &leg = legs[j];
+        startCycle(leg, (j == GAIT_RIGHT) ? 0.0f : 0.5f);
+        leg.angle = getReference(leg.phase, leg.cycleDuration, leg.speed);
+        leg.reference = leg.angle;
+        leg.leading = (j == GAIT_RIGHT);
+        leg.weightShare = (j == GAIT_RIGHT) ? 0.0f : 1.0f;
+        leg.stanceTime = (j == GAIT_RIGHT) ? 0.0f : 0.5f * leg.cycleDuration;
+        leg.heelStrike = false;
+    }
+
+    updateFrame();
+}
+
+/**
+ * @brief Gets the parameters of a typical pilot, walking steadily.
+ * @return the default parameters.
+ */
+SurrogatePlantParams SurrogatePlant::getDefaultParams()
+{
+    SurrogatePlantParams p;
+    p.bodyweight = 60.0f;
+    p.cycleDuration = 1.1f;
+    p.cycleVariability = 0.02f;
+    p.stanceRatio = 0.6f;
+    p.hipAmplitude = 20.0f;
+    p.hipOffset = 5.0f;
+    p.hipFrequency = 3.0f;
+    p.loadingTime = 0.1f;
+    p.contactAngle = 0.9f;
+    p.cadenceChangeInterval = 0.0f;
+    p.cadenceChangeRange = 0.2f;
+    p.cadenceChangeTime = 2.0f;
+    p.stumbleProbability = 0.0f;
+    p.seed = 0;
+    return p;
+}
+
+/**
+ * @brief Advances the simulation by one time step.
+ * @param dt the time step [s].
+ * @param torques torques of the orthosis at each hip, in the joint frame,
+ * positive towards the flexion, as set by the controller at the previous step
+ * [N.m].
+ */
+void SurrogatePlant::step(float dt, const float torques[N_GAIT_LEGS])
+{
+    // Cadence intended by the pilot.
+    if(time >= nextCadenceChange)
+    {
+        uniform_real_distribution<float> change(-params.cadenceChangeRange,
+                                                params.cadenceChangeRange);
+        exponential_distribution<float> interval(1.0f / params.cadenceChangeInterval);
+        targetCycle = params.cycleDuration * (1.0f + change(generator));
+        nextCadenceChange = time + interval(generator);
+    }
+    intendedCycle += (targetCycle - intendedCycle) * min(dt / params.cadenceChangeTime, 1.0f);
+
+    // Phases of the pattern, pulled towards opposition.
+    float phaseRates[N_GAIT_LEGS];
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        const SurrogateLeg &leg = legs[j];
+        const SurrogateLeg &other = legs[1 - j];
+        float coupling = COUPLING_GAIN * sinf(2.0f * (float)M_PI *
+                                              (other.phase - leg.phase - 0.5f));
+        phaseRates[j] = (1.0f + coupling) / leg.cycleDuration;
+        if(leg.stumbleTime > 0.0f)
+            phaseRates[j] *= STUMBLE_SLOWDOWN;
+    }
+
+    // Dynamics of the hips, then landing of the swing feet.
+    float contactAngle = params.hipOffset + params.contactAngle * params.hipAmplitude;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        SurrogateLeg &leg = legs[j];
+        leg.heelStrike = false;
+        leg.phase += phaseRates[j] * dt;
+        leg.stumbleTime = max(leg.stumbleTime - dt, 0.0f);
+
+        float referenceSpeed;
+        leg.reference = getReference(leg.phase, 1.0f / phaseRates[j], referenceSpeed);
+
+        // The pilot tracks the pattern with the same bandwidth in stance,
+        // where the whole body drives the hip.
+        float inertia = leg.inContact ? stanceInertia : swingInertia;
+        float gain = inertia / swingInertia;
+        float torque = gain * (stiffness * RAD_PER_DEG * (leg.reference - leg.angle) +
+                               damping * RAD_PER_DEG * (referenceSpeed - leg.speed)) +
+                       torques[j];
+        if(!leg.inContact)
+        {
+            torque += legMass * GRAVITY * LEG_COM_DISTANCE *
+                      (sinf(RAD_PER_DEG * leg.reference) - sinf(RAD_PER_DEG * leg.angle));
+        }
+
+        float previousAngle = leg.angle;
+        leg.speed += torque / inertia / RAD_PER_DEG * dt;
+        leg.angle += leg.speed * dt;
+
+        if(leg.inContact)
+            continue;
+
+        float fraction = -1.0f; // Of the time step, before the landing.
+        if(leg.phase >= MIN_LANDING_PHASE && leg.angle >= contactAngle)
+        {
+            fraction = (previousAngle < contactAngle) ?
+                           (contactAngle - previousAngle) / (leg.angle - previousAngle) : 0.0f;
+        }
+        else if(leg.phase >= MAX_LANDING_PHASE)
+            fraction = 1.0f;
+
+        if(fraction >= 0.0f)
+        {
+            startCycle(leg, 0.0f);
+            leg.phase = (1.0f - fraction) * dt / leg.cycleDuration;
+            leg.heelStrike = true;
+            leg.heelStrikeTime = time + fraction * dt;
+            leg.stanceTime = (1.0f - fraction) * dt;
+            leg.leading = true;
+            leg.weightShare = 0.0f;
+            legs[1 - j].leading = false;
+        }
+    }
+
+    // Transfer of the weight to the leading foot, and lift-off of the
+    // trailing one when unloaded.
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        SurrogateLeg &leg = legs[j];
+        if(!leg.inContact || leg.heelStrike)
+            continue;
+
+        leg.stanceTime += dt;
+        if(leg.leading || !legs[1 - j].inContact)
+            leg.weightShare = min(leg.weightShare + dt / params.loadingTime, 1.0f);
+        else
+        {
+            leg.weightShare -= dt / params.loadingTime;
+            if(leg.weightShare <= 0.0f)
+            {
+                leg.inContact = false;
+                leg.weightShare = 0.0f;
+                if(leg.stumbleNext)
+                {
+                    leg.stumbleTime = STUMBLE_DURATION;
+                    leg.stumbleNext = false;
+                }
+            }
+        }
+    }
+
+    float shares = legs[GAIT_LEFT].weightShare + legs[GAIT_RIGHT].weightShare;
+    int nContacts = (int)legs[GAIT_LEFT].inContact + (int)legs[GAIT_RIGHT].inContact;
+    for(SurrogateLeg &leg : legs)
+    {
+        if(!leg.inContact)
+            leg.load = 0.0f;
+        else if(shares > 0.0f)
+            leg.load = params.bodyweight * GRAVITY * leg.weightShare / shares;
+        else
+            leg.load = params.bodyweight * GRAVITY / nContacts;
+    }
+
+    time += dt;
+    updateFrame();
+}
+
+/**
+ * @brief Gets the sensor values of the current time, as seen by the
+ * controller.
+ * @return the sensor values.
+ */
+const SensorFrame &SurrogatePlant::getFrame() const
+{
+    return frame;
+}
+
+/**
+ * @brief Gets the state of a leg, e.g. to know the exact times of the
+ * heel-strikes.
+ * @param leg the leg, GAIT_LEFT or GAIT_RIGHT.
+ * @return the state of the leg.
+ */
+const SurrogateLeg &SurrogatePlant::getLeg(int leg) const
+{
+    return legs[leg];
+}
+
+/**
+ * @brief Gets the simulated time.
+ * @return the time since the creation [s].
+ */
+float SurrogatePlant::getTime() const
+{
+    return time;
+}
+
+/**
+ * @brief Gets the mean gait cycle duration currently intended by the pilot,
+ * without the variability of each cycle.
+ * @return the cycle duration [s].
+ */
+float SurrogatePlant::getIntendedCycleDuration() const
+{
+    return intendedCycle;
+}
+
+/**
+ * @brief Evaluates the hip flexion pattern of the pilot: a cosine, flexed at
+ * the end of the swing, whose first half is stretched over the stance, so that
+ * the extension peaks around the toe-off. It is shifted so that it crosses the
+ * contact angle at the heel-strike.
+ * @param phase phase of the leg, 0 at heel-strike, repeating after 1 [].
+ * @param cycleDuration duration of the cycle at the current pace [s].
+ * @param speed hip flexion speed of the pattern [deg/s].
+ * @return the hip flexion of the pattern [deg].
+ */
+float SurrogatePlant::getReference(float phase, float cycleDuration, float &speed) const
+{
+    float cyclePhase = phase + phaseShift;
+    cyclePhase -= floorf(cyclePhase);
+    float warped, warpRate;
+    if(cyclePhase < params.stanceRatio)
+    {
+        warpRate = 0.5f / params.stanceRatio;
+        warped = cyclePhase * warpRate;
+    }
+    else
+    {
+        warpRate = 0.5f / (1.0f - params.stanceRatio);
+        warped = 0.5f + (cyclePhase - params.stanceRatio) * warpRate;
+    }
+
+    float angle = 2.0f * (float)M_PI * warped;
+    speed = -params.hipAmplitude * 2.0f * (float)M_PI * warpRate / cycleDuration * sinf(angle);
+    return params.hipOffset + params.hipAmplitude * cosf(angle);
+}
+
+/**
+ * @brief Starts a gait cycle of a leg at its heel-strike, drawing its intended
+ * duration and whether its swing will hesitate.
+ * @param leg the leg.
+ * @param phase phase of the leg in the new cycle [].
+ */
+void SurrogatePlant::startCycle(SurrogateLeg &leg, float phase)
+{
+    normal_distribution<float> variability(0.0f, params.cycleVariability);
+    uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    leg.phase = phase;
+    leg.cycleDuration = intendedCycle * max(1.0f + variability(generator), 0.5f);
+    leg.inContact = true;
+    leg.stumbleTime = 0.0f;
+    leg.stumbleNext = (uniform(generator) < params.stumbleProbability);
+    leg.load = 0.0f;
+}
+
+/**
+ * @brief Updates the sensor values from the state of the legs.
+ */
+void SurrogatePlant::updateFrame()
+{
+    frame.time = time;
+    frame.leftHipAngle = legs[GAIT_LEFT].angle;
+    frame.rightHipAngle = legs[GAIT_RIGHT].angle;
+    frame.leftHipSpeed = legs[GAIT_LEFT].speed;
+    frame.rightHipSpeed = legs[GAIT_RIGHT].speed;
+
+    const SoleSide sides[N_GAIT_LEGS] = { SOLE_LEFT, SOLE_RIGHT };
+    array<float, 8> *voltages[N_GAIT_LEGS] = { &frame.leftSoleVoltages,
+                                               &frame.rightSoleVoltages };
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        const SurrogateLeg &leg = legs[j];
+        float rollover = min(leg.stanceTime / (params.stanceRatio * leg.cycleDuration), 1.0f);
+        distributeFootLoad(leg.load, rollover, calibration, sides[j], *voltages[j]);
+    }
+}
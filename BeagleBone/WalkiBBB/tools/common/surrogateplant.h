@@ -0,0 +1,118 @@
+#ifndef SURROGATEPLANT_H
+#define SURROGATEPLANT_H
+
+#include <random>
+
+#include "../../controllers/ewalk/gaittorquegenerator.h"
+#include "gaittrace.h"
+
+/**
+ * @brief Parameters of the pilot simulated by a SurrogatePlant.
+ */
+struct SurrogatePlantParams
+{
+    float bodyweight;       ///< [kg]
+    float cycleDuration;    ///< Gait cycle duration intended by the pilot, at the start [s]
+    float cycleVariability; ///< Relative SD of the duration of each cycle []
+    float stanceRatio;      ///< Fraction of the intended gait cycle in stance []
+    float hipAmplitude;     ///< Half of the range of the hip flexion [deg]
+    float hipOffset;        ///< Middle of the range of the hip flexion [deg]
+    float hipFrequency;     ///< Natural frequency of the tracking by the pilot, in swing [Hz]
+    float loadingTime;      ///< Duration of the transfer of the weight between the feet [s]
+    float contactAngle;     ///< Hip flexion at which the foot lands, as a fraction of the amplitude []
+    float cadenceChangeInterval; ///< Mean time between two changes of the cadence, 0 for none [s]
+    float cadenceChangeRange; ///< Max. relative change of the intended cycle duration []
+    float cadenceChangeTime; ///< Time constant of the transition to a new cadence [s]
+    float stumbleProbability; ///< Probability of a hesitation of the swing, per step []
+    unsigned int seed;      ///< Random seed of the cycles and perturbations
+};
+
+/**
+ * @brief State of a leg of a SurrogatePlant.
+ */
+struct SurrogateLeg
+{
+    float angle;            ///< Hip flexion [deg]
+    float speed;            ///< [deg/s]
+    float reference;        ///< Hip flexion intended by the pilot [deg]
+    float phase;            ///< Phase of the pilot's pattern, 0 at heel-strike [0-1], more if late.
+    float cycleDuration;    ///< Intended duration of the current cycle [s]
+    bool inContact;
+    bool leading;           ///< The foot landed after the other one.
+    float weightShare;      ///< Weight the foot takes, relative to the other one [0-1]
+    float stanceTime;       ///< Time since the heel-strike [s]
+    float load;             ///< [N]
+    float stumbleTime;      ///< Remaining time of the hesitation of the swing [s]
+    bool stumbleNext;       ///< The next swing hesitates.
+    bool heelStrike;        ///< The foot landed during the last step.
+    float heelStrikeTime;   ///< Time of this heel-strike [s]
+};
+
+/**
+ * @brief Lightweight model of the hips and feet of a pilot wearing the
+ * orthosis, to run the controller in closed loop without a treadmill or a
+ * SCONE/OpenSim simulation: the hip angles and sole loads depend on the
+ * torques of the controller.
+ *
+ * Each leg is a pendulum around the hip. The pilot drives it along a hip
+ * flexion pattern (a cosine, warped so that the extension peaks at toe-off),
+ * paced by a phase oscillator per leg, with a PD law of stiffness
+ * hipFrequency and gravity compensation. The torque of the orthosis adds to
+ * the pilot's, so that it deviates the leg from the pattern. In stance, the
+ * leg also carries the body, so its inertia is larger, as are the gains of the
+ * pilot, and gravity does not act on it.
+ *
+ * The legs are coupled by the feet and by the oscillators:
+ * - the foot lands when the swing leg, late in its cycle, flexes beyond
+ *   contactAngle, so an assistance of the swing makes the step shorter, and a
+ *   resistance longer. The phase of the leg is then reset to 0, so the cadence
+ *   follows the steps actually made.
+ * - the weight shifts from the trailing foot to the leading one in
+ *   loadingTime, then the trailing foot lifts off. The load of each sole rolls
+ *   from the heel to the toes during the stance.
+ * - the phases of the legs are pulled towards opposition.
+ *
+ * The intended cycle duration varies at each step (cycleVariability), changes
+ * at random times (cadenceChangeInterval, cadenceChangeRange), and some swings
+ * hesitate (stumbleProbability). The model runs in O(1) per step, without any
+ * allocation.
+ */
+class SurrogatePlant
+{
+public:
+    SurrogatePlant(const SurrogatePlantParams &params, const SoleCalibration &calibration);
+
+    static SurrogatePlantParams getDefaultParams();
+
+    void step(float dt, const float torques[N_GAIT_LEGS]);
+
+    const SensorFrame &getFrame() const;
+    const SurrogateLeg &getLeg(int leg) const;
+    float getTime() const;
+    float getIntendedCycleDuration() const;
+
+private:
+    float getReference(float phase, float cycleDuration, float &speed) const;
+    void startCycle(SurrogateLeg &leg, float phase);
+    void updateFrame();
+
+    SurrogatePlantParams params;
+    const SoleCalibration &calibration;
+    std::mt19937 generator;
+
+    float legMass;          ///< [kg]
+    float swingInertia;     ///< Around the hip [kg.m^2]
+    float stanceInertia;    ///< [kg.m^2]
+    float stiffness;        ///< [N.m/rad]
+    float damping;          ///< [N.m.s/rad]
+    float phaseShift;       ///< Of the pattern, so that it lands at the end of the cycle [].
+
+    float time;             ///< [s]
+    float intendedCycle;    ///< Current intended cycle duration [s]
+    float targetCycle;      ///< Intended cycle duration after the cadence change [s]
+    float nextCadenceChange; ///< [s]
+    SurrogateLeg legs[N_GAIT_LEGS];
+    SensorFrame frame;
+};
+
+#endif // SURROGATEPLANT_H
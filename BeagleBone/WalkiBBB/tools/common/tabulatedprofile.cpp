@@ -0,0 +1,85 @@
+#include "tabulatedprofile.h"
+
+#include <algorithm>
+#include <random>
+
+#include "../../controllers/ewalk/gaittorquegenerator.h"
+#include "../../controllers/ewalk/winterprofile.h"
+
+using namespace std;
+
+TabulatedProfile makeUnevenProfile(const HarmonicCoefficients &coefficients,
+                                   int nPoints, unsigned int seed)
+{
+    mt19937 generator(seed);
+    uniform_real_distribution<float> gapDistribution(0.25f, 1.75f);
+
+    vector<float> gaps(nPoints);
+    float sum = 0.0f;
+    for(float &gap : gaps)
+    {
+        gap = gapDistribution(generator);
+        sum += gap;
+    }
+
+    const float period = GaitTorqueGenerator::getHarmonicPeriod(coefficients);
+
+    TabulatedProfile profile;
+    float phase = 0.0f;
+    for(int i=0; i<nPoints; i++)
+    {
+        profile.phases.push_back(phase);
+        profile.torques.push_back(
+                    TorqueProfileTable::evaluateHarmonics(coefficients, phase * period));
+        phase += gaps[i] / sum;
+    }
+
+    return profile;
+}
+
+TabulatedProfile getWinterProfile()
+{
+    TabulatedProfile profile;
+    for(int i=0; i<WINTER_PROFILE_N_POINTS; i++)
+    {
+        profile.phases.push_back(winterHipTorqueProfile1[i].percentGc);
+        profile.torques.push_back(winterHipTorqueProfile1[i].torquePerBodyweight);
+    }
+
+    return profile;
+}
+
+float interpolateProfile(const TabulatedProfile &profile, float phase)
+{
+    const vector<float> &x = profile.phases;
+    const vector<float> &y = profile.torques;
+    size_t n = x.size();
+
+    // First point after the phase, then the interval, wrapped if needed.
+    size_t next = upper_bound(x.begin(), x.end(), phase) - x.begin();
+
+    float x0, y0, x1, y1;
+    if(next == 0)
+    {
+        x0 = x[n-1] - 1.0f;
+        y0 = y[n-1];
+    }
+    else
+    {
+        x0 = x[next-1];
+        y0 = y[next-1];
+    }
+
+    if(next == n)
+    {
+        x1 = x[0] + 1.0f;
+        y1 = y[0];
+    }
+    else
+    {
+        x1 = x[next];
+        y1 = y[next];
+    }
+
+    return (x1 > x0) ? y0 + (y1 - y0) * (phase - x0) / (x1 - x0) : y0;
+}
@@ -0,0 +1,46 @@
+#ifndef TABULATEDPROFILE_H
+#define TABULATEDPROFILE_H
+
+#include <vector>
+
+#include "../../controllers/ewalk/torqueprofiletable.h"
+
+/**
+ * @brief Points of a tabulated torque profile, as given to
+ * TorqueProfileTable::setPoints().
+ */
+struct TabulatedProfile
+{
+    std::vector<float> phases;  ///< Increasing, within [0-1] [].
+    std::vector<float> torques; ///< [N.m/kg].
+};
+
+/**
+ * @brief Samples a sum-of-sines profile at unevenly spaced phases, like the
+ * output of a simulation with a variable time step. The first point is at
+ * phase 0, and the gaps between the points vary randomly by a factor up to 7.
+ * @param coefficients the profile coefficients.
+ * @param nPoints number of points.
+ * @param seed seed of the random gaps.
+ * @return the points, with the torque of the closed form.
+ */
+TabulatedProfile makeUnevenProfile(const HarmonicCoefficients &coefficients,
+                                   int nPoints, unsigned int seed);
+
+/**
+ * @brief Gets the Winter hip torque profile of the controller.
+ * @return the points, every 2% of the gait cycle, from 0 to 100%.
+ */
+TabulatedProfile getWinterProfile();
+
+/**
+ * @brief Interpolates the points linearly, searching the interval by
+ * bisection, wrapping from the last point to the first one, as
+ * TorqueProfileTable::setPoints() does.
+ * @param profile the points.
+ * @param phase phase within [0-1[ [].
+ * @return the torque [N.m/kg].
+ */
+float interpolateProfile(const TabulatedProfile &profile, float phase);
+
+#endif // TABULATEDPROFILE_H
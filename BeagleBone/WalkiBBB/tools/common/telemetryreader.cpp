@@ -0,0 +1,181 @@
+#include "telemetryreader.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Constructor.
+ */
+TelemetryReader::TelemetryReader() :
+    recordSize(0),
+    startWallTime(0),
+    startMonotonicTime(0)
+{
+
+}
+
+/**
+ * @brief Reads a segment file, and appends its records to the ones already
+ * read. The first segment sets the channels, the next ones must have the same.
+ * @param path path of the segment file.
+ * @return true if the segment could be read, false otherwise.
+ */
+bool TelemetryReader::appendSegment(const string &path)
+{
+    ifstream file(path, ios::binary);
+    if(!file.is_open())
+    {
+        cerr << "Could not open " << path << "." << endl;
+        return false;
+    }
+
+    vector<uint8_t> data((istreambuf_iterator<char>(file)),
+                         istreambuf_iterator<char>());
+
+    TelemetrySegmentHeader h;
+    if(data.size() < sizeof(h))
+    {
+        cerr << path << ": truncated header." << endl;
+        return false;
+    }
+    memcpy(&h, data.data(), sizeof(h));
+
+    if(h.magic != TELEMETRY_MAGIC || h.version != TELEMETRY_VERSION ||
+       h.headerSize > data.size() || h.recordSize == 0)
+    {
+        cerr << path << ": not a telemetry file of version "
+             << TELEMETRY_VERSION << "." << endl;
+        return false;
+    }
+
+    // Channels.
+    vector<TelemetryChannel> segmentChannels;
+    size_t pos = sizeof(h);
+    for(int i=0; i<h.nChannels; i++)
+    {
+        TelemetryChannelDescriptor d;
+        if(pos + sizeof(d) > h.headerSize)
+        {
+            cerr << path << ": truncated channels description." << endl;
+            return false;
+        }
+        memcpy(&d, &data[pos], sizeof(d));
+        pos += sizeof(d);
+
+        if(pos + d.nameLength + d.unitLength > h.headerSize ||
+           d.offset + (d.type == TELEMETRY_BOOL ? 1 : 4) > h.recordSize)
+        {
+            cerr << path << ": invalid channel " << i << "." << endl;
+            return false;
+        }
+
+        TelemetryChannel c;
+        c.name.assign((const char*)&data[pos], d.nameLength);
+        pos += d.nameLength;
+        c.unit.assign((const char*)&data[pos], d.unitLength);
+        pos += d.unitLength;
+        c.type = (TelemetryType)d.type;
+        c.offset = d.offset;
+        c.bit = d.bit;
+        segmentChannels.push_back(c);
+    }
+
+    if(recordSize == 0)
+    {
+        channels = segmentChannels;
+        recordSize = h.recordSize;
+        startWallTime = h.startWallTime;
+        startMonotonicTime = h.startMonotonicTime;
+    }
+    else if(h.recordSize != recordSize || segmentChannels.size() != channels.size() ||
+            h.startMonotonicTime != startMonotonicTime)
+    {
+        cerr << path << ": not from the same recording as the previous files."
+             << endl;
+        return false;
+    }
+
+    // Records. If the recorder was not stopped properly, the file has its
+    // full reserved size, and only the first nRecords are valid.
+    size_t available = (data.size() - h.headerSize) / recordSize;
+    size_t nRecords = (h.nRecords < available) ? (size_t)h.nRecords : available;
+
+    records.insert(records.end(), data.begin() + h.headerSize,
+                   data.begin() + h.headerSize + nRecords * recordSize);
+
+    return true;
+}
+
+/**
+ * @brief Gets the channels of the recording.
+ * @return the channels.
+ */
+const vector<TelemetryChannel> &TelemetryReader::getChannels() const
+{
+    return channels;
+}
+
+/**
+ * @brief Gets the number of records read.
+ * @return the number of records.
+ */
+size_t TelemetryReader::getRecordsCount() const
+{
+    return (recordSize > 0) ? records.size() / recordSize : 0;
+}
+
+/**
+ * @brief Gets the wall clock time of the start of the recording.
+ * @return the Unix time [us].
+ */
+int64_t TelemetryReader::getStartWallTime() const
+{
+    return startWallTime;
+}
+
+/**
+ * @brief Gets the time of a record.
+ * @param record index of the record.
+ * @return the time since the start of the recording [s].
+ */
+double TelemetryReader::getTime(size_t record) const
+{
+    int64_t timestamp;
+    memcpy(&timestamp, &records[record * recordSize], sizeof(timestamp));
+    return (double)(timestamp - startMonotonicTime) / 1e6;
+}
+
+/**
+ * @brief Gets the value of a channel in a record.
+ * @param record index of the record.
+ * @param channel index of the channel.
+ * @return the value.
+ */
+double TelemetryReader::getValue(size_t record, size_t channel) const
+{
+    const TelemetryChannel &c = channels[channel];
+    const uint8_t *p = &records[record * recordSize + c.offset];
+
+    switch(c.type)
+    {
+    case TELEMETRY_FLOAT32:
+    {
+        float f;
+        memcpy(&f, p, 4);
+        return f;
+    }
+    case TELEMETRY_INT32:
+    {
+        int32_t i;
+        memcpy(&i, p, 4);
+        return i;
+    }
+    case TELEMETRY_BOOL:
+        return ((*p >> c.bit) & 1) ? 1.0 : 0.0;
+    default:
+        return 0.0;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef TELEMETRYREADER_H
+#define TELEMETRYREADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../lib/telemetryrecorder.h"
+
+/**
+ * @brief Channel of a telemetry recording.
+ */
+struct TelemetryChannel
+{
+    std::string name, unit;
+    TelemetryType type;
+    uint32_t offset; ///< [B].
+    uint8_t bit;
+};
+
+/**
+ * @brief Reads the segment files written by TelemetryRecorder. Several
+ * segments of the same recording can be appended, in order.
+ */
+class TelemetryReader
+{
+public:
+    TelemetryReader();
+
+    bool appendSegment(const std::string &path);
+
+    const std::vector<TelemetryChannel> &getChannels() const;
+    size_t getRecordsCount() const;
+    int64_t getStartWallTime() const;
+
+    double getTime(size_t record) const;
+    double getValue(size_t record, size_t channel) const;
+
+private:
+    std::vector<TelemetryChannel> channels;
+    uint32_t recordSize;
+    int64_t startWallTime, startMonotonicTime; ///< [us].
+    std::vector<uint8_t> records; ///< All the records, back-to-back.
+};
+
+#endif // TELEMETRYREADER_H
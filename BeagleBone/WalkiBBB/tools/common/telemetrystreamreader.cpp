@@ -0,0 +1,237 @@
+#include "telemetrystreamreader.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief Constructor.
+ */
+TelemetryStreamReader::TelemetryStreamReader() :
+    bufferPos(0),
+    valid(true),
+    resolution(STREAM_RESOLUTION),
+    hasKeyframe(false),
+    time(0),
+    skippedCount(0),
+    droppedCount(0),
+    frameSize(0)
+{
+
+}
+
+/**
+ * @brief Appends received bytes, to be decoded by nextFrame().
+ * @param data the bytes.
+ * @param size the number of bytes.
+ */
+void TelemetryStreamReader::append(const uint8_t *data, size_t size)
+{
+    // Drop the decoded bytes from time to time.
+    if(bufferPos > 0 && bufferPos >= buffer.size() / 2)
+    {
+        buffer.erase(buffer.begin(), buffer.begin() + bufferPos);
+        bufferPos = 0;
+    }
+
+    buffer.insert(buffer.end(), data, data + size);
+}
+
+/**
+ * @brief Decodes the messages received, until the next frame.
+ * @return true if a frame was decoded, false if more bytes are needed or if
+ * the stream is invalid.
+ */
+bool TelemetryStreamReader::nextFrame()
+{
+    while(valid && buffer.size() - bufferPos >= sizeof(uint16_t))
+    {
+        uint16_t length;
+        memcpy(&length, &buffer[bufferPos], sizeof(length));
+        if(buffer.size() - bufferPos - sizeof(length) < length)
+            return false;
+
+        const uint8_t *p = &buffer[bufferPos + sizeof(length)];
+        const uint8_t *end = p + length;
+        bufferPos += sizeof(length) + length;
+
+        if(length == 0)
+            valid = false;
+        else if(*p == STREAM_SCHEMA)
+            valid = decodeSchema(p + 1, end);
+        else if(*p == STREAM_KEYFRAME || *p == STREAM_DELTA)
+        {
+            valid = decodeFrame(p + 1, end, *p == STREAM_KEYFRAME);
+            if(valid)
+            {
+                frameSize = sizeof(length) + length;
+                return true;
+            }
+        }
+        else
+            valid = false;
+
+        if(!valid)
+            cerr << "Invalid telemetry stream message." << endl;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Checks if all the messages decoded so far were valid.
+ * @return false if the stream is corrupted, true otherwise.
+ */
+bool TelemetryStreamReader::isValid() const
+{
+    return valid;
+}
+
+/**
+ * @brief Gets the channels, known once the schema is received.
+ * @return the channels, in the order of the values.
+ */
+const vector<StreamChannel> &TelemetryStreamReader::getChannels() const
+{
+    return channels;
+}
+
+/**
+ * @brief Gets the timestamp of the last frame.
+ * @return the timestamp [us].
+ */
+int64_t TelemetryStreamReader::getTime() const
+{
+    return time;
+}
+
+/**
+ * @brief Gets the value of a channel, in the last frame.
+ * @param channel the channel index.
+ * @return the value, with the stream resolution for the floats.
+ */
+double TelemetryStreamReader::getValue(size_t channel) const
+{
+    int32_t q = values[channel];
+
+    if(channels[channel].type == TELEMETRY_FLOAT32)
+        return (q == STREAM_NAN) ? NAN : (double)q * resolution;
+    else
+        return (double)q;
+}
+
+/**
+ * @brief Gets the number of snapshots skipped by the decimation before the
+ * last frame.
+ * @return the number of skipped snapshots.
+ */
+uint32_t TelemetryStreamReader::getSkippedCount() const
+{
+    return skippedCount;
+}
+
+/**
+ * @brief Gets the number of frames dropped by the sender before the last
+ * frame, because the link was too slow.
+ * @return the number of dropped frames.
+ */
+uint32_t TelemetryStreamReader::getDroppedCount() const
+{
+    return droppedCount;
+}
+
+/**
+ * @brief Gets the size of the last frame, as sent.
+ * @return the size of the message [B].
+ */
+size_t TelemetryStreamReader::getFrameSize() const
+{
+    return frameSize;
+}
+
+bool TelemetryStreamReader::decodeSchema(const uint8_t *p, const uint8_t *end)
+{
+    uint16_t n;
+    if(end - p < (ptrdiff_t)(sizeof(n) + sizeof(resolution)))
+        return false;
+    memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    memcpy(&resolution, p, sizeof(resolution));
+    p += sizeof(resolution);
+
+    channels.clear();
+    for(int i=0; i<n; i++)
+    {
+        if(end - p < 3)
+            return false;
+
+        StreamChannel c;
+        c.type = (TelemetryType)p[0];
+        uint8_t nameLength = p[1], unitLength = p[2];
+        p += 3;
+
+        if(end - p < nameLength + unitLength || c.type > TELEMETRY_BOOL)
+            return false;
+        c.name.assign((const char*)p, nameLength);
+        p += nameLength;
+        c.unit.assign((const char*)p, unitLength);
+        p += unitLength;
+
+        channels.push_back(c);
+    }
+
+    values.assign(channels.size(), 0);
+    hasKeyframe = false;
+    return true;
+}
+
+bool TelemetryStreamReader::decodeFrame(const uint8_t *p, const uint8_t *end, bool keyframe)
+{
+    if(!keyframe && !hasKeyframe)
+        return false;
+
+    int64_t t, skipped, dropped;
+    if(!streamGetVarint(p, end, t) || !streamGetVarint(p, end, skipped) ||
+       !streamGetVarint(p, end, dropped))
+    {
+        return false;
+    }
+
+    if(keyframe)
+    {
+        for(size_t i=0; i<channels.size(); i++)
+        {
+            int64_t v;
+            if(!streamGetVarint(p, end, v))
+                return false;
+            values[i] = (int32_t)v;
+        }
+        time = t;
+        hasKeyframe = true;
+    }
+    else
+    {
+        const uint8_t *mask = p;
+        p += (channels.size() + 7) / 8;
+        if(p > end)
+            return false;
+
+        for(size_t i=0; i<channels.size(); i++)
+        {
+            if(!(mask[i/8] & (1 << (i % 8))))
+                continue;
+
+            int64_t delta;
+            if(!streamGetVarint(p, end, delta))
+                return false;
+            values[i] = (int32_t)(values[i] + delta);
+        }
+        time += t;
+    }
+
+    skippedCount = (uint32_t)skipped;
+    droppedCount = (uint32_t)dropped;
+    return p == end;
+}
@@ -0,0 +1,59 @@
+#ifndef TELEMETRYSTREAMREADER_H
+#define TELEMETRYSTREAMREADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../lib/telemetrystreamer.h"
+
+/**
+ * @brief Variable of a telemetry stream.
+ */
+struct StreamChannel
+{
+    std::string name, unit;
+    TelemetryType type;
+};
+
+/**
+ * @brief Decodes the stream sent by TelemetryStreamer. The bytes received
+ * are appended as they come, then the frames are decoded one by one, each
+ * updating the values of all the channels.
+ */
+class TelemetryStreamReader
+{
+public:
+    TelemetryStreamReader();
+
+    void append(const uint8_t *data, size_t size);
+    bool nextFrame();
+    bool isValid() const;
+
+    const std::vector<StreamChannel> &getChannels() const;
+    int64_t getTime() const;
+    double getValue(size_t channel) const;
+    uint32_t getSkippedCount() const;
+    uint32_t getDroppedCount() const;
+    size_t getFrameSize() const;
+
+private:
+    bool decodeSchema(const uint8_t *p, const uint8_t *end);
+    bool decodeFrame(const uint8_t *p, const uint8_t *end, bool keyframe);
+
+    std::vector<uint8_t> buffer;    ///< Bytes received, not decoded yet.
+    size_t bufferPos;               ///< [B].
+    bool valid;
+
+    std::vector<StreamChannel> channels;
+    float resolution;
+    bool hasKeyframe;
+
+    // Last frame.
+    int64_t time;                   ///< [us].
+    std::vector<int32_t> values;    ///< Quantized.
+    uint32_t skippedCount, droppedCount;
+    size_t frameSize;               ///< [B].
+};
+
+#endif // TELEMETRYSTREAMREADER_H
@@ -0,0 +1,474 @@
+/**
+ * Segments the results of a SCONE/OpenSim simulation (e.g. a directory of
+ * "SCONE Software/results") into gait cycles, from the heel-strikes of a foot,
+ * time-normalizes every cycle to 0-100% GC, and computes the mean and SD
+ * curves of all the columns of all the .sto files, on all the cores, replacing
+ * encoder_heelstrike.m and the manual steps before fourier_decomposition.m.
+ * The mean curve of a torque can also be written as a tabulated profile that
+ * the controller loads directly.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "../common/gaitcycles.h"
+#include "../common/stofile.h"
+
+using namespace std;
+using namespace chrono;
+
+#define DEFAULT_CONTACT "ground_forces:Ground_Force 0"  ///< Right foot, foot_r of the model.
+#define DEFAULT_SKIPPED_FRACTION 0.1    ///< Start of the simulation ignored, as in encoder_heelstrike.m.
+#define DEFAULT_MIN_CYCLE 0.5           ///< [s].
+#define DEFAULT_TOLERANCE 0.2           ///< Max. deviation of a cycle from the median duration [].
+#define DEFAULT_N_POINTS 101            ///< Every 1% GC, 0 and 100% included.
+
+/**
+ * @brief Mean and SD curves of all the columns of a file.
+ */
+struct FileAverage
+{
+    string path;
+    bool loaded;
+    int nCycles;                    ///< Cycles within the time span of the file.
+    vector<string> columns;         ///< Averaged columns, without the time.
+    vector<vector<float>> means, sds; ///< Per column, then per point.
+    bool written;
+};
+
+static void printUsage()
+{
+    cout << "Usage: cycleaverage [options] <results directory>" << endl
+         << "  --contact <file>:<column>  foot load giving the heel-strikes (default: "
+         << DEFAULT_CONTACT << ")" << endl
+         << "  --threshold <x>            heel-strike when the load magnitude rises above x (default: 0)" << endl
+         << "  --min-cycle <s>            shortest gait cycle, shorter are contact bounces (default: "
+         << DEFAULT_MIN_CYCLE << ")" << endl
+         << "  --tolerance <fraction>     max. deviation of a cycle from the median duration (default: "
+         << DEFAULT_TOLERANCE << ")" << endl
+         << "  --skip <fraction>          ignored fraction at the start (default: "
+         << DEFAULT_SKIPPED_FRACTION << ")" << endl
+         << "  --points <n>               points per cycle, from 0 to 100% GC (default: "
+         << DEFAULT_N_POINTS << ")" << endl
+         << "  --match <text>             only average the .sto files whose name contains text (repeatable)" << endl
+         << "  --file <name>              also average this file of the directory, e.g. without .sto (repeatable)" << endl
+         << "  --out <directory>          write <file>.cycles.sto there, with the mean and SD of each column" << endl
+         << "  --profile <file>:<column>  write the mean of this torque as a tabulated profile" << endl
+         << "  --mass <kg>                divide the profile by the bodyweight" << endl
+         << "  --scale <k>                multiply the profile by k" << endl
+         << "  --interpolation <name>     interpolation of the profile, linear or cubic (default: linear)" << endl
+         << "  --profile-out <file>       profile file (default: <column>.profile)" << endl
+         << "  --threads <n>              number of threads (default: all cores)" << endl;
+}
+
+/**
+ * @brief Splits a "<file>:<column>" argument.
+ * @param text the argument.
+ * @param file the file name.
+ * @param column the column name.
+ * @return true if both parts are present, false otherwise.
+ */
+static bool splitFileColumn(const string &text, string &file, string &column)
+{
+    size_t separator = text.find(':');
+    if(separator == string::npos || separator == 0 || separator + 1 == text.size())
+        return false;
+
+    file = text.substr(0, separator);
+    column = text.substr(separator + 1);
+    return true;
+}
+
+/**
+ * @brief Gets the name of a file without the directory and the .sto
+ * extension.
+ * @param path path of the file.
+ * @return the name, e.g. "f0914m_Actuation_force".
+ */
+static string getStem(const string &path)
+{
+    string name = path.substr(path.find_last_of('/') + 1);
+    if(name.size() > 4 && name.compare(name.size() - 4, 4, ".sto") == 0)
+        name.erase(name.size() - 4);
+    return name;
+}
+
+/**
+ * @brief Formats a curve as space-separated values, with 6 significant
+ * digits.
+ * @param values the values.
+ * @return the formatted values.
+ */
+static string formatCurve(const vector<float> &values)
+{
+    ostringstream oss;
+    oss << setprecision(6);
+    for(size_t i=0; i<values.size(); i++)
+        oss << (i > 0 ? " " : "") << values[i];
+    return oss.str();
+}
+
+/**
+ * @brief Writes the curves of a file as a .sto file, which the stocache
+ * reader can load again: a "percent_gc" column, then the mean and SD of each
+ * column, suffixed with "_mean" and "_sd".
+ * @param path path of the file to write.
+ * @param average the curves.
+ * @param nPoints points per cycle.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeCycleTable(const string &path, const FileAverage &average, int nPoints)
+{
+    ofstream file(path);
+    if(!file.is_open())
+        return false;
+
+    file << "Gait cycle average of " << getStem(average.path) << endl
+         << "version=1" << endl
+         << "nRows=" << nPoints << endl
+         << "nColumns=" << 1 + 2 * average.columns.size() << endl
+         << "nCycles=" << average.nCycles << endl
+         << "endheader" << endl
+         << "percent_gc";
+    for(const string &column : average.columns)
+        file << "\t" << column << "_mean\t" << column << "_sd";
+    file << endl;
+
+    file << setprecision(8);
+    for(int p=0; p<nPoints; p++)
+    {
+        file << 100.0 * p / (nPoints - 1);
+        for(size_t c=0; c<average.columns.size(); c++)
+            file << "\t" << average.means[c][p] << "\t" << average.sds[c][p];
+        file << "\n";
+    }
+
+    return file.good();
+}
+
+/**
+ * @brief Writes a mean curve as a tabulated profile file, in the format of
+ * ProfileStore. The SD is written too, under a key the controller ignores.
+ * @param path path of the file to write.
+ * @param mean the mean torque, normalized [N.m/kg].
+ * @param sd the SD of the torque, normalized [N.m/kg].
+ * @param period mean duration of the cycles [s].
+ * @param interpolation "linear" or "cubic".
+ * @param source description of the averaged column, written as a comment.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeProfile(const string &path, const vector<float> &mean,
+                         const vector<float> &sd, double period,
+                         const string &interpolation, const string &source)
+{
+    // Written to a temporary file, then renamed, so that the ProfileStore of
+    // the controller never reads it half-written.
+    string tmpPath = path + ".tmp";
+    ofstream file(tmpPath);
+    if(!file.is_open())
+        return false;
+
+    vector<float> phases;
+    for(size_t p=0; p<mean.size(); p++)
+        phases.push_back((float)p / (mean.size() - 1));
+
+    file << "# Tabulated hip torque profile, from heel-strike to heel-strike [N.m/kg]." << endl
+         << "# Mean of " << source << ", by tools/cycleaverage." << endl
+         << "phase: " << formatCurve(phases) << endl
+         << "torque: " << formatCurve(mean) << endl
+         << "torque_sd: " << formatCurve(sd) << endl
+         << "period: " << setprecision(4) << period << endl
+         << "interpolation: " << interpolation << endl;
+
+    file.close();
+    if(file.fail() || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    string directory, contact = DEFAULT_CONTACT, outDirectory;
+    string profileSource, profilePath, interpolation = "linear";
+    vector<string> matches, extraFiles;
+    double threshold = 0.0, minCycle = DEFAULT_MIN_CYCLE, tolerance = DEFAULT_TOLERANCE;
+    double skippedFraction = DEFAULT_SKIPPED_FRACTION, mass = 1.0, scale = 1.0;
+    int nPoints = DEFAULT_N_POINTS;
+    int nThreads = (int)thread::hardware_concurrency();
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--contact" && hasValue)
+            contact = argv[++i];
+        else if(arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]);
+        else if(arg == "--min-cycle" && hasValue)
+            minCycle = atof(argv[++i]);
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else if(arg == "--skip" && hasValue)
+            skippedFraction = atof(argv[++i]);
+        else if(arg == "--points" && hasValue)
+            nPoints = atoi(argv[++i]);
+        else if(arg == "--match" && hasValue)
+            matches.push_back(argv[++i]);
+        else if(arg == "--file" && hasValue)
+            extraFiles.push_back(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outDirectory = argv[++i];
+        else if(arg == "--profile" && hasValue)
+            profileSource = argv[++i];
+        else if(arg == "--mass" && hasValue)
+            mass = atof(argv[++i]);
+        else if(arg == "--scale" && hasValue)
+            scale = atof(argv[++i]);
+        else if(arg == "--interpolation" && hasValue)
+            interpolation = argv[++i];
+        else if(arg == "--profile-out" && hasValue)
+            profilePath = argv[++i];
+        else if(arg == "--threads" && hasValue)
+            nThreads = atoi(argv[++i]);
+        else if(arg.size() > 0 && arg[0] != '-' && directory.empty())
+            directory = arg;
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    string contactFile, contactColumn, profileFile, profileColumn;
+    if(directory.empty() || nPoints < 2 || mass <= 0.0 || tolerance <= 0.0 ||
+       !splitFileColumn(contact, contactFile, contactColumn) ||
+       (!profileSource.empty() && !splitFileColumn(profileSource, profileFile, profileColumn)) ||
+       (interpolation != "linear" && interpolation != "cubic"))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Find the heel-strikes and the cycles.
+    auto startTime = steady_clock::now();
+    vector<GaitCycle> cycles;
+    int nHeelStrikes, nRejected;
+    {
+        StoTable table;
+        string path = directory + "/" + contactFile;
+        if(!table.load(path))
+        {
+            cerr << "Could not load " << path << "." << endl;
+            return 1;
+        }
+
+        const float *time = table.getTimeColumn();
+        const float *load = table.getColumn(contactColumn);
+        if(time == nullptr || load == nullptr || table.getRowsCount() < 2)
+        {
+            cerr << path << " has no time or no \"" << contactColumn << "\" column." << endl;
+            return 1;
+        }
+
+        size_t nRows = table.getRowsCount();
+        vector<double> heelStrikes = findHeelStrikes(time, load, nRows, (float)threshold,
+                                                     minCycle);
+        nHeelStrikes = (int)heelStrikes.size();
+
+        size_t firstRow = min((size_t)(skippedFraction * nRows), nRows - 1);
+        cycles = selectCycles(heelStrikes, time[firstRow], tolerance, nRejected);
+    }
+
+    if(cycles.empty())
+    {
+        cerr << "No gait cycle found from " << nHeelStrikes << " heel-strikes of \""
+             << contactColumn << "\" of " << contactFile << "." << endl;
+        return 1;
+    }
+
+    double sum = 0.0, squares = 0.0;
+    for(const GaitCycle &c : cycles)
+    {
+        sum += c.end - c.start;
+        squares += (c.end - c.start) * (c.end - c.start);
+    }
+    double meanDuration = sum / cycles.size();
+    double sdDuration = sqrt(max(squares / cycles.size() - meanDuration * meanDuration, 0.0));
+
+    cout << nHeelStrikes << " heel-strikes of \"" << contactColumn << "\" of " << contactFile
+         << ", " << cycles.size() << " cycles from " << fixed << setprecision(2)
+         << cycles.front().start << " to " << cycles.back().end << " s (" << nRejected
+         << " rejected), " << setprecision(3) << meanDuration << " +- " << sdDuration
+         << " s." << endl;
+
+    // List the files.
+    vector<string> files;
+    for(const string &path : listStoFiles(directory))
+    {
+        bool matching = matches.empty();
+        for(const string &m : matches)
+            matching = matching || (getStem(path).find(m) != string::npos);
+        if(matching)
+            files.push_back(path);
+    }
+    for(const string &name : extraFiles)
+        files.push_back(directory + "/" + name);
+
+    // Create the output directory, as the TelemetryRecorder does. If it
+    // cannot be created, the writing of the curves fails below.
+    if(!outDirectory.empty())
+        mkdir(outDirectory.c_str(), 0755);
+
+    // Average the columns of each file, the files shared between the threads.
+    vector<FileAverage> averages(files.size());
+    atomic<size_t> nextFile(0);
+
+    auto worker = [&]()
+    {
+        size_t i;
+        while((i = nextFile.fetch_add(1)) < files.size())
+        {
+            FileAverage &average = averages[i];
+            average.path = files[i];
+            average.loaded = false;
+            average.nCycles = 0;
+            average.written = false;
+
+            StoTable table;
+            if(!table.load(files[i]) || table.getTimeColumn() == nullptr)
+                continue;
+            average.loaded = true;
+
+            CycleSampling sampling = sampleCycles(table.getTimeColumn(), table.getRowsCount(),
+                                                  cycles, nPoints);
+            average.nCycles = (int)sampling.cycles.size();
+            if(average.nCycles == 0)
+                continue;
+
+            const vector<string> &names = table.getColumnNames();
+            for(size_t c=0; c<names.size(); c++)
+            {
+                if(names[c].compare(0, 4, "time") == 0)
+                    continue;
+
+                average.columns.push_back(names[c]);
+                average.means.push_back(vector<float>(nPoints));
+                average.sds.push_back(vector<float>(nPoints));
+                averageCycles(sampling, table.getColumn(c), average.means.back().data(),
+                              average.sds.back().data());
+            }
+
+            if(!outDirectory.empty())
+            {
+                average.written = writeCycleTable(outDirectory + "/" + getStem(files[i]) +
+                                                  ".cycles.sto", average, nPoints);
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for(int t=1; t<max(1, nThreads); t++)
+        threads.push_back(thread(worker));
+    worker();
+    for(thread &t : threads)
+        t.join();
+
+    double elapsed = duration<double, milli>(steady_clock::now() - startTime).count();
+
+    // Report.
+    size_t nColumns = 0, nAveraged = 0;
+    bool failed = false;
+
+    cout << "file\tcolumns\tcycles" << endl;
+    for(const FileAverage &average : averages)
+    {
+        cout << getStem(average.path) << "\t";
+        if(!average.loaded)
+        {
+            cout << "not loaded" << endl;
+            failed = true;
+            continue;
+        }
+
+        cout << average.columns.size() << "\t" << average.nCycles << endl;
+        nColumns += average.columns.size();
+        nAveraged += (average.nCycles > 0) ? 1 : 0;
+
+        if(!outDirectory.empty() && average.nCycles > 0 && !average.written)
+        {
+            cerr << "Could not write the curves of " << average.path << " to "
+                 << outDirectory << "." << endl;
+            failed = true;
+        }
+    }
+
+    cout << nAveraged << " files, " << nColumns << " columns averaged over "
+         << cycles.size() << " cycles in " << setprecision(1) << elapsed << " ms ("
+         << max(1, nThreads) << " threads)." << endl;
+
+    // Export the profile.
+    if(!profileSource.empty())
+    {
+        const FileAverage *average = nullptr;
+        for(const FileAverage &a : averages)
+        {
+            if(a.path == directory + "/" + profileFile)
+                average = &a;
+        }
+
+        size_t c = 0;
+        if(average != nullptr)
+        {
+            while(c < average->columns.size() && average->columns[c] != profileColumn)
+                c++;
+        }
+
+        if(average == nullptr || c == average->columns.size())
+        {
+            cerr << "The profile column \"" << profileColumn << "\" of " << profileFile
+                 << " was not averaged (add the file with --file if it has no .sto"
+                 << " extension)." << endl;
+            return 1;
+        }
+
+        vector<float> mean = average->means[c], sd = average->sds[c];
+        for(size_t p=0; p<mean.size(); p++)
+        {
+            mean[p] *= scale / mass;
+            sd[p] *= fabs(scale) / mass;
+        }
+
+        if(profilePath.empty())
+            profilePath = profileColumn + ".profile";
+
+        ostringstream source;
+        source << average->nCycles << " gait cycles of \"" << profileColumn << "\" of "
+               << profileFile << ", scale " << scale << ", mass " << mass << " kg";
+
+        if(!writeProfile(profilePath, mean, sd, meanDuration, interpolation, source.str()))
+        {
+            cerr << "Could not write " << profilePath << "." << endl;
+            return 1;
+        }
+        cout << "Profile written to " << profilePath << "." << endl;
+    }
+
+    return failed ? 1 : 0;
+}
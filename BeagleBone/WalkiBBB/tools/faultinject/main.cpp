@@ -0,0 +1,663 @@
+/**
+ * Injects faults into the eWalk controller, and measures the time from the
+ * onset of each fault until both simulated motors are driven to zero torque.
+ * The controller is built with SIM_REAL_TIME: it runs on the simulated
+ * drivers, but in real time, with its own CAN and supervisor threads, and the
+ * periods and priorities of the orthosis, so the measured reaction times
+ * include the scheduling latency of the machine. The control loop of the tool
+ * calls update() every MAIN_LOOP_PERIOD, with the assistance enabled, on a
+ * synthetic walk.
+ *
+ * The faults are injected on the right leg by the model of the simulated
+ * motors, which runs inside their updates, by the control loop (stall,
+ * excessive bodyweight), or by holding the CAN thread in a signal handler,
+ * outside the motors. The CAN thread is also held inside an update of the
+ * motors, where the supervisor must not access them at the same time. The
+ * worst case of each fault is compared to SafetySupervisor::getReactionBound().
+ */
+
+#ifndef SIM_REAL_TIME
+#error "faultinject must be built with -DSIM_REAL_TIME, see tools/README.md."
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "../common/controllerharness.h"
+#include "../../lib/periodicexecutor.h"
+
+using namespace std;
+using namespace chrono;
+
+const float BODYWEIGHT = 60.0f;             // [kg]
+const float ASSISTANCE = 50.0f;             // [%]
+const float OVERLOAD = 100.0f;              // Bodyweight factor for the torque limit.
+const int64_t MISSED_TIMEOUT = 500000;      // Time to wait for a cut-off [us].
+const int64_t SETTLE_TIME = 30000;          // Time to recover between trials [us].
+const int64_t ASSIST_TIMEOUT = 10000000;    // Time to assist again after a trial [us].
+const int64_t LATE_DURATION = 20000;        // Hold inside the motors, above canTimeout [us].
+const int64_t HOLD_TIMEOUT = 100000;        // Time to hold the CAN thread outside the motors [us].
+const int MOTOR_IDS[N_GAIT_LEGS] = {2, 1};  // As in the controller.
+
+/**
+ * @brief Gets the time of the real monotonic clock, as read by the controller
+ * built with SIM_REAL_TIME.
+ * @return the time [us].
+ */
+static int64_t nowUs()
+{
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief State of the CAN thread, held by holdCanThread().
+ */
+enum CanHoldState
+{
+    CAN_RUNNING = 0,
+    CAN_HELD,           ///< Held in the signal handler, outside the motors.
+    CAN_HOLD_DECLINED   ///< The signal came while in the motors, not held.
+};
+
+static const ControllerHarness *heldHarness = nullptr;
+static std::atomic<bool> canHoldRequested(false);
+static std::atomic<int> canHoldState(CAN_RUNNING);
+
+/**
+ * @brief Signal handler, run by the CAN thread: holds it until the hold is no
+ * longer requested, unless it was in the motors, where the supervisor would
+ * have to wait for it.
+ */
+static void holdCanThread(int)
+{
+    if(heldHarness->areMotorsInUse())
+    {
+        canHoldState = CAN_HOLD_DECLINED;
+        return;
+    }
+
+    canHoldState = CAN_HELD;
+    const timespec pause = {0, 100000};
+    while(canHoldRequested)
+        nanosleep(&pause, nullptr);
+    canHoldState = CAN_RUNNING;
+}
+
+/**
+ * @brief Controller under test, updated in real time by a control loop, with
+ * the faults injected on request.
+ */
+class InjectedController
+{
+public:
+    InjectedController(const GaitTrace &walk) :
+        walk(walk),
+        controlLoop(microseconds((int)(MAIN_LOOP_PERIOD * 1000000.0f)), 5.0f),
+        realTime(true),
+        started(false),
+        stop(false),
+        injected(SAFETY_OK),
+        lateInMotors(false),
+        holdInMotors(false),
+        enableRequested(false),
+        armed(false),
+        updating(false),
+        concurrentUpdates(0),
+        faultStart(-1),
+        cutOffTime(-1),
+        releaseTime(-1),
+        holdStart(-1),
+        lastBeatTime(0),
+        lastCanUpdateTime(0)
+    {
+        for(int j=0; j<N_GAIT_LEGS; j++)
+        {
+            setpoints[j] = 0.0f;
+            zeroTimes[j] = -1;
+        }
+
+        // The model must be set before the CAN thread starts.
+        using namespace std::placeholders;
+        SimHardware::getInstance().motorModel =
+            bind(&InjectedController::modelMotor, this, _1, _2);
+
+        harness = new ControllerHarness();
+        harness->setBodyweight(BODYWEIGHT);
+        harness->setAssistance(ASSISTANCE);
+        harness->setEnabled(true);
+
+        canThread = harness->getCanThread()->native_handle();
+        heldHarness = harness;
+        started.store(true, memory_order_release);
+
+        controlThread = thread(&InjectedController::runControl, this);
+        struct sched_param sp;
+        sp.sched_priority = 1; // Below the CAN and supervisor threads.
+        if(pthread_setschedparam(controlThread.native_handle(), SCHED_RR, &sp) != 0)
+            realTime = false;
+    }
+
+    ~InjectedController()
+    {
+        canHoldRequested = false;
+        holdInMotors = false;
+        injected = SAFETY_OK;
+        stop = true;
+        controlThread.join();
+
+        delete harness;
+        heldHarness = nullptr;
+        SimHardware::getInstance().motorModel = nullptr;
+    }
+
+    /**
+     * @brief Starts injecting a fault, and measuring the reaction to it.
+     * @param fault the fault, as it should be detected.
+     * @param inMotors with SAFETY_CAN_STALLED, hold the CAN thread inside an
+     * update of the motors for LATE_DURATION, instead of outside them until
+     * the cut-off.
+     * @return true if the fault was injected, false if the CAN thread could
+     * not be held.
+     */
+    bool inject(SafetyFault fault, bool inMotors = false)
+    {
+        for(int j=0; j<N_GAIT_LEGS; j++)
+            zeroTimes[j] = -1;
+        faultStart = -1;
+        cutOffTime = -1;
+        releaseTime = -1;
+        holdStart = -1;
+        lateInMotors = inMotors;
+        holdInMotors = inMotors;
+        armed = true;
+        injected = fault;
+
+        if(fault != SAFETY_CAN_STALLED)
+            return true;
+
+        if(inMotors)
+        {
+            // Release the CAN thread after LATE_DURATION in the motors.
+            int64_t deadline = nowUs() + MISSED_TIMEOUT;
+            while(holdStart < 0 && nowUs() < deadline)
+                this_thread::sleep_for(microseconds(100));
+            this_thread::sleep_for(microseconds(LATE_DURATION));
+            holdInMotors = false;
+            return holdStart >= 0;
+        }
+
+        // Hold the CAN thread, retrying when the signal comes while it is in
+        // the motors.
+        canHoldRequested = true;
+        int64_t deadline = nowUs() + HOLD_TIMEOUT;
+        while(nowUs() < deadline)
+        {
+            canHoldState = CAN_RUNNING;
+            pthread_kill(canThread, SIGUSR1);
+            while(canHoldState == CAN_RUNNING && nowUs() < deadline)
+                this_thread::sleep_for(microseconds(50));
+
+            if(canHoldState == CAN_HELD)
+                return true;
+            this_thread::sleep_for(microseconds(137));
+        }
+
+        canHoldRequested = false;
+        return false;
+    }
+
+    /**
+     * @brief Stops injecting the fault, enables the controller again, which
+     * clears the fault, and waits until both motors get a torque again.
+     * @return true if the controller assists again, false otherwise.
+     */
+    bool recover()
+    {
+        armed = false;
+        holdInMotors = false;
+        canHoldRequested = false;
+        injected = SAFETY_OK;
+        this_thread::sleep_for(microseconds(SETTLE_TIME));
+
+        // The fault is only cleared once the control loop disabled the
+        // controller, so enable it again until then.
+        int64_t deadline = nowUs() + ASSIST_TIMEOUT;
+        while(getSupervisor().getFault() != SAFETY_OK && nowUs() < deadline)
+        {
+            enableRequested = true;
+            this_thread::sleep_for(microseconds(SETTLE_TIME));
+        }
+
+        return waitAssisting(deadline);
+    }
+
+    /**
+     * @brief Waits until both motors get a non-zero torque.
+     * @param deadline the time to give up [us].
+     * @return true if both motors got a torque before the deadline.
+     */
+    bool waitAssisting(int64_t deadline)
+    {
+        while(setpoints[GAIT_LEFT] == 0.0f || setpoints[GAIT_RIGHT] == 0.0f)
+        {
+            if(nowUs() > deadline)
+                return false;
+            this_thread::sleep_for(microseconds(1000));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Gets the onset of the injected fault, as defined by
+     * SafetySupervisor::getReactionBound(): the fault at the motors, the end
+     * of the torque error duration, or the end of the timeout of a stall. For
+     * the CAN thread held inside the motors, this is the end of the hold.
+     * @return the onset [us], -1 if the fault did not reach the motors yet.
+     */
+    int64_t getOnset()
+    {
+        const SafetyLimits &limits = getSupervisor().getLimits();
+
+        switch(injected.load())
+        {
+        case SAFETY_CONTROL_STALLED:
+            return lastBeatTime + limits.controlTimeout;
+        case SAFETY_CAN_STALLED:
+            return lateInMotors ? releaseTime.load() : lastCanUpdateTime + limits.canTimeout;
+        case SAFETY_TORQUE_ERROR:
+            return (faultStart < 0) ? -1 : faultStart + limits.torqueErrorDuration;
+        default:
+            return faultStart;
+        }
+    }
+
+    /**
+     * @brief Gets the time the torque was cut off, during a trial.
+     * @return the first time both motors were updated with a zero setpoint
+     * after the injection [us], -1 if not yet.
+     */
+    int64_t getCutOffTime() const
+    {
+        return cutOffTime;
+    }
+
+    /**
+     * @brief Gets the number of updates of a motor that started while another
+     * thread was updating a motor.
+     * @return the number of updates, 0 if the motors have a single owner.
+     */
+    int getConcurrentUpdatesCount() const
+    {
+        return concurrentUpdates;
+    }
+
+    /**
+     * @brief Gets whether the control loop runs with a real-time priority.
+     * @return true if it got it, false otherwise.
+     */
+    bool hasRealTimePriorities() const
+    {
+        return realTime;
+    }
+
+    /**
+     * @brief Gets the number of iterations of the threads that started more
+     * than half a period late, so that did not run on time.
+     * @return the total of the control loop, and of the CAN and supervisor
+     * threads of the controller.
+     */
+    uint32_t getOverrunsCount()
+    {
+        return controlLoop.getMonitor().getOverrunsCount() +
+               harness->getThreadsOverrunsCount();
+    }
+
+    /**
+     * @brief Gets the safety supervisor of the controller.
+     * @return the supervisor.
+     */
+    SafetySupervisor &getSupervisor()
+    {
+        return harness->getSafetySupervisor();
+    }
+
+private:
+    /**
+     * @brief Updates the controller every MAIN_LOOP_PERIOD, with the soles of
+     * the walk, repeated, unless the control loop stall is injected.
+     */
+    void runControl()
+    {
+        size_t i = 0;
+
+        controlLoop.start();
+        while(!stop)
+        {
+            SafetyFault fault = (SafetyFault)injected.load();
+            if(fault != SAFETY_CONTROL_STALLED)
+            {
+                if(enableRequested.exchange(false))
+                    harness->setEnabled(true);
+                harness->setBodyweight((fault == SAFETY_TORQUE_LIMIT) ?
+                                       OVERLOAD * BODYWEIGHT : BODYWEIGHT);
+                harness->setSoles(walk.frames[i]);
+                i = (i + 1) % walk.frames.size();
+
+                lastBeatTime = nowUs();
+                harness->getController().update(MAIN_LOOP_PERIOD);
+            }
+
+            controlLoop.waitNextPeriod();
+        }
+    }
+
+    /**
+     * @brief Model of the simulated motors, called by each of their updates,
+     * by the CAN thread, or by the supervisor cutting the torque off. Moves
+     * the hips, injects the faults on the right leg, and records the updates
+     * with a zero setpoint.
+     * @param id CAN ID of the motor.
+     * @param motor state of the motor.
+     */
+    void modelMotor(int id, SimMotor &motor)
+    {
+        if(!started.load(memory_order_acquire))
+            return;
+
+        if(updating.exchange(true))
+            concurrentUpdates++;
+
+        int64_t now = nowUs();
+        bool canThreadUpdate = pthread_equal(pthread_self(), canThread);
+        int j = (id == MOTOR_IDS[GAIT_LEFT]) ? GAIT_LEFT : GAIT_RIGHT;
+        SafetyFault fault = (SafetyFault)injected.load();
+        const SafetyLimits &limits = getSupervisor().getLimits();
+
+        motor.position = 20.0f * sinf((float)now * 6e-6f + j * 3.0f);
+        motor.speed = 120.0f;
+        if(j == GAIT_RIGHT)
+        {
+            if(fault == SAFETY_ANGLE_LIMIT)
+                motor.position = 2.0f * limits.maxAngle;
+            else if(fault == SAFETY_SPEED_LIMIT)
+                motor.speed = 2.0f * limits.maxSpeed;
+            else if(fault == SAFETY_TORQUE_ERROR)
+                motor.torque = motor.torqueSetpoint + 2.0f * limits.maxTorqueError;
+
+            // Late inside the motors: until the release, the supervisor must
+            // leave them to the CAN thread.
+            if(canThreadUpdate && holdInMotors)
+            {
+                holdStart = now;
+                while(holdInMotors)
+                    this_thread::sleep_for(microseconds(100));
+                releaseTime = nowUs();
+            }
+        }
+
+        // The fault reached the motors with this update. The excessive
+        // bodyweight may first exceed the torque limit on either leg.
+        bool reached = (j == GAIT_RIGHT &&
+                        (fault == SAFETY_ANGLE_LIMIT || fault == SAFETY_SPEED_LIMIT ||
+                         fault == SAFETY_TORQUE_ERROR)) ||
+                       (fault == SAFETY_TORQUE_LIMIT &&
+                        fabsf(motor.torqueSetpoint) > limits.maxTorque);
+        int64_t none = -1;
+        if(armed && reached)
+            faultStart.compare_exchange_strong(none, now);
+
+        setpoints[j] = motor.torqueSetpoint;
+        if(canThreadUpdate)
+            lastCanUpdateTime = now;
+
+        if(armed && motor.torqueSetpoint == 0.0f)
+        {
+            now = nowUs();
+            none = -1;
+            zeroTimes[j].compare_exchange_strong(none, now);
+            none = -1;
+            if(zeroTimes[1 - j] >= 0)
+                cutOffTime.compare_exchange_strong(none, now);
+        }
+
+        updating = false;
+    }
+
+    const GaitTrace &walk;
+    ControllerHarness *harness;
+    pthread_t canThread;
+
+    PeriodicExecutor controlLoop;
+    thread controlThread;
+    bool realTime;                      ///< The control loop got its real-time priority.
+    std::atomic<bool> started;          ///< The controller is created.
+    std::atomic<bool> stop;
+
+    std::atomic<int> injected;          ///< SafetyFault injected, SAFETY_OK if none.
+    std::atomic<bool> lateInMotors;     ///< The CAN stall is a hold inside the motors.
+    std::atomic<bool> holdInMotors;     ///< Hold the CAN thread inside the motors.
+    std::atomic<bool> enableRequested;  ///< Enable the controller at the next update.
+    std::atomic<bool> armed;            ///< A trial is running.
+
+    std::atomic<bool> updating;         ///< A motor is being updated.
+    std::atomic<int> concurrentUpdates;
+    std::atomic<float> setpoints[N_GAIT_LEGS];  ///< Last setpoints of the motors [N.m].
+    std::atomic<int64_t> zeroTimes[N_GAIT_LEGS]; ///< First zero setpoint of each motor [us].
+    std::atomic<int64_t> faultStart;    ///< First update with the fault [us].
+    std::atomic<int64_t> cutOffTime;    ///< Both setpoints at zero after the injection [us].
+    std::atomic<int64_t> releaseTime;   ///< End of the hold inside the motors [us].
+    std::atomic<int64_t> holdStart;     ///< Start of the hold inside the motors [us].
+    std::atomic<int64_t> lastBeatTime;  ///< Last update() of the controller [us].
+    std::atomic<int64_t> lastCanUpdateTime; ///< [us]
+};
+
+/**
+ * @brief Reaction times to one kind of fault, over the trials.
+ */
+struct FaultStats
+{
+    string name;
+    SafetyFault fault;          ///< Injected and expected fault.
+    bool inMotors;              ///< CAN thread held inside the motors.
+    int64_t bound;              ///< Max. reaction time [us].
+    vector<int64_t> reactions;  ///< [us]
+    int late = 0;               ///< Trials with an overrun of a thread.
+    int missed = 0;             ///< No cut-off, or another fault detected.
+};
+
+static void printUsage()
+{
+    cout << "Usage: faultinject [options]" << endl
+         << "  --trials <n>    trials per fault (default: 50)" << endl
+         << "  --calm <s>      duration without fault before, to count false trips (default: 2)" << endl
+         << "  --jitter <us>   scheduling latency allowed above the bound (default: 500)" << endl
+         << "  --seed <n>      random seed of the injection times (default: 1)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int nTrials = 50;
+    float calmDuration = 2.0f;
+    int64_t jitter = 500;
+    unsigned int seed = 1;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--trials" && hasValue)
+            nTrials = max(atoi(argv[++i]), 1);
+        else if(arg == "--calm" && hasValue)
+            calmDuration = max((float)atof(argv[++i]), 0.0f);
+        else if(arg == "--jitter" && hasValue)
+            jitter = atoi(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            seed = (unsigned int)atoi(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = holdCanThread;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+
+    // Synthetic walk, with the same calibration of the soles as the
+    // controller.
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+    SyntheticGaitParams gait = getDefaultSyntheticGaitParams();
+    gait.duration = 120.0f;
+    gait.dt = MAIN_LOOP_PERIOD;
+    gait.bodyweight = BODYWEIGHT;
+    GaitTrace walk = makeSyntheticGait(gait, calibration);
+
+    InjectedController controller(walk);
+    SafetySupervisor &supervisor = controller.getSupervisor();
+    if(!controller.hasRealTimePriorities())
+        cout << "Could not set the real-time priorities, the latencies may be higher." << endl;
+
+    if(!controller.waitAssisting(nowUs() + ASSIST_TIMEOUT))
+    {
+        cout << "The controller did not assist." << endl;
+        return 2;
+    }
+
+    // Without any fault, the supervisor must not trip.
+    int falseTrips = 0;
+    int64_t calmEnd = nowUs() + (int64_t)(calmDuration * 1e6f);
+    while(nowUs() < calmEnd)
+    {
+        if(supervisor.getFault() != SAFETY_OK)
+        {
+            cout << "False trip: " << SafetySupervisor::getFaultName(supervisor.getFault())
+                 << endl;
+            falseTrips++;
+            controller.recover();
+        }
+        this_thread::sleep_for(microseconds(1000));
+    }
+
+    // Each fault, then the CAN thread late inside the motors. There, the
+    // supervisor must wait, and the CAN thread cuts the torque off at its next
+    // update after the release.
+    vector<FaultStats> stats;
+    for(int f=SAFETY_CONTROL_STALLED; f<N_SAFETY_FAULTS; f++)
+    {
+        FaultStats s;
+        s.name = SafetySupervisor::getFaultName((SafetyFault)f);
+        s.fault = (SafetyFault)f;
+        s.inMotors = false;
+        s.bound = supervisor.getReactionBound(s.fault, CAN_UPDATE_PERIOD) + jitter;
+        stats.push_back(s);
+    }
+
+    FaultStats lateStats;
+    lateStats.name = "CAN thread late in the motors";
+    lateStats.fault = SAFETY_CAN_STALLED;
+    lateStats.inMotors = true;
+    lateStats.bound = CAN_UPDATE_PERIOD + jitter;
+    stats.push_back(lateStats);
+
+    // Inject each fault at random times, relative to the periods of the threads.
+    mt19937 generator(seed);
+    uniform_int_distribution<int> delayDistribution(0, (int)(2.0f * MAIN_LOOP_PERIOD * 1e6f));
+
+    int64_t supervisorMax = 0;
+    for(FaultStats &s : stats)
+    {
+        // The supervisor also measures the hold inside the motors.
+        if(s.inMotors)
+            supervisorMax = supervisor.getMaxReactionTime();
+
+        for(int t=0; t<nTrials; t++)
+        {
+            this_thread::sleep_for(microseconds(delayDistribution(generator)));
+            uint32_t overruns = controller.getOverrunsCount();
+            bool injected = controller.inject(s.fault, s.inMotors);
+
+            int64_t deadline = nowUs() + MISSED_TIMEOUT;
+            while(injected && controller.getCutOffTime() < 0 && nowUs() < deadline)
+                this_thread::sleep_for(microseconds(200));
+
+            int64_t onset = controller.getOnset();
+            int64_t cutOffTime = controller.getCutOffTime();
+            bool late = (controller.getOverrunsCount() != overruns);
+
+            if(!injected || cutOffTime < 0 || onset < 0 || cutOffTime < onset ||
+               supervisor.getFault() != s.fault)
+            {
+                cout << "Missed " << s.name << ", detected: "
+                     << SafetySupervisor::getFaultName(supervisor.getFault()) << endl;
+                s.missed++;
+            }
+            else
+            {
+                s.reactions.push_back(cutOffTime - onset);
+                if(late)
+                    s.late++;
+            }
+
+            if(!controller.recover())
+            {
+                cout << "The controller did not assist again after " << s.name << "." << endl;
+                return 2;
+            }
+        }
+    }
+
+    const int concurrentUpdates = controller.getConcurrentUpdatesCount();
+
+    // Report the reaction times against their bounds, over all the trials,
+    // late or not.
+    bool passed = (falseTrips == 0) && (concurrentUpdates == 0);
+    cout << "fault\ttrials\tmissed\tlate\tmin\tmedian\tmax\tbound\t[us]" << endl;
+    for(FaultStats &s : stats)
+    {
+        sort(s.reactions.begin(), s.reactions.end());
+
+        cout << s.name << "\t" << nTrials << "\t" << s.missed << "\t" << s.late << "\t";
+        if(s.reactions.empty())
+            cout << "-\t-\t-\t";
+        else
+        {
+            cout << s.reactions.front() << "\t" << s.reactions[s.reactions.size() / 2]
+                 << "\t" << s.reactions.back() << "\t";
+        }
+        cout << s.bound << endl;
+
+        if(s.missed > 0 || s.reactions.empty() || s.reactions.back() > s.bound)
+            passed = false;
+    }
+
+    cout << "False trips: " << falseTrips << " in " << calmDuration << " s." << endl
+         << "Concurrent updates of the motors: " << concurrentUpdates << "." << endl
+         << "Max. reaction time measured by the supervisor, before the holds in the motors: "
+         << supervisorMax << " us." << endl;
+
+    if(!passed)
+    {
+        cout << "A fault was missed or cut off later than its bound, or the motors were "
+                "updated by two threads at once." << endl;
+        return 2;
+    }
+
+    return 0;
+}
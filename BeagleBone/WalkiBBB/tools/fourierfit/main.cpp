@@ -0,0 +1,468 @@
+/**
+ * Fits the sum-of-sines hip torque profiles of the eWalk controller to a
+ * torque trace: a column of a SCONE/OpenSim .sto file (e.g. "Torque_right" or
+ * "Healthy_Joint_Torques"), or the Winter table of the controller. The models
+ * with 1 to 8 harmonics are fitted, and one of them is written as coefficients
+ * the controller can use directly.
+ *
+ * The controller evaluates the profiles at the time since the last
+ * heel-strike, so the time of the .sto traces is shifted to start at a
+ * heel-strike, found in the foot load of the simulation, and only the samples
+ * of whole gait cycles are fitted.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/gaitcycles.h"
+#include "../common/harmonicfit.h"
+#include "../common/stofile.h"
+#include "../../controllers/ewalk/winterprofile.h"
+
+using namespace std;
+using namespace chrono;
+
+#define DEFAULT_SKIPPED_FRACTION 0.1    ///< Start of the traces ignored, as in poly_fourier_fit.m.
+#define DEFAULT_MIN_PERIOD 0.5          ///< [s].
+#define DEFAULT_MAX_PERIOD 3.0          ///< [s].
+#define DEFAULT_WINTER_PERIOD 2.0       ///< Period of the controller profiles [s].
+#define DEFAULT_EXPORTED_HARMONICS 3    ///< Number of terms of the current profiles.
+#define DEFAULT_CONTACT "ground_forces:Ground_Force 0"  ///< Right foot, as cycleaverage.
+#define DEFAULT_MIN_CYCLE 0.5           ///< [s].
+#define DEFAULT_TOLERANCE 0.2           ///< Max. deviation of a cycle from the median duration [].
+#define N_MEAN_CYCLE_POINTS 101         ///< Every 1% GC, to compare the fit to the mean cycle.
+
+static void printUsage()
+{
+    cout << "Usage: fourierfit [options] <.sto file> | --winter" << endl
+         << "  --column <name>       fitted column (default: the only non-time column)" << endl
+         << "  --winter              fit the Winter table of the controller instead" << endl
+         << "  --skip <fraction>     ignored fraction at the start (default: "
+         << DEFAULT_SKIPPED_FRACTION << ", 0 for --winter)" << endl
+         << "  --contact <file>:<column>  foot load giving the heel-strikes, file in the"
+         << " directory of the .sto file (default: " << DEFAULT_CONTACT << ")" << endl
+         << "  --threshold <x>       heel-strike when the load magnitude rises above x (default: 0)" << endl
+         << "  --min-cycle <s>       shortest gait cycle, shorter are contact bounces (default: "
+         << DEFAULT_MIN_CYCLE << ")" << endl
+         << "  --tolerance <fraction>  max. deviation of a cycle from the median duration (default: "
+         << DEFAULT_TOLERANCE << ")" << endl
+         << "  --period <s>          fixed gait cycle duration, no search (default for --winter: "
+         << DEFAULT_WINTER_PERIOD << ")" << endl
+         << "  --min-period <s>      shortest gait cycle searched (default: "
+         << DEFAULT_MIN_PERIOD << ")" << endl
+         << "  --max-period <s>      longest gait cycle searched (default: "
+         << DEFAULT_MAX_PERIOD << ")" << endl
+         << "  --mass <kg>           divide the trace by the bodyweight" << endl
+         << "  --scale <k>           multiply the trace by k" << endl
+         << "  --robust <n>          least absolute residuals, n reweighting passes" << endl
+         << "  --harmonics <n>       number of terms of the exported model (default: "
+         << DEFAULT_EXPORTED_HARMONICS << ")" << endl
+         << "  --name <name>         name of the printed C++ constant (default: FITTED_PROFILE)" << endl
+         << "  --out <file>          write the exported coefficients to this file" << endl
+         << "  --threads <n>         number of threads (default: all cores)" << endl;
+}
+
+/**
+ * @brief Formats the first coefficients of a row. The values have 6 decimals,
+ * without the trailing zeros, so that they are also valid C++ float literals
+ * with the suffix.
+ * @param values the coefficients.
+ * @param n the number of coefficients to format, N_HARMONICS to include the
+ * zeros of the unused terms.
+ * @param separator the separator between the values.
+ * @param suffix text after each value.
+ * @return the formatted values.
+ */
+static string formatValues(const array<float, N_HARMONICS> &values, int n,
+                           const string &separator, const string &suffix)
+{
+    string formatted;
+    for(int i=0; i<n; i++)
+    {
+        ostringstream oss;
+        oss << fixed << setprecision(6) << values[i];
+        string value = oss.str();
+        value.erase(max(value.find_last_not_of('0'), value.find('.') + 1) + 1);
+
+        if(i > 0)
+            formatted += separator;
+        formatted += value + suffix;
+    }
+    return formatted;
+}
+
+/**
+ * @brief Writes coefficients as a "key: values" text file, with the "a", "b"
+ * and "c" keys, in the format of lib/keyvaluefile.h.
+ * @param path path of the file to write.
+ * @param fit the fit to write.
+ * @param source description of the fitted trace, written as a comment.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeCoefficients(const string &path, const HarmonicFit &fit,
+                              const string &source)
+{
+    // Written to a temporary file, then renamed, so that the ProfileStore of
+    // the controller never reads it half-written.
+    string tmpPath = path + ".tmp";
+    ofstream file(tmpPath);
+    if(!file.is_open())
+        return false;
+
+    file << "# Sum-of-sines hip torque profile: torque(t) = sum_i a[i]*sin(b[i]*t + c[i])," << endl
+         << "# t being the time since the heel-strike [s]." << endl
+         << "# Fitted by tools/fourierfit to " << source << "," << endl
+         << "# " << fit.nHarmonics << " harmonics, period " << 2.0 * M_PI / fit.fundamental
+         << " s, RMSE " << fit.rmse << ", R2 " << fit.r2 << "." << endl
+         << "a: " << formatValues(fit.coefficients.a, fit.nHarmonics, " ", "") << endl
+         << "b: " << formatValues(fit.coefficients.b, fit.nHarmonics, " ", "") << endl
+         << "c: " << formatValues(fit.coefficients.c, fit.nHarmonics, " ", "") << endl;
+
+    file.close();
+    if(file.fail() || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Splits a "<file>:<column>" argument.
+ * @param text the argument.
+ * @param file the file name.
+ * @param column the column name.
+ * @return true if both parts are present, false otherwise.
+ */
+static bool splitFileColumn(const string &text, string &file, string &column)
+{
+    size_t separator = text.find(':');
+    if(separator == string::npos || separator == 0 || separator + 1 == text.size())
+        return false;
+
+    file = text.substr(0, separator);
+    column = text.substr(separator + 1);
+    return true;
+}
+
+/**
+ * @brief Evaluates a fitted model.
+ * @param fit the fit.
+ * @param t time since the heel-strike [s].
+ * @return the torque, same unit as the trace.
+ */
+static double evaluateFit(const HarmonicFit &fit, double t)
+{
+    double torque = 0.0;
+    for(int i=0; i<N_HARMONICS; i++)
+    {
+        torque += fit.coefficients.a[i] *
+                  sin(fit.coefficients.b[i] * t + fit.coefficients.c[i]);
+    }
+    return torque;
+}
+
+int main(int argc, char *argv[])
+{
+    string path, column, outPath, constantName = "FITTED_PROFILE";
+    string contact = DEFAULT_CONTACT;
+    bool useWinter = false;
+    double skippedFraction = -1.0, period = 0.0;
+    double threshold = 0.0, minCycle = DEFAULT_MIN_CYCLE, tolerance = DEFAULT_TOLERANCE;
+    double minPeriod = DEFAULT_MIN_PERIOD, maxPeriod = DEFAULT_MAX_PERIOD;
+    double mass = 1.0, scale = 1.0;
+    int robustIterations = 0, exportedHarmonics = DEFAULT_EXPORTED_HARMONICS;
+    int nThreads = (int)thread::hardware_concurrency();
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--winter")
+            useWinter = true;
+        else if(arg == "--column" && hasValue)
+            column = argv[++i];
+        else if(arg == "--skip" && hasValue)
+            skippedFraction = atof(argv[++i]);
+        else if(arg == "--contact" && hasValue)
+            contact = argv[++i];
+        else if(arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]);
+        else if(arg == "--min-cycle" && hasValue)
+            minCycle = atof(argv[++i]);
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else if(arg == "--period" && hasValue)
+            period = atof(argv[++i]);
+        else if(arg == "--min-period" && hasValue)
+            minPeriod = atof(argv[++i]);
+        else if(arg == "--max-period" && hasValue)
+            maxPeriod = atof(argv[++i]);
+        else if(arg == "--mass" && hasValue)
+            mass = atof(argv[++i]);
+        else if(arg == "--scale" && hasValue)
+            scale = atof(argv[++i]);
+        else if(arg == "--robust" && hasValue)
+            robustIterations = atoi(argv[++i]);
+        else if(arg == "--harmonics" && hasValue)
+            exportedHarmonics = atoi(argv[++i]);
+        else if(arg == "--name" && hasValue)
+            constantName = argv[++i];
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if(arg == "--threads" && hasValue)
+            nThreads = atoi(argv[++i]);
+        else if(arg.size() > 0 && arg[0] != '-' && path.empty())
+            path = arg;
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    string contactFile, contactColumn;
+    if(useWinter == !path.empty() || mass <= 0.0 || minPeriod <= 0.0 ||
+       maxPeriod <= minPeriod || exportedHarmonics < 1 ||
+       exportedHarmonics > N_HARMONICS || tolerance <= 0.0 ||
+       !splitFileColumn(contact, contactFile, contactColumn))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if(skippedFraction < 0.0)
+        skippedFraction = useWinter ? 0.0 : DEFAULT_SKIPPED_FRACTION;
+
+    // Get the trace, with the time since the first heel-strike.
+    vector<double> time, values;
+    vector<float> meanCycle; // Heel-strike aligned, for comparison.
+    double meanCycleDuration = 0.0; // [s].
+    string source;
+
+    if(useWinter)
+    {
+        if(period <= 0.0)
+            period = DEFAULT_WINTER_PERIOD;
+
+        // The table starts at a heel-strike already.
+        for(int i=0; i<WINTER_PROFILE_N_POINTS; i++)
+        {
+            time.push_back(winterHipTorqueProfile1[i].percentGc * period);
+            values.push_back(winterHipTorqueProfile1[i].torquePerBodyweight);
+        }
+        source = "the Winter table";
+
+        size_t nSkipped = (size_t)(skippedFraction * time.size());
+        time.erase(time.begin(), time.begin() + nSkipped);
+        values.erase(values.begin(), values.begin() + nSkipped);
+    }
+    else
+    {
+        StoTable table;
+        if(!table.load(path))
+        {
+            cerr << "Could not load " << path << "." << endl;
+            return 1;
+        }
+
+        const float *timeColumn = table.getTimeColumn();
+        if(timeColumn == nullptr)
+        {
+            cerr << path << " has no time column." << endl;
+            return 1;
+        }
+
+        // Default to the only column that is not a time.
+        const vector<string> &names = table.getColumnNames();
+        if(column.empty())
+        {
+            for(const string &name : names)
+            {
+                if(name.compare(0, 4, "time") == 0)
+                    continue;
+                if(!column.empty())
+                {
+                    column.clear();
+                    break;
+                }
+                column = name;
+            }
+        }
+
+        const float *valuesColumn = table.getColumn(column);
+        if(valuesColumn == nullptr)
+        {
+            cerr << "Select the fitted column with --column, among:" << endl;
+            for(const string &name : names)
+                cerr << "  " << name << endl;
+            return 1;
+        }
+
+        // Heel-strikes, as in cycleaverage.
+        size_t slash = path.find_last_of('/');
+        string contactPath = ((slash == string::npos) ? string(".") : path.substr(0, slash)) +
+                             "/" + contactFile;
+
+        StoTable contactTable;
+        if(!contactTable.load(contactPath))
+        {
+            cerr << "Could not load " << contactPath << ", select the foot load with"
+                 << " --contact." << endl;
+            return 1;
+        }
+
+        const float *contactTime = contactTable.getTimeColumn();
+        const float *load = contactTable.getColumn(contactColumn);
+        size_t nContactRows = contactTable.getRowsCount();
+        if(contactTime == nullptr || load == nullptr || nContactRows < 2)
+        {
+            cerr << contactPath << " has no time or no \"" << contactColumn << "\" column."
+                 << endl;
+            return 1;
+        }
+
+        vector<double> heelStrikes = findHeelStrikes(contactTime, load, nContactRows,
+                                                     (float)threshold, minCycle);
+        size_t firstRow = min((size_t)(skippedFraction * nContactRows), nContactRows - 1);
+        int nRejected;
+        vector<GaitCycle> cycles = selectCycles(heelStrikes, contactTime[firstRow], tolerance,
+                                                nRejected);
+
+        // Only the cycles within the trace are fitted, and the first one
+        // starts at t = 0.
+        CycleSampling sampling = sampleCycles(timeColumn, table.getRowsCount(), cycles,
+                                              N_MEAN_CYCLE_POINTS);
+        if(sampling.cycles.empty())
+        {
+            cerr << "No whole gait cycle in " << path << ", from " << heelStrikes.size()
+                 << " heel-strikes of \"" << contactColumn << "\" of " << contactFile
+                 << "." << endl;
+            return 1;
+        }
+
+        double firstHeelStrike = sampling.cycles.front().start;
+        for(const GaitCycle &c : sampling.cycles)
+        {
+            for(size_t r=0; r<table.getRowsCount(); r++)
+            {
+                if(timeColumn[r] >= c.start && timeColumn[r] < c.end)
+                {
+                    time.push_back(timeColumn[r] - firstHeelStrike);
+                    values.push_back(valuesColumn[r]);
+                }
+            }
+            meanCycleDuration += (c.end - c.start) / sampling.cycles.size();
+        }
+
+        meanCycle.resize(N_MEAN_CYCLE_POINTS);
+        vector<float> sd(N_MEAN_CYCLE_POINTS);
+        averageCycles(sampling, valuesColumn, meanCycle.data(), sd.data());
+
+        cout << sampling.cycles.size() << " gait cycles of " << meanCycleDuration
+             << " s on average (" << nRejected << " rejected), from the heel-strike at "
+             << firstHeelStrike << " s of \"" << contactColumn << "\" of " << contactFile
+             << "." << endl;
+
+        source = "\"" + column + "\" of " + path;
+    }
+
+    for(double &v : values)
+        v *= scale / mass;
+    for(float &v : meanCycle)
+        v *= (float)(scale / mass);
+
+    if(time.size() < 2 * N_HARMONICS)
+    {
+        cerr << "Not enough samples to fit." << endl;
+        return 1;
+    }
+
+    cout << "Fitting " << source << ": " << time.size() << " samples, from "
+         << time.front() << " to " << time.back() << " s." << endl;
+
+    // Fit all the numbers of harmonics.
+    vector<HarmonicFit> fits;
+    auto startTime = steady_clock::now();
+
+    cout << "harmonics\tperiod [s]\tRMSE\tR2\ttime [ms]" << endl;
+    for(int n=1; n<=N_HARMONICS; n++)
+    {
+        auto fitStartTime = steady_clock::now();
+
+        if(period > 0.0)
+        {
+            fits.push_back(fitHarmonics(time, values, n, 2.0 * M_PI / period,
+                                        robustIterations));
+        }
+        else
+        {
+            fits.push_back(searchHarmonics(time, values, n, minPeriod, maxPeriod,
+                                           robustIterations, nThreads));
+        }
+
+        const HarmonicFit &fit = fits.back();
+        cout << n << "\t" << 2.0 * M_PI / fit.fundamental << "\t" << fit.rmse
+             << "\t" << fit.r2 << "\t"
+             << duration<double>(steady_clock::now() - fitStartTime).count() * 1000.0
+             << endl;
+    }
+
+    cout << "Fitted in " << duration<double>(steady_clock::now() - startTime).count()
+         << " s." << endl;
+
+    // The controller evaluates the profile over each cycle from its
+    // heel-strike, so compare the fits to the mean cycle this way.
+    if(!meanCycle.empty())
+    {
+        cout << "RMSE against the mean cycle, from the heel-strike:";
+        for(const HarmonicFit &fit : fits)
+        {
+            double sum2 = 0.0;
+            for(int p=0; p<N_MEAN_CYCLE_POINTS; p++)
+            {
+                double t = meanCycleDuration * p / (N_MEAN_CYCLE_POINTS - 1);
+                double error = evaluateFit(fit, t) - meanCycle[p];
+                sum2 += error * error;
+            }
+            cout << " " << sqrt(sum2 / N_MEAN_CYCLE_POINTS);
+        }
+        cout << endl;
+    }
+    cout << endl;
+
+    // Export the selected model.
+    const HarmonicFit &exported = fits[exportedHarmonics - 1];
+
+    cout << "const HarmonicCoefficients " << constantName << " =" << endl
+         << "{" << endl
+         << "    {{" << formatValues(exported.coefficients.a, N_HARMONICS, ", ", "f") << "}},    // a" << endl
+         << "    {{" << formatValues(exported.coefficients.b, N_HARMONICS, ", ", "f") << "}},    // b" << endl
+         << "    {{" << formatValues(exported.coefficients.c, N_HARMONICS, ", ", "f") << "}}     // c" << endl
+         << "};" << endl;
+
+    if(!outPath.empty())
+    {
+        if(!writeCoefficients(outPath, exported, source))
+        {
+            cerr << "Could not write " << outPath << "." << endl;
+            return 1;
+        }
+        cout << "Coefficients written to " << outPath << "." << endl;
+    }
+
+    return 0;
+}
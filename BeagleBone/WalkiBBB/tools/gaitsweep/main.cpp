@@ -0,0 +1,322 @@
+/**
+ * Runs many copies of the heel-strike synchronization and torque logic of the
+ * eWalk controller over the same gait trace, each with its own parameters, in
+ * parallel on all the cores, and reports the metrics of each configuration in
+ * one table.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/gaitmetrics.h"
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Parameter that can be swept.
+ */
+struct SweepParameter
+{
+    const char *name;
+    const char *description;
+    float &(*get)(GaitRunConfig &config);
+};
+
+const SweepParameter PARAMETERS[] =
+{
+    {"assist", "percent assistance [%]",
+     [](GaitRunConfig &c) -> float& { return c.assistance; }},
+    {"threshold", "stance foot load threshold [N]",
+     [](GaitRunConfig &c) -> float& { return c.params.stanceFootLoadThreshold; }},
+    {"control_ratio", "period correction ratio [0-1]",
+     [](GaitRunConfig &c) -> float& { return c.params.controlRatio; }},
+    {"gain_slew", "gain slew per step [0-1]",
+     [](GaitRunConfig &c) -> float& { return c.params.gainSlewRate; }},
+    {"pg_max", "upper limit of the performed gait",
+     [](GaitRunConfig &c) -> float& { return c.params.performedGaitMax; }},
+    {"pg_max_reset", "performed gait after the upper limit",
+     [](GaitRunConfig &c) -> float& { return c.params.performedGaitMaxReset; }},
+    {"pg_min", "lower limit of the performed gait",
+     [](GaitRunConfig &c) -> float& { return c.params.performedGaitMin; }},
+    {"pg_min_reset", "performed gait after the lower limit",
+     [](GaitRunConfig &c) -> float& { return c.params.performedGaitMinReset; }},
+    {"min_period", "shortest profile period [s]",
+     [](GaitRunConfig &c) -> float& { return c.params.minPeriod; }},
+    {"ready_min", "lower performed gait bound to start",
+     [](GaitRunConfig &c) -> float& { return c.params.readyMinPerformedGait; }},
+    {"ready_max", "upper performed gait bound to start",
+     [](GaitRunConfig &c) -> float& { return c.params.readyMaxPerformedGait; }}
+};
+
+const int N_PARAMETERS = sizeof(PARAMETERS) / sizeof(PARAMETERS[0]);
+
+/**
+ * @brief Values of a swept parameter.
+ */
+struct Sweep
+{
+    int parameter; ///< Index in PARAMETERS.
+    vector<float> values;
+};
+
+static void printUsage()
+{
+    cout << "Usage: gaitsweep [options] --sweep <param>=<values> [--sweep ...]" << endl
+         << "  --sweep <p>=<values>  values of a parameter, as a list \"a,b,c\" or a range" << endl
+         << "                        \"first:last:step\". All the combinations are run." << endl
+         << "  --trace <file.csv>    recorded trace (default: synthetic gait)" << endl
+         << "  --duration <s>        duration of the synthetic gait (default: 120)" << endl
+         << "  --cycle <s>           GC duration of the synthetic gait (default: 1.1)" << endl
+         << "  --seed <n>            random seed of the synthetic gait (default: 0)" << endl
+         << "  --bodyweight <kg>     pilot bodyweight (default: 60)" << endl
+         << "  --reference <N>       foot load of the reference heel-strikes (default: 0.5)" << endl
+         << "  --threads <n>         number of threads (default: all cores)" << endl
+         << "  --out <file.csv>      also write the table to a CSV file" << endl
+         << "Parameters (default value):" << endl;
+
+    GaitRunConfig defaults;
+    defaults.params = GaitTorqueGenerator::getDefaultParams();
+    defaults.assistance = 50.0f;
+    for(const SweepParameter &p : PARAMETERS)
+    {
+        cout << "  " << left << setw(14) << p.name << setw(40) << p.description
+             << "(" << p.get(defaults) << ")" << endl;
+    }
+}
+
+/**
+ * @brief Parses the values of a --sweep option.
+ * @param text the option value, "name=a,b,c" or "name=first:last:step".
+ * @param sweep the parsed sweep.
+ * @return true if the text is valid, false otherwise.
+ */
+static bool parseSweep(const string &text, Sweep &sweep)
+{
+    size_t equal = text.find('=');
+    if(equal == string::npos)
+        return false;
+
+    string name = text.substr(0, equal);
+    string values = text.substr(equal + 1);
+
+    sweep.parameter = -1;
+    for(int i=0; i<N_PARAMETERS; i++)
+    {
+        if(name == PARAMETERS[i].name)
+            sweep.parameter = i;
+    }
+    if(sweep.parameter < 0)
+    {
+        cerr << "Unknown parameter \"" << name << "\"." << endl;
+        return false;
+    }
+
+    sweep.values.clear();
+    float first, last, step;
+    char c1, c2;
+    istringstream range(values);
+    if(values.find(':') != string::npos)
+    {
+        if(!(range >> first >> c1 >> last >> c2 >> step) || c1 != ':' ||
+           c2 != ':' || step <= 0.0f || last < first)
+        {
+            return false;
+        }
+
+        int n = (int)floorf((last - first) / step + 1e-3f) + 1;
+        for(int i=0; i<n; i++)
+            sweep.values.push_back(first + i * step);
+    }
+    else
+    {
+        istringstream list(values);
+        string item;
+        while(getline(list, item, ','))
+            sweep.values.push_back(atof(item.c_str()));
+    }
+
+    return !sweep.values.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    string tracePath, outPath;
+    SyntheticGaitParams gaitParams = getDefaultSyntheticGaitParams();
+    gaitParams.duration = 120.0f;
+    float bodyweight = 60.0f;
+    float referenceThreshold = 0.5f;
+    int nThreads = (int)thread::hardware_concurrency();
+    vector<Sweep> sweeps;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--sweep" && hasValue)
+        {
+            Sweep sweep;
+            if(!parseSweep(argv[++i], sweep))
+            {
+                cerr << "Invalid sweep \"" << argv[i] << "\"." << endl;
+                return 1;
+            }
+            sweeps.push_back(sweep);
+        }
+        else if(arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if(arg == "--duration" && hasValue)
+            gaitParams.duration = atof(argv[++i]);
+        else if(arg == "--cycle" && hasValue)
+            gaitParams.cycleDuration = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            gaitParams.seed = atoi(argv[++i]);
+        else if(arg == "--bodyweight" && hasValue)
+            bodyweight = atof(argv[++i]);
+        else if(arg == "--reference" && hasValue)
+            referenceThreshold = atof(argv[++i]);
+        else if(arg == "--threads" && hasValue)
+            nThreads = atoi(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // Load or generate the trace, and convert it to foot loads once.
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+
+    GaitTrace trace;
+    if(!tracePath.empty())
+    {
+        if(!loadGaitTrace(tracePath, trace))
+            return 1;
+    }
+    else
+    {
+        gaitParams.bodyweight = bodyweight;
+        trace = makeSyntheticGait(gaitParams, calibration);
+    }
+
+    FootLoadTrace loads = computeFootLoads(trace, calibration, referenceThreshold);
+
+    // List all the combinations of the swept values.
+    GaitRunConfig defaults;
+    defaults.params = GaitTorqueGenerator::getDefaultParams();
+    defaults.assistance = 50.0f;
+    defaults.bodyweight = bodyweight;
+
+    vector<GaitRunConfig> configs(1, defaults);
+    for(const Sweep &sweep : sweeps)
+    {
+        vector<GaitRunConfig> expanded;
+        for(const GaitRunConfig &c : configs)
+        {
+            for(float v : sweep.values)
+            {
+                expanded.push_back(c);
+                PARAMETERS[sweep.parameter].get(expanded.back()) = v;
+            }
+        }
+        configs.swap(expanded);
+    }
+
+    // Run them in parallel.
+    vector<GaitMetrics> metrics(configs.size());
+    atomic<size_t> nextConfig(0);
+
+    auto startTime = steady_clock::now();
+
+    auto worker = [&]()
+    {
+        size_t i;
+        while((i = nextConfig.fetch_add(1)) < configs.size())
+            metrics[i] = runGait(loads, BETA_PROFILE, configs[i]);
+    };
+
+    vector<thread> threads;
+    for(int t=1; t<max(1, nThreads); t++)
+        threads.push_back(thread(worker));
+    worker();
+    for(thread &t : threads)
+        t.join();
+
+    double elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    // Report, one line per configuration.
+    ofstream outFile;
+    if(!outPath.empty())
+    {
+        outFile.open(outPath);
+        if(!outFile.is_open())
+        {
+            cerr << "Could not create " << outPath << "." << endl;
+            return 1;
+        }
+    }
+
+    ostringstream header;
+    for(const Sweep &sweep : sweeps)
+        header << PARAMETERS[sweep.parameter].name << "\t";
+    header << "ready_time[s]\tphase_rms[%]\tphase_max[%]\theel_strikes\t"
+           << "torque_rms[Nm]\trate_rms[Nm/s]\tstep_max[Nm]";
+    cout << header.str() << endl;
+    if(outFile.is_open())
+    {
+        string csvHeader = header.str();
+        for(char &c : csvHeader)
+        {
+            if(c == '\t')
+                c = ',';
+        }
+        outFile << csvHeader << "\n";
+    }
+
+    for(size_t i=0; i<configs.size(); i++)
+    {
+        const GaitMetrics &m = metrics[i];
+
+        ostringstream line;
+        line << setprecision(4);
+        for(const Sweep &sweep : sweeps)
+            line << PARAMETERS[sweep.parameter].get(configs[i]) << "\t";
+        line << m.readyTime << "\t" << m.phaseErrorRms << "\t" << m.phaseErrorMax
+             << "\t" << m.nDetectedHeelStrikes << "/" << m.nReferenceHeelStrikes
+             << "\t" << m.torqueRms << "\t" << m.torqueRateRms << "\t"
+             << m.torqueStepMax;
+        cout << line.str() << endl;
+
+        if(outFile.is_open())
+        {
+            string csvLine = line.str();
+            for(char &c : csvLine)
+            {
+                if(c == '\t')
+                    c = ',';
+            }
+            outFile << csvLine << "\n";
+        }
+    }
+
+    cout << configs.size() << " configurations of " << trace.frames.size()
+         << " steps in " << elapsed << " s (" << nThreads << " threads, "
+         << configs.size() * trace.frames.size() / elapsed / 1e6
+         << " M steps/s)." << endl;
+
+    return 0;
+}
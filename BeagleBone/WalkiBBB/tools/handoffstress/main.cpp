@@ -0,0 +1,417 @@
+/**
+ * Stress test of the exchanges between the threads of the eWalk controller:
+ * the TripleBuffer of the motors state (CAN thread to control loop), the
+ * TripleBuffer of the torque commands (control loop to CAN thread), and the
+ * SpscRing of the foot sensors acquisitions (acquisition thread to control
+ * loop), with the same value types as eWalkTimeBasedTorqueProfile.
+ *
+ * The threads run without any pause, as fast as the host allows, against a
+ * mock motor whose every published value is derived from its update count.
+ * Each side checks every snapshot it gets: all its fields must come from the
+ * same update (no torn read), and the updates must never go backwards. The
+ * threads also yield the CPU at random times, so that the hand-offs happen at
+ * all the points of the exchanges, even on a single core.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+
+using namespace std;
+using namespace chrono;
+
+const int64_t VALUE_MASK = 0xFFFFF; // Keeps the values exact in a float.
+
+/**
+ * @brief Gets a value of a snapshot, from its sequence number.
+ * @param sequence sequence number of the snapshot.
+ * @param field index of the field.
+ * @return the value, different for each field and each of 2^20 consecutive
+ * sequence numbers.
+ */
+static float makeValue(int64_t sequence, int field)
+{
+    return (float)((sequence + 7919 * field) & VALUE_MASK) + 0.25f * (field & 3);
+}
+
+/**
+ * @brief Mock hip motors: each update changes all their measurements, to
+ * values derived from the update count.
+ */
+class MockMotors
+{
+public:
+    MockMotors() : nUpdates(0)
+    {
+        for(float &setpoint : setpoints)
+            setpoint = 0.0f;
+    }
+
+    /**
+     * @brief Updates the measurements, as a CAN exchange would.
+     * @param state output state of both motors, timestamped with the update
+     * count.
+     */
+    void update(HipMotorsState &state)
+    {
+        nUpdates++;
+        for(int j=0; j<N_GAIT_LEGS; j++)
+        {
+            state.angles[j] = makeValue(nUpdates, 3*j);
+            state.speeds[j] = makeValue(nUpdates, 3*j + 1);
+            state.torques[j] = makeValue(nUpdates, 3*j + 2);
+        }
+        state.timestamp = nUpdates;
+    }
+
+    float setpoints[N_GAIT_LEGS];
+
+private:
+    int64_t nUpdates;
+};
+
+/**
+ * @brief Checks that a motors state comes from a single update.
+ * @param state the state.
+ * @return true if consistent, false if torn.
+ */
+static bool isConsistent(const HipMotorsState &state)
+{
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(state.angles[j] != makeValue(state.timestamp, 3*j) ||
+           state.speeds[j] != makeValue(state.timestamp, 3*j + 1) ||
+           state.torques[j] != makeValue(state.timestamp, 3*j + 2))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that a torque command comes from a single write.
+ * @param command the command.
+ * @return true if consistent, false if torn.
+ */
+static bool isConsistent(const HipMotorsCommand &command)
+{
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        if(command.torques[j] != makeValue(command.timestamp, j))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fills a foot sensors frame from a sequence number.
+ * @param sequence the sequence number.
+ * @param frame output frame.
+ */
+static void makeFrame(int64_t sequence, FootSensorsFrame &frame)
+{
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        for(int i=0; i<8; i++)
+        {
+            frame.soleVoltages[j][i] = makeValue(sequence, 20*j + i);
+            frame.cellLoads[j][i] = makeValue(sequence, 20*j + 8 + i);
+        }
+        frame.footLoads[j] = makeValue(sequence, 20*j + 16);
+        for(int k=0; k<3; k++)
+        {
+            frame.footImus[j].accel[k] = (int16_t)(sequence + k);
+            frame.footImus[j].gyro[k] = (int16_t)(sequence - k);
+        }
+        frame.footImus[j].temperature = (int16_t)(sequence + j);
+    }
+    frame.timestamp = sequence;
+}
+
+/**
+ * @brief Checks that a foot sensors frame comes from a single push.
+ * @param frame the frame.
+ * @return true if consistent, false if torn.
+ */
+static bool isConsistent(const FootSensorsFrame &frame)
+{
+    FootSensorsFrame expected;
+    makeFrame(frame.timestamp, expected);
+
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        for(int i=0; i<8; i++)
+        {
+            if(frame.soleVoltages[j][i] != expected.soleVoltages[j][i] ||
+               frame.cellLoads[j][i] != expected.cellLoads[j][i])
+            {
+                return false;
+            }
+        }
+        if(frame.footLoads[j] != expected.footLoads[j] ||
+           frame.footImus[j].temperature != expected.footImus[j].temperature)
+        {
+            return false;
+        }
+        for(int k=0; k<3; k++)
+        {
+            if(frame.footImus[j].accel[k] != expected.footImus[j].accel[k] ||
+               frame.footImus[j].gyro[k] != expected.footImus[j].gyro[k])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Yields the CPU to the other threads, every interval calls on average.
+ */
+class RandomYield
+{
+public:
+    /**
+     * @brief Constructor.
+     * @param interval mean number of calls between two yields, 0 for never.
+     * @param seed random seed, different for each thread.
+     */
+    RandomYield(int interval, unsigned int seed) :
+        generator(seed),
+        distribution(0, max(2 * interval - 1, 0)),
+        countdown(0),
+        interval(interval)
+    {
+    }
+
+    /**
+     * @brief Called at each iteration of a thread.
+     */
+    void tick()
+    {
+        if(interval <= 0 || --countdown > 0)
+            return;
+
+        this_thread::yield();
+        countdown = distribution(generator) + 1;
+    }
+
+private:
+    minstd_rand generator;
+    uniform_int_distribution<int> distribution;
+    int countdown;
+    int interval;
+};
+
+/**
+ * @brief Counts of the checks of one exchange, by its reader.
+ */
+struct ExchangeStats
+{
+    int64_t nWrites = 0;    ///< Values published by the writer.
+    int64_t nReads = 0;     ///< Snapshots read.
+    int64_t nNew = 0;       ///< Snapshots read that were new.
+    int64_t nTorn = 0;      ///< Snapshots mixing several writes.
+    int64_t nBackwards = 0; ///< Snapshots older than the previous one.
+    int64_t nDropped = 0;   ///< Values dropped because the ring was full.
+};
+
+static void printUsage()
+{
+    cout << "Usage: handoffstress [options]" << endl
+         << "  --duration <s>    duration of the test (default: 5)" << endl
+         << "  --yield <n>       mean iterations of each thread between two yields, 0 for never (default: 8)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    float testDuration = 5.0f;
+    int yieldInterval = 8;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--duration" && hasValue)
+            testDuration = atof(argv[++i]);
+        else if(arg == "--yield" && hasValue)
+            yieldInterval = max(atoi(argv[++i]), 0);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    TripleBuffer<HipMotorsState> motorsState;
+    TripleBuffer<HipMotorsCommand> motorsCommand;
+    SpscRing<FootSensorsFrame, FOOT_SENSORS_RING_SIZE> footSensorsRing;
+    atomic<bool> stop(false);
+
+    // Consistent initial values, as update 0 and command 0.
+    HipMotorsState initialState;
+    initialState.timestamp = 0;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+    {
+        initialState.angles[j] = makeValue(0, 3*j);
+        initialState.speeds[j] = makeValue(0, 3*j + 1);
+        initialState.torques[j] = makeValue(0, 3*j + 2);
+    }
+    motorsState.write(initialState);
+    HipMotorsCommand initialCommand;
+    for(int j=0; j<N_GAIT_LEGS; j++)
+        initialCommand.torques[j] = makeValue(0, j);
+    initialCommand.timestamp = 0;
+    motorsCommand.write(initialCommand);
+
+    ExchangeStats stateStats, commandStats, sensorsStats;
+
+    // CAN thread: writes the motors state, reads the commands.
+    thread canThread([&]()
+    {
+        MockMotors motors;
+        HipMotorsState state;
+        HipMotorsCommand command;
+        int64_t lastCommand = -1;
+        RandomYield yield(yieldInterval, 1);
+
+        while(!stop.load(memory_order_relaxed))
+        {
+            yield.tick();
+            bool isNew = motorsCommand.read(command);
+            commandStats.nReads++;
+            commandStats.nNew += isNew ? 1 : 0;
+            if(!isConsistent(command))
+                commandStats.nTorn++;
+            if(command.timestamp < lastCommand)
+                commandStats.nBackwards++;
+            lastCommand = command.timestamp;
+            for(int j=0; j<N_GAIT_LEGS; j++)
+                motors.setpoints[j] = command.torques[j];
+
+            motors.update(state);
+            motorsState.write(state);
+            stateStats.nWrites++;
+        }
+    });
+
+    // Acquisition thread: pushes the foot sensors.
+    thread sensorsThread([&]()
+    {
+        FootSensorsFrame frame;
+        int64_t sequence = 0;
+        RandomYield yield(yieldInterval, 2);
+
+        while(!stop.load(memory_order_relaxed))
+        {
+            yield.tick();
+            sequence++;
+            makeFrame(sequence, frame);
+            footSensorsRing.push(frame);
+            sensorsStats.nWrites++;
+        }
+    });
+
+    // Control loop, on the main thread: reads the motors state and the foot
+    // sensors, writes the commands.
+    auto startTime = steady_clock::now();
+    auto endTime = startTime + duration<double>(testDuration);
+    HipMotorsState state;
+    FootSensorsFrame frame;
+    HipMotorsCommand command;
+    int64_t lastState = -1, lastFrame = 0, sequence = 0;
+    RandomYield yield(yieldInterval, 3);
+
+    while(steady_clock::now() < endTime)
+    {
+        for(int n=0; n<100; n++)
+        {
+            yield.tick();
+            bool isNew = motorsState.read(state);
+            stateStats.nReads++;
+            stateStats.nNew += isNew ? 1 : 0;
+            if(!isConsistent(state))
+                stateStats.nTorn++;
+            if(state.timestamp < lastState)
+                stateStats.nBackwards++;
+            lastState = state.timestamp;
+
+            while(footSensorsRing.pop(frame))
+            {
+                sensorsStats.nReads++;
+                sensorsStats.nNew++;
+                if(!isConsistent(frame))
+                    sensorsStats.nTorn++;
+                if(frame.timestamp <= lastFrame)
+                    sensorsStats.nBackwards++;
+                lastFrame = frame.timestamp;
+            }
+
+            sequence++;
+            for(int j=0; j<N_GAIT_LEGS; j++)
+                command.torques[j] = makeValue(sequence, j);
+            command.timestamp = sequence;
+            motorsCommand.write(command);
+            commandStats.nWrites++;
+        }
+    }
+
+    stop = true;
+    canThread.join();
+    sensorsThread.join();
+
+    // The frames still in the ring.
+    while(footSensorsRing.pop(frame))
+    {
+        sensorsStats.nReads++;
+        sensorsStats.nNew++;
+        if(!isConsistent(frame))
+            sensorsStats.nTorn++;
+        if(frame.timestamp <= lastFrame)
+            sensorsStats.nBackwards++;
+        lastFrame = frame.timestamp;
+    }
+    sensorsStats.nDropped = (int64_t)footSensorsRing.getDroppedCount();
+
+    double elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    cout << "exchange\twrites\treads\tnew\ttorn\tbackwards\tdropped" << endl;
+    const char *const names[] = {"motors_state", "motors_command", "foot_sensors"};
+    const ExchangeStats *stats[] = {&stateStats, &commandStats, &sensorsStats};
+    bool passed = true;
+    for(int i=0; i<3; i++)
+    {
+        const ExchangeStats &s = *stats[i];
+        cout << names[i] << "\t" << s.nWrites << "\t" << s.nReads << "\t" << s.nNew << "\t"
+             << s.nTorn << "\t" << s.nBackwards << "\t" << s.nDropped << endl;
+        if(s.nTorn > 0 || s.nBackwards > 0 || s.nNew == 0)
+            passed = false;
+    }
+
+    // Every frame pushed was either popped or dropped, once.
+    if(sensorsStats.nReads + sensorsStats.nDropped != sensorsStats.nWrites)
+    {
+        cout << "Frames lost: " << sensorsStats.nWrites << " pushed, " << sensorsStats.nReads
+             << " popped, " << sensorsStats.nDropped << " dropped." << endl;
+        passed = false;
+    }
+
+    cout << elapsed << " s, " << thread::hardware_concurrency() << " cores." << endl;
+    if(!passed)
+    {
+        cout << "FAILED." << endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * Measures how precisely the heel-strikes are dated, and the resulting phase
+ * error of the torque profiles, depending on how the soles are sampled: once
+ * per time step as before, or several times per step, with the threshold
+ * crossings interpolated by the HeelStrikeTimer of the controller.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/gaitmetrics.h"
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+
+using namespace std;
+
+/**
+ * @brief Way of sampling the soles during each time step.
+ */
+struct SamplingMode
+{
+    const char *name;
+    int nSamples;       ///< Acquisitions per time step, 0 for all the samples of the trace.
+    bool spread;        ///< Evenly spread over the step, instead of back-to-back at its end.
+    bool interpolate;   ///< Date the heel-strikes with the HeelStrikeTimer.
+};
+
+const SamplingMode MODES[] =
+{
+    {"step", 1, false, false},
+    {"interpolated", 1, false, true},
+    {"burst", 2, false, true},
+    {"burst", 4, false, true},
+    {"spread", 2, true, true},
+    {"spread", 4, true, true},
+    {"spread", 0, true, true}
+};
+
+/**
+ * @brief Accuracy of the heel-strike times over a trace.
+ */
+struct TimingError
+{
+    float mean, rms, max; ///< [us]
+    int n;
+};
+
+static void printUsage()
+{
+    cout << "Usage: heelstrikebench [options]" << endl
+         << "  --rate <Hz>           sampling rate of the soles (default: 8000)" << endl
+         << "  --duration <s>        duration of the synthetic gait (default: 120)" << endl
+         << "  --cycle <s>           GC duration of the synthetic gait (default: 1.1)" << endl
+         << "  --variability <SD>    relative SD of the GC durations (default: 0.02)" << endl
+         << "  --seed <n>            random seed of the synthetic gait (default: 0)" << endl
+         << "  --bodyweight <kg>     pilot bodyweight (default: 60)" << endl
+         << "  --threshold <N>       stance foot load threshold (default: 0.5)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    SyntheticGaitParams gaitParams = getDefaultSyntheticGaitParams();
+    gaitParams.duration = 120.0f;
+    float rate = 8000.0f;
+    float bodyweight = 60.0f;
+    float threshold = GaitTorqueGenerator::getDefaultParams().stanceFootLoadThreshold;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--rate" && hasValue)
+            rate = atof(argv[++i]);
+        else if(arg == "--duration" && hasValue)
+            gaitParams.duration = atof(argv[++i]);
+        else if(arg == "--cycle" && hasValue)
+            gaitParams.cycleDuration = atof(argv[++i]);
+        else if(arg == "--variability" && hasValue)
+            gaitParams.cycleVariability = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            gaitParams.seed = atoi(argv[++i]);
+        else if(arg == "--bodyweight" && hasValue)
+            bodyweight = atof(argv[++i]);
+        else if(arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // The trace is generated at the sampling rate of the soles, and decimated
+    // to the time steps of the controller.
+    const int samplesPerStep = (int)lroundf(rate * MAIN_LOOP_PERIOD);
+    if(samplesPerStep < 4 || fabsf(samplesPerStep / rate - MAIN_LOOP_PERIOD) > 1e-6f)
+    {
+        cerr << "The sampling rate must be a multiple of " << 1.0f / MAIN_LOOP_PERIOD
+             << " Hz, at least 4 times the control rate." << endl;
+        return 1;
+    }
+    const double samplePeriod = 1.0 / rate; // [s]
+
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+
+    gaitParams.dt = (float)samplePeriod;
+    gaitParams.bodyweight = bodyweight;
+    GaitTrace trace = makeSyntheticGait(gaitParams, calibration);
+    FootLoadTrace samples = computeFootLoads(trace, calibration, threshold);
+    trace.frames.clear();
+
+    const size_t nSteps = samples.loads[GAIT_LEFT].size() / samplesPerStep;
+
+    // Exact time of the heel-strikes of reference, interpolated between the
+    // samples of the trace, and the step during which they happen. Those of
+    // the first step have no previous sample to be interpolated from.
+    vector<double> strikeTimes[N_GAIT_LEGS];
+    vector<size_t> strikeSteps[N_GAIT_LEGS];
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        const vector<float> &loads = samples.loads[leg];
+        for(size_t i : samples.heelStrikes[leg])
+        {
+            if(i < (size_t)samplesPerStep || i / samplesPerStep >= nSteps)
+                continue;
+
+            double fraction = (threshold - loads[i-1]) / (loads[i] - loads[i-1]);
+            strikeTimes[leg].push_back((i - 1 + fraction) * samplePeriod);
+            strikeSteps[leg].push_back(i / samplesPerStep);
+        }
+    }
+
+    // The controller samples the soles at the end of each step.
+    auto stepTime = [&](size_t s) { return ((s + 1) * samplesPerStep - 1) * samplePeriod; };
+
+    GaitRunConfig config;
+    config.params = GaitTorqueGenerator::getDefaultParams();
+    config.params.stanceFootLoadThreshold = threshold;
+    config.assistance = 50.0f;
+    config.bodyweight = bodyweight;
+
+    cout << "mode\tsamples/step\terror_mean[us]\terror_rms[us]\terror_max[us]\t"
+         << "phase_rms[%]\tphase_max[%]\theel_strikes" << endl;
+
+    for(const SamplingMode &mode : MODES)
+    {
+        int nSamples = (mode.nSamples > 0) ? mode.nSamples : samplesPerStep;
+
+        FootLoadTrace steps;
+        steps.dt = MAIN_LOOP_PERIOD;
+
+        HeelStrikeTimer timer;
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            steps.loads[leg].resize(nSteps);
+            if(mode.interpolate)
+                steps.crossingAges[leg].resize(nSteps);
+        }
+
+        for(size_t s=0; s<nSteps; s++)
+        {
+            timer.beginStep();
+            for(int k=0; k<nSamples; k++)
+            {
+                size_t i = mode.spread ?
+                           s * samplesPerStep + (k + 1) * samplesPerStep / nSamples - 1 :
+                           (s + 1) * samplesPerStep - nSamples + k;
+                float loads[N_GAIT_LEGS];
+                for(int leg=0; leg<N_GAIT_LEGS; leg++)
+                    loads[leg] = samples.loads[leg][i];
+                timer.addSample(llround(i * samplePeriod * 1e6), loads, threshold);
+            }
+
+            size_t last = (s + 1) * samplesPerStep - 1;
+            for(int leg=0; leg<N_GAIT_LEGS; leg++)
+            {
+                steps.loads[leg][s] = samples.loads[leg][last];
+                if(mode.interpolate)
+                    steps.crossingAges[leg][s] = timer.getCrossingAge((GaitLeg)leg);
+            }
+        }
+
+        // Error of the heel-strike times given to the torque generator.
+        TimingError error = { 0.0f, 0.0f, 0.0f, 0 };
+        double errorSum = 0.0, errorSum2 = 0.0;
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            for(size_t h=0; h<strikeTimes[leg].size(); h++)
+            {
+                size_t s = strikeSteps[leg][h];
+                double delay = stepTime(s) - strikeTimes[leg][h];
+
+                steps.heelStrikes[leg].push_back(s);
+                steps.heelStrikeDelays[leg].push_back((float)delay);
+
+                double age = mode.interpolate ? steps.crossingAges[leg][s] : 0.0;
+                double e = (delay - age) * 1e6;
+                errorSum += e;
+                errorSum2 += e * e;
+                error.max = max(error.max, (float)fabs(e));
+                error.n++;
+            }
+        }
+        if(error.n > 0)
+        {
+            error.mean = (float)(errorSum / error.n);
+            error.rms = (float)sqrt(errorSum2 / error.n);
+        }
+
+        GaitMetrics m = runGait(steps, BETA_PROFILE, config);
+
+        cout << setprecision(4) << mode.name << "\t" << nSamples << "\t"
+             << error.mean << "\t" << error.rms << "\t" << error.max << "\t"
+             << m.phaseErrorRms << "\t" << m.phaseErrorMax << "\t"
+             << m.nDetectedHeelStrikes << "/" << m.nReferenceHeelStrikes << endl;
+    }
+
+    return 0;
+}
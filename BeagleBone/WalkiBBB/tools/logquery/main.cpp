@@ -0,0 +1,316 @@
+/**
+ * Indexes a directory of sessions (the session logs of the WalkiBBB program
+ * and the telemetry recorded by the controller) once, then finds the time
+ * windows where SyncVars had given values, e.g. "percent_assist=60" and
+ * "enable_controller=1", and extracts telemetry channels over these windows.
+ * The index is saved in the directory, and updated with the new or modified
+ * files only, so the queries do not read the logs again.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../common/sessionindex.h"
+#include "../common/telemetryreader.h"
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Parses a condition, e.g. "percent_assist=60" or "bodyweight>=70".
+ * @param text the condition.
+ * @param index the index, to find the SyncVar.
+ * @param condition the parsed condition.
+ * @return true if the condition is valid and the SyncVar is known, false
+ * otherwise.
+ */
+static bool parseCondition(const string &text, const SessionIndex &index,
+                           SessionCondition &condition)
+{
+    size_t opStart = text.find_first_of("!<>=");
+    if(opStart == string::npos || opStart == 0)
+    {
+        cerr << "Invalid condition: " << text << "." << endl;
+        return false;
+    }
+    size_t opEnd = text.find_first_not_of("!<>=", opStart);
+
+    string name = text.substr(0, opStart);
+    condition.op = text.substr(opStart, opEnd - opStart);
+    string value = (opEnd == string::npos) ? "" : text.substr(opEnd);
+
+    char *end;
+    condition.value = strtof(value.c_str(), &end);
+    if(value.empty() || *end != '\0' ||
+       (condition.op != "=" && condition.op != "!=" && condition.op != "<" &&
+        condition.op != "<=" && condition.op != ">" && condition.op != ">="))
+    {
+        cerr << "Invalid condition: " << text << "." << endl;
+        return false;
+    }
+
+    condition.var = index.findVar(name);
+    if(condition.var < 0)
+    {
+        cerr << "Unknown or ambiguous SyncVar: " << name << "." << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes the values of telemetry channels over the windows, reading
+ * only the segments that overlap them.
+ * @param index the index.
+ * @param windows the windows.
+ * @param channels names of the channels.
+ * @param out the output.
+ * @return the number of samples written.
+ */
+static size_t extractChannels(const SessionIndex &index, const vector<SessionWindow> &windows,
+                              const vector<string> &channels, ostream &out)
+{
+    out << "window\ttime\twall_time";
+    for(const string &channel : channels)
+        out << "\t" << channel;
+    out << endl << fixed;
+
+    unique_ptr<TelemetryReader> reader;
+    size_t loadedSegment = SIZE_MAX;
+    size_t nSamples = 0;
+
+    for(size_t w=0; w<windows.size(); w++)
+    {
+        const SessionWindow &window = windows[w];
+        for(size_t s : index.findSegments(window.start, window.end))
+        {
+            if(s != loadedSegment)
+            {
+                reader.reset(new TelemetryReader());
+                loadedSegment = s;
+                if(!reader->appendSegment(index.getDirectory() + "/" +
+                                          index.getSegments()[s].path))
+                    continue;
+            }
+
+            const vector<TelemetryChannel> &segmentChannels = reader->getChannels();
+            vector<size_t> columns;
+            for(const string &channel : channels)
+            {
+                for(size_t c=0; c<segmentChannels.size(); c++)
+                {
+                    if(segmentChannels[c].name == channel)
+                        columns.push_back(c);
+                }
+            }
+            if(columns.size() != channels.size())
+            {
+                cerr << index.getSegments()[s].path << ": missing channels." << endl;
+                continue;
+            }
+
+            auto wallTime = [&](size_t record)
+            {
+                return reader->getStartWallTime() + llround(reader->getTime(record) * 1e6);
+            };
+
+            // First record of the window, by bisection.
+            size_t first = 0, last = reader->getRecordsCount();
+            while(first < last)
+            {
+                size_t middle = (first + last) / 2;
+                if(wallTime(middle) < window.start)
+                    first = middle + 1;
+                else
+                    last = middle;
+            }
+
+            for(size_t r=first; r<reader->getRecordsCount(); r++)
+            {
+                int64_t t = wallTime(r);
+                if(t >= window.end)
+                    break;
+
+                out << (w + 1) << "\t" << setprecision(4) << (t - window.start) / 1e6
+                    << "\t" << setprecision(6) << t / 1e6;
+                for(size_t c : columns)
+                    out << "\t" << setprecision(6) << reader->getValue(r, c);
+                out << "\n";
+                nSamples++;
+            }
+        }
+    }
+
+    return nSamples;
+}
+
+static void printUsage()
+{
+    cout << "Usage: logquery [options] <directory>" << endl
+         << "  --rebuild               read all the files again, ignoring the saved index" << endl
+         << "  --where <var><op><x>    condition on a SyncVar, <op> among = != < <= > >=," << endl
+         << "                          e.g. percent_assist=60 (repeatable, all must hold)" << endl
+         << "  --extract <channel>     print this telemetry channel over the windows (repeatable)" << endl
+         << "  --out <file>            write the extracted channels to this file" << endl
+         << "  --events                print the SyncVar values and changes of all the sessions" << endl
+         << "  --sessions              list the sessions and the telemetry segments" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    bool rebuild = false, printEvents = false, printSessions = false;
+    vector<string> whereTexts, channels;
+    string directory, outPath;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--rebuild")
+            rebuild = true;
+        else if(arg == "--events")
+            printEvents = true;
+        else if(arg == "--sessions")
+            printSessions = true;
+        else if(arg == "--where" && hasValue)
+            whereTexts.push_back(argv[++i]);
+        else if(arg == "--extract" && hasValue)
+            channels.push_back(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if(arg.size() > 0 && arg[0] != '-' && directory.empty())
+            directory = arg;
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    if(directory.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Index the directory, reading only the new and modified files.
+    auto startTime = steady_clock::now();
+    SessionIndex index;
+    if(!index.build(directory, rebuild))
+    {
+        cerr << "Could not read the directory " << directory << "." << endl;
+        return 1;
+    }
+    double buildTime = duration<double, milli>(steady_clock::now() - startTime).count();
+
+    cout << "Indexed " << index.getSessions().size() << " sessions and "
+         << index.getSegments().size() << " telemetry segments, "
+         << index.getScannedFilesCount() << " files read, in " << fixed << setprecision(1)
+         << buildTime << " ms." << endl;
+
+    const vector<LogSession> &sessions = index.getSessions();
+    const vector<string> &varNames = index.getVarNames();
+
+    if(printSessions)
+    {
+        cout << "session\tstart\tend\tduration\tevents" << endl;
+        for(const LogSession &session : sessions)
+        {
+            cout << session.path << "\t" << SessionIndex::formatTime(session.startTime)
+                 << "\t" << SessionIndex::formatTime(session.endTime) << "\t"
+                 << setprecision(1) << (session.endTime - session.startTime) / 1e6 << "\t"
+                 << session.events.size() << endl;
+        }
+
+        cout << "segment\tstart\tend\trecords\tchannels" << endl;
+        for(const TelemetrySegmentInfo &segment : index.getSegments())
+        {
+            cout << segment.path << "\t" << SessionIndex::formatTime(segment.startTime)
+                 << "\t" << SessionIndex::formatTime(segment.endTime) << "\t"
+                 << segment.nRecords << "\t" << segment.channels.size() << endl;
+        }
+    }
+
+    if(printEvents)
+    {
+        cout << "session\ttime\tsyncvar\tvalue\tprevious" << endl;
+        for(const LogSession &session : sessions)
+        {
+            for(const SessionEvent &event : session.events)
+            {
+                if(event.type == SESSION_EVENT_MESSAGE)
+                    continue;
+
+                cout << session.path << "\t" << SessionIndex::formatTime(event.time) << "\t"
+                     << varNames[event.var] << "\t" << setprecision(6) << event.value
+                     << "\t" << event.previous << endl;
+            }
+        }
+    }
+
+    // Find the windows where all the conditions hold.
+    vector<SessionCondition> conditions;
+    for(const string &text : whereTexts)
+    {
+        SessionCondition condition;
+        if(!parseCondition(text, index, condition))
+            return 1;
+        conditions.push_back(condition);
+    }
+
+    startTime = steady_clock::now();
+    vector<SessionWindow> windows = index.findWindows(conditions);
+    double queryTime = duration<double, milli>(steady_clock::now() - startTime).count();
+
+    if(!conditions.empty() || channels.empty())
+    {
+        double totalDuration = 0.0;
+        cout << "window\tsession\tstart\tend\tduration [s]" << endl;
+        for(size_t w=0; w<windows.size(); w++)
+        {
+            const SessionWindow &window = windows[w];
+            double duration = (window.end - window.start) / 1e6;
+            totalDuration += duration;
+
+            cout << (w + 1) << "\t" << sessions[window.session].path << "\t"
+                 << SessionIndex::formatTime(window.start) << "\t"
+                 << SessionIndex::formatTime(window.end) << "\t"
+                 << setprecision(3) << duration << endl;
+        }
+        cout << windows.size() << " windows, " << setprecision(3) << totalDuration
+             << " s, found in " << queryTime << " ms." << endl;
+    }
+
+    // Extract the channels over the windows.
+    if(!channels.empty())
+    {
+        size_t nSamples;
+        if(outPath.empty())
+            nSamples = extractChannels(index, windows, channels, cout);
+        else
+        {
+            ofstream out(outPath);
+            if(!out.is_open())
+            {
+                cerr << "Could not write " << outPath << "." << endl;
+                return 1;
+            }
+            nSamples = extractChannels(index, windows, channels, out);
+        }
+
+        cout << nSamples << " samples extracted." << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,464 @@
+/**
+ * Micro-benchmarks the functions of the eWalk controller run at each time
+ * step, over the input sequences of a synthetic walk, and reports their
+ * computation time in ns/call, with its repeatability over several runs. The
+ * results can be saved as a baseline, and later runs compared to it to catch
+ * regressions.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+#include "../common/controllerharness.h"
+#include "../common/gaitmetrics.h"
+#include "../common/tabulatedprofile.h"
+
+using namespace std;
+using namespace chrono;
+
+#if defined(__aarch64__)
+const char *const ARCHITECTURE = "aarch64";
+#elif defined(__arm__)
+const char *const ARCHITECTURE = "arm";
+#elif defined(__x86_64__)
+const char *const ARCHITECTURE = "x86_64";
+#else
+const char *const ARCHITECTURE = "unknown";
+#endif
+
+/**
+ * @brief Computation time of a benchmarked function, over all the runs.
+ */
+struct BenchmarkResult
+{
+    string name;
+    double median;  ///< [ns/call].
+    double min;     ///< [ns/call].
+    double mean;    ///< [ns/call].
+    double cv;      ///< Standard deviation over the runs, relative to the mean [%].
+};
+
+/**
+ * @brief Times a function over a sequence of inputs, several times.
+ *
+ * Each run calls prepare(i) then run(i) for each input i, then prepare(i)
+ * alone, and the time per call is the difference. prepare() sets the inputs
+ * or the state that run() expects, e.g. the mocked ADC values, without being
+ * counted. The state is reset before each pass, and a first run warms up the
+ * caches and is ignored.
+ * @param name name of the benchmark.
+ * @param nCalls number of inputs.
+ * @param nRuns number of timed runs.
+ * @param reset resets the state before each pass.
+ * @param prepare prepares the input i.
+ * @param run calls the benchmarked function on the input i, and returns a
+ * value of its result, so that the call cannot be optimized out.
+ * @return the statistics of the runs.
+ */
+template<typename Reset, typename Prepare, typename Run>
+static BenchmarkResult runBenchmark(const string &name, size_t nCalls, int nRuns,
+                                    Reset reset, Prepare prepare, Run run)
+{
+    vector<double> times;
+    float checksum = 0.0f;
+
+    for(int r=0; r<=nRuns; r++)
+    {
+        reset();
+        auto startTime = steady_clock::now();
+        for(size_t i=0; i<nCalls; i++)
+        {
+            prepare(i);
+            checksum += run(i);
+        }
+        double total = duration<double, nano>(steady_clock::now() - startTime).count();
+
+        reset();
+        startTime = steady_clock::now();
+        for(size_t i=0; i<nCalls; i++)
+            prepare(i);
+        double overhead = duration<double, nano>(steady_clock::now() - startTime).count();
+
+        if(r > 0)
+            times.push_back(max(total - overhead, 0.0) / nCalls);
+    }
+
+    // Keeps the timed calls from being optimized out.
+    if(std::isnan(checksum))
+        cout << endl;
+
+    BenchmarkResult result;
+    result.name = name;
+
+    sort(times.begin(), times.end());
+    size_t n = times.size();
+    result.median = (n % 2 == 1) ? times[n/2] : 0.5 * (times[n/2 - 1] + times[n/2]);
+    result.min = times.front();
+
+    double sum = 0.0, sum2 = 0.0;
+    for(double t : times)
+        sum += t;
+    result.mean = sum / n;
+    for(double t : times)
+        sum2 += (t - result.mean) * (t - result.mean);
+    result.cv = (n > 1 && result.mean > 0.0) ?
+                100.0 * sqrt(sum2 / (n - 1)) / result.mean : 0.0;
+
+    return result;
+}
+
+/**
+ * @brief Reads the median times of a baseline saved with --out.
+ * @param path path of the CSV file.
+ * @param medians median time of each benchmark, by name [ns/call].
+ * @return true if the file could be read, false otherwise.
+ */
+static bool loadBaseline(const string &path, map<string, double> &medians)
+{
+    ifstream file(path);
+    if(!file.is_open())
+    {
+        cerr << "Could not open " << path << "." << endl;
+        return false;
+    }
+
+    string line;
+    getline(file, line); // Header.
+    while(getline(file, line))
+    {
+        stringstream ss(line);
+        string name, architecture, median;
+        if(getline(ss, name, ',') && getline(ss, architecture, ',') &&
+           getline(ss, median, ','))
+        {
+            if(architecture != ARCHITECTURE)
+            {
+                cerr << path << " was measured on " << architecture
+                     << ", not on " << ARCHITECTURE << "." << endl;
+            }
+            medians[name] = atof(median.c_str());
+        }
+    }
+
+    return true;
+}
+
+static void printUsage()
+{
+    cout << "Usage: microbench [options]" << endl
+         << "  --duration <s>       duration of the synthetic gait (default: 60)" << endl
+         << "  --runs <n>           timed runs of each benchmark (default: 15)" << endl
+         << "  --filter <text>      only run the benchmarks whose name contains it" << endl
+         << "  --cpu <n>            run on this CPU only, for steadier results" << endl
+         << "  --out <file.csv>     save the results, e.g. as a baseline" << endl
+         << "  --baseline <file>    compare the medians to a saved baseline" << endl
+         << "  --tolerance <%>      slowdown of the median reported as a regression (default: 10)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    SyntheticGaitParams gaitParams = getDefaultSyntheticGaitParams();
+    gaitParams.duration = 60.0f;
+    int nRuns = 15;
+    string filter, outPath, baselinePath;
+    int cpu = -1;
+    float tolerance = 10.0f;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--duration" && hasValue)
+            gaitParams.duration = atof(argv[++i]);
+        else if(arg == "--runs" && hasValue)
+            nRuns = max(atoi(argv[++i]), 1);
+        else if(arg == "--filter" && hasValue)
+            filter = argv[++i];
+        else if(arg == "--cpu" && hasValue)
+            cpu = atoi(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if(arg == "--baseline" && hasValue)
+            baselinePath = argv[++i];
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    if(cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if(sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            cerr << "Could not run on CPU " << cpu << "." << endl;
+    }
+
+    map<string, double> baseline;
+    if(!baselinePath.empty() && !loadBaseline(baselinePath, baseline))
+        return 1;
+
+    // Inputs: the sensors of a synthetic walk, with the same calibration of
+    // the soles as the controller.
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+    const GaitTrace trace = makeSyntheticGait(gaitParams, calibration);
+    const FootLoadTrace loads = computeFootLoads(trace, calibration, 0.5f);
+    const size_t nSteps = trace.frames.size();
+    const float dt = trace.dt;
+
+    vector<float> percentsGc(nSteps);
+    vector<VecNf<SOLE_N_CELLS>> voltages[N_GAIT_LEGS];
+    vector<float> footLoads(N_GAIT_LEGS * nSteps);
+    for(size_t s=0; s<nSteps; s++)
+    {
+        float cycles = trace.frames[s].time / gaitParams.cycleDuration;
+        percentsGc[s] = cycles - floorf(cycles);
+
+        VecNf<SOLE_N_CELLS> left, right;
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            left[i] = trace.frames[s].leftSoleVoltages[i];
+            right[i] = trace.frames[s].rightSoleVoltages[i];
+        }
+        voltages[GAIT_LEFT].push_back(left);
+        voltages[GAIT_RIGHT].push_back(right);
+
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+            footLoads[N_GAIT_LEGS*s + leg] = loads.loads[leg][s];
+    }
+
+    // Controller on the simulated hardware, enabled, as during a walk.
+    ControllerHarness harness;
+    harness.setBodyweight(gaitParams.bodyweight);
+    harness.setAssistance(50.0f);
+    harness.setEnabled(true);
+    eWalkTimeBasedTorqueProfile &controller = harness.getController();
+    SimHardware &hw = SimHardware::getInstance();
+    const int64_t dtUs = (int64_t)llroundf(dt * 1e6f);
+
+    // Torque generator configured as in the controller.
+    GaitTorqueGenerator gait;
+    gait.setProfile(BETA_PROFILE);
+    gait.setScale(PROFILE_TORQUE_MULTIPLIER * gaitParams.bodyweight);
+    const GaitJointsState &joints = gait.getJoints();
+
+    // Same, synchronized on the whole walk, to compute the torques at a steady
+    // cadence.
+    gait.reset();
+    for(size_t s=0; s<nSteps; s++)
+    {
+        gait.advanceTime(dt);
+        gait.updateGaitCycle(&footLoads[N_GAIT_LEGS*s]);
+    }
+    const GaitTorqueGenerator walkingGait = gait;
+
+    // Sum-of-sines profile of the controller, sampled in a table.
+    TorqueProfileTable harmonicTable;
+    harmonicTable.setHarmonics(BETA_PROFILE);
+    const float harmonicPeriod = harmonicTable.getPeriod();
+
+    // Tabulated profile with many unevenly spaced points, resampled with each
+    // interpolation.
+    const TabulatedProfile unevenProfile = makeUnevenProfile(BETA_PROFILE, 300, 1);
+    TorqueProfileTable unevenTables[2];
+    for(int i=0; i<2; i++)
+    {
+        unevenTables[i].setInterpolation((TableInterpolation)i);
+        unevenTables[i].setPoints(unevenProfile.phases.data(), unevenProfile.torques.data(),
+                                  (int)unevenProfile.phases.size(), 1.0f);
+    }
+
+    auto noReset = [](){};
+    auto noPrepare = [](size_t){};
+    auto resetGait = [&](){ gait.reset(); };
+    auto resetWalkingGait = [&](){ gait = walkingGait; };
+    auto advanceGait = [&](size_t){ gait.advanceTime(dt); };
+
+    vector<BenchmarkResult> results;
+    auto selected = [&](const string &name)
+    {
+        return filter.empty() || name.find(filter) != string::npos;
+    };
+
+    if(selected("getTorqueFromProfile"))
+    {
+        results.push_back(runBenchmark("getTorqueFromProfile", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s) { return controller.getTorqueFromProfile(percentsGc[s]); }));
+    }
+
+    if(selected("TorqueProfileTable::evaluateHarmonics"))
+    {
+        // Closed form with the libm sine, for both legs half a cycle apart, as
+        // the controller computed the torques before the tables.
+        results.push_back(runBenchmark("TorqueProfileTable::evaluateHarmonics", nSteps, nRuns,
+                                       noReset, noPrepare,
+            [&](size_t s)
+            {
+                float time = percentsGc[s] * harmonicPeriod;
+                return TorqueProfileTable::evaluateHarmonics(BETA_PROFILE, time) +
+                       TorqueProfileTable::evaluateHarmonics(BETA_PROFILE,
+                                                             time + 0.5f * harmonicPeriod);
+            }));
+    }
+
+    if(selected("TorqueProfileTable::harmonic"))
+    {
+        // Same, from the table.
+        results.push_back(runBenchmark("TorqueProfileTable::harmonic", nSteps, nRuns,
+                                       noReset, noPrepare,
+            [&](size_t s)
+            {
+                float time = percentsGc[s] * harmonicPeriod;
+                return harmonicTable.getTorque(time) +
+                       harmonicTable.getTorque(time + 0.5f * harmonicPeriod);
+            }));
+    }
+
+    if(selected("TorqueProfileTable::linear"))
+    {
+        results.push_back(runBenchmark("TorqueProfileTable::linear", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s) { return unevenTables[TABLE_LINEAR].getTorqueAtPhase(percentsGc[s]); }));
+    }
+
+    if(selected("TorqueProfileTable::cubic"))
+    {
+        results.push_back(runBenchmark("TorqueProfileTable::cubic", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s) { return unevenTables[TABLE_CUBIC_HERMITE].getTorqueAtPhase(percentsGc[s]); }));
+    }
+
+    if(selected("interpolateProfile"))
+    {
+        // Same points, searched at each call, for reference.
+        results.push_back(runBenchmark("interpolateProfile", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s) { return interpolateProfile(unevenProfile, percentsGc[s]); }));
+    }
+
+    if(selected("SoleCalibration::convert"))
+    {
+        VecNf<SOLE_N_CELLS> leftCells, rightCells;
+        results.push_back(runBenchmark("SoleCalibration::convert", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s)
+            {
+                float left, right;
+                calibration.convert(voltages[GAIT_LEFT][s], voltages[GAIT_RIGHT][s],
+                                    leftCells, rightCells, left, right);
+                return left + right;
+            }));
+    }
+
+    if(selected("updateFootLoads"))
+    {
+        // The ADC values are written to the simulated drivers, then acquired
+        // SOLES_BURST_SIZE times, converted and queued as on the exoskeleton.
+        results.push_back(runBenchmark("updateFootLoads", nSteps, nRuns, noReset,
+            [&](size_t s)
+            {
+                hw.timeUs += dtUs;
+                harness.setSensors(trace.frames[s]);
+            },
+            [&](size_t) { controller.updateFootLoads(dt); return 0.0f; }));
+    }
+
+    if(selected("GaitTorqueGenerator::updateGaitCycle"))
+    {
+        results.push_back(runBenchmark("GaitTorqueGenerator::updateGaitCycle", nSteps, nRuns,
+            resetGait, advanceGait,
+            [&](size_t s)
+            {
+                gait.updateGaitCycle(&footLoads[N_GAIT_LEGS*s]);
+                return joints.newPeriod[GAIT_LEFT];
+            }));
+    }
+
+    if(selected("GaitTorqueGenerator::computeTorques"))
+    {
+        results.push_back(runBenchmark("GaitTorqueGenerator::computeTorques", nSteps, nRuns,
+            resetWalkingGait, advanceGait,
+            [&](size_t) { gait.computeTorques(); return joints.torque[GAIT_LEFT]; }));
+    }
+
+    if(selected("GaitTorqueGenerator::computeTorquesDirect"))
+    {
+        results.push_back(runBenchmark("GaitTorqueGenerator::computeTorquesDirect", nSteps, nRuns,
+            resetWalkingGait, advanceGait,
+            [&](size_t) { gait.computeTorquesDirect(); return joints.torque[GAIT_LEFT]; }));
+    }
+
+    if(selected("update"))
+    {
+        // Whole time step, for reference.
+        results.push_back(runBenchmark("update", nSteps, nRuns, noReset, noPrepare,
+            [&](size_t s) { harness.step(dt, trace.frames[s]); return harness.getLeftTorque(); }));
+    }
+
+    // Report.
+    cout << "Architecture: " << ARCHITECTURE << ", " << nSteps << " calls x "
+         << nRuns << " runs per benchmark." << endl;
+    cout << "benchmark\tmedian[ns]\tmin[ns]\tmean[ns]\tcv[%]";
+    if(!baseline.empty())
+        cout << "\tbaseline[ns]\tchange[%]";
+    cout << endl;
+
+    int nRegressions = 0;
+    for(const BenchmarkResult &r : results)
+    {
+        cout << fixed << setprecision(1) << r.name << "\t" << r.median << "\t" << r.min
+             << "\t" << r.mean << "\t" << r.cv;
+
+        if(!baseline.empty())
+        {
+            auto it = baseline.find(r.name);
+            if(it == baseline.end() || it->second <= 0.0)
+                cout << "\t-\t-";
+            else
+            {
+                double change = 100.0 * (r.median / it->second - 1.0);
+                cout << "\t" << it->second << "\t" << showpos << change << noshowpos;
+                // Only if even the fastest run is slower than the baseline, so
+                // that the noise of a busy host is not reported.
+                if(change > tolerance && r.min > it->second)
+                {
+                    cout << "\tREGRESSION";
+                    nRegressions++;
+                }
+            }
+        }
+        cout << endl;
+    }
+
+    if(!outPath.empty())
+    {
+        ofstream outFile(outPath);
+        if(!outFile.is_open())
+        {
+            cerr << "Could not create " << outPath << "." << endl;
+            return 1;
+        }
+
+        outFile << "benchmark,architecture,median_ns,min_ns,mean_ns,cv_percent\n";
+        for(const BenchmarkResult &r : results)
+        {
+            outFile << r.name << "," << ARCHITECTURE << "," << r.median << "," << r.min
+                    << "," << r.mean << "," << r.cv << "\n";
+        }
+    }
+
+    return (nRegressions > 0) ? 2 : 0;
+}
@@ -0,0 +1,418 @@
+/**
+ * Compares the gait phase estimated by the heel-strike synchronization of the
+ * GaitTorqueGenerator with the continuous estimate of the AdaptiveOscillator,
+ * over a recorded or synthetic gait trace with a cadence change: phase lag and
+ * error at each time step, prediction of the next heel-strike, number of steps
+ * to converge after the change, and computation time.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/gaitmetrics.h"
+#include "../../controllers/ewalk/adaptiveoscillator.h"
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+
+using namespace std;
+using namespace chrono;
+
+const int CONVERGED_STEPS = 3; // Consecutive steps within the tolerance.
+const float WARMUP_DURATION = 10.0f; // Ignored after both estimators start [s].
+const int TIMING_REPETITIONS = 20;
+
+/**
+ * @brief Phase estimates of one estimator at each time step.
+ */
+struct PhaseEstimates
+{
+    const char *name;
+    vector<float> phases[N_GAIT_LEGS];      ///< [0-1[, negative if unknown.
+    vector<float> timesToStrike[N_GAIT_LEGS]; ///< Predicted time to the next heel-strike [s].
+    double timePerStep;                     ///< Computation time per time step [ns].
+};
+
+/**
+ * @brief Accuracy of one estimator.
+ */
+struct PhaseErrors
+{
+    float lag;              ///< Mean of estimated minus true phase [%GC].
+    float rms, max;         ///< [%GC]
+    float predictionRms;    ///< Error of the predicted heel-strike times [ms].
+    int convergenceSteps;   ///< Steps after the cadence change, -1 if never.
+};
+
+static void printUsage()
+{
+    cout << "Usage: phasebench [options]" << endl
+         << "  --trace <file.csv>    recorded trace (default: synthetic gait)" << endl
+         << "  --duration <s>        duration of the synthetic gait (default: 120)" << endl
+         << "  --cycle <s>           GC duration of the synthetic gait (default: 1.1)" << endl
+         << "  --variability <SD>    relative SD of the GC durations (default: 0.01)" << endl
+         << "  --seed <n>            random seed of the synthetic gait (default: 0)" << endl
+         << "  --change-time <s>     time of the cadence change, negative for none (default: 60)" << endl
+         << "  --change-cycle <s>    GC duration after the change (default: 0.9)" << endl
+         << "  --bodyweight <kg>     pilot bodyweight (default: 60)" << endl
+         << "  --threshold <N>       stance foot load threshold (default: 0.5)" << endl
+         << "  --tolerance <%GC>     phase error of a converged step (default: 3)" << endl
+         << "  --phase-gain <g>      AFO phase coupling (default: "
+         << AdaptiveOscillator::getDefaultParams().phaseGain << ")" << endl
+         << "  --frequency-gain <g>  AFO frequency coupling (default: "
+         << AdaptiveOscillator::getDefaultParams().frequencyGain << ")" << endl
+         << "  --amplitude-gain <g>  AFO amplitudes learning rate (default: "
+         << AdaptiveOscillator::getDefaultParams().amplitudeGain << ")" << endl
+         << "  --alignment <r>       AFO heel-strike alignment rate (default: "
+         << AdaptiveOscillator::getDefaultParams().alignmentRate << ")" << endl;
+}
+
+/**
+ * @brief Wraps a phase difference to [-0.5, 0.5[.
+ * @param phase the phase difference [GC].
+ * @return the wrapped difference [GC].
+ */
+static float wrapPhase(float phase)
+{
+    return phase - floorf(phase + 0.5f);
+}
+
+/**
+ * @brief Compares the estimates to the true phase.
+ * @param estimates the estimates of one estimator.
+ * @param truePhases true phase of each leg at each step, negative if unknown.
+ * @param trueTimesToStrike true time to the next heel-strike of each leg [s].
+ * @param cycleStarts reference heel-strike times of each leg [steps].
+ * @param firstStep first time step of the statistics.
+ * @param changeStep time step of the cadence change, negative for none.
+ * @param tolerance phase error of a converged step [%GC].
+ * @return the errors.
+ */
+static PhaseErrors evaluate(const PhaseEstimates &estimates,
+                            const vector<float> truePhases[N_GAIT_LEGS],
+                            const vector<float> trueTimesToStrike[N_GAIT_LEGS],
+                            const vector<double> cycleStarts[N_GAIT_LEGS],
+                            size_t firstStep, long changeStep, float tolerance)
+{
+    PhaseErrors e = { 0.0f, 0.0f, 0.0f, 0.0f, -1 };
+    double sum = 0.0, sum2 = 0.0, predictionSum2 = 0.0;
+    size_t n = 0;
+
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        for(size_t s=firstStep; s<truePhases[leg].size(); s++)
+        {
+            if(truePhases[leg][s] < 0.0f || estimates.phases[leg][s] < 0.0f)
+                continue;
+
+            float error = wrapPhase(estimates.phases[leg][s] - truePhases[leg][s]) * 100.0f;
+            sum += error;
+            sum2 += error * error;
+            e.max = max(e.max, fabsf(error));
+
+            float prediction = (estimates.timesToStrike[leg][s] - trueTimesToStrike[leg][s]) * 1e3f;
+            predictionSum2 += prediction * prediction;
+            n++;
+        }
+    }
+
+    if(n > 0)
+    {
+        e.lag = (float)(sum / n);
+        e.rms = (float)sqrt(sum2 / n);
+        e.predictionRms = (float)sqrt(predictionSum2 / n);
+    }
+
+    // Steps of each leg after the change until CONVERGED_STEPS in a row stay
+    // within the tolerance. The slowest leg counts.
+    if(changeStep < 0)
+        return e;
+
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        const vector<double> &starts = cycleStarts[leg];
+        int nSteps = 0, nConverged = 0, converged = -1;
+
+        for(size_t c=0; c+1<starts.size() && converged < 0; c++)
+        {
+            if(starts[c] < changeStep)
+                continue;
+
+            float stepMax = 0.0f;
+            bool known = true;
+            for(size_t s=(size_t)ceil(starts[c]); s<starts[c+1]; s++)
+            {
+                if(estimates.phases[leg][s] < 0.0f)
+                    known = false;
+                else
+                {
+                    float error = wrapPhase(estimates.phases[leg][s] - truePhases[leg][s]);
+                    stepMax = max(stepMax, fabsf(error) * 100.0f);
+                }
+            }
+
+            nSteps++;
+            nConverged = (known && stepMax < tolerance) ? nConverged + 1 : 0;
+            if(nConverged == CONVERGED_STEPS)
+                converged = nSteps - CONVERGED_STEPS;
+        }
+
+        if(converged < 0)
+        {
+            e.convergenceSteps = -1;
+            break;
+        }
+        e.convergenceSteps = max(e.convergenceSteps, converged);
+    }
+
+    return e;
+}
+
+int main(int argc, char *argv[])
+{
+    string tracePath;
+    SyntheticGaitParams gaitParams = getDefaultSyntheticGaitParams();
+    gaitParams.duration = 120.0f;
+    gaitParams.cycleVariability = 0.01f;
+    gaitParams.changeTime = 60.0f;
+    gaitParams.changedCycleDuration = 0.9f;
+    float bodyweight = 60.0f;
+    float threshold = GaitTorqueGenerator::getDefaultParams().stanceFootLoadThreshold;
+    float tolerance = 3.0f;
+    AdaptiveOscillatorParams afoParams = AdaptiveOscillator::getDefaultParams();
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if(arg == "--duration" && hasValue)
+            gaitParams.duration = atof(argv[++i]);
+        else if(arg == "--cycle" && hasValue)
+            gaitParams.cycleDuration = atof(argv[++i]);
+        else if(arg == "--variability" && hasValue)
+            gaitParams.cycleVariability = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            gaitParams.seed = atoi(argv[++i]);
+        else if(arg == "--change-time" && hasValue)
+            gaitParams.changeTime = atof(argv[++i]);
+        else if(arg == "--change-cycle" && hasValue)
+            gaitParams.changedCycleDuration = atof(argv[++i]);
+        else if(arg == "--bodyweight" && hasValue)
+            bodyweight = atof(argv[++i]);
+        else if(arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]);
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else if(arg == "--phase-gain" && hasValue)
+            afoParams.phaseGain = atof(argv[++i]);
+        else if(arg == "--frequency-gain" && hasValue)
+            afoParams.frequencyGain = atof(argv[++i]);
+        else if(arg == "--amplitude-gain" && hasValue)
+            afoParams.amplitudeGain = atof(argv[++i]);
+        else if(arg == "--alignment" && hasValue)
+            afoParams.alignmentRate = atof(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // Load or generate the trace, and convert it to foot loads once.
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    calibration.load(SOLES_CALIBRATION_FILE, false);
+
+    GaitTrace trace;
+    if(!tracePath.empty())
+    {
+        if(!loadGaitTrace(tracePath, trace))
+            return 1;
+    }
+    else
+    {
+        gaitParams.bodyweight = bodyweight;
+        trace = makeSyntheticGait(gaitParams, calibration);
+    }
+
+    FootLoadTrace loads = computeFootLoads(trace, calibration, threshold);
+    const size_t nSteps = trace.frames.size();
+    const float dt = trace.dt;
+    const long changeStep = (gaitParams.changeTime >= 0.0f) ?
+                            lroundf(gaitParams.changeTime / dt) : -1;
+
+    // True phase, linear between the heel-strikes of reference, interpolated
+    // between the time steps.
+    vector<double> cycleStarts[N_GAIT_LEGS];
+    vector<float> truePhases[N_GAIT_LEGS], trueTimesToStrike[N_GAIT_LEGS];
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        const vector<float> &l = loads.loads[leg];
+        for(size_t i : loads.heelStrikes[leg])
+        {
+            if(i > 0)
+                cycleStarts[leg].push_back(i - 1 + (threshold - l[i-1]) / (l[i] - l[i-1]));
+        }
+
+        truePhases[leg].assign(nSteps, -1.0f);
+        trueTimesToStrike[leg].assign(nSteps, 0.0f);
+        for(size_t c=0; c+1<cycleStarts[leg].size(); c++)
+        {
+            double start = cycleStarts[leg][c], end = cycleStarts[leg][c+1];
+            for(size_t s=(size_t)ceil(start); s<end; s++)
+            {
+                truePhases[leg][s] = (float)((s - start) / (end - start));
+                trueTimesToStrike[leg][s] = (float)((end - s) * dt);
+            }
+        }
+    }
+
+    // Run both estimators side by side, as the controller would.
+    GaitTorqueGenerator gait;
+    gait.setProfile(BETA_PROFILE);
+    gait.getParams().stanceFootLoadThreshold = threshold;
+    gait.reset();
+    gait.setScale(PROFILE_TORQUE_MULTIPLIER * bodyweight);
+
+    AdaptiveOscillator afo;
+    afo.getParams() = afoParams;
+    afo.reset(gait.getProfilePeriod());
+
+    PhaseEstimates generatorEstimates, afoEstimates;
+    generatorEstimates.name = "heel-strikes";
+    afoEstimates.name = "oscillator";
+    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+    {
+        generatorEstimates.phases[leg].assign(nSteps, -1.0f);
+        generatorEstimates.timesToStrike[leg].assign(nSteps, 0.0f);
+        afoEstimates.phases[leg].assign(nSteps, -1.0f);
+        afoEstimates.timesToStrike[leg].assign(nSteps, 0.0f);
+    }
+
+    const GaitJointsState &joints = gait.getJoints();
+    const AdaptiveOscillatorState &oscillators = afo.getJoints();
+    size_t firstStep = nSteps;
+
+    for(size_t s=0; s<nSteps; s++)
+    {
+        const SensorFrame &f = trace.frames[s];
+        float hipAngles[N_GAIT_LEGS], footLoads[N_GAIT_LEGS];
+        int nHeelStrikes[N_GAIT_LEGS];
+        hipAngles[GAIT_LEFT] = f.leftHipAngle;
+        hipAngles[GAIT_RIGHT] = f.rightHipAngle;
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            footLoads[leg] = loads.loads[leg][s];
+            nHeelStrikes[leg] = joints.nHeelStrikes[leg];
+        }
+
+        gait.advanceTime(dt);
+        gait.updateGaitCycle(footLoads);
+        gait.computeTorques();
+
+        afo.update(hipAngles, dt);
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            if(joints.nHeelStrikes[leg] != nHeelStrikes[leg])
+                afo.onHeelStrike(leg, 0.0f);
+        }
+
+        bool bothKnown = true;
+        for(int leg=0; leg<N_GAIT_LEGS; leg++)
+        {
+            if(gait.getReady() == 1 && joints.firstStep[leg] == 1)
+            {
+                float cycles = joints.time[leg] / joints.originalPeriod[leg];
+                float phase = cycles - floorf(cycles);
+                generatorEstimates.phases[leg][s] = phase;
+                generatorEstimates.timesToStrike[leg][s] = (1.0f - phase) * joints.newPeriod[leg];
+            }
+            else
+                bothKnown = false;
+
+            if(afo.isAligned(leg))
+            {
+                afoEstimates.phases[leg][s] = oscillators.gaitPhase[leg];
+                afoEstimates.timesToStrike[leg][s] = oscillators.timeToHeelStrike[leg];
+            }
+            else
+                bothKnown = false;
+        }
+
+        if(bothKnown && firstStep == nSteps)
+            firstStep = s + (size_t)lroundf(WARMUP_DURATION / dt);
+    }
+
+    // Computation time of each estimator alone, over the whole trace.
+    vector<float> anglesCopy(N_GAIT_LEGS * nSteps);
+    for(size_t s=0; s<nSteps; s++)
+    {
+        anglesCopy[N_GAIT_LEGS*s + GAIT_LEFT] = trace.frames[s].leftHipAngle;
+        anglesCopy[N_GAIT_LEGS*s + GAIT_RIGHT] = trace.frames[s].rightHipAngle;
+    }
+
+    auto startTime = steady_clock::now();
+    for(int r=0; r<TIMING_REPETITIONS; r++)
+    {
+        afo.reset(gait.getProfilePeriod());
+        for(size_t s=0; s<nSteps; s++)
+            afo.update(&anglesCopy[N_GAIT_LEGS*s], dt);
+    }
+    afoEstimates.timePerStep = duration<double, nano>(steady_clock::now() - startTime).count() /
+                               (TIMING_REPETITIONS * nSteps);
+
+    float checksum = 0.0f;
+    startTime = steady_clock::now();
+    for(int r=0; r<TIMING_REPETITIONS; r++)
+    {
+        gait.reset();
+        for(size_t s=0; s<nSteps; s++)
+        {
+            float footLoads[N_GAIT_LEGS] = { loads.loads[GAIT_LEFT][s], loads.loads[GAIT_RIGHT][s] };
+            gait.advanceTime(dt);
+            gait.updateGaitCycle(footLoads);
+            gait.computeTorques();
+            checksum += joints.time[GAIT_LEFT];
+        }
+    }
+    generatorEstimates.timePerStep = duration<double, nano>(steady_clock::now() - startTime).count() /
+                                     (TIMING_REPETITIONS * nSteps);
+    checksum += oscillators.gaitPhase[GAIT_LEFT];
+
+    // Report.
+    if(firstStep >= nSteps)
+    {
+        cerr << "The estimators did not start before the end of the trace." << endl;
+        return 1;
+    }
+
+    cout << "estimator\tlag[%GC]\terror_rms[%GC]\terror_max[%GC]\tprediction_rms[ms]\t"
+         << "convergence[steps]\ttime[ns/step]" << endl;
+
+    for(const PhaseEstimates *estimates : { &generatorEstimates, &afoEstimates })
+    {
+        PhaseErrors e = evaluate(*estimates, truePhases, trueTimesToStrike,
+                                 cycleStarts, firstStep, changeStep, tolerance);
+
+        cout << setprecision(4) << estimates->name << "\t" << e.lag << "\t" << e.rms
+             << "\t" << e.max << "\t" << e.predictionRms << "\t";
+        if(changeStep < 0)
+            cout << "-";
+        else if(e.convergenceSteps < 0)
+            cout << "never";
+        else
+            cout << e.convergenceSteps;
+        cout << "\t" << estimates->timePerStep << endl;
+    }
+
+    // Keeps the timed loops from being optimized out.
+    if(std::isnan(checksum))
+        cout << endl;
+
+    return 0;
+}
@@ -0,0 +1,313 @@
+/**
+ * Checks the ProfileStore of the controller, with its loader thread running on
+ * a temporary directory of profile files:
+ * - a profile file must be reloaded when modified, even within the same second
+ *   as the last load, or with the same date but another size,
+ * - the first sum-of-sines frequency must be the smallest, the others being in
+ *   any order, and the trailing terms without amplitude must be ignored, as
+ *   written by tools/fourierfit,
+ * - the files beyond PROFILE_STORE_MAX_PROFILES must be ignored, even when
+ *   modified,
+ * - a profile replaced by a reload must be kept while the control loop reports
+ *   it in use, or has not reported since the reload, then freed,
+ * - GaitTorqueGenerator::getProfilesInUse() must list the profiles of the
+ *   joints, and the previous ones only while crossfading.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../controllers/ewalk/gaittorquegenerator.h"
+#include "../../controllers/ewalk/profilestore.h"
+
+using namespace std;
+using namespace chrono;
+
+const int SCAN_WAIT = PROFILE_STORE_SCAN_PERIOD + 300; // Longer than a scan [ms].
+const int N_STEPS = 1000; // Steps of the generator, at 1 kHz.
+
+/**
+ * @brief Writes a sum-of-sines profile file, through a temporary file.
+ * @param path path of the file.
+ * @param a amplitude of the fundamental, written with 4 decimals, so that
+ * all the versions of the file have the same size.
+ * @param b the frequencies, as written in the file.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeProfile(const string &path, float a, const string &b = "3.1416 6.2832")
+{
+    string tmpPath = path + ".tmp";
+    {
+        ofstream file(tmpPath);
+        file.setf(ios::fixed);
+        file.precision(4);
+        file << "a: " << a << " 0.1000" << endl
+             << "b: " << b << endl
+             << "c: 0.0000 0.0000" << endl;
+        if(!file.good())
+            return false;
+    }
+
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * @brief Writes a sum-of-sines profile file, with any number of terms.
+ * @param path path of the file.
+ * @param a the amplitudes, as written in the file.
+ * @param b the frequencies, as written in the file.
+ * @param c the phases, as written in the file.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeHarmonics(const string &path, const string &a, const string &b,
+                           const string &c)
+{
+    ofstream file(path);
+    file << "a: " << a << endl
+         << "b: " << b << endl
+         << "c: " << c << endl;
+    return file.good();
+}
+
+/**
+ * @brief Sets the modification date of a file.
+ * @param path path of the file.
+ * @param date the date.
+ * @return true if the date was set, false otherwise.
+ */
+static bool setDate(const string &path, const timespec &date)
+{
+    const timespec dates[2] = {date, date};
+    return utimensat(AT_FDCWD, path.c_str(), dates, 0) == 0;
+}
+
+/**
+ * @brief Gets the amplitude of the fundamental of a profile.
+ * @param store the store.
+ * @param index index of the profile.
+ * @return the amplitude, or -1 if there is no profile.
+ */
+static float getAmplitude(const ProfileStore &store, int index)
+{
+    const TorqueProfile *profile = store.getProfile(index);
+    return (profile != nullptr) ? profile->coefficients.a[0] : -1.0f;
+}
+
+/**
+ * @brief Prints the result of a check.
+ * @param name name of the check.
+ * @param passed result of the check.
+ * @param failed set to true if the check failed.
+ */
+static void report(const string &name, bool passed, bool &failed)
+{
+    cout << name << "\t" << (passed ? "ok" : "FAILED") << endl;
+    failed |= !passed;
+}
+
+/**
+ * @brief Checks if a profile is in a list of profiles in use.
+ * @param inUse the list, of GAIT_MAX_PROFILES_IN_USE profiles.
+ * @param profile the profile.
+ * @return true if the profile is in the list, false otherwise.
+ */
+static bool isInUse(const TorqueProfile *const inUse[], const TorqueProfile *profile)
+{
+    for(int i=0; i<GAIT_MAX_PROFILES_IN_USE; i++)
+    {
+        if(inUse[i] == profile)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Walks with a generator, both feet alternating every half second,
+ * from a profile to another, requested once walking.
+ * @param from the first profile.
+ * @param to the profile requested after the first heel-strikes.
+ * @param crossfading set to true if "from" was in use while crossfading.
+ * @param afterCrossfade set to true if "from" was in use at the end.
+ */
+static void walk(const TorqueProfile *from, const TorqueProfile *to,
+                 bool &crossfading, bool &afterCrossfade)
+{
+    GaitTorqueGenerator gait;
+    gait.setProfile(from);
+    gait.reset();
+
+    crossfading = false;
+    const TorqueProfile *inUse[GAIT_MAX_PROFILES_IN_USE];
+
+    for(int i=0; i<10 * N_STEPS; i++)
+    {
+        // Each foot is loaded for 0.6 s every second, the right one shifted.
+        float footLoads[N_GAIT_LEGS] = {(i % N_STEPS < 600) ? 400.0f : 0.0f,
+                                        ((i + 500) % N_STEPS < 600) ? 400.0f : 0.0f};
+        gait.advanceTime(1.0f / N_STEPS);
+        gait.updateGaitCycle(footLoads);
+        gait.computeTorques();
+
+        if(i == 5 * N_STEPS)
+            gait.requestProfile(to);
+
+        gait.getProfilesInUse(inUse);
+        if(gait.getJoints().crossfade[GAIT_LEFT] < 1.0f ||
+           gait.getJoints().crossfade[GAIT_RIGHT] < 1.0f)
+        {
+            crossfading |= isInUse(inUse, from);
+        }
+    }
+
+    afterCrossfade = isInUse(inUse, from);
+}
+
+static void printUsage()
+{
+    cout << "Usage: profilecheck [options]" << endl
+         << "  --tmp <dir>     directory of the temporary profile files (default: /tmp)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string tmpDir = "/tmp";
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    bool failed = false;
+
+    string directory = tmpDir + "/profilecheck_" + to_string(getpid());
+    string path = directory + "/CHECK" + PROFILE_FILE_EXTENSION;
+    string unsortedPath = directory + "/unsorted.conf";
+
+    if(mkdir(directory.c_str(), 0755) != 0 || !writeProfile(path, 1.0f))
+    {
+        cerr << "Could not write the profiles in " << directory << "." << endl;
+        return 1;
+    }
+
+    // Invalid coefficients: the period is given by the first frequency.
+    TorqueProfile unsorted;
+    report("unsorted_b", writeProfile(unsortedPath, 1.0f, "6.2832 3.1416") &&
+                         !ProfileStore::loadFile(unsortedPath, "unsorted", unsorted), failed);
+
+    // The unused terms written by fourierfit, and the order of the built-in
+    // profiles.
+    TorqueProfile padded;
+    report("padded_terms", writeHarmonics(unsortedPath, "1.0 0.1 0.0 0.0", "3.141593 6.283185 0.0 0.0",
+                                          "0.0 0.0 0.0 0.0") &&
+                           ProfileStore::loadFile(unsortedPath, "padded", padded) &&
+                           fabs(padded.period - 2.0f) < 1e-4f, failed);
+
+    TorqueProfile bookOrder;
+    report("book_order", writeHarmonics(unsortedPath, "1.0 0.5 0.2", "3.1416 9.4248 6.2832",
+                                        "0.0 0.0 0.0") &&
+                         ProfileStore::loadFile(unsortedPath, "book_order", bookOrder), failed);
+    remove(unsortedPath.c_str());
+
+    ProfileStore store;
+    store.start(directory);
+    int index = store.findProfile("CHECK");
+    report("loaded", index >= 0 && getAmplitude(store, index) == 1.0f, failed);
+
+    // Modified within the same second as the last load, then with the same
+    // date, but another size.
+    struct stat status;
+    stat(path.c_str(), &status);
+    timespec sameSecond = status.st_mtim;
+    sameSecond.tv_nsec = (sameSecond.tv_nsec + 500000000) % 1000000000;
+
+    const TorqueProfile *first = store.getProfile(index);
+    bool sameSecondOk = writeProfile(path, 2.0f) && setDate(path, sameSecond);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("same_second", sameSecondOk && getAmplitude(store, index) == 2.0f, failed);
+
+    bool sameDateOk = writeProfile(path, 3.0f, "3.1416 6.28320") && setDate(path, sameSecond);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("same_date", sameDateOk && getAmplitude(store, index) == 3.0f, failed);
+
+    // Without any report of the control loop, the replaced profiles are kept.
+    report("kept_without_reports", store.getRetiredCount() == 2, failed);
+
+    // The control loop still uses the first version: only the second is
+    // freed.
+    const TorqueProfile *inUse[] = {first, store.getProfile(index)};
+    store.reportProfilesInUse(inUse, 2);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("kept_in_use", store.getRetiredCount() == 1 && first->coefficients.a[0] == 1.0f,
+           failed);
+
+    // The current version is reported in use, then replaced: it is kept until
+    // the next report, while the first version, no longer in use, is freed.
+    const TorqueProfile *third = store.getProfile(index);
+    store.reportProfilesInUse(&third, 1);
+    writeProfile(path, 4.0f);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("kept_until_reported", store.getRetiredCount() == 1, failed);
+
+    store.reportProfilesInUse(nullptr, 0);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("freed", store.getRetiredCount() == 0 && getAmplitude(store, index) == 4.0f, failed);
+
+    // More files than profiles: the last ones are ignored, even when modified,
+    // and the others are still reloaded.
+    vector<string> extraPaths;
+    for(int i=0; i<PROFILE_STORE_MAX_PROFILES; i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/EXTRA_%02d", i);
+        extraPaths.push_back(directory + name + PROFILE_FILE_EXTENSION);
+        writeProfile(extraPaths.back(), 1.0f);
+    }
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    bool fullOk = (store.getCount() == PROFILE_STORE_MAX_PROFILES) &&
+                  (store.findProfile("EXTRA_00") >= 0) &&
+                  (store.findProfile("EXTRA_31") < 0);
+
+    writeProfile(extraPaths.back(), 2.0f);
+    writeProfile(path, 5.0f);
+    this_thread::sleep_for(milliseconds(SCAN_WAIT));
+    report("full", fullOk && store.getCount() == PROFILE_STORE_MAX_PROFILES &&
+                   store.findProfile("EXTRA_31") < 0 && getAmplitude(store, index) == 5.0f,
+           failed);
+
+    store.stop();
+
+    // Profiles used by the generator, around a crossfade.
+    bool crossfading, afterCrossfade;
+    walk(store.getProfile(store.findProfile("BOOK")),
+         store.getProfile(store.findProfile("BETA")), crossfading, afterCrossfade);
+    report("in_use_crossfading", crossfading, failed);
+    report("unused_after_crossfade", !afterCrossfade, failed);
+
+    remove(path.c_str());
+    for(const string &p : extraPaths)
+        remove(p.c_str());
+    rmdir(directory.c_str());
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,300 @@
+/**
+ * Replays a recorded or synthetic gait trace through the eWalk controller,
+ * without the hardware and as fast as the host allows, and captures every
+ * torque command sent to the motors.
+ *
+ * In soak mode, the trace is repeated for hours of simulated time, and each
+ * repetition is compared to the second one, to check that the clock and the
+ * torques of the controller do not drift over a long session.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/controllerharness.h"
+
+using namespace std;
+using namespace chrono;
+
+/**
+ * @brief Counts the heel-strikes of the right leg in a trace, as the rising
+ * edges of the total sole voltage.
+ * @param trace the gait trace.
+ * @return the number of gait cycles.
+ */
+static int countGaitCycles(const GaitTrace &trace)
+{
+    const float CONTACT_VOLTAGE = 0.05f; // [V].
+
+    int count = 0;
+    bool inContact = false;
+
+    for(const SensorFrame &f : trace.frames)
+    {
+        float sum = 0.0f;
+        for(float v : f.rightSoleVoltages)
+            sum += v;
+
+        if(!inContact && sum > CONTACT_VOLTAGE)
+            count++;
+        inContact = (sum > CONTACT_VOLTAGE);
+    }
+
+    return count;
+}
+
+/**
+ * @brief Drift of the controller over the repetitions of a soak test.
+ */
+struct SoakStats
+{
+    vector<float> referenceTorques;     ///< Left and right, at each step of the 2nd repetition [N.m].
+    float maxTorqueDifference = 0.0f;   ///< To the 2nd repetition [N.m].
+    double maxDifferenceTime = 0.0;     ///< [s]
+    int64_t maxClockError = 0;          ///< Controller time minus steps times dt [ticks].
+    double maxClockErrorTime = 0.0;     ///< [s]
+    float maxProfileTime = 0.0f;        ///< Time along the profiles, over their period [].
+    double maxProfileTimeTime = 0.0;    ///< [s]
+    int nNegativeProfileTimes = 0;
+};
+
+static void printUsage()
+{
+    cout << "Usage: replay [options]" << endl
+         << "  --trace <file.csv>   recorded trace (default: synthetic gait)" << endl
+         << "  --save-trace <file>  save the replayed trace as CSV" << endl
+         << "  --duration <s>       duration of the synthetic gait (default: 600)" << endl
+         << "  --cycle <s>          GC duration of the synthetic gait (default: 1.1)" << endl
+         << "  --seed <n>           random seed of the synthetic gait (default: 0)" << endl
+         << "  --assist <%>         percent assistance (default: 50)" << endl
+         << "  --bodyweight <kg>    pilot bodyweight (default: 60)" << endl
+         << "  --repeat <n>         replay the trace n times (default: 1)" << endl
+         << "  --profile <n>        torque profile, 0: BOOK, 1: ALPHA, 2: BETA, 3: WINTER (default: 2)" << endl
+         << "  --switch-at <s>      time of the selection of the profile (default: 0)" << endl
+         << "  --soak <h>           repeat the trace for this simulated time, and check the drift" << endl
+         << "  --soak-tolerance <N.m> torque difference between repetitions reported as a drift (default: 0.01)" << endl
+         << "  --out <file.csv>     write every torque command" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string tracePath, saveTracePath, outPath;
+    SyntheticGaitParams gait = getDefaultSyntheticGaitParams();
+    float assistance = 50.0f;
+    float bodyweight = 60.0f;
+    int nRepeats = 1;
+    int profile = -1;
+    float switchTime = 0.0f;
+    float soakDuration = 0.0f;
+    float soakTolerance = 0.01f;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else if(arg == "--save-trace" && hasValue)
+            saveTracePath = argv[++i];
+        else if(arg == "--duration" && hasValue)
+            gait.duration = atof(argv[++i]);
+        else if(arg == "--cycle" && hasValue)
+            gait.cycleDuration = atof(argv[++i]);
+        else if(arg == "--seed" && hasValue)
+            gait.seed = atoi(argv[++i]);
+        else if(arg == "--assist" && hasValue)
+            assistance = atof(argv[++i]);
+        else if(arg == "--bodyweight" && hasValue)
+            bodyweight = atof(argv[++i]);
+        else if(arg == "--repeat" && hasValue)
+            nRepeats = atoi(argv[++i]);
+        else if(arg == "--profile" && hasValue)
+            profile = atoi(argv[++i]);
+        else if(arg == "--switch-at" && hasValue)
+            switchTime = atof(argv[++i]);
+        else if(arg == "--soak" && hasValue)
+            soakDuration = atof(argv[++i]) * 3600.0f;
+        else if(arg == "--soak-tolerance" && hasValue)
+            soakTolerance = atof(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // Load or generate the trace.
+    GaitTrace trace;
+    if(!tracePath.empty())
+    {
+        if(!loadGaitTrace(tracePath, trace))
+            return 1;
+    }
+    else
+    {
+        // Same calibration of the soles as the controller, so that it reads
+        // back the simulated forces.
+        SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+        calibration.load(SOLES_CALIBRATION_FILE, false);
+
+        gait.bodyweight = bodyweight;
+        trace = makeSyntheticGait(gait, calibration);
+    }
+
+    if(!saveTracePath.empty() && !saveGaitTrace(saveTracePath, trace))
+        return 1;
+
+    ofstream outFile;
+    if(!outPath.empty())
+    {
+        outFile.open(outPath);
+        if(!outFile.is_open())
+        {
+            cerr << "Could not create " << outPath << "." << endl;
+            return 1;
+        }
+        outFile << "time,left_torque,right_torque\n";
+    }
+
+    // Replay.
+    ControllerHarness harness;
+    harness.setBodyweight(bodyweight);
+    harness.setAssistance(assistance);
+    harness.setEnabled(true);
+
+    float traceDuration = trace.frames.size() * trace.dt;
+    bool soak = (soakDuration > 0.0f);
+    if(soak)
+        nRepeats = max((int)ceil(soakDuration / traceDuration), 3);
+    SoakStats soakStats;
+
+    // The clock of the controller is checked against the number of steps
+    // times the step, as a microsecond clock would count them, rather than
+    // against a time accumulated from dt as the controller does.
+    int64_t startTicks = harness.getGaitTicks();
+    int64_t stepTicks = llround((double)trace.dt * 1e6) * (GAIT_TICKS_PER_SECOND / 1000000);
+    const GaitJointsState &joints = harness.getGait().getJoints();
+
+    auto startTime = steady_clock::now();
+
+    bool profileSelected = false;
+    for(int r=0; r<nRepeats; r++)
+    {
+        for(size_t i=0; i<trace.frames.size(); i++)
+        {
+            const SensorFrame &f = trace.frames[i];
+            double time = (double)r * traceDuration + f.time;
+
+            if(profile >= 0 && !profileSelected && f.time >= switchTime)
+            {
+                harness.setProfile(profile);
+                profileSelected = true;
+            }
+
+            harness.step(trace.dt, f);
+
+            if(outFile.is_open())
+            {
+                outFile << time << "," << harness.getLeftTorque() << ","
+                        << harness.getRightTorque() << "\n";
+            }
+
+            if(soak)
+            {
+                // The first repetition starts from the reset state, so the
+                // second one is the reference.
+                float torques[N_GAIT_LEGS] = {harness.getLeftTorque(),
+                                              harness.getRightTorque()};
+                if(r == 1)
+                {
+                    soakStats.referenceTorques.insert(soakStats.referenceTorques.end(),
+                                                      torques, torques + N_GAIT_LEGS);
+                }
+                else if(r > 1)
+                {
+                    for(int leg=0; leg<N_GAIT_LEGS; leg++)
+                    {
+                        float difference = fabsf(torques[leg] -
+                                                 soakStats.referenceTorques[N_GAIT_LEGS*i + leg]);
+                        if(difference > soakStats.maxTorqueDifference)
+                        {
+                            soakStats.maxTorqueDifference = difference;
+                            soakStats.maxDifferenceTime = time;
+                        }
+                    }
+                }
+
+                int64_t nSteps = (int64_t)r * trace.frames.size() + i + 1;
+                int64_t clockError = harness.getGaitTicks() - startTicks - nSteps * stepTicks;
+                if(llabs(clockError) > llabs(soakStats.maxClockError))
+                {
+                    soakStats.maxClockError = clockError;
+                    soakStats.maxClockErrorTime = time;
+                }
+
+                // The time along the profiles must stay within a few periods.
+                for(int leg=0; leg<N_GAIT_LEGS; leg++)
+                {
+                    float profileTime = joints.time[leg] / joints.originalPeriod[leg];
+                    if(profileTime < 0.0f)
+                        soakStats.nNegativeProfileTimes++;
+                    if(profileTime > soakStats.maxProfileTime)
+                    {
+                        soakStats.maxProfileTime = profileTime;
+                        soakStats.maxProfileTimeTime = time;
+                    }
+                }
+            }
+        }
+    }
+
+    double elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    // Report.
+    long nSteps = (long)trace.frames.size() * nRepeats;
+    double simulatedTime = (double)traceDuration * nRepeats;
+    int nCycles = countGaitCycles(trace) * nRepeats;
+
+    cout << "Steps:            " << nSteps << endl
+         << "Simulated time:   " << simulatedTime << " s" << endl
+         << "Gait cycles:      " << nCycles << endl
+         << "Host time:        " << elapsed << " s" << endl
+         << "Time per step:    " << elapsed / nSteps * 1e9 << " ns" << endl
+         << "Real-time factor: " << simulatedTime / elapsed << "x" << endl
+         << "Gait cycles/s:    " << nCycles / elapsed << endl;
+
+    if(soak)
+    {
+        double clockError = (double)soakStats.maxClockError / GAIT_TICKS_PER_SECOND;
+        float maxProfileTime = GAIT_WRAP_PERIODS +
+                               harness.getGait().getParams().performedGaitMax;
+        bool drift = (soakStats.maxTorqueDifference > soakTolerance ||
+                      fabs(clockError) > 0.5 * trace.dt ||
+                      soakStats.maxProfileTime > maxProfileTime ||
+                      soakStats.nNegativeProfileTimes > 0);
+
+        cout << "Max. torque diff.: " << soakStats.maxTorqueDifference << " N.m at "
+             << soakStats.maxDifferenceTime << " s" << endl
+             << "Max. clock error: " << clockError << " s at "
+             << soakStats.maxClockErrorTime << " s" << endl
+             << "Max. profile time: " << soakStats.maxProfileTime << " periods at "
+             << soakStats.maxProfileTimeTime << " s (max. " << maxProfileTime << ", "
+             << soakStats.nNegativeProfileTimes << " negative)" << endl
+             << "Soak test:        " << (drift ? "DRIFT" : "passed") << endl;
+
+        if(drift)
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,350 @@
+/**
+ * Checks the SoleCalibration of the controller. The conversion of the soles
+ * voltages to forces by convert(), used at each time step, is compared to the
+ * model in its original form (voltageToForce()), for the default model and for
+ * random per-cell calibrations, over the whole range of voltages, including
+ * the saturation and invalid voltages. The calibration files are checked too:
+ * a saved calibration must load back unchanged, and a file with invalid
+ * coefficients must be rejected without modifying the current calibration.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../controllers/ewalk/ewalktimebasedtorqueprofile.h"
+#include "../../lib/keyvaluefile.h"
+
+using namespace std;
+
+const int N_CHECKED_VOLTAGES = 20000; // Evenly spaced, beyond the excitation.
+const char *SIDE_KEYS[N_SOLES] = {"left", "right"};
+
+/**
+ * @brief Results of the comparison of convert() to voltageToForce().
+ */
+struct ConversionStats
+{
+    double maxRelError = 0.0; ///< Relative to the force, or to 1 N below.
+    int nChecked = 0;
+    int nOutOfRange = 0;      ///< Forces outside [0, SOLE_CELL_MAX_FORCE].
+    int nDecreasing = 0;      ///< Forces lower than at a lower voltage.
+    int nInvalidInput = 0;    ///< Non-zero forces for NaN or negative voltages.
+};
+
+/**
+ * @brief Draws a random calibration of all the cells, around the default
+ * model, with some cells having b = 0.
+ * @param calibration the calibration to set.
+ * @param rng the random generator.
+ */
+static void randomizeCalibration(SoleCalibration &calibration, mt19937 &rng)
+{
+    uniform_real_distribution<float> factor(0.5f, 2.0f);
+    uniform_int_distribution<int> zeroB(0, 7);
+
+    SoleCalibration defaultCalibration(SOLES_EXCIT_VOLTAGE);
+    const SoleCellModel &model = defaultCalibration.getCellModel(SOLE_LEFT, 0);
+
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            SoleCellModel cell;
+            cell.a = model.a * factor(rng);
+            cell.b = (zeroB(rng) == 0) ? 0.0f : model.b * factor(rng);
+            cell.r = model.r * factor(rng);
+            calibration.setCellModel((SoleSide)s, i, cell);
+        }
+    }
+}
+
+/**
+ * @brief Converts the voltages of all the cells with convert(), with the same
+ * voltage on every cell.
+ * @param calibration the calibration.
+ * @param voltage the voltage [V].
+ * @param loads the forces of each cell, for each side [N].
+ */
+static void convertAll(const SoleCalibration &calibration, float voltage,
+                       VecNf<SOLE_N_CELLS> loads[N_SOLES])
+{
+    VecNf<SOLE_N_CELLS> voltages[N_SOLES];
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+            voltages[s][i] = voltage;
+    }
+
+    float leftFootLoad, rightFootLoad;
+    calibration.convert(voltages[SOLE_LEFT], voltages[SOLE_RIGHT],
+                        loads[SOLE_LEFT], loads[SOLE_RIGHT],
+                        leftFootLoad, rightFootLoad);
+}
+
+/**
+ * @brief Compares convert() to voltageToForce() over the whole range of
+ * voltages, and checks that the forces are in range and increase with the
+ * voltage.
+ * @param calibration the calibration to check.
+ * @param stats the results to update.
+ */
+static void checkConversion(const SoleCalibration &calibration, ConversionStats &stats)
+{
+    VecNf<SOLE_N_CELLS> loads[N_SOLES], previousLoads[N_SOLES];
+    float maxVoltage = 1.1f * SOLES_EXCIT_VOLTAGE;
+
+    for(int k=0; k<=N_CHECKED_VOLTAGES; k++)
+    {
+        float voltage = maxVoltage * (float)k / N_CHECKED_VOLTAGES;
+        convertAll(calibration, voltage, loads);
+
+        for(int s=0; s<N_SOLES; s++)
+        {
+            for(int i=0; i<SOLE_N_CELLS; i++)
+            {
+                float force = loads[s][i];
+                float reference = calibration.voltageToForce((SoleSide)s, i, voltage);
+                double error = fabs((double)force - reference) / max(fabs((double)reference), 1.0);
+
+                stats.maxRelError = max(stats.maxRelError, error);
+                stats.nChecked++;
+
+                if(!(force >= 0.0f && force <= SOLE_CELL_MAX_FORCE))
+                    stats.nOutOfRange++;
+
+                if(k > 0 && force < previousLoads[s][i])
+                    stats.nDecreasing++;
+
+                previousLoads[s][i] = force;
+            }
+        }
+    }
+
+    // Invalid voltages, that the ADC cannot give, but the conversion must not
+    // let through.
+    const float invalidVoltages[] = {-0.001f, -1.0f, -numeric_limits<float>::infinity(),
+                                     numeric_limits<float>::quiet_NaN()};
+
+    for(float voltage : invalidVoltages)
+    {
+        convertAll(calibration, voltage, loads);
+
+        for(int s=0; s<N_SOLES; s++)
+        {
+            for(int i=0; i<SOLE_N_CELLS; i++)
+            {
+                if(loads[s][i] != 0.0f)
+                    stats.nInvalidInput++;
+            }
+        }
+    }
+
+    // Beyond the excitation voltage, the model would give a negative force.
+    convertAll(calibration, numeric_limits<float>::infinity(), loads);
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            if(loads[s][i] != SOLE_CELL_MAX_FORCE)
+                stats.nOutOfRange++;
+        }
+    }
+}
+
+/**
+ * @brief Checks if two calibrations have exactly the same models.
+ * @param a first calibration.
+ * @param b second calibration.
+ * @return true if all the coefficients are equal, false otherwise.
+ */
+static bool sameModels(const SoleCalibration &a, const SoleCalibration &b)
+{
+    for(int s=0; s<N_SOLES; s++)
+    {
+        for(int i=0; i<SOLE_N_CELLS; i++)
+        {
+            const SoleCellModel &ma = a.getCellModel((SoleSide)s, i);
+            const SoleCellModel &mb = b.getCellModel((SoleSide)s, i);
+
+            if(ma.a != mb.a || ma.b != mb.b || ma.r != mb.r)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Writes a calibration file with one coefficient replaced, then checks
+ * that load() rejects it, and keeps the current calibration.
+ * @param reference a valid calibration, whose coefficients are written.
+ * @param path path of the temporary file.
+ * @param key key of the replaced coefficients, e.g. "left_coef_b".
+ * @param value the invalid value, as written in the file, or empty to remove
+ * the entry.
+ * @return true if the file was rejected and the calibration kept, false
+ * otherwise.
+ */
+static bool checkRejected(const SoleCalibration &reference, const string &path,
+                          const string &key, const string &value)
+{
+    if(!reference.save(path))
+        return false;
+
+    // Rewrites the file with the value of the last cell replaced.
+    KeyValueFile file;
+    if(!file.load(path, false))
+        return false;
+
+    if(value.empty())
+    {
+        KeyValueFile stripped;
+        for(int s=0; s<N_SOLES; s++)
+        {
+            for(string coefficient : {"_coef_a", "_coef_b", "_resistance"})
+            {
+                string k = SIDE_KEYS[s] + coefficient;
+                string values;
+                if(k != key && file.getString(k, values))
+                    stripped.setString(k, values);
+            }
+        }
+        file = stripped;
+    }
+    else
+    {
+        string values;
+        file.getString(key, values);
+        values = values.substr(0, values.rfind(' ') + 1) + value;
+        file.setString(key, values);
+    }
+
+    if(!file.save(path))
+        return false;
+
+    SoleCalibration calibration = reference;
+    bool loaded = calibration.load(path, false);
+
+    return !loaded && sameModels(calibration, reference);
+}
+
+/**
+ * @brief Prints the results of the comparison for a set of calibrations.
+ * @param name name of the set.
+ * @param stats the results.
+ */
+static void printStats(const string &name, const ConversionStats &stats)
+{
+    cout << name << "\t" << stats.nChecked << "\t" << scientific << setprecision(2)
+         << stats.maxRelError << defaultfloat << "\t" << stats.nOutOfRange
+         << "\t" << stats.nDecreasing << "\t" << stats.nInvalidInput << endl;
+}
+
+static void printUsage()
+{
+    cout << "Usage: solecheck [options]" << endl
+         << "  --calibrations <n>  random calibrations to check (default: 100)" << endl
+         << "  --seed <n>          seed of the random calibrations (default: 1)" << endl
+         << "  --tolerance <x>     max. relative error of convert() (default: 1e-4)" << endl
+         << "  --tmp <dir>         directory of the temporary calibration file (default: /tmp)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int nCalibrations = 100;
+    unsigned int seed = 1;
+    double tolerance = 1e-4;
+    string tmpDir = "/tmp";
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--calibrations" && hasValue)
+            nCalibrations = max(atoi(argv[++i]), 0);
+        else if(arg == "--seed" && hasValue)
+            seed = (unsigned int)atoi(argv[++i]);
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else if(arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    mt19937 rng(seed);
+    bool failed = false;
+
+    // Conversion.
+    cout << "calibration\tchecked\tmax_rel_error\tout_of_range\tdecreasing\tinvalid_input" << endl;
+
+    SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+    ConversionStats defaultStats;
+    checkConversion(calibration, defaultStats);
+    printStats("default", defaultStats);
+
+    ConversionStats randomStats;
+    for(int c=0; c<nCalibrations; c++)
+    {
+        randomizeCalibration(calibration, rng);
+        checkConversion(calibration, randomStats);
+    }
+    printStats("random", randomStats);
+
+    for(const ConversionStats &stats : {defaultStats, randomStats})
+    {
+        if(stats.maxRelError > tolerance || stats.nOutOfRange > 0 ||
+           stats.nDecreasing > 0 || stats.nInvalidInput > 0)
+        {
+            failed = true;
+        }
+    }
+
+    // Calibration files.
+    string path = tmpDir + "/solecheck_" + to_string(seed) + ".conf";
+    SoleCalibration reference(SOLES_EXCIT_VOLTAGE);
+    randomizeCalibration(reference, rng);
+
+    SoleCalibration loaded(SOLES_EXCIT_VOLTAGE);
+    bool roundTrip = reference.save(path) && loaded.load(path, false) &&
+                     sameModels(loaded, reference);
+    cout << endl << "file\tresult" << endl
+         << "saved\t" << (roundTrip ? "loaded" : "FAILED") << endl;
+    failed |= !roundTrip;
+
+    struct InvalidEntry
+    {
+        const char *key;
+        const char *value;
+    };
+    const InvalidEntry invalidEntries[] =
+    {
+        {"left_coef_a", "0"}, {"left_coef_a", "-2.89e5"}, {"right_coef_a", "nan"},
+        {"left_coef_b", "-1"}, {"right_coef_b", "inf"}, {"right_coef_b", "1e39"},
+        {"left_resistance", "0"}, {"right_resistance", "-3000"},
+        {"right_resistance", "3000 3000"}, {"left_coef_b", "x"}, {"right_coef_a", ""}
+    };
+
+    for(const InvalidEntry &entry : invalidEntries)
+    {
+        bool rejected = checkRejected(reference, path, entry.key, entry.value);
+        cout << entry.key << "=" << (entry.value[0] ? entry.value : "<missing>") << "\t"
+             << (rejected ? "rejected" : "FAILED") << endl;
+        failed |= !rejected;
+    }
+
+    remove(path.c_str());
+
+    return failed ? 2 : 0;
+}
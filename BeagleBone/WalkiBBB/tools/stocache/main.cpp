@@ -0,0 +1,156 @@
+/**
+ * Loads all the .sto files of SCONE/OpenSim results directories, building the
+ * columnar caches the first time, and reports the loading time. Can also print
+ * a column of a file.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "../common/stofile.h"
+
+using namespace std;
+using namespace chrono;
+
+static void printUsage()
+{
+    cout << "Usage: stocache [options] <directory or .sto file>..." << endl
+         << "  --no-cache          always parse the text files" << endl
+         << "  --rebuild           parse the text files and rewrite the caches" << endl
+         << "  --threads <n>       number of loading threads (default: all cores)" << endl
+         << "  --print <column>    print the time and this column of each file" << endl
+         << "  --quiet             only print the totals" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    bool useCache = true, rebuild = false, quiet = false;
+    int nThreads = (int)thread::hardware_concurrency();
+    string printedColumn;
+    vector<string> paths;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--no-cache")
+            useCache = false;
+        else if(arg == "--rebuild")
+            rebuild = true;
+        else if(arg == "--quiet")
+            quiet = true;
+        else if(arg == "--threads" && hasValue)
+            nThreads = atoi(argv[++i]);
+        else if(arg == "--print" && hasValue)
+            printedColumn = argv[++i];
+        else if(arg.size() > 0 && arg[0] != '-')
+            paths.push_back(arg);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    if(paths.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // List the files.
+    vector<string> files;
+    for(const string &p : paths)
+    {
+        struct stat st;
+        if(stat(p.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            vector<string> dirFiles = listStoFiles(p);
+            files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+        }
+        else
+            files.push_back(p);
+    }
+
+    // Load them in parallel.
+    vector<unique_ptr<StoTable>> tables(files.size());
+    vector<char> loaded(files.size(), false); // Not vector<bool>, written concurrently.
+    atomic<size_t> nextFile(0);
+
+    auto startTime = steady_clock::now();
+
+    auto worker = [&]()
+    {
+        size_t i;
+        while((i = nextFile.fetch_add(1)) < files.size())
+        {
+            tables[i].reset(new StoTable());
+
+            if(rebuild)
+            {
+                loaded[i] = tables[i]->parse(files[i]) &&
+                            tables[i]->saveCache(StoTable::getCachePath(files[i]),
+                                                 files[i]);
+            }
+            else
+                loaded[i] = tables[i]->load(files[i], useCache);
+        }
+    };
+
+    vector<thread> threads;
+    for(int t=1; t<max(1, nThreads); t++)
+        threads.push_back(thread(worker));
+    worker();
+    for(thread &t : threads)
+        t.join();
+
+    double elapsed = duration<double>(steady_clock::now() - startTime).count();
+
+    // Report.
+    size_t nValues = 0, nMapped = 0, nFailed = 0;
+    for(size_t i=0; i<files.size(); i++)
+    {
+        if(!loaded[i])
+        {
+            nFailed++;
+            continue;
+        }
+
+        const StoTable &t = *tables[i];
+        nValues += t.getRowsCount() * t.getColumnsCount();
+        nMapped += t.isMapped() ? 1 : 0;
+
+        if(!quiet)
+        {
+            cout << files[i] << ": " << t.getRowsCount() << " rows x "
+                 << t.getColumnsCount() << " columns"
+                 << (t.isMapped() ? " (cache)" : "") << endl;
+        }
+
+        if(!printedColumn.empty())
+        {
+            const float *time = t.getTimeColumn();
+            const float *column = t.getColumn(printedColumn);
+            if(time != nullptr && column != nullptr)
+            {
+                for(size_t r=0; r<t.getRowsCount(); r++)
+                    cout << time[r] << "\t" << column[r] << "\n";
+            }
+        }
+    }
+
+    cout << "Loaded " << files.size() - nFailed << " files (" << nMapped
+         << " from cache, " << nFailed << " failed), " << nValues
+         << " values, in " << elapsed * 1000.0 << " ms." << endl;
+
+    return (nFailed > 0) ? 1 : 0;
+}
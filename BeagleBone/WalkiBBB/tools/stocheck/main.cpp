@@ -0,0 +1,369 @@
+/**
+ * Checks the .sto reader of the tools (tools/common/stofile.h) and its
+ * columnar cache. A synthetic .sto file is written with the number formats
+ * found in the SCONE/OpenSim results, then:
+ * - the parsed values must be those of strtof(), to 1 ULP,
+ * - the second load must map the cache, with exactly the parsed values,
+ * - a modified .sto file must be parsed again, even with the same size,
+ * - a corrupted cache must be ignored, and the text parsed again,
+ * - an invalid .sto file must be rejected.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/stofile.h"
+
+using namespace std;
+
+const float TIME_STEP = 0.005f; // [s].
+
+// Columns of the synthetic file: the row index and the time are both named
+// "time", as in the exported files, and a name contains a space.
+const char *COLUMN_NAMES[] = {"time", "pelvis_tilt", "hip_flexion_r", "Ground_Force 0",
+                              "activation", "time"};
+const int N_COLUMNS = sizeof(COLUMN_NAMES) / sizeof(COLUMN_NAMES[0]);
+
+/**
+ * @brief Synthetic table, kept as the text of each value.
+ */
+struct SyntheticTable
+{
+    size_t nRows = 0;
+    vector<string> tokens; ///< Row by row.
+};
+
+/**
+ * @brief Formats a random value, in one of the formats found in the .sto
+ * files, or in a rarer one that the reader must also accept.
+ * @param rng the random generator.
+ * @return the text of the value.
+ */
+static string randomToken(mt19937 &rng)
+{
+    uniform_int_distribution<int> format(0, 9);
+    uniform_real_distribution<double> value(-200.0, 200.0);
+    uniform_int_distribution<int> exponent(-40, 38);
+    char text[64];
+
+    switch(format(rng))
+    {
+    case 0:
+    case 1:
+    case 2:
+        snprintf(text, sizeof(text), "%.8f", value(rng)); // SCONE.
+        break;
+    case 3:
+    case 4:
+        snprintf(text, sizeof(text), "%.6e", value(rng) * pow(10.0, exponent(rng)));
+        break;
+    case 5:
+        snprintf(text, sizeof(text), "%.17g", value(rng));
+        break;
+    case 6:
+        snprintf(text, sizeof(text), "%.25f", value(rng) / 1000.0); // > 19 digits.
+        break;
+    case 7:
+        snprintf(text, sizeof(text), "%d", (int)value(rng));
+        break;
+    case 8:
+        snprintf(text, sizeof(text), "%+.3E", value(rng) * 1e-30); // Denormals.
+        break;
+    default:
+    {
+        const char *special[] = {"nan", "inf", "-inf", "-0", ".5", "5.", "1e5", "7e-15"};
+        return special[uniform_int_distribution<int>(0, 7)(rng)];
+    }
+    }
+
+    return text;
+}
+
+/**
+ * @brief Draws a synthetic table.
+ * @param nRows the number of rows.
+ * @param rng the random generator.
+ * @return the table.
+ */
+static SyntheticTable makeTable(size_t nRows, mt19937 &rng)
+{
+    SyntheticTable table;
+    table.nRows = nRows;
+
+    for(size_t r=0; r<nRows; r++)
+    {
+        for(int c=0; c<N_COLUMNS; c++)
+        {
+            if(c == 0)
+                table.tokens.push_back(to_string(r));
+            else if(c == N_COLUMNS - 1)
+                table.tokens.push_back(to_string(r * TIME_STEP));
+            else
+                table.tokens.push_back(randomToken(rng));
+        }
+    }
+
+    return table;
+}
+
+/**
+ * @brief Writes a table as a .sto file.
+ * @param table the table.
+ * @param path path of the file.
+ * @param endHeader false to omit the "endheader" line.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeSto(const SyntheticTable &table, const string &path, bool endHeader = true)
+{
+    ofstream file(path);
+    if(!file.is_open())
+        return false;
+
+    file << "stocheck" << "\n" << "version=1\n" << "nRows=" << table.nRows << "\n"
+         << "nColumns=" << N_COLUMNS << "\n" << "inDegrees=no\n";
+    if(endHeader)
+        file << "endheader\n";
+
+    for(int c=0; c<N_COLUMNS; c++)
+        file << (c > 0 ? "\t" : "") << COLUMN_NAMES[c];
+    file << "\n";
+
+    for(size_t r=0; r<table.nRows; r++)
+    {
+        for(int c=0; c<N_COLUMNS; c++)
+            file << (c > 0 ? "\t" : "") << table.tokens[r * N_COLUMNS + c];
+        file << "\n";
+    }
+
+    return file.good();
+}
+
+/**
+ * @brief Gets the distance between two floats, in units of the last place.
+ * @param a first value.
+ * @param b second value.
+ * @return the distance, 0 if both are NaN.
+ */
+static int64_t ulpDistance(float a, float b)
+{
+    if(std::isnan(a) || std::isnan(b))
+        return (std::isnan(a) && std::isnan(b)) ? 0 : INT64_MAX;
+
+    // Maps the floats to integers ordered as the floats.
+    auto key = [](float x) -> int64_t
+    {
+        int32_t i;
+        memcpy(&i, &x, sizeof(i));
+        return (i < 0) ? -(int64_t)(i & 0x7FFFFFFF) : (int64_t)i;
+    };
+
+    return llabs(key(a) - key(b));
+}
+
+/**
+ * @brief Compares a loaded table to the synthetic one.
+ * @param sto the loaded table.
+ * @param table the synthetic table.
+ * @param maxUlp max. distance to strtof() of the text, over all the values.
+ * @param nInexact number of values not equal to strtof() of the text.
+ * @return true if the table has the right shape and names, false otherwise.
+ */
+static bool compareTable(const StoTable &sto, const SyntheticTable &table,
+                         int64_t &maxUlp, size_t &nInexact)
+{
+    maxUlp = 0;
+    nInexact = 0;
+
+    if(sto.getRowsCount() != table.nRows || sto.getColumnsCount() != (size_t)N_COLUMNS ||
+       sto.getColumnNames()[N_COLUMNS - 1] != "time_2" ||
+       sto.getColumnNames()[3] != "Ground_Force 0" ||
+       sto.getTimeColumn() != sto.getColumn(N_COLUMNS - 1))
+    {
+        return false;
+    }
+
+    for(int c=0; c<N_COLUMNS; c++)
+    {
+        const float *column = sto.getColumn(c);
+        for(size_t r=0; r<table.nRows; r++)
+        {
+            float expected = strtof(table.tokens[r * N_COLUMNS + c].c_str(), nullptr);
+            int64_t distance = ulpDistance(column[r], expected);
+
+            maxUlp = max(maxUlp, distance);
+            nInexact += (distance > 0) ? 1 : 0;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks if two tables have exactly the same values.
+ * @param a first table.
+ * @param b second table.
+ * @return true if all the values have the same bits, false otherwise.
+ */
+static bool sameValues(const StoTable &a, const StoTable &b)
+{
+    if(a.getRowsCount() != b.getRowsCount() || a.getColumnsCount() != b.getColumnsCount() ||
+       a.getColumnNames() != b.getColumnNames() || a.getName() != b.getName())
+    {
+        return false;
+    }
+
+    for(size_t c=0; c<a.getColumnsCount(); c++)
+    {
+        if(memcmp(a.getColumn(c), b.getColumn(c), a.getRowsCount() * sizeof(float)) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Prints the result of a check.
+ * @param name name of the check.
+ * @param passed result of the check.
+ * @param failed set to true if the check failed.
+ */
+static void report(const string &name, bool passed, bool &failed)
+{
+    cout << name << "\t" << (passed ? "ok" : "FAILED") << endl;
+    failed |= !passed;
+}
+
+static void printUsage()
+{
+    cout << "Usage: stocheck [options]" << endl
+         << "  --rows <n>      rows of the synthetic file (default: 20000)" << endl
+         << "  --seed <n>      seed of the synthetic values (default: 1)" << endl
+         << "  --tmp <dir>     directory of the temporary files (default: /tmp)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nRows = 20000;
+    unsigned int seed = 1;
+    string tmpDir = "/tmp";
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--rows" && hasValue)
+            nRows = (size_t)max(atoi(argv[++i]), 1);
+        else if(arg == "--seed" && hasValue)
+            seed = (unsigned int)atoi(argv[++i]);
+        else if(arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    mt19937 rng(seed);
+    bool failed = false;
+
+    string directory = tmpDir + "/stocheck_" + to_string(getpid());
+    string path = directory + "/check.sto";
+    string cachePath = StoTable::getCachePath(path);
+
+    if(mkdir(directory.c_str(), 0755) != 0)
+    {
+        cerr << "Could not create " << directory << "." << endl;
+        return 1;
+    }
+
+    SyntheticTable table = makeTable(nRows, rng);
+    if(!writeSto(table, path))
+    {
+        cerr << "Could not write " << path << "." << endl;
+        return 1;
+    }
+
+    // Parsing, against strtof().
+    StoTable parsed;
+    int64_t maxUlp;
+    size_t nInexact;
+    bool parsedOk = parsed.parse(path) && compareTable(parsed, table, maxUlp, nInexact);
+    if(parsedOk)
+    {
+        cout << "values\t" << nRows * N_COLUMNS << endl
+             << "inexact\t" << nInexact << endl
+             << "max_ulp\t" << maxUlp << endl;
+    }
+    report("parse", parsedOk && maxUlp <= 1, failed);
+
+    // First load: parsed, and the cache written. Second load: mapped.
+    StoTable first, second;
+    report("first_load", first.load(path) && !first.isMapped() && sameValues(first, parsed),
+           failed);
+    report("cache_written", access(cachePath.c_str(), F_OK) == 0, failed);
+    report("cache_load", second.load(path) && second.isMapped() && sameValues(second, parsed),
+           failed);
+
+    // Modified file, with the same size: the last digit of a time changes.
+    SyntheticTable modified = table;
+    string &token = modified.tokens[2 * N_COLUMNS - 1];
+    token.back() = (token.back() == '1') ? '2' : '1';
+    StoTable reparsed, expected;
+    bool modifiedOk = writeSto(modified, path) && expected.parse(path) &&
+                      reparsed.load(path) && !reparsed.isMapped() &&
+                      sameValues(reparsed, expected) && !sameValues(reparsed, parsed);
+    report("modified_same_size", modifiedOk, failed);
+
+    // Corrupted caches: truncated, then with a wrong magic number.
+    StoTable afterTruncation, afterBadMagic;
+    bool truncatedOk = (truncate(cachePath.c_str(), sizeof(StoCacheHeader) + 8) == 0) &&
+                       afterTruncation.load(path) && !afterTruncation.isMapped() &&
+                       sameValues(afterTruncation, expected);
+    report("truncated_cache", truncatedOk, failed);
+
+    bool badMagicOk = false;
+    {
+        fstream cache(cachePath, ios::in | ios::out | ios::binary);
+        uint32_t magic = 0;
+        if(cache.is_open() && cache.write((const char*)&magic, sizeof(magic)))
+        {
+            cache.close();
+            badMagicOk = afterBadMagic.load(path) && !afterBadMagic.isMapped() &&
+                         sameValues(afterBadMagic, expected);
+        }
+    }
+    report("bad_magic_cache", badMagicOk, failed);
+
+    // Invalid files: no "endheader", a missing value, a word instead of a
+    // number.
+    StoTable invalid;
+    report("no_endheader", writeSto(table, path, false) && !invalid.load(path, false), failed);
+
+    SyntheticTable missingValue = table;
+    missingValue.tokens[2 * N_COLUMNS + 2] = "";
+    report("missing_value", writeSto(missingValue, path) && !invalid.load(path, false), failed);
+
+    SyntheticTable word = table;
+    word.tokens[3 * N_COLUMNS + 2] = "walk";
+    report("invalid_number", writeSto(word, path) && !invalid.load(path, false), failed);
+
+    remove(cachePath.c_str());
+    rmdir(cachePath.substr(0, cachePath.find_last_of('/')).c_str());
+    remove(path.c_str());
+    rmdir(directory.c_str());
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,369 @@
+/**
+ * Receives the telemetry stream of the eWalk controller, optionally draining
+ * it at a limited rate like a slow Wi-Fi link, and reports the throughput.
+ * With --loopback, the controller is run in real time on a synthetic gait, in
+ * the same process, so that the stream can be measured without the
+ * exoskeleton.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../common/controllerharness.h"
+#include "../common/telemetrystreamreader.h"
+
+using namespace std;
+using namespace chrono;
+
+const int READ_PERIOD = 10; // [ms].
+
+// Variables compared to the decoded ones in loopback, by channel name.
+const int N_CHECKED = 6;
+const char *const CHECKED_CHANNELS[N_CHECKED] =
+{
+    "left_hip_angle", "right_hip_angle", "left_torque_cmd", "right_torque_cmd",
+    "check/left_foot_load", "check/right_foot_load"
+};
+
+/**
+ * @brief Values of the checked variables after one step of the controller.
+ */
+struct CheckedValues
+{
+    int64_t time;               ///< [us].
+    float values[N_CHECKED];
+};
+
+/**
+ * @brief Controller run in real time, streaming on a local port.
+ */
+struct LoopbackController
+{
+    ControllerHarness harness;
+    GaitTrace trace;
+    thread *runThread;
+    atomic<bool> finished;
+
+    mutex checkedMutex;
+    deque<CheckedValues> checked;
+};
+
+/**
+ * @brief Steps the controller on the trace, each step at its time, and
+ * queues the values to check.
+ * @param c the controller.
+ */
+static void runController(LoopbackController *c)
+{
+    auto startTime = steady_clock::now();
+
+    for(size_t s=0; s<c->trace.frames.size(); s++)
+    {
+        this_thread::sleep_until(startTime + microseconds((int64_t)(s * c->trace.dt * 1e6)));
+        c->harness.step(c->trace.dt, c->trace.frames[s]);
+
+        const eWalkLoggedVars &l = c->harness.getLoggedVars();
+        CheckedValues v;
+        v.time = SimHardware::getInstance().timeUs;
+        v.values[0] = l.hipAngles[GAIT_LEFT];
+        v.values[1] = l.hipAngles[GAIT_RIGHT];
+        v.values[2] = l.torqueCmds[GAIT_LEFT];
+        v.values[3] = l.torqueCmds[GAIT_RIGHT];
+        v.values[4] = l.footLoads[GAIT_LEFT];
+        v.values[5] = l.footLoads[GAIT_RIGHT];
+
+        lock_guard<mutex> lock(c->checkedMutex);
+        c->checked.push_back(v);
+    }
+
+    c->finished = true;
+}
+
+/**
+ * @brief Connects to the stream.
+ * @param host name or address of the controller.
+ * @param port TCP port of the stream.
+ * @param window receive buffer of the socket, 0 for the default [B].
+ * @return the socket, or -1 if it could not connect.
+ */
+static int connectToStream(const string &host, int port, int window)
+{
+    addrinfo hints, *addresses;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if(getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0)
+    {
+        cerr << "Unknown host " << host << "." << endl;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    // Before connecting, so that the TCP window is negotiated accordingly.
+    if(fd >= 0 && window > 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &window, sizeof(window));
+
+    if(fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if(fd < 0)
+        cerr << "Could not connect to " << host << ":" << port << "." << endl;
+    return fd;
+}
+
+static void printUsage()
+{
+    cout << "Usage: streamclient [options]" << endl
+         << "  --host <name>        address of the controller (default: localhost)" << endl
+         << "  --port <n>           port of the stream (default: " << TELEMETRY_STREAM_PORT << ")" << endl
+         << "  --loopback           run the controller locally on a synthetic gait" << endl
+         << "  --duration <s>       duration of the measurement (default: 30)" << endl
+         << "  --rate <kB/s>        max. rate of reading, 0 for no limit (default: 0)" << endl
+         << "  --window <kB>        receive buffer of the socket (default: 4)" << endl
+         << "  --quiet              only print the summary" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string host = "localhost";
+    int port = TELEMETRY_STREAM_PORT;
+    bool loopback = false;
+    float runDuration = 30.0f;
+    float rate = 0.0f;
+    float window = 4.0f;
+    bool quiet = false;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--host" && hasValue)
+            host = argv[++i];
+        else if(arg == "--port" && hasValue)
+            port = atoi(argv[++i]);
+        else if(arg == "--loopback")
+            loopback = true;
+        else if(arg == "--duration" && hasValue)
+            runDuration = atof(argv[++i]);
+        else if(arg == "--rate" && hasValue)
+            rate = atof(argv[++i]);
+        else if(arg == "--window" && hasValue)
+            window = atof(argv[++i]);
+        else if(arg == "--quiet")
+            quiet = true;
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // Local controller.
+    LoopbackController *controller = nullptr;
+    if(loopback)
+    {
+        controller = new LoopbackController();
+        controller->finished = false;
+
+        SoleCalibration calibration(SOLES_EXCIT_VOLTAGE);
+        calibration.load(SOLES_CALIBRATION_FILE, false);
+
+        SyntheticGaitParams gait = getDefaultSyntheticGaitParams();
+        gait.duration = runDuration;
+        controller->trace = makeSyntheticGait(gait, calibration);
+
+        controller->harness.setBodyweight(gait.bodyweight);
+        controller->harness.setAssistance(50.0f);
+        controller->harness.setEnabled(true);
+
+        if(!controller->harness.startStream(port))
+            return 1;
+
+        host = "127.0.0.1";
+    }
+
+    int fd = connectToStream(host, port, (int)(window * 1000.0f));
+    if(fd < 0)
+        return 1;
+
+    if(loopback)
+        controller->runThread = new thread(runController, controller);
+
+    // Receive, at most rate bytes per second.
+    TelemetryStreamReader reader;
+    vector<uint8_t> buffer(64*1024);
+    bool closed = false;
+
+    uint64_t nBytes = 0, nFrames = 0, nSnapshots = 0, nDropped = 0, frameBytes = 0;
+    uint64_t lastBytes = 0, lastFrames = 0, lastSnapshots = 0, lastDropped = 0;
+    double budget = 0.0; // [B].
+    int checkedIndices[N_CHECKED];
+    double maxErrors[N_CHECKED] = {};
+    uint64_t nCheckedFrames = 0;
+
+    const double bytesPerTick = rate * 1000.0 * READ_PERIOD / 1000.0;
+    auto startTime = steady_clock::now();
+    auto nextRead = startTime;
+    auto nextReport = startTime + seconds(1);
+
+    if(!quiet)
+        cout << "  t [s]  frames/s     kB/s  B/frame  snapshots/frame  dropped" << endl;
+
+    while(!closed)
+    {
+        nextRead += milliseconds(READ_PERIOD);
+        this_thread::sleep_until(nextRead);
+
+        double elapsed = duration<double>(steady_clock::now() - startTime).count();
+        if(loopback ? controller->finished.load() : elapsed >= runDuration)
+            break;
+
+        size_t allowance = SIZE_MAX;
+        if(rate > 0.0f)
+        {
+            budget = min(budget + bytesPerTick, 2.0 * bytesPerTick);
+            allowance = (size_t)budget;
+        }
+
+        while(allowance > 0)
+        {
+            ssize_t n = recv(fd, buffer.data(), min(buffer.size(), allowance), MSG_DONTWAIT);
+            if(n > 0)
+            {
+                reader.append(buffer.data(), (size_t)n);
+                allowance -= (rate > 0.0f) ? (size_t)n : 0;
+                budget -= n;
+                nBytes += n;
+            }
+            else
+            {
+                closed = (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+                break;
+            }
+        }
+
+        while(reader.nextFrame())
+        {
+            nFrames++;
+            nSnapshots += 1 + reader.getSkippedCount() + reader.getDroppedCount();
+            nDropped += reader.getDroppedCount();
+            frameBytes += reader.getFrameSize();
+
+            if(!loopback)
+                continue;
+
+            // Compare with the values of the same step.
+            if(nFrames == 1)
+            {
+                const vector<StreamChannel> &channels = reader.getChannels();
+                for(int i=0; i<N_CHECKED; i++)
+                {
+                    checkedIndices[i] = -1;
+                    for(size_t j=0; j<channels.size(); j++)
+                    {
+                        if(channels[j].name == CHECKED_CHANNELS[i])
+                            checkedIndices[i] = (int)j;
+                    }
+                }
+            }
+
+            lock_guard<mutex> lock(controller->checkedMutex);
+            deque<CheckedValues> &checked = controller->checked;
+            while(!checked.empty() && checked.front().time < reader.getTime())
+                checked.pop_front();
+
+            if(!checked.empty() && checked.front().time == reader.getTime())
+            {
+                for(int i=0; i<N_CHECKED; i++)
+                {
+                    if(checkedIndices[i] < 0)
+                        continue;
+
+                    double error = fabs(reader.getValue(checkedIndices[i]) -
+                                        checked.front().values[i]);
+                    maxErrors[i] = max(maxErrors[i], error);
+                }
+                nCheckedFrames++;
+            }
+        }
+
+        if(!reader.isValid())
+            return 1;
+
+        if(!quiet && steady_clock::now() >= nextReport)
+        {
+            uint64_t frames = nFrames - lastFrames;
+            printf("%7.0f %9lu %8.1f %8.1f %16.2f %8lu\n", elapsed,
+                   (unsigned long)frames, (nBytes - lastBytes) / 1000.0,
+                   frames > 0 ? (double)(nBytes - lastBytes) / frames : 0.0,
+                   frames > 0 ? (double)(nSnapshots - lastSnapshots) / frames : 0.0,
+                   (unsigned long)(nDropped - lastDropped));
+            fflush(stdout);
+
+            lastBytes = nBytes;
+            lastFrames = nFrames;
+            lastSnapshots = nSnapshots;
+            lastDropped = nDropped;
+            nextReport += seconds(1);
+        }
+    }
+
+    double elapsed = duration<double>(steady_clock::now() - startTime).count();
+    close(fd);
+
+    if(loopback)
+    {
+        controller->runThread->join();
+        delete controller->runThread;
+    }
+
+    // Report.
+    size_t nChannels = reader.getChannels().size();
+    double snapshotSize = sizeof(int64_t) + 4.0 * nChannels; // As recorded, 4 B per value.
+    double bytesPerFrame = (nFrames > 0) ? (double)frameBytes / nFrames : 0.0;
+
+    cout << "Channels:         " << nChannels << endl
+         << "Duration:         " << elapsed << " s" << endl
+         << "Frames:           " << nFrames << endl
+         << "Frames/s:         " << nFrames / elapsed << endl
+         << "Throughput:       " << nBytes / elapsed / 1000.0 << " kB/s" << endl
+         << "Bytes per frame:  " << bytesPerFrame << endl
+         << "Full snapshot:    " << snapshotSize << " B" << endl
+         << "Compression:      " << ((bytesPerFrame > 0.0) ? snapshotSize / bytesPerFrame : 0.0) << "x" << endl
+         << "Snapshots/frame:  " << ((nFrames > 0) ? (double)nSnapshots / nFrames : 0.0) << endl
+         << "Dropped frames:   " << nDropped << endl;
+
+    if(loopback)
+    {
+        cout << "Checked frames:   " << nCheckedFrames << endl;
+        for(int i=0; i<N_CHECKED; i++)
+            cout << "Max. error " << CHECKED_CHANNELS[i] << ": " << maxErrors[i] << endl;
+
+        delete controller;
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * Checks the accuracy of the TorqueProfileTable. The tables sampled from the
+ * sum-of-sines profiles of the controller are compared to the closed form with
+ * the libm sine, which the controller evaluated at each step before. The
+ * tables resampled from tabulated profiles (the Winter profile of the
+ * controller, and a sum-of-sines profile sampled at many unevenly spaced
+ * phases) are compared to the source points, and between them to the linear
+ * interpolation of the points, or to the closed form when known. Each check is
+ * done with each interpolation.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/tabulatedprofile.h"
+#include "../../controllers/ewalk/gaittorquegenerator.h"
+#include "../../controllers/ewalk/harmonicprofiles.h"
+
+using namespace std;
+
+const int N_CHECKED_PHASES = 100000; // Evenly spaced, between the points.
+
+/**
+ * @brief Maximum and RMS of a set of errors.
+ */
+struct ErrorStats
+{
+    double sum2 = 0.0;
+    double max = 0.0;
+    int n = 0;
+
+    void add(double error)
+    {
+        sum2 += error * error;
+        max = std::max(max, fabs(error));
+        n++;
+    }
+
+    double rms() const
+    {
+        return (n > 0) ? sqrt(sum2 / n) : 0.0;
+    }
+};
+
+/**
+ * @brief Resamples a profile, then compares the table to the source points.
+ * @param profile the points.
+ * @param interpolation interpolation of the table.
+ * @param reference gives the torque at any phase [N.m/kg].
+ * @param pointErrors errors at the points, except a point at phase 1, which
+ * the table wraps to phase 0.
+ * @param betweenErrors errors at evenly spaced phases, against the reference,
+ * except in the last interval of the table if there is a point at phase 1.
+ */
+template<typename Reference>
+static void checkTable(const TabulatedProfile &profile, TableInterpolation interpolation,
+                       Reference reference, ErrorStats &pointErrors,
+                       ErrorStats &betweenErrors)
+{
+    TorqueProfileTable table;
+    table.setInterpolation(interpolation);
+    table.setPoints(profile.phases.data(), profile.torques.data(),
+                    (int)profile.phases.size(), 1.0f);
+
+    for(size_t i=0; i<profile.phases.size(); i++)
+    {
+        if(profile.phases[i] < 1.0f)
+            pointErrors.add(table.getTorqueAtPhase(profile.phases[i]) - profile.torques[i]);
+    }
+
+    // If the points end with a different torque at phase 1 than at 0, the
+    // last interval of the table steps to the torque at 0, as the next cycle.
+    bool closed = (profile.phases.back() >= 1.0f);
+    float lastPhase = closed ? 1.0f - 1.0f / TORQUE_PROFILE_TABLE_SIZE : 1.0f;
+
+    for(int i=0; i<N_CHECKED_PHASES; i++)
+    {
+        float phase = (i + 0.5f) / N_CHECKED_PHASES;
+        if(phase < lastPhase)
+            betweenErrors.add(table.getTorqueAtPhase(phase) - reference(phase));
+    }
+}
+
+/**
+ * @brief Samples a sum-of-sines profile in a table, then compares it to the
+ * closed form over its first period.
+ * @param coefficients the profile.
+ * @param interpolation interpolation of the table.
+ * @param errors errors at evenly spaced times.
+ */
+static void checkHarmonicTable(const HarmonicCoefficients &coefficients,
+                               TableInterpolation interpolation, ErrorStats &errors)
+{
+    TorqueProfileTable table;
+    table.setInterpolation(interpolation);
+    table.setHarmonics(coefficients);
+
+    for(int i=0; i<N_CHECKED_PHASES; i++)
+    {
+        float time = (i + 0.5f) / N_CHECKED_PHASES * table.getPeriod();
+        errors.add(table.getTorque(time) -
+                   TorqueProfileTable::evaluateHarmonics(coefficients, time));
+    }
+}
+
+static void printUsage()
+{
+    cout << "Usage: tableaccuracy [options]" << endl
+         << "  --points <n>          points of the uneven profile (default: 300)" << endl
+         << "  --seed <n>            random seed of the uneven spacing (default: 1)" << endl
+         << "  --tolerance <N.m/kg>  max. error at the source points, or of the sum-of-sines tables (default: 0.01)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int nPoints = 300;
+    unsigned int seed = 1;
+    float tolerance = 0.01f;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--points" && hasValue)
+            nPoints = max(atoi(argv[++i]), 2);
+        else if(arg == "--seed" && hasValue)
+            seed = (unsigned int)atoi(argv[++i]);
+        else if(arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    const TabulatedProfile winter = getWinterProfile();
+    const TabulatedProfile uneven = makeUnevenProfile(BETA_PROFILE, nPoints, seed);
+    const float betaPeriod = GaitTorqueGenerator::getHarmonicPeriod(BETA_PROFILE);
+
+    // The Winter profile is only known at its points, so between them the
+    // reference is the straight line, as interpolated before the table.
+    auto winterReference = [&](float phase) { return interpolateProfile(winter, phase); };
+    auto betaReference = [&](float phase)
+    {
+        return TorqueProfileTable::evaluateHarmonics(BETA_PROFILE, phase * betaPeriod);
+    };
+
+    cout << "profile\tinterpolation\tpoints_max\tpoints_rms\tbetween_max\tbetween_rms\t[N.m/kg]"
+         << endl;
+
+    bool passed = true;
+    const char *const interpolationNames[] = {"linear", "cubic"};
+    const char *const harmonicNames[] = {"BOOK", "ALPHA", "BETA"};
+    const HarmonicCoefficients *harmonicProfiles[] = {&BOOK_PROFILE, &ALPHA_PROFILE,
+                                                      &BETA_PROFILE};
+    for(int i=0; i<2; i++)
+    {
+        TableInterpolation interpolation = (TableInterpolation)i;
+
+        // The sum-of-sines profiles have no source points, only the closed
+        // form.
+        for(int p=0; p<3; p++)
+        {
+            ErrorStats harmonicErrors;
+            checkHarmonicTable(*harmonicProfiles[p], interpolation, harmonicErrors);
+            cout << scientific << setprecision(2)
+                 << harmonicNames[p] << "\t" << interpolationNames[i] << "\t-\t-\t"
+                 << harmonicErrors.max << "\t" << harmonicErrors.rms() << endl;
+
+            if(harmonicErrors.max > tolerance)
+                passed = false;
+        }
+
+        ErrorStats winterPoints, winterBetween, unevenPoints, unevenBetween;
+        checkTable(winter, interpolation, winterReference, winterPoints, winterBetween);
+        checkTable(uneven, interpolation, betaReference, unevenPoints, unevenBetween);
+
+        cout << scientific << setprecision(2)
+             << "WINTER\t" << interpolationNames[i] << "\t" << winterPoints.max << "\t"
+             << winterPoints.rms() << "\t" << winterBetween.max << "\t"
+             << winterBetween.rms() << endl
+             << "BETA/" << nPoints << "\t" << interpolationNames[i] << "\t"
+             << unevenPoints.max << "\t" << unevenPoints.rms() << "\t"
+             << unevenBetween.max << "\t" << unevenBetween.rms() << endl;
+
+        if(winterPoints.max > tolerance || unevenPoints.max > tolerance)
+            passed = false;
+    }
+
+    // For reference, the points interpolated without the table.
+    ErrorStats sourceBetween;
+    for(int i=0; i<N_CHECKED_PHASES; i++)
+    {
+        float phase = (i + 0.5f) / N_CHECKED_PHASES;
+        sourceBetween.add(interpolateProfile(uneven, phase) - betaReference(phase));
+    }
+    cout << "BETA/" << nPoints << "\tpoints\t-\t-\t" << sourceBetween.max << "\t"
+         << sourceBetween.rms() << endl;
+
+    if(!passed)
+    {
+        cout << "Error above " << tolerance << " N.m/kg." << endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+/**
+ * Converts the binary telemetry files recorded by the controller
+ * (TelemetryRecorder) to CSV, or to a MATLAB .mat file with one column vector
+ * per variable.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/telemetryreader.h"
+
+using namespace std;
+
+// MAT-file level 5 format constants.
+const uint32_t MI_INT8 = 1;
+const uint32_t MI_INT32 = 5;
+const uint32_t MI_UINT32 = 6;
+const uint32_t MI_DOUBLE = 9;
+const uint32_t MI_MATRIX = 14;
+const uint32_t MX_DOUBLE_CLASS = 6;
+
+/**
+ * @brief Writes all the records as CSV, with the time as first column.
+ * @param reader the telemetry records.
+ * @param out the output stream.
+ */
+static void writeCsv(const TelemetryReader &reader, ostream &out)
+{
+    const vector<TelemetryChannel> &channels = reader.getChannels();
+
+    out << "time";
+    for(const TelemetryChannel &c : channels)
+        out << "," << c.name;
+    out << "\n";
+
+    char buffer[32];
+    for(size_t r=0; r<reader.getRecordsCount(); r++)
+    {
+        snprintf(buffer, sizeof(buffer), "%.6f", reader.getTime(r));
+        out << buffer;
+
+        for(size_t i=0; i<channels.size(); i++)
+        {
+            snprintf(buffer, sizeof(buffer), ",%.9g", reader.getValue(r, i));
+            out << buffer;
+        }
+        out << "\n";
+    }
+}
+
+/**
+ * @brief Converts a channel name to a valid MATLAB variable name, e.g.
+ * "check/left_stance?" to "check_left_stance_".
+ * @param name the channel name.
+ * @return the variable name.
+ */
+static string toMatlabName(const string &name)
+{
+    string s = name;
+    for(char &c : s)
+    {
+        if(!isalnum((unsigned char)c) && c != '_')
+            c = '_';
+    }
+
+    if(s.empty() || !isalpha((unsigned char)s[0]))
+        s = "v_" + s;
+
+    return s.substr(0, 63);
+}
+
+static void writeU32(ostream &out, uint32_t value)
+{
+    out.write((const char*)&value, sizeof(value));
+}
+
+static void writePadding(ostream &out, size_t size)
+{
+    static const char zeros[8] = {0};
+    out.write(zeros, (8 - size % 8) % 8);
+}
+
+/**
+ * @brief Writes a column vector of doubles as a MAT-file matrix element.
+ * @param out the output stream.
+ * @param name the variable name.
+ * @param values the values.
+ */
+static void writeMatVector(ostream &out, const string &name,
+                           const vector<double> &values)
+{
+    uint32_t namePadded = (uint32_t)((name.size() + 7) / 8 * 8);
+    uint32_t dataSize = (uint32_t)(values.size() * sizeof(double));
+
+    uint32_t matrixSize = (8 + 8) +             // Array flags.
+                          (8 + 8) +             // Dimensions.
+                          (8 + namePadded) +    // Name.
+                          (8 + dataSize);       // Real part.
+
+    writeU32(out, MI_MATRIX);
+    writeU32(out, matrixSize);
+
+    writeU32(out, MI_UINT32);
+    writeU32(out, 8);
+    writeU32(out, MX_DOUBLE_CLASS);
+    writeU32(out, 0);
+
+    writeU32(out, MI_INT32);
+    writeU32(out, 8);
+    writeU32(out, (uint32_t)values.size());
+    writeU32(out, 1);
+
+    writeU32(out, MI_INT8);
+    writeU32(out, (uint32_t)name.size());
+    out.write(name.data(), name.size());
+    writePadding(out, name.size());
+
+    writeU32(out, MI_DOUBLE);
+    writeU32(out, dataSize);
+    out.write((const char*)values.data(), dataSize);
+}
+
+/**
+ * @brief Writes all the channels to a MAT-file (level 5, uncompressed), one
+ * column vector per channel, plus the "time" vector.
+ * @param reader the telemetry records.
+ * @param path path of the .mat file.
+ * @return true if the file could be written, false otherwise.
+ */
+static bool writeMat(const TelemetryReader &reader, const string &path)
+{
+    ofstream out(path, ios::binary);
+    if(!out.is_open())
+    {
+        cerr << "Could not create " << path << "." << endl;
+        return false;
+    }
+
+    // Header: text, subsystem offset, version and endianness indicator.
+    char header[128];
+    memset(header, ' ', sizeof(header));
+    string text = "MATLAB 5.0 MAT-file, converted from WalkiBBB telemetry";
+    memcpy(header, text.data(), text.size());
+    memset(header + 116, 0, 8);
+    header[124] = 0x00;
+    header[125] = 0x01;
+    header[126] = 'I';
+    header[127] = 'M';
+    out.write(header, sizeof(header));
+
+    size_t nRecords = reader.getRecordsCount();
+    vector<double> values(nRecords);
+
+    for(size_t r=0; r<nRecords; r++)
+        values[r] = reader.getTime(r);
+    writeMatVector(out, "time", values);
+
+    const vector<TelemetryChannel> &channels = reader.getChannels();
+    vector<string> usedNames = {"time"};
+    for(size_t i=0; i<channels.size(); i++)
+    {
+        for(size_t r=0; r<nRecords; r++)
+            values[r] = reader.getValue(r, i);
+
+        string name = toMatlabName(channels[i].name);
+        while(find(usedNames.begin(), usedNames.end(), name) != usedNames.end())
+            name = name.substr(0, 61) + "_2";
+        usedNames.push_back(name);
+
+        writeMatVector(out, name, values);
+    }
+
+    return out.good();
+}
+
+static void printUsage()
+{
+    cout << "Usage: telemetry2csv [options] <segment.wtlm>..." << endl
+         << "  The segments of a recording must be given in order." << endl
+         << "  --csv <file>   write a CSV file (default: CSV to stdout)" << endl
+         << "  --mat <file>   write a MATLAB .mat file" << endl
+         << "  --info         only print the channels and the duration" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string csvPath, matPath;
+    bool infoOnly = false;
+    vector<string> segments;
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--csv" && hasValue)
+            csvPath = argv[++i];
+        else if(arg == "--mat" && hasValue)
+            matPath = argv[++i];
+        else if(arg == "--info")
+            infoOnly = true;
+        else if(arg.size() > 0 && arg[0] != '-')
+            segments.push_back(arg);
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    if(segments.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    TelemetryReader reader;
+    for(const string &s : segments)
+    {
+        if(!reader.appendSegment(s))
+            return 1;
+    }
+
+    size_t nRecords = reader.getRecordsCount();
+
+    if(infoOnly)
+    {
+        cout << "Records: " << nRecords << endl;
+        if(nRecords > 0)
+        {
+            cout << "Duration: " << reader.getTime(nRecords - 1) - reader.getTime(0)
+                 << " s" << endl;
+        }
+        for(const TelemetryChannel &c : reader.getChannels())
+            cout << "  " << c.name << " [" << c.unit << "]" << endl;
+        return 0;
+    }
+
+    if(!matPath.empty() && !writeMat(reader, matPath))
+        return 1;
+
+    if(!csvPath.empty())
+    {
+        ofstream out(csvPath);
+        if(!out.is_open())
+        {
+            cerr << "Could not create " << csvPath << "." << endl;
+            return 1;
+        }
+        writeCsv(reader, out);
+    }
+    else if(matPath.empty())
+        writeCsv(reader, cout);
+
+    return 0;
+}
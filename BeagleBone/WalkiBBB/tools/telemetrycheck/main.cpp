@@ -0,0 +1,338 @@
+/**
+ * Checks the TelemetryRecorder of the controller, and the TelemetryReader of
+ * telemetry2csv. A recording is made with a block of fields and separate
+ * channels of each type, whose every value is derived from the index of the
+ * record, then read back from the segment files. Each record read must have
+ * the values of its index, the indices must increase, and every record must
+ * either be in the files or be counted as dropped. The recording is long
+ * enough to span several segment files, and ends with a burst that fills the
+ * ring, to check the dropping of records. The disk is also made to look full
+ * at the first change of segment, to check that the records are dropped then,
+ * and that the recording goes on in the next segment once there is space.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "../common/telemetryreader.h"
+
+using namespace std;
+using namespace chrono;
+
+const int N_BOOL_CHANNELS = 11;     // More than a byte of packed bits.
+const int N_BLOCK_SAMPLES = 64;     // Makes the records large, for several segments.
+const int PACED_BATCH = 1000;       // Records between two pauses of the recording.
+const int PACED_PAUSE = 2 * TELEMETRY_WRITER_PERIOD; // [ms].
+const int BURST_SIZE = 4 * TELEMETRY_RING_SIZE;
+const uint64_t NO_FREE_SPACE = 1ULL << 60; // Min. free space that no disk has [B].
+
+/**
+ * @brief Block recorded as a whole, as the control loop state of the
+ * controller. Only some of the samples are described by fields, the others
+ * are recorded but ignored.
+ */
+struct CheckBlock
+{
+    float angle;
+    int count;
+    bool flag;
+    float samples[N_BLOCK_SAMPLES];
+};
+
+const TelemetryField CHECK_BLOCK_FIELDS[] =
+{
+    TELEMETRY_FIELD(CheckBlock, "angle", "rad", angle),
+    TELEMETRY_FIELD(CheckBlock, "count", "-", count),
+    TELEMETRY_FIELD(CheckBlock, "flag", "-", flag),
+    TELEMETRY_FIELD(CheckBlock, "first_sample", "N", samples[0]),
+    TELEMETRY_FIELD(CheckBlock, "last_sample", "N", samples[N_BLOCK_SAMPLES - 1])
+};
+const int N_BLOCK_FIELDS = sizeof(CHECK_BLOCK_FIELDS) / sizeof(CHECK_BLOCK_FIELDS[0]);
+
+/**
+ * @brief Variables recorded, all derived from the index of the record.
+ */
+struct CheckValues
+{
+    CheckBlock block;
+    float level;
+    int index;
+    bool bits[N_BOOL_CHANNELS];
+
+    /**
+     * @brief Sets all the values for a record. Each float is exact, and
+     * differs between consecutive records.
+     * @param i index of the record.
+     */
+    void set(int i)
+    {
+        block.angle = (float)(i % 65536) * 0.25f;
+        block.count = 3 * i + 1;
+        block.flag = (i % 3 == 0);
+        for(int k=0; k<N_BLOCK_SAMPLES; k++)
+            block.samples[k] = -(float)(i % 4096) - k;
+        level = (float)(i % 8192) / 8.0f;
+        index = i;
+        for(int k=0; k<N_BOOL_CHANNELS; k++)
+            bits[k] = ((i >> k) & 1) != 0;
+    }
+};
+
+/**
+ * @brief Gets the expected values of the channels of a record, in the order
+ * of the channels of the recording: the block fields, the 4-byte channels,
+ * then the booleans.
+ * @param i index of the record.
+ * @return the values.
+ */
+static vector<double> expectedValues(int i)
+{
+    CheckValues v;
+    v.set(i);
+
+    vector<double> values = {v.block.angle, (double)v.block.count, v.block.flag ? 1.0 : 0.0,
+                             v.block.samples[0], v.block.samples[N_BLOCK_SAMPLES - 1],
+                             v.level, (double)v.index};
+    for(int k=0; k<N_BOOL_CHANNELS; k++)
+        values.push_back(v.bits[k] ? 1.0 : 0.0);
+
+    return values;
+}
+
+/**
+ * @brief Lists the segment files of a directory, in the order of their index.
+ * @param directory the directory.
+ * @return the paths of the files.
+ */
+static vector<string> listSegments(const string &directory)
+{
+    vector<string> paths;
+
+    DIR *dir = opendir(directory.c_str());
+    if(dir == nullptr)
+        return paths;
+
+    while(struct dirent *entry = readdir(dir))
+    {
+        string name = entry->d_name;
+        if(name.size() > 5 && name.compare(name.size() - 5, 5, ".wtlm") == 0)
+            paths.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+
+    // The names only differ by the index, zero-padded.
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+/**
+ * @brief Checks that a closed segment file was truncated to its records, and
+ * that its header gives their number.
+ * @param path path of the segment file.
+ * @return true if the file is consistent, false otherwise.
+ */
+static bool checkSegmentSize(const string &path)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    if(!file.is_open())
+        return false;
+
+    uint64_t size = (uint64_t)file.tellg();
+    file.seekg(0);
+
+    TelemetrySegmentHeader h;
+    if(!file.read((char*)&h, sizeof(h)))
+        return false;
+
+    return size == h.headerSize + h.nRecords * h.recordSize;
+}
+
+static void printUsage()
+{
+    cout << "Usage: telemetrycheck [options]" << endl
+         << "  --records <n>   records written at a sustainable pace (default: 200000)" << endl
+         << "  --tmp <dir>     directory of the temporary recording (default: /tmp)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int nPacedRecords = 200000;
+    string tmpDir = "/tmp";
+
+    for(int i=1; i<argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if(arg == "--records" && hasValue)
+            nPacedRecords = max(atoi(argv[++i]), 1);
+        else if(arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else
+        {
+            printUsage();
+            return (arg == "--help") ? 0 : 1;
+        }
+    }
+
+    // Recording.
+    string directory = tmpDir + "/telemetrycheck_" + to_string(getpid());
+
+    CheckValues values;
+    values.set(0);
+
+    TelemetryRecorder recorder;
+    recorder.setBlock(&values.block, sizeof(values.block), CHECK_BLOCK_FIELDS, N_BLOCK_FIELDS);
+    recorder.addChannel("level", "m", values.level);
+    recorder.addChannel("index", "-", values.index);
+    for(int k=0; k<N_BOOL_CHANNELS; k++)
+        recorder.addChannel("bit_" + to_string(k), "-", values.bits[k]);
+
+    // Without enough free space, no file must be created.
+    recorder.setMinFreeSpace(NO_FREE_SPACE);
+    bool startWithoutSpace = recorder.start(directory, "check");
+    recorder.stop();
+    bool noSpaceRefused = !startWithoutSpace && listSegments(directory).empty();
+    recorder.setMinFreeSpace(TELEMETRY_MIN_FREE_SPACE);
+
+    if(!recorder.start(directory, "check"))
+    {
+        cerr << "Could not start the recording in " << directory << "." << endl;
+        return 1;
+    }
+
+    // The disk looks full from the middle of the first segment, until the
+    // writer fails to create the second one.
+    int nRecordsPerSegment = TELEMETRY_SEGMENT_SIZE / recorder.getRecordSize();
+    bool failureSeen = false, failingAtEnd = false;
+    uint64_t nDroppedBeforeBurst = 0;
+
+    int nRecords = nPacedRecords + BURST_SIZE;
+    for(int i=0; i<nRecords; i++)
+    {
+        values.set(i);
+        recorder.record(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+
+        if(i == nRecordsPerSegment / 2)
+            recorder.setMinFreeSpace(NO_FREE_SPACE);
+        else if(!failureSeen && recorder.isFailing())
+        {
+            failureSeen = true;
+            recorder.setMinFreeSpace(TELEMETRY_MIN_FREE_SPACE);
+        }
+
+        if(i < nPacedRecords && (i + 1) % PACED_BATCH == 0)
+            this_thread::sleep_for(milliseconds(PACED_PAUSE));
+
+        if(i == nPacedRecords - 1)
+        {
+            failingAtEnd = recorder.isFailing();
+            nDroppedBeforeBurst = recorder.getDroppedCount();
+        }
+    }
+
+    recorder.stop();
+
+    uint64_t nWritten = recorder.getRecordsCount();
+    uint64_t nDropped = recorder.getDroppedCount();
+
+    // Reading.
+    vector<string> segments = listSegments(directory);
+    TelemetryReader reader;
+    bool readable = !segments.empty();
+    int nTruncated = 0;
+
+    for(const string &s : segments)
+    {
+        readable &= reader.appendSegment(s);
+        if(!checkSegmentSize(s))
+            nTruncated++;
+    }
+
+    bool sameChannels = readable &&
+        (reader.getChannels().size() == (size_t)(N_BLOCK_FIELDS + 2 + N_BOOL_CHANNELS));
+    vector<string> names = {"angle", "count", "flag", "first_sample", "last_sample",
+                            "level", "index"};
+    for(int k=0; k<N_BOOL_CHANNELS; k++)
+        names.push_back("bit_" + to_string(k));
+
+    for(size_t c=0; sameChannels && c<names.size(); c++)
+        sameChannels = (reader.getChannels()[c].name == names[c]);
+
+    size_t nRead = readable ? reader.getRecordsCount() : 0;
+    int nWrongValues = 0, nBackwards = 0;
+    int lastIndex = -1;
+    double lastTime = -1.0;
+
+    for(size_t r=0; sameChannels && r<nRead; r++)
+    {
+        int index = (int)reader.getValue(r, N_BLOCK_FIELDS + 1);
+        double time = reader.getTime(r);
+
+        if(index <= lastIndex || index >= nRecords || time < lastTime)
+        {
+            nBackwards++;
+            continue;
+        }
+
+        vector<double> expected = expectedValues(index);
+        for(size_t c=0; c<expected.size(); c++)
+        {
+            if(reader.getValue(r, c) != expected[c])
+            {
+                nWrongValues++;
+                break;
+            }
+        }
+
+        lastIndex = index;
+        lastTime = time;
+    }
+
+    bool countsMatch = (nRead == nWritten) && (nWritten + nDropped == (uint64_t)nRecords);
+
+    cout << "record_size\t" << recorder.getRecordSize() << " B" << endl
+         << "segments\t" << segments.size() << endl
+         << "recorded\t" << nRecords << endl
+         << "written\t" << nWritten << endl
+         << "dropped\t" << nDropped << endl
+         << "read\t" << nRead << endl
+         << "channels\t" << (sameChannels ? "ok" : "FAILED") << endl
+         << "wrong_values\t" << nWrongValues << endl
+         << "backwards\t" << nBackwards << endl
+         << "untruncated\t" << nTruncated << endl
+         << "start_without_space\t" << (noSpaceRefused ? "ok" : "FAILED") << endl
+         << "disk_full\t" << (failureSeen ? "ok" : "FAILED") << endl
+         << "recovered\t" << (failureSeen && !failingAtEnd && segments.size() >= 2 ?
+                                  "ok" : "FAILED") << endl;
+
+    bool failed = !readable || !sameChannels || !countsMatch || nWrongValues > 0 ||
+                  nBackwards > 0 || nTruncated > 0 || !noSpaceRefused || !failureSeen ||
+                  failingAtEnd || segments.size() < 2;
+
+    // The burst must have overflowed the ring, without blocking.
+    if(nDropped == nDroppedBeforeBurst)
+    {
+        cout << "The burst of " << BURST_SIZE << " records was not dropped in part." << endl;
+        failed = true;
+    }
+
+    for(const string &s : segments)
+        remove(s.c_str());
+    rmdir(directory.c_str());
+
+    return failed ? 2 : 0;
+}